@@ -0,0 +1,378 @@
+/*!****************************************************************************
+
+	@file	allocs.h
+	@file	allocs.cpp
+
+	@brief	Tracking of the heap allocations: the global operator new is
+			replaced when built with -D_TRACKALLOCS, and counts the
+			allocations and their bytes, in all and per call site (the
+			stack of the caller). The check of the steady state runs the
+			game and fails if a tick allocates.
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include "platform.h"
+
+#ifdef __linux__
+	#include <dlfcn.h>
+	#include <execinfo.h>
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <new>
+
+#include "game.h"
+#include "maths.h"
+#include "utils.h"
+#include "commdefs.h"
+#include "allocs.h"
+#include "counters.h"
+
+
+static std::atomic<uint64_t> g_nAllocCount(0), g_nAllocBytes(0);	///< since the start
+static TAllocSite g_AllocSites[ALLOCSITES];
+static std::atomic<bool> g_bAllocSites(true);	///< the sites are counted
+
+
+
+#ifdef _TRACKALLOCS
+
+/*!****************************************************************************
+* @brief	Counts an allocation, and its call site
+* @param	nBytes The bytes allocated
+* @note		The sites live in a fixed table, open addressing on the hash
+*			of the stack: nothing is allocated here. When the table is
+*			full the allocation is counted in all, but not in a site.
+*			Never inlined: the frames skipped are known.
+******************************************************************************/
+__attribute__((noinline)) static void TrackTheAllocation(size_t nBytes)
+{
+	static thread_local bool bInside = false;
+
+	g_nAllocCount.fetch_add(1, std::memory_order_relaxed);
+	g_nAllocBytes.fetch_add(nBytes, std::memory_order_relaxed);
+
+	CountThe(ctAllocations, 1);
+	CountThe(ctAllocBytes, nBytes);
+											// taking the stack may allocate
+											// the first time
+	if( bInside || !g_bAllocSites.load(std::memory_order_relaxed) ) return;
+	bInside = true;
+
+	void* pFrames[ALLOCDEPTH + 2] = {};
+											// skips this function and the
+											// operator new
+#ifdef __linux__
+	int nFrames = ::backtrace(pFrames, ALLOCDEPTH + 2);
+#else
+	int nFrames = ::CaptureStackBackTrace(0, ALLOCDEPTH + 2, pFrames, NULL);
+#endif
+
+	uint64_t nHash = 0xCBF29CE484222325ULL;	// FNV-1a
+
+	for(int i=2; i<nFrames; ++i)
+	{
+		nHash = (nHash ^ uint64_t(uintptr_t(pFrames[i]))) * 0x100000001B3ULL;
+	}
+
+	if( !nHash ) nHash = 1;
+
+	for(unsigned n=0; n<ALLOCSITES; ++n)
+	{
+		TAllocSite* pSite = &g_AllocSites[(nHash + n) & (ALLOCSITES - 1)];
+
+		uint64_t nSlot = pSite->nHash.load(std::memory_order_acquire);
+
+		if( !nSlot )
+		{
+			if( pSite->nHash.compare_exchange_strong(nSlot, nHash, std::memory_order_acq_rel) )
+			{
+				for(int i=0; i<ALLOCDEPTH; ++i)
+				{
+					pSite->pFrames[i] = i + 2 < nFrames ? pFrames[i + 2] : nullptr;
+				}
+
+				nSlot = nHash;
+			}
+		}
+
+		if( nSlot == nHash )
+		{
+			pSite->nCount.fetch_add(1, std::memory_order_relaxed);
+			pSite->nBytes.fetch_add(nBytes, std::memory_order_relaxed);
+			break;
+		}
+	}
+
+	bInside = false;
+}
+
+/*!****************************************************************************
+* @noop	The replaced global allocation functions: the arrays and the
+*		nothrow forms share them, the aligned forms are not replaced
+******************************************************************************/
+void* operator new(size_t nBytes)
+{
+	void* p = malloc(nBytes ? nBytes : 1);
+	if( !p ) throw std::bad_alloc();
+
+	TrackTheAllocation(nBytes);
+
+	return p;
+}
+
+void* operator new[](size_t nBytes)
+{
+	return operator new(nBytes);
+}
+
+void* operator new(size_t nBytes, const std::nothrow_t&) noexcept
+{
+	void* p = malloc(nBytes ? nBytes : 1);
+	if( p ) TrackTheAllocation(nBytes);
+
+	return p;
+}
+
+void* operator new[](size_t nBytes, const std::nothrow_t& Tag) noexcept
+{
+	return operator new(nBytes, Tag);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+#endif
+
+/*!****************************************************************************
+* @brief	Checks if the allocations are tracked
+* @return	Returns true when built with -D_TRACKALLOCS, false otherwise
+******************************************************************************/
+bool IsTrackingTheAllocations()
+{
+#ifdef _TRACKALLOCS
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*!****************************************************************************
+* @brief	Gets the allocations since the start, of all the threads
+* @return	The allocations and their bytes, zero if not tracked
+******************************************************************************/
+TAllocCount GetTheAllocations()
+{
+	return TAllocCount{ g_nAllocCount.load(std::memory_order_relaxed),
+		g_nAllocBytes.load(std::memory_order_relaxed) };
+}
+
+/*!****************************************************************************
+* @brief	Forgets the call sites, to count them again
+* @note		Not while other threads allocate
+******************************************************************************/
+void ClearTheAllocSites()
+{
+	for(TAllocSite& Site : g_AllocSites)
+	{
+		Site.nHash = 0;
+		Site.nCount = 0;
+		Site.nBytes = 0;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Starts or stops counting the call sites
+* @param	bTrack True to count them, as at the start
+* @note		The allocations are counted in all anyway
+******************************************************************************/
+void TrackTheAllocSites(bool bTrack)
+{
+	g_bAllocSites = bTrack;
+}
+
+/*!****************************************************************************
+* @brief	Writes the call sites allocating most, with their stacks
+* @param	nTop The sites written
+* @note		The addresses are rebased to the preferred base of the
+*			executable, for addr2line -f -C -e asteroids-2k.exe (on
+*			Linux to its load address, for the default PIE build)
+******************************************************************************/
+void ReportTheAllocSites(unsigned nTop)
+{
+	TAllocSite* pSites[ALLOCSITES];
+	unsigned nSites = 0;
+
+	for(TAllocSite& Site : g_AllocSites)
+	{
+		if( Site.nHash.load(std::memory_order_acquire) && Site.nCount.load() ) pSites[nSites++] = &Site;
+	}
+
+	std::sort(pSites, pSites + nSites, [](const TAllocSite* pA, const TAllocSite* pB)
+		{
+			return pA->nCount.load() > pB->nCount.load();
+		});
+
+#ifdef __linux__
+	Dl_info Info = {};
+	::dladdr((const void*) &ReportTheAllocSites, &Info);
+
+	uintptr_t nRebase = 0 - uintptr_t(Info.dli_fbase);
+#else
+	HMODULE hModule = ::GetModuleHandleA(NULL);
+	const IMAGE_DOS_HEADER* pDos = (const IMAGE_DOS_HEADER*) hModule;
+	const IMAGE_NT_HEADERS* pNt = (const IMAGE_NT_HEADERS*)((const BYTE*) hModule + pDos->e_lfanew);
+
+	uintptr_t nRebase = uintptr_t(pNt->OptionalHeader.ImageBase) - uintptr_t(hModule);
+#endif
+
+	char Buffer[256];
+
+	for(unsigned i=0; i<std::min(nTop, nSites); ++i)
+	{
+		const TAllocSite* pSite = pSites[i];
+
+		sprintf(Buffer, "  site %u: %llu allocations, %llu bytes, from\n", i + 1,
+			(unsigned long long) pSite->nCount.load(), (unsigned long long) pSite->nBytes.load());
+		LogTheText(Buffer);
+
+		int nFrames = 0;
+		while( nFrames < ALLOCDEPTH && pSite->pFrames[nFrames] ) nFrames++;
+
+		for(int n=0; n<nFrames; ++n)
+		{
+			sprintf(Buffer, "    0x%llx\n", (unsigned long long)(uintptr_t(pSite->pFrames[n]) + nRebase));
+			LogTheText(Buffer);
+		}
+	}
+}
+
+/*!****************************************************************************
+* @brief	Checks that the ticks of the game allocate nothing
+* @param	pGame Pointer to the game engine
+* @param	nTicks Number of ticks checked
+* @return	Returns true if no tick allocated, false otherwise
+* @note		A bot plays ALLOCWARMUP ticks first, so that the containers
+*			reach their capacity, then the checked ones. The ticks
+*			changing the level, or ending the game, are not a steady
+*			state: they are run, not checked, though their sites are
+*			reported. The game is left at the end of the run. The
+*			outcome and the sites of the allocations go to the console
+*			and to the debugger.
+******************************************************************************/
+bool VerifyTheAllocations(TGame* pGame, unsigned nTicks)
+{
+	assert(pGame);
+
+	if( !IsTrackingTheAllocations() )
+	{
+		LogTheText("allocations: not tracked, build with -D_TRACKALLOCS\n");
+		return false;
+	}
+
+	TRandom Random;
+	SeedTheRandom(&Random, RANDSEED);
+
+	unsigned nChecked = 0, nFailed = 0;
+	TAllocCount Total{ 0, 0 };
+
+	ClearTheAllocSites();
+	TrackTheAllocSites(false);
+
+	for(unsigned i=0; i<ALLOCWARMUP + nTicks; ++i)
+	{
+		if( IsGameOver(pGame) ) StartTheMatch(pGame, RANDSEED + i);
+
+		SetTheInput(pGame, (unsigned char)(RandUnit(&Random) * 256.0)
+			& (inLeft | inRight | inThrust | inFire | inShield));
+
+		ResetTheArena(&pGame->Arena);
+
+		int nLevel = pGame->nLevel;
+											// only the sites of the ticks
+											// after the warm-up
+		TrackTheAllocSites(i >= ALLOCWARMUP);
+
+		TAllocCount Start = GetTheAllocations();
+
+		Run(pGame);
+
+		TAllocCount End = GetTheAllocations();
+
+		TrackTheAllocSites(false);
+
+		if( i < ALLOCWARMUP || pGame->nLevel != nLevel || IsGameOver(pGame) ) continue;
+
+		nChecked++;
+
+		if( End.nCount != Start.nCount )
+		{
+			nFailed++;
+			Total.nCount += End.nCount - Start.nCount;
+			Total.nBytes += End.nBytes - Start.nBytes;
+		}
+	}
+
+	TrackTheAllocSites(true);
+
+	char Buffer[256];
+	sprintf(Buffer, "allocations: %u ticks checked on %u threads, %u allocating, %llu allocations, %llu bytes: %s\n",
+		nChecked, pGame->bSerial ? 1 : GetTheThreads(&pGame->Jobs), nFailed, (unsigned long long) Total.nCount, (unsigned long long) Total.nBytes,
+		nFailed ? "FAILED" : "none");
+	LogTheText(Buffer);
+
+	if( nFailed ) ReportTheAllocSites(ALLOCREPORT);
+
+	return nChecked > 0 && !nFailed;
+}
+
+/*!****************************************************************************
+* @brief	Checks the steady state of a headless game, e.g. after a change
+*			of the hot paths
+* @param	pConfig The ticks checked, a number; empty for ALLOCTICKS
+* @return	Returns true if no tick allocated, false otherwise
+* @note		The systems run serially first, then on ALLOCWORKERS workers
+*			and the main thread, as in the windowed game
+******************************************************************************/
+bool RunTheAllocCheck(const char* pConfig)
+{
+	assert(pConfig);
+
+	unsigned nTicks = ALLOCTICKS;
+
+	if( *pConfig && (sscanf(pConfig, "%u", &nTicks) != 1 || nTicks == 0) ) return false;
+
+	TVecStrings strErrors;
+	TGame* pGame = CreateTheHeadlessGame(strErrors);
+
+	if( !pGame )
+	{
+		for(const std::string& strError : strErrors) LogTheText((strError + "\n").c_str());
+		return false;
+	}
+
+	StartTheMatch(pGame);
+
+	bool bResult = VerifyTheAllocations(pGame, nTicks);
+
+	SetupJobSystem(&pGame->Jobs, ALLOCWORKERS);
+	pGame->bSerial = false;
+
+	bResult = VerifyTheAllocations(pGame, nTicks) && bResult;
+
+	DeleteTheHeadlessGame(pGame);
+
+	return bResult;
+}
@@ -0,0 +1,42 @@
+
+#ifndef _ALLOCS_H_
+#define _ALLOCS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "game.h"
+#include "commdefs.h"
+
+
+#define ALLOCSITES			1024			///< call sites tracked, a power of 2
+#define ALLOCDEPTH			6				///< return addresses of a call site
+#define ALLOCWARMUP			(10 * FPS)		///< ticks before the check, see VerifyTheAllocations()
+#define ALLOCTICKS			(60 * FPS)		///< ticks checked, by default
+#define ALLOCREPORT			10				///< sites reported when the check fails
+#define ALLOCWORKERS		3				///< workers of the systems, in the threaded check
+
+
+struct TAllocCount
+{
+	uint64_t nCount, nBytes;
+};
+
+struct TAllocSite							///< allocations from the same stack
+{
+	std::atomic<uint64_t> nHash;			///< of the stack, 0 if the slot is free
+	void* pFrames[ALLOCDEPTH];
+	std::atomic<uint64_t> nCount, nBytes;
+};
+
+bool IsTrackingTheAllocations();
+TAllocCount GetTheAllocations();
+void ClearTheAllocSites();
+void TrackTheAllocSites(bool bTrack);
+void ReportTheAllocSites(unsigned nTop);
+
+bool VerifyTheAllocations(TGame* pGame, unsigned nTicks);
+bool RunTheAllocCheck(const char* pConfig);
+
+#endif
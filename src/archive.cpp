@@ -0,0 +1,150 @@
+/*!****************************************************************************
+
+	@file	archive.h
+	@file	archive.cpp
+
+	@brief	Packed assets archive reader
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include <assert.h>
+#include <string.h>
+
+#include "archive.h"
+#include "utils.h"
+
+
+/*!****************************************************************************
+* @brief	Opens an assets archive, built by the a2kpack tool
+* @param	pArchive Pointer to the archive data structure
+* @param	strFileName Path to the archive file
+* @return	Returns true for success, false otherwise
+* @note		The archive is mapped in memory once: the assets are served
+*			straight from the mapping, without further file accesses
+******************************************************************************/
+bool OpenTheArchive(TArchive* pArchive, std::string strFileName)
+{
+	assert(pArchive);
+
+	memset(pArchive, 0, sizeof(TArchive));
+
+	if( !MapTheFile(&pArchive->File, strFileName) ) return false;
+
+	const unsigned char* pData = pArchive->File.pData;
+	unsigned nSize = pArchive->File.nSize;
+
+	bool bResult = false;
+
+	if( nSize >= sizeof(TArchiveHeader) )
+	{
+		const TArchiveHeader* pHeader = (const TArchiveHeader*) pData;
+
+		if( !memcmp(pHeader->Magic, ARCHIVE_MAGIC, 4)
+			&& pHeader->nVersion == ARCHIVE_VERSION
+			&& pHeader->nEntries <= (nSize - sizeof(TArchiveHeader)) / sizeof(TArchiveEntry) )
+		{
+			pArchive->pEntries = (const TArchiveEntry*) (pData + sizeof(TArchiveHeader));
+			pArchive->nEntries = pHeader->nEntries;
+
+			bResult = true;
+											// validates the whole index once,
+											// so that lookups need no checks
+			for(unsigned i=0; bResult && i<pArchive->nEntries; ++i)
+			{
+				const TArchiveEntry& Entry = pArchive->pEntries[i];
+
+				if( Entry.nOffset > nSize || Entry.nSize > nSize - Entry.nOffset
+					|| Entry.Name[ARCHIVE_NAMELEN-1] != 0
+					|| (i > 0 && strcmp(pArchive->pEntries[i-1].Name, Entry.Name) >= 0) )
+				{
+					bResult = false;
+				}
+			}
+		}
+	}
+
+	if( !bResult ) CloseTheArchive(pArchive);
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Closes an assets archive
+* @param	pArchive Pointer to the archive data structure
+* @note		Pointers to the assets are no longer valid after closing
+******************************************************************************/
+void CloseTheArchive(TArchive* pArchive)
+{
+	assert(pArchive);
+
+	UnmapTheFile(&pArchive->File);
+
+	pArchive->pEntries = nullptr;
+	pArchive->nEntries = 0;
+}
+
+/*!****************************************************************************
+* @brief	Gets the id of an asset
+* @param	pArchive Pointer to the archive data structure
+* @param	pName The asset name (i.e. the original file name)
+* @return	The asset id, -1 if not found
+******************************************************************************/
+int FindTheAsset(TArchive* pArchive, const char* pName)
+{
+	assert(pArchive);
+	assert(pName);
+											// binary search: the index is sorted
+	int nLow = 0, nHigh = int(pArchive->nEntries) - 1;
+
+	while( nLow <= nHigh )
+	{
+		int nMid = (nLow + nHigh) / 2;
+		int nCmp = strcmp(pArchive->pEntries[nMid].Name, pName);
+
+		if( nCmp == 0 ) return nMid;
+
+		if( nCmp < 0 ) nLow = nMid + 1;
+		else nHigh = nMid - 1;
+	}
+
+	return -1;
+}
+
+/*!****************************************************************************
+* @brief	Gets an asset by id
+* @param	pArchive Pointer to the archive data structure
+* @param	nAsset The asset id
+* @param[out] ppData Pointer to the asset data, inside the mapping
+* @param[out] pnSize Size of the asset data
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool GetTheAsset(TArchive* pArchive, int nAsset, const unsigned char** ppData, unsigned* pnSize)
+{
+	assert(pArchive);
+	assert(ppData);
+	assert(pnSize);
+
+	if( nAsset < 0 || nAsset >= int(pArchive->nEntries) ) return false;
+
+	*ppData = pArchive->File.pData + pArchive->pEntries[nAsset].nOffset;
+	*pnSize = pArchive->pEntries[nAsset].nSize;
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Gets an asset by name
+* @param	pArchive Pointer to the archive data structure
+* @param	pName The asset name
+* @param[out] ppData Pointer to the asset data, inside the mapping
+* @param[out] pnSize Size of the asset data
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool GetTheAsset(TArchive* pArchive, const char* pName, const unsigned char** ppData, unsigned* pnSize)
+{
+	return GetTheAsset(pArchive, FindTheAsset(pArchive, pName), ppData, pnSize);
+}
@@ -0,0 +1,57 @@
+
+#ifndef _ARCHIVE_H_
+#define _ARCHIVE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "utils.h"
+
+
+#define ARCHIVEFILE			"assets.pak"
+
+#define ARCHIVE_MAGIC		"A2KP"
+#define ARCHIVE_VERSION		1
+#define ARCHIVE_NAMELEN		32		///< including the terminating zero
+#define ARCHIVE_ALIGN		16		///< alignment of each asset data
+
+
+/*
+* Layout (little endian):
+*
+*	TArchiveHeader
+*	TArchiveEntry[nEntries]		sorted by name, the index is the asset id
+*	asset data					each one aligned to ARCHIVE_ALIGN bytes
+*/
+
+struct TArchiveHeader
+{
+	char Magic[4];
+	uint32_t nVersion;
+	uint32_t nEntries;
+	uint32_t nReserved;
+};
+
+struct TArchiveEntry
+{
+	char Name[ARCHIVE_NAMELEN];
+	uint32_t nOffset;				///< from the beginning of the archive
+	uint32_t nSize;
+};
+
+struct TArchive
+{
+	TMappedFile File;
+	const TArchiveEntry* pEntries;
+	unsigned nEntries;
+};
+
+bool OpenTheArchive(TArchive* pArchive, std::string strFileName);
+void CloseTheArchive(TArchive* pArchive);
+
+int FindTheAsset(TArchive* pArchive, const char* pName);
+bool GetTheAsset(TArchive* pArchive, int nAsset, const unsigned char** ppData, unsigned* pnSize);
+bool GetTheAsset(TArchive* pArchive, const char* pName, const unsigned char** ppData, unsigned* pnSize);
+
+#endif
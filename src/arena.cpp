@@ -0,0 +1,173 @@
+/*!****************************************************************************
+
+	@file	arena.h
+	@file	arena.cpp
+
+	@brief	Linear arena for the data living one frame: an allocation is a
+			pointer bump, the reset frees everything at once. With the
+			STL adapter (TArenaAllocator) the vectors and the strings of a
+			frame come from the arena too.
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+#include "arena.h"
+
+
+
+/*!****************************************************************************
+* @brief	Sets-up an arena
+* @param	pArena Pointer to the arena
+* @param	nSize Bytes of the block, grown by the resets if a frame needs
+*			more, e.g. FRAMEARENASIZE
+******************************************************************************/
+void SetupTheArena(TArena* pArena, size_t nSize)
+{
+	assert(pArena);
+	assert(nSize > 0);
+
+	pArena->pBlock = (unsigned char*) malloc(nSize);
+	if( !pArena->pBlock ) throw std::bad_alloc();
+
+	pArena->nSize = nSize;
+	pArena->nUsed = 0;
+	pArena->Spills.clear();
+	pArena->nSpilled = 0;
+	pArena->nPeak = 0;
+}
+
+/*!****************************************************************************
+* @brief	Frees the memory of an arena
+* @param	pArena Pointer to the arena
+******************************************************************************/
+void CleanupTheArena(TArena* pArena)
+{
+	assert(pArena);
+
+	for(void* pSpill : pArena->Spills) free(pSpill);
+	pArena->Spills.clear();
+
+	free(pArena->pBlock);
+	pArena->pBlock = nullptr;
+	pArena->nSize = pArena->nUsed = pArena->nSpilled = 0;
+}
+
+/*!****************************************************************************
+* @brief	Empties an arena: all that was taken from it is gone
+* @param	pArena Pointer to the arena
+* @note		If the last frame spilled to the heap the block is replaced
+*			by a larger one, twice the size at least: after a few frames
+*			the block fits the largest frame, and nothing is allocated
+*			any more. In _DEBUG the old contents are scrambled, to catch
+*			the data kept after the reset.
+******************************************************************************/
+void ResetTheArena(TArena* pArena)
+{
+	assert(pArena);
+	assert(pArena->pBlock);
+
+	size_t nTaken = pArena->nUsed + pArena->nSpilled;
+	pArena->nPeak = std::max(pArena->nPeak, nTaken);
+
+	if( pArena->nSpilled )
+	{
+		for(void* pSpill : pArena->Spills) free(pSpill);
+		pArena->Spills.clear();
+
+		size_t nSize = pArena->nSize;
+		while( nSize < nTaken + nTaken / 2 ) nSize *= 2;
+
+		unsigned char* pBlock = (unsigned char*) malloc(nSize);
+
+		if( pBlock )
+		{
+			free(pArena->pBlock);
+			pArena->pBlock = pBlock;
+			pArena->nSize = nSize;
+		}
+
+		pArena->nSpilled = 0;
+	}
+#ifdef _DEBUG
+	else
+	{
+		memset(pArena->pBlock, 0xDD, pArena->nUsed);
+	}
+#endif
+
+	pArena->nUsed = 0;
+}
+
+/*!****************************************************************************
+* @brief	Takes memory from an arena
+* @param	pArena Pointer to the arena
+* @param	nBytes The bytes
+* @param	nAlign The alignment, a power of 2 up to ARENAALIGN
+* @return	Pointer to the memory, valid until the next reset
+* @note		A pointer bump. When the block is full the memory comes from
+*			the heap, and is given back at the reset. Not thread-safe:
+*			an arena belongs to a thread.
+******************************************************************************/
+void* AllocateInTheArena(TArena* pArena, size_t nBytes, size_t nAlign)
+{
+	assert(pArena);
+	assert(pArena->pBlock);
+	assert(nAlign > 0 && nAlign <= ARENAALIGN && (nAlign & (nAlign - 1)) == 0);
+
+	size_t nStart = (pArena->nUsed + nAlign - 1) & ~(nAlign - 1);
+
+	if( nStart + nBytes <= pArena->nSize )
+	{
+		pArena->nUsed = nStart + nBytes;
+		return pArena->pBlock + nStart;
+	}
+											// malloc() aligns to ARENAALIGN
+	void* pSpill = malloc(std::max<size_t>(nBytes, 1));
+	if( !pSpill ) throw std::bad_alloc();
+
+	pArena->Spills.push_back(pSpill);
+	pArena->nSpilled += nBytes;
+
+	return pSpill;
+}
+
+/*!****************************************************************************
+* @brief	Formats a string in an arena, as sprintf()
+* @param	pArena Pointer to the arena
+* @param	pFormat The format, followed by the values
+* @return	The string, valid until the next reset
+******************************************************************************/
+const char* PrintInTheArena(TArena* pArena, const char* pFormat, ...)
+{
+	assert(pArena);
+	assert(pFormat);
+
+	va_list Args, Copy;
+	va_start(Args, pFormat);
+	va_copy(Copy, Args);
+
+	int nLength = vsnprintf(nullptr, 0, pFormat, Args);
+	va_end(Args);
+
+	if( nLength < 0 ) nLength = 0;
+
+	char* pText = (char*) AllocateInTheArena(pArena, nLength + 1, 1);
+
+	vsnprintf(pText, nLength + 1, pFormat, Copy);
+	va_end(Copy);
+
+	return pText;
+}
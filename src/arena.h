@@ -0,0 +1,55 @@
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "vectors.h"
+
+
+#define FRAMEARENASIZE		(256 * 1024)	///< bytes of the frame arena, at the start
+#define ARENAALIGN			16				///< alignment of the blocks
+
+
+struct TArena								///< bump-pointer allocator, emptied as a whole
+{
+	unsigned char* pBlock;
+	size_t nSize, nUsed;					///< bytes of the block, and taken from it
+	std::vector<void*> Spills;				///< taken from the heap when the block is full
+	size_t nSpilled;						///< bytes of the spills, since the reset
+	size_t nPeak;							///< most bytes taken between two resets
+};
+
+void SetupTheArena(TArena* pArena, size_t nSize);
+void CleanupTheArena(TArena* pArena);
+void ResetTheArena(TArena* pArena);
+
+void* AllocateInTheArena(TArena* pArena, size_t nBytes, size_t nAlign);
+const char* PrintInTheArena(TArena* pArena, const char* pFormat, ...);
+
+
+template <typename T>
+struct TArenaAllocator						///< STL allocator on an arena: freeing is a no-op,
+{											///< the memory comes back at the reset
+	typedef T value_type;
+
+	TArena* pArena;
+
+	TArenaAllocator(TArena* pArena) : pArena(pArena) {}
+	template <typename U> TArenaAllocator(const TArenaAllocator<U>& Other) : pArena(Other.pArena) {}
+
+	T* allocate(size_t nCount) { return (T*) AllocateInTheArena(pArena, nCount * sizeof(T), alignof(T)); }
+	void deallocate(T*, size_t) {}
+
+	template <typename U> bool operator==(const TArenaAllocator<U>& Other) const { return pArena == Other.pArena; }
+	template <typename U> bool operator!=(const TArenaAllocator<U>& Other) const { return pArena != Other.pArena; }
+};
+
+template <typename T> using TArenaVector = std::vector<T, TArenaAllocator<T>>;
+
+typedef TArenaVector<TVector2> TArenaPoints;
+typedef TArenaVector<const char*> TArenaStrings;
+
+#endif
@@ -27,6 +27,14 @@
 #include "maths.h"
 #include "utils.h"
 #include "commdefs.h"
+#include "netplay.h"
+#include "server.h"
+#include "batch.h"
+#include "spectator.h"
+#include "snapshot.h"
+#include "profiler.h"
+#include "counters.h"
+#include "allocs.h"
 
 #include "resource.h"
 
@@ -69,8 +77,6 @@ bool Setup(HWND hWnd)
 
 	bool bResult = false;
 
-	srand(::GetCurrentTime());
-
 	TVideoManager *pVM = new TVideoManager();
 	assert(pVM);
 
@@ -81,26 +87,99 @@ bool Setup(HWND hWnd)
 	{
 		TALSystem *pALSystem = new TALSystem();
 		assert(pALSystem);
-		
-		if( SetupSoundManager(pALSystem) )
-		{
-			TSoundManager *pSM = new TSoundManager();
-			assert(pSM);
 
+		TSoundManager *pSM = new TSoundManager();
+		assert(pSM);
+
+		bool bAudio = false;
+		const char* pAudio = getenv(AUDIOVAR);
+		std::string strAudio = pAudio ? pAudio : "";
+											// the software mixer needs no
+											// sound hardware
+		if( strAudio == "null" )
+		{
+			bAudio = SetupSoftwareMixer(pSM, mdNull, "", true);
+		}
+		else if( strAudio == "wav" )
+		{
+			bAudio = SetupSoftwareMixer(pSM, mdWavFile, GetExePath() + "\\" + AUDIOFILE, true);
+		}
+		else if( SetupSoundManager(pALSystem) )
+		{
 			pSM->pALSystem = pALSystem;
+			bAudio = true;
+		}
+		else
+		{
+											// no OpenAL device: plays mute
+			bAudio = SetupSoftwareMixer(pSM, mdNull, "", true);
+		}
+
+		if( !pSM->pALSystem ) delete pALSystem;
+
+		if( bAudio )
+		{
 			SetMasterVolume(pSM, 0.25);
 
 			TGame* pGame = new TGame();
 			assert(pGame);
 			g_pGame = pGame;
-			
-			bResult = Setup(pGame, pVM, pSM);
+											// two players over the network,
+											// alone if the session fails
+			const char* pNet = getenv(NETVAR);
 
-#ifdef _DEVEL
-			Restart(pGame);
-#else
-			GameOver(pGame);
-#endif
+			if( pNet )
+			{
+				TNetplay* pNetplay = new TNetplay();
+				assert(pNetplay);
+
+				if( SetupTheNetplay(pNetplay, pNet) ) pGame->pNetplay = pNetplay;
+				else delete pNetplay;
+			}
+											// a stream of the game for the
+											// spectators, or one to watch
+			const char* pSpectate = getenv(SPECTATEVAR);
+			const char* pReplay = getenv(REPLAYVAR);
+
+			if( pSpectate )
+			{
+				TSpectator* pSpectator = new TSpectator();
+				assert(pSpectator);
+
+				if( SetupTheSpectator(pSpectator, pSpectate) ) pGame->pSpectator = pSpectator;
+				else delete pSpectator;
+			}
+
+			if( pReplay )
+			{
+				TReplay* pViewer = new TReplay();
+				assert(pViewer);
+
+				if( SetupTheReplay(pViewer, pReplay) ) pGame->pReplay = pViewer;
+				else delete pViewer;
+			}
+											// the stages of the frames are
+											// timed, F2 shows them, F3 dumps
+											// them, to the file given or to
+											// the default one
+			const char* pProfile = getenv(PROFILEVAR);
+
+			if( pProfile )
+			{
+				TProfiler* pProfiler = new TProfiler();
+				assert(pProfiler);
+
+				SetupTheProfiler(pProfiler, *pProfile ? std::string(pProfile)
+					: GetExePath() + "\\" + PROFILEFILE);
+				pGame->pProfiler = pProfiler;
+			}
+
+											// a new game at every run, but
+											// the same one for both peers
+			uint64_t nSeed = pGame->pNetplay ? RANDSEED : MakeTheSeed();
+											// the setup goes on in background,
+											// see MainLoop()
+			bResult = Setup(pGame, pVM, pSM, nSeed);
 		}
 	}
 
@@ -120,6 +199,8 @@ int Cleanup()
 											// clean up video manager
 	CleanupVideoManager(g_pGame->pVM);
 
+	CloseTheCounters();
+
 	return 0;
 }
 
@@ -131,15 +212,66 @@ int Cleanup()
 ******************************************************************************/
 void KeyboardHandler(WPARAM nKey)
 {
+	TProfiler* pProfiler = g_pGame ? g_pGame->pProfiler : nullptr;
+
+	if( pProfiler && nKey == VK_F2 ) pProfiler->bOverlay = !pProfiler->bOverlay;
+
+	if( pProfiler && nKey == VK_F3 )
+	{
+		if( !DumpTheTrace(pProfiler) ) ::MessageBeep(MB_ICONHAND);
+	}
+
 #ifdef _DEBUG
+											// the setup tasks are still
+											// building the game
+	if( !g_pGame || IsStarting(g_pGame) ) return;
 
 	int VK_N = 0x4E, VK_P = 0x50, VK_Q = 0x51, VK_S = 0x53, VK_X = 0x58;
+	int VK_A = 0x41, VK_J = 0x4A, VK_T = 0x54, VK_V = 0x56;
 
 
 	if( nKey == VK_X )
 	{
 		RegisterBestScore(g_pGame);
 	}
+											// stress test of the systems
+	if( nKey == VK_T )
+	{
+		StressTheWorld(g_pGame, STRESSASTEROIDS);
+	}
+
+	if( nKey == VK_J )
+	{
+		g_pGame->bSerial = !g_pGame->bSerial;
+	}
+											// snapshots: replay check, quick
+											// save and quick load
+	if( nKey == VK_V )
+	{
+		if( !VerifyTheSnapshot(g_pGame, SNAPSHOTTICKS) ) ::MessageBeep(MB_ICONHAND);
+	}
+
+											// a run of the game, failing if
+											// a tick allocates
+	if( nKey == VK_A )
+	{
+		if( !VerifyTheAllocations(g_pGame, ALLOCTICKS) ) ::MessageBeep(MB_ICONHAND);
+	}
+
+	if( nKey == VK_F5 )
+	{
+		TSnapshot Snapshot;
+		SaveTheSnapshot(g_pGame, Snapshot);
+		WriteTheSnapshot(Snapshot, GetExePath() + "\\" + SNAPSHOTFILE);
+	}
+
+	if( nKey == VK_F9 )
+	{
+		TSnapshot Snapshot;
+
+		if( !ReadTheSnapshot(Snapshot, GetExePath() + "\\" + SNAPSHOTFILE)
+			|| !LoadTheSnapshot(g_pGame, Snapshot) ) ::MessageBeep(MB_ICONHAND);
+	}
 
 
 /*
@@ -156,47 +288,75 @@ if( hDlgRes ) ::MessageBeep(-1);
 #endif
 }
 
+/*!****************************************************************************
+* @brief	Gets the command of the ship bound to a key
+* @param	nKey The virtual key
+* @return	The command, see enInput, 0 if none
+******************************************************************************/
+unsigned char GetTheCommand(WPARAM nKey)
+{
+	int VK_N = 0x4E, VK_S = 0x53;
+
+	if( nKey == VK_N ) return inRestart;
+	if( nKey == VK_S ) return inShield;
+	if( nKey == VK_SPACE ) return inFire;
+	if( nKey == VK_LEFT ) return inLeft;
+	if( nKey == VK_RIGHT ) return inRight;
+	if( nKey == VK_UP ) return inThrust;
+
+	return 0;
+}
+
+/*!****************************************************************************
+* @brief	Queues the press or the release of a key of the ship, with its
+*			time
+* @param	nKey The virtual key
+* @param	bDown True for a press, false for a release
+* @note		From WM_KEYDOWN and WM_KEYUP: the auto-repeat of a key held is
+*			dropped by the queue. The time is taken at the dispatch of the
+*			message, on the clock of the ticks.
+******************************************************************************/
+void QueueTheKey(WPARAM nKey, bool bDown)
+{
+	unsigned char nCommand = GetTheCommand(nKey);
+
+	if( g_pGame && nCommand ) PushTheInput(&g_pGame->Input, nCommand, bDown, GetTheTime());
+}
+
 /*!****************************************************************************
 * @brief	Keyboard handler
-* @note		Uses GetAsynkKeyState() function instead of WM_KEYDOWN event
-*			handler so that can handle multiple keys pressed simultaneously
+* @note		The commands of the ship are sampled from the queue of the key
+*			events, so that a key pressed and released between two ticks
+*			is not lost. The queue is not sampled in the input dialog:
+*			its events wait for the game. The other keys still use
+*			GetAsynkKeyState().
 ******************************************************************************/
 void KeyboardHandler()
 {
 	static SHORT nKeys[256];
-	int VK_N = 0x4E, VK_P = 0x50, VK_Q = 0x51, VK_S = 0x53;
+	int VK_P = 0x50, VK_Q = 0x51;
 
-	nKeys[VK_N] = GetAsyncKeyState(0x4E);
 	nKeys[VK_P] = GetAsyncKeyState(0x50);
 	nKeys[VK_Q] = GetAsyncKeyState(0x51);
-	nKeys[VK_S] = GetAsyncKeyState(0x53);
 
-	nKeys[VK_LEFT] = GetAsyncKeyState(VK_LEFT);
-	nKeys[VK_RIGHT] = GetAsyncKeyState(VK_RIGHT);
-	nKeys[VK_UP] = GetAsyncKeyState(VK_UP);
-	nKeys[VK_DOWN] = GetAsyncKeyState(VK_DOWN);
-	nKeys[VK_SPACE] = GetAsyncKeyState(VK_SPACE);
 	nKeys[VK_ESCAPE] = GetAsyncKeyState(VK_ESCAPE);
 	nKeys[VK_ADD] = GetAsyncKeyState(VK_ADD);
 	nKeys[VK_SUBTRACT] = GetAsyncKeyState(VK_SUBTRACT);
 
 if( !IsInputDialog(g_pGame) )
 {
-	if( nKeys[VK_N] ) Restart(g_pGame);
-	if( nKeys[VK_P] ) PauseTheGame(g_pGame);
+											// the commands of the ship are
+											// applied by the next tick
+	unsigned char nInput = SampleTheInput(&g_pGame->Input, GetTheTime());
+
+	if( nKeys[VK_P] && !g_pGame->pNetplay ) PauseTheGame(g_pGame);
 	if( nKeys[VK_ADD] ) IncreaseMasterVolume(g_pGame->pSM);
 	if( nKeys[VK_SUBTRACT] ) DecreaseMasterVolume(g_pGame->pSM);
 	if( nKeys[VK_ESCAPE] | nKeys[VK_Q] ) { EndTheGame(g_pGame); PostQuitMessage(0); }
 
-	if( IsAlive(g_pGame->pShips[scHuman]) )
-	{
-		if( nKeys[VK_S] ) ActivateTheShield(g_pGame->pShips[scHuman]);
-		if( nKeys[VK_SPACE] ) ShotTheMissile(g_pGame, g_pGame->pShips[scHuman]);		
-		if( nKeys[VK_LEFT] ) RotateLeft(g_pGame->pShips[scHuman], SHIP_ROTSTEP);
-		if( nKeys[VK_RIGHT] ) RotateRight(g_pGame->pShips[scHuman], SHIP_ROTSTEP);
-		if( nKeys[VK_UP] ) Impulse(g_pGame->pShips[scHuman], SHIP_IMPULSE);
-	}
+	SetTheInput(g_pGame, nInput);
 }
+else SetTheInput(g_pGame, 0);
 }
 
 /*!****************************************************************************
@@ -208,26 +368,66 @@ void ForceToFPS(unsigned nFPS)
 	assert(nFPS > 0);
 
 	static unsigned nCurTime = ::GetTickCount();
+
+	TProfileScope Scope(g_pGame->pProfiler, psSleep);
 											
 	while( (::GetTickCount() - nCurTime) < 1.0/FPS * 1000.0) {;}
 	nCurTime = ::GetTickCount();
 }
 
 /*!****************************************************************************
-* @brief	Main application loop
+* @brief	Runs a frame: the input, a tick of the game and the wait for
+*			the next frame
+* @note		Its stages are timed while profiling, see profiler.h
 ******************************************************************************/
-void MainLoop()
+void RunTheFrame()
 {
 	assert(g_pGame);
 
-	KeyboardHandler();
+	TProfiler* pProfiler = g_pGame->pProfiler;
+
+	{
+		TProfileScope Scope(pProfiler, psInput);
 
-	if( IsRunning(g_pGame) && !IsPausing(g_pGame) )
+		KeyboardHandler();
+	}
+											// a spectator runs no tick: the
+											// frames come from the stream
+	if( g_pGame->pReplay )
+	{
+		if( !IsPausing(g_pGame) && AdvanceTheReplay(g_pGame->pReplay, g_pGame) )
+		{
+			InvalidateRect(g_pGame->pVM->hWnd, &g_pGame->pVM->ClientArea, FALSE);
+		}
+
+		ForceToFPS(FPS);
+	}
+											// over the network the ticks are
+											// run by the netplay session
+	else if( g_pGame->pNetplay )
+	{
+		if( AdvanceTheNetplay(g_pGame->pNetplay, g_pGame) )
+		{
+			if( g_pGame->pSpectator ) StreamTheTick(g_pGame->pSpectator, g_pGame);
+
+			InvalidateRect(g_pGame->pVM->hWnd, &g_pGame->pVM->ClientArea, FALSE);
+		}
+
+		ForceToFPS(FPS);
+	}
+	else if( IsRunning(g_pGame) && !IsPausing(g_pGame) )
 	{
 											// clear the screen to black
-		ClearScreen(g_pGame->pVM, RGB(0,0,0));
+		{
+			TProfileScope Scope(pProfiler, psClear);
+
+			ClearScreen(g_pGame->pVM, RGB(0,0,0));
+		}
 
 		Run(g_pGame);
+		ConsumeTheInput(&g_pGame->Input);
+
+		if( g_pGame->pSpectator ) StreamTheTick(g_pGame->pSpectator, g_pGame);
 											// Force to repaint. The last paramater
 											// [BOOL bErase] must be set to FALSE
 											// to avoid annoying flickering effects
@@ -239,6 +439,44 @@ void MainLoop()
 	}
 }
 
+/*!****************************************************************************
+* @brief	Main application loop
+******************************************************************************/
+void MainLoop()
+{
+	assert(g_pGame);
+											// the data of the last frame
+											// is gone
+	ResetTheArena(&g_pGame->Arena);
+											// shows empty frames until
+											// the setup is completed
+	if( IsStarting(g_pGame) )
+	{
+		ClearScreen(g_pGame->pVM, RGB(0,0,0));
+		InvalidateRect(g_pGame->pVM->hWnd, &g_pGame->pVM->ClientArea, FALSE);
+
+		if( !PollTheSetup(g_pGame) ) return;
+
+#ifdef _DEVEL
+		Restart(g_pGame);
+#else
+		GameOver(g_pGame);
+#endif
+	}
+
+	TProfiler* pProfiler = g_pGame->pProfiler;
+
+	{
+		TProfileScope Scope(pProfiler, psFrame);
+
+		RunTheFrame();
+	}
+
+	if( pProfiler ) EndTheFrame(pProfiler);
+
+	PublishTheCounters();
+}
+
 /*!****************************************************************************
 * @brief	The Win32 application entry point
 * @param	hInstance	Handle to current application instance
@@ -254,6 +492,44 @@ int WINAPI WinMain(
    _In_ int       nCmdShow
 )
 {
+											// the counters of the hot paths,
+											// for tools/a2kstat, in any mode
+	const char* pCounters = getenv(COUNTERSVAR);
+
+	if( pCounters ) OpenTheCounters(*pCounters ? pCounters : COUNTERSNAME);
+											// a headless server, without
+											// the window
+	const char* pServer = getenv(SERVERVAR);
+											// or a batch of games stepped
+											// by random bots, to time them
+	const char* pBatch = getenv(BATCHVAR);
+											// or the check of the allocations
+											// of a steady game
+	const char* pAllocCheck = getenv(ALLOCCHECKVAR);
+											// or the check of the software
+											// mixer, against a reference
+	const char* pMixCheck = getenv(MIXCHECKVAR);
+											// or the check of the snapshots,
+											// replaying a game
+	const char* pSnapCheck = getenv(SNAPCHECKVAR);
+											// or the world systems timed
+											// on 1 to N threads
+	const char* pStress = getenv(STRESSVAR);
+
+	if( pServer || pBatch || pAllocCheck || pMixCheck || pSnapCheck || pStress )
+	{
+		bool bResult = pServer ? RunTheServer(pServer)
+			: pBatch ? RunTheBatch(pBatch)
+			: pAllocCheck ? RunTheAllocCheck(pAllocCheck)
+			: pMixCheck ? VerifyTheMixer(*pMixCheck ? pMixCheck : MIXCHECKFILE)
+			: pSnapCheck ? RunTheSnapshotCheck(pSnapCheck)
+			: RunTheStress(pStress);
+
+		CloseTheCounters();
+
+		return bResult ? 0 : 1;
+	}
+
 	WNDCLASSEX wcex;
 
 	wcex.cbSize			= sizeof(WNDCLASSEX);
@@ -352,6 +628,8 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 				HDC hPaintDC = BeginPaint(hWnd, &ps);
 
 				RECT Rect = g_pGame->pVM->ClientArea;
+
+				TProfileScope Scope(g_pGame->pProfiler, psBlit);
 				::BitBlt(hPaintDC, 0, 0, Rect.right, Rect.bottom, g_pGame->pVM->hDC, 0, 0, SRCCOPY);
 
 				EndPaint(hWnd, &ps);
@@ -368,9 +646,19 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 
 		case WM_KEYDOWN:
 											// see notes above on KeyboardHandler()
+			QueueTheKey(wParam, true);
 			KeyboardHandler(wParam);
 		break;
 
+		case WM_KEYUP:
+			QueueTheKey(wParam, false);
+		break;
+											// the keys released elsewhere
+											// are not seen
+		case WM_KILLFOCUS:
+			if( g_pGame ) PushTheCommands(&g_pGame->Input, 0, GetTheTime());
+		break;
+
 		default:
 			return DefWindowProc(hWnd, message, wParam, lParam);
 		break;
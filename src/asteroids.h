@@ -1,7 +1,8 @@
+
 #ifndef _ASTEROIDS_H_
 #define _ASTEROIDS_H_
 
-#include <windows.h>
+#include "platform.h"
 #include <map>
 #include <string>
 #include <vector>
@@ -9,40 +10,18 @@
 
 //#include <sdl2/sdl.h>
 
+#include "ecs.h"
 #include "video.h"
 #include "vectors.h"
 
 
-enum enAsteroidClass { acBig, acMedium, acSmall };
-
-struct TAsteroid
-{
-	bool bAlive;
-	COLORREF Color;
-	double Radius, Rot, DRot;
-	TVecPoints Shape;
-	TVector2 Pos, Vel, Acc;
-	TVideoManager* pVM;
-	enAsteroidClass nClass;
-};
-
-typedef std::vector<TAsteroid> TVecAsteroids;
-typedef std::vector<TAsteroid*> TVecPtrAsteroids;
+#define ASTEROID_MAXVERTS	16
 
-bool Collide(TAsteroid* pAsteroid, TVector2 Pt);
-bool IsAlive(TAsteroid* pAsteroid);
-void Crash(TAsteroid* pAsteroid);
 
-void SetPos(TAsteroid* pAsteroid, TVector2 Pos);
-TVector2 GetPos(TAsteroid* pAsteroid);
-TVector2 GetVel(TAsteroid* pAsteroid);
-enAsteroidClass GetClass(TAsteroid* pAsteroid);
+enum enAsteroidClass { acBig, acMedium, acSmall };
 
-void Update(TAsteroid* pAsteroid, double DeltaT);
-TVecPoints RandShape(double Size);
+void RandShape(double Size, TVecPoints& Pts);
 
-void Build(TAsteroid* pAsteroid, TVideoManager* VideoManager,
-	enAsteroidClass nClass, TVector2 Pos, TVector2 Vel, double Radius);
+TEntity MakeTheAsteroid(TWorld* pWorld, enAsteroidClass nClass, TVector2 Pos, TVector2 Vel, double Radius);
 
 #endif
-
@@ -14,23 +14,31 @@
 #include <windows.h>
 #include <assert.h>
 
+#include <string.h>
+
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <algorithm>
 
 #include <al/al.h>
 #include <al/alc.h>
+#include <al/alext.h>
 
 //#include <sdl2/sdl.h>
 //#include <sdl2/sdl_audio.h>
 
 #include "audio.h"
+#include "tasks.h"
 #include "utils.h"
+#include "counters.h"
 
 
 //-----------------------------------------------------------------------------
 #define DELTAVOLUME	0.05
 
+#define WAVE_FORMAT_PCM				0x0001
+#define WAVE_FORMAT_IEEE_FLOAT		0x0003
+#define WAVE_FORMAT_EXTENSIBLE		0xFFFE
+
 
 /*!****************************************************************************
 * @brief	Initialize the sound manager
@@ -58,15 +66,43 @@ bool SetupSoundManager(TALSystem *pALSystem)
 	}
 	else
 	{
-											// Handle Exception
-	   ::MessageBox(0, TEXT("Error intializing OpenAL!"), TEXT("Error"), MB_OK | MB_ICONERROR);
-	 
+											// no device: the caller falls
+											// back to the software mixer
 		bResult = false;
 	}
 
 	return bResult;
 }
 
+/*!****************************************************************************
+* @brief	Setting-up the software mixer as the audio backend
+* @param	pSM Pointer to the sound manager
+* @param	nDevice The output device, see enMixerDevice
+* @param	strFileName Path of the output file, for the WAV file device
+* @param	bRealtime If true the mix is rendered in real time, otherwise
+*			by calling RenderTheMixer()
+* @return	Returns true for success, false otherwise
+* @note		Needs no sound hardware: the sounds are mixed in software
+******************************************************************************/
+bool SetupSoftwareMixer(TSoundManager* pSM, int nDevice, std::string strFileName, bool bRealtime)
+{
+	assert(pSM);
+	assert(!pSM->pMixer);
+
+	TMixer *pMixer = new TMixer();
+	assert(pMixer);
+
+	if( !SetupTheMixer(pMixer, nDevice, strFileName, bRealtime) )
+	{
+		delete pMixer;
+		return false;
+	}
+
+	pSM->pMixer = pMixer;
+
+	return true;
+}
+
 /*!****************************************************************************
 * @brief	Cleanup the sound manager
 * @param	pSM Pointer to the sound manager
@@ -74,6 +110,19 @@ bool SetupSoundManager(TALSystem *pALSystem)
 void CleanupSoundManager(TSoundManager* pSM)
 {
 	assert(pSM);
+
+	StopTheAudio(pSM);
+
+	if( pSM->pMixer )
+	{
+		CleanupTheMixer(pSM->pMixer);
+
+		delete pSM->pMixer;
+		pSM->pMixer = nullptr;
+
+		return;
+	}
+
 	assert(pSM->pALSystem);
 	assert(pSM->pALSystem->pAlcContext);
 
@@ -85,6 +134,7 @@ void CleanupSoundManager(TSoundManager* pSM)
 * @brief	Set master volume
 * @param	pSM Pointer to the sound manager
 * @param	Volume Value for volume, between 0..1
+* @note		Applied by the audio thread
 ******************************************************************************/
 void SetMasterVolume(TSoundManager* pSM, double Volume)
 {
@@ -93,7 +143,9 @@ void SetMasterVolume(TSoundManager* pSM, double Volume)
 	if( Volume > 1.0 ) Volume = 1.0;
 	if( Volume < 0 ) Volume = 0;
 
-	alListenerf(AL_GAIN, Volume);
+	pSM->Volume = Volume;
+
+	PushTheCommand(pSM, TAudioCommand{ acVolume, -1, false, float(Volume) });
 }
 
 /*!****************************************************************************
@@ -105,11 +157,7 @@ double GetMasterVolume(TSoundManager* pSM)
 {
 	assert(pSM);
 
-	ALfloat Volume = 0;
-
-	alGetListenerf(AL_GAIN, &Volume);
-
-	return double(Volume);
+	return pSM->Volume;
 }
 
 /*!****************************************************************************
@@ -147,95 +195,241 @@ void DecreaseMasterVolume(TSoundManager* pSM)
 }
 
 /*!****************************************************************************
-* @brief	Load a sound from file
+* @brief	Makes a sound track, not decoded, with the default settings
+* @param	strName The name of the sound
+* @param	strFileName Path to the WAV file, empty if in memory
+* @param	pImage Pointer to the WAV image in memory, nullptr if in a file
+* @param	nImageSize Size of the WAV image
+* @return	The track: by default a sound behaves like it owns a single
+*			source, with no rate limit
+******************************************************************************/
+static TSoundTrack MakeTheTrack(std::string strName, std::string strFileName,
+	const unsigned char* pImage, unsigned nImageSize)
+{
+	TSoundTrack SoundTrack { strName, strFileName, pImage, nImageSize, false, 0, false };
+
+	SoundTrack.nPriority = 0;
+	SoundTrack.nMaxVoices = 1;
+	SoundTrack.nQueued = 0;
+	SoundTrack.bQueuedLoop = false;
+	SoundTrack.nMinTicks = 0;
+	SoundTrack.bScaleGain = false;
+	SoundTrack.nLastTick = 0;
+
+	return SoundTrack;
+}
+
+/*!****************************************************************************
+* @brief	Registers a sound stored in a file, without decoding it
 * @param	pSM Pointer to the sound manager
+* @param	strName The name of the sound
 * @param	strFileName Path to an audio file in WAV PCM format
-* @return	Returns true for success, false otherwise
+* @return	Returns the handle of the sound, -1 if the file is not a WAV
+* @note		Handles are assigned in registration order, starting from 0
 ******************************************************************************/
-bool LoadTheSound(TSoundManager* pSM, std::string strFileName)
+int RegisterTheSound(TSoundManager* pSM, std::string strName, std::string strFileName)
 {
 	assert(pSM);
 
-	bool bResult = false;
+	int nResult = -1;
+											// just peeks at the magic word
+	if( IsWavFile(strFileName) )
+	{
+		TSoundTrack SoundTrack = MakeTheTrack(strName, strFileName, nullptr, 0);
 
-	int nChannels=0, nSampleRate=0, nBps=0, nSize = 0;
-	char *pData = LoadWAV(strFileName.c_str(), nChannels, nSampleRate, nBps, nSize); 
+		nResult = pSM->SoundTracks.size();
+		pSM->SoundTracks.push_back(SoundTrack);
+	}
 
-/*
-printf("\n\nFile Name: %s", strFileName.c_str());
-printf("\nchannels: %d", nChannels);
-printf("\nSampleRate: %d", nSampleRate);
-printf("\nBps: %d", nBps);
-printf("\nSamples per channel: %d", nSize);
-*/
+	return nResult;
+}
 
-	if( pData )
+/*!****************************************************************************
+* @brief	Registers a sound stored in memory, without decoding it
+* @param	pSM Pointer to the sound manager
+* @param	strName The name of the sound
+* @param	pData Pointer to the image of a WAV PCM file: it must stay
+*			valid until the sound is decoded
+* @param	nSize Size of the file image
+* @return	Returns the handle of the sound, -1 if the image is not valid
+******************************************************************************/
+int RegisterTheSound(TSoundManager* pSM, std::string strName, const unsigned char* pData, unsigned nSize)
+{
+	assert(pSM);
+
+	int nResult = -1;
+
+	TWavInfo Wav;
+											// only the chunk headers are read
+	if( ParseWAV(pData, nSize, &Wav) )
 	{
-		ALuint nBufferId, nFormat;
-		alGenBuffers(1, &nBufferId);
+		TSoundTrack SoundTrack = MakeTheTrack(strName, "", pData, nSize);
+
+		nResult = pSM->SoundTracks.size();
+		pSM->SoundTracks.push_back(SoundTrack);
+	}
 
-		if( nChannels == 1 )
+	return nResult;
+}
+
+/*!****************************************************************************
+* @brief	Gets the OpenAL format of a WAV sound
+* @param	Wav The WAV audio format
+* @return	The OpenAL buffer format
+* @note		The float formats need the AL_EXT_FLOAT32 extension
+******************************************************************************/
+static ALenum GetTheFormat(const TWavInfo& Wav)
+{
+	ALenum nFormat;
+
+	if( Wav.nBps == 32 )
+	{
+		nFormat = Wav.nChannels == 1 ? AL_FORMAT_MONO_FLOAT32 : AL_FORMAT_STEREO_FLOAT32;
+	}
+	else if( Wav.nChannels == 1 )
+	{
+		if( Wav.nBps == 8 )
 		{
-			if( nBps == 8 )
-			{
-				nFormat = AL_FORMAT_MONO8;
-			}
-			else
-			{
-				nFormat = AL_FORMAT_MONO16;
-			}
+			nFormat = AL_FORMAT_MONO8;
 		}
 		else
 		{
-			if( nBps == 8 )
-			{
-				nFormat = AL_FORMAT_STEREO8;
-			}
-			else
-			{
-				nFormat = AL_FORMAT_STEREO16;
-			}
+			nFormat = AL_FORMAT_MONO16;
 		}
+	}
+	else
+	{
+		if( Wav.nBps == 8 )
+		{
+			nFormat = AL_FORMAT_STEREO8;
+		}
+		else
+		{
+			nFormat = AL_FORMAT_STEREO16;
+		}
+	}
+
+	return nFormat;
+}
 
-		alBufferData(nBufferId, nFormat, pData, nSize, nSampleRate);
+/*!****************************************************************************
+* @brief	Decodes a registered sound in an OpenAL buffer
+* @param	pSM Pointer to the sound manager
+* @param	nSound The sound handle
+* @return	Returns true for success, false otherwise
+* @note		Sounds longer than STREAMTHRESHOLD are not decoded: their
+*			samples are kept in memory (mapped) to be streamed. The
+*			software mixer plays all the sounds from memory.
+******************************************************************************/
+bool DecodeTheSound(TSoundManager* pSM, int nSound)
+{
+	assert(pSM);
+	assert(nSound >= 0 && nSound < int(pSM->SoundTracks.size()));
 
-		ALuint nSourceId;
-		alGenSources(1, &nSourceId);
+	TSoundTrack& Track = pSM->SoundTracks[nSound];
 
-		alSourcei(nSourceId, AL_BUFFER, nBufferId);
+	if( Track.bDecoded ) return true;
 
-		std::string strName = GetFileName(strFileName, true);
+	TMappedFile File;
+	memset(&File, 0, sizeof(File));
 
-		TSoundTrack SoundTrack { strName, nBufferId, nSourceId };
+	const unsigned char* pData = Track.pImage;
+	unsigned nSize = Track.nImageSize;
 
-		pSM->SoundTracks.insert(make_pair(strName, SoundTrack));
+	if( !pData )
+	{
+		if( !MapTheFile(&File, Track.strFileName) ) return false;
 
-		bResult = true;
+		pData = File.pData;
+		nSize = File.nSize;
 	}
 
-	return bResult;
+	TWavInfo Wav;
+											// OpenAL may not play the floats
+	bool bFormat = ParseWAV(pData, nSize, &Wav)
+		&& (Wav.nBps != 32 || pSM->pMixer || alIsExtensionPresent("AL_EXT_FLOAT32"));
+
+	if( bFormat )
+	{
+		if( pSM->pMixer || (Wav.nSize > STREAMTHRESHOLD && pSM->nStreams) )
+		{
+											// the mapping must outlive the voices
+			Track.File = File;
+			memset(&File, 0, sizeof(File));
+
+			Track.Wav = Wav;
+			Track.bStream = !pSM->pMixer;
+		}
+		else
+		{
+			ALuint nBufferId;
+			alGenBuffers(1, &nBufferId);
+											// OpenAL reads the samples straight
+											// from the file image
+			alBufferData(nBufferId, GetTheFormat(Wav), Wav.pSamples, Wav.nSize, Wav.nSampleRate);
+
+			Track.nBufferId = nBufferId;
+		}
+
+		Track.bDecoded = true;
+	}
+
+	if( File.pData ) UnmapTheFile(&File);
+
+	return Track.bDecoded;
 }
 
 /*!****************************************************************************
 * @brief	Load sounds from a list of specified files
 * @param	pSM Pointer to the sound manager
 * @param	strSounds A list of sound filenames to be open
+* @param	pArchive The assets archive, if any. Sounds not found in it
+*			are loaded from the data folder
 * @return	Returns true for success, false otherwise
+* @note		The i-th sound in the list gets the handle i. The sounds are
+*			only registered: each one is decoded when first played
 ******************************************************************************/
-bool LoadTheSounds(TSoundManager* pSM, std::vector<std::string> strSounds)
+bool LoadTheSounds(TSoundManager* pSM, const std::vector<std::string>& strSounds, TArchive* pArchive)
 {
 	assert(pSM);
 	assert(strSounds.size());
 
 	bool bResult = true;
 
+	if( !pSM->nVoices && !BuildTheVoices(pSM) )
+	{
+		return false;
+	}
+											// without streams, long sounds
+											// are decoded as the short ones
+	if( !pSM->nStreams && !pSM->pMixer ) BuildTheStreams(pSM);
+											// from now on the voices and the
+											// streams belong to the audio thread
+	if( !pSM->AudioThread.joinable() ) StartTheAudio(pSM);
+
 	std::string strDataPath = GetDataPath();
 
+	pSM->SoundTracks.reserve(pSM->SoundTracks.size() + strSounds.size());
+
 	for(int i=0; i<strSounds.size(); ++i)
 	{
-		std::string strWavFile = strDataPath + strSounds[i] + ".wav";
+		std::string strWavFile = strSounds[i] + ".wav";
+
+		const unsigned char* pData = nullptr;
+		unsigned nSize = 0;
+
+		int nSound = -1;
+
+		if( pArchive && GetTheAsset(pArchive, strWavFile.c_str(), &pData, &nSize) )
+		{
+			nSound = RegisterTheSound(pSM, strSounds[i], pData, nSize);
+		}
+		else
+		{
+			nSound = RegisterTheSound(pSM, strSounds[i], strDataPath + strWavFile);
+		}
 
-		if( !LoadTheSound(pSM, strWavFile) )
+		if( nSound < 0 )
 		{
 			bResult = false;
 			break;
@@ -253,58 +447,454 @@ void FreeTheSounds(TSoundManager* pSM)
 {
 	assert(pSM);
 
-	for(auto Iter=pSM->SoundTracks.begin();Iter!=pSM->SoundTracks.end();++Iter)
+	StopTheAudio(pSM);
+											// sources must release the
+											// buffers before deleting them
+	FreeTheStreams(pSM);
+	FreeTheVoices(pSM);
+
+	for(int i=0; i<pSM->SoundTracks.size(); ++i)
 	{
-		alDeleteSources(1, &Iter->second.nSourceId);
+		TSoundTrack& Track = pSM->SoundTracks[i];
+
+		if( Track.bDecoded && !Track.bStream && !pSM->pMixer )
+		{
+			alDeleteBuffers(1, &Track.nBufferId);
+		}
+
+		if( Track.File.pData ) UnmapTheFile(&Track.File);
 	}
+
+	pSM->SoundTracks.clear();
 }
 
 /*!****************************************************************************
-* @brief	Play and audio track
+* @brief	Sets the voice allocation policy of a sound
 * @param	pSM Pointer to the sound manager
-* @param	strSound The soundtrack to be played
-* @param	bLoop Flag for looping: true if must be played repeatedly
+* @param	nSound The sound handle
+* @param	nPriority Priority: a new sound can steal voices with equal
+*			or lower priority when the pool is exhausted
+* @param	nMaxVoices Max number of instances of the sound playing at once
 ******************************************************************************/
-void PlayTheSound(TSoundManager* pSM, std::string strSound, bool bLoop)
+void SetSoundPriority(TSoundManager* pSM, int nSound, int nPriority, int nMaxVoices)
 {
 	assert(pSM);
+	assert(nMaxVoices > 0);
 
-	if( pSM->SoundTracks.size() )
+	if( nSound >= 0 && nSound < int(pSM->SoundTracks.size()) )
 	{
-		auto it = pSM->SoundTracks.find(strSound);
+		pSM->SoundTracks[nSound].nPriority = nPriority;
+		pSM->SoundTracks[nSound].nMaxVoices = nMaxVoices;
+	}
+}
 
-		//if( !it._Ptr->_Isnil )
-		if( it._M_node != nullptr)
+/*!****************************************************************************
+* @brief	Sets how often a queued sound can be played
+* @param	pSM Pointer to the sound manager
+* @param	nSound The sound handle
+* @param	nMinTicks Min number of ticks between two plays, the events
+*			queued meanwhile are dropped
+* @param	bScaleGain If true, the events coalesced in a tick play the
+*			sound louder, up to QUEUEMAXGAIN
+******************************************************************************/
+void SetSoundRateLimit(TSoundManager* pSM, int nSound, int nMinTicks, bool bScaleGain)
+{
+	assert(pSM);
+	assert(nMinTicks >= 0);
+
+	if( nSound >= 0 && nSound < int(pSM->SoundTracks.size()) )
+	{
+		pSM->SoundTracks[nSound].nMinTicks = nMinTicks;
+		pSM->SoundTracks[nSound].bScaleGain = bScaleGain;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Allocates the pool of AL sources shared by all the sounds
+* @param	pSM Pointer to the sound manager
+* @return	Returns true for success, false otherwise
+* @note		The pool may be smaller than MAXVOICES if the device
+*			runs out of sources. The sources can play louder than 1.0,
+*			up to QUEUEMAXGAIN, if the device allows it: see MaxGain.
+******************************************************************************/
+bool BuildTheVoices(TSoundManager* pSM)
+{
+	assert(pSM);
+	assert(pSM->nVoices == 0);
+
+	alGetError();
+											// the mixer takes any gain
+	pSM->MaxGain = QUEUEMAXGAIN;
+
+	for(int i=0; i<MAXVOICES; ++i)
+	{
+		ALuint nSourceId = 0;
+											// the mixer voices match the
+											// sound manager ones
+		if( !pSM->pMixer )
 		{
-			TSoundTrack ST = it->second;
+			alGenSources(1, &nSourceId);
 
-			alSourcei(ST.nSourceId, AL_LOOPING, bLoop);
-			alSourcePlay(ST.nSourceId);
+			if( alGetError() != AL_NO_ERROR ) break;
+											// by default OpenAL clamps the
+											// gain to 1.0; the spec allows
+											// no more, some devices do
+			alSourcef(nSourceId, AL_MAX_GAIN, QUEUEMAXGAIN);
+
+			if( alGetError() != AL_NO_ERROR ) pSM->MaxGain = 1.0;
 		}
+
+		TVoice& Voice = pSM->Voices[pSM->nVoices++];
+
+		Voice.nSourceId = nSourceId;
+		Voice.nSound = -1;
+		Voice.nPriority = 0;
+		Voice.bLoop = false;
+		Voice.nStamp = 0;
 	}
+
+	return pSM->nVoices > 0;
 }
 
 /*!****************************************************************************
-* @brief	Stops to playing a sound source
+* @brief	Releases the pool of AL sources
 * @param	pSM Pointer to the sound manager
-* @param	strSound Sound source to be stopped
 ******************************************************************************/
-void StopTheSound(TSoundManager* pSM, std::string strSound)
+void FreeTheVoices(TSoundManager* pSM)
 {
 	assert(pSM);
 
-	if( pSM->SoundTracks.size() )
+	for(int i=0; i<pSM->nVoices; ++i)
+	{
+		if( pSM->pMixer )
+		{
+			StopTheMixerVoice(pSM->pMixer, i);
+		}
+		else
+		{
+			alSourceStop(pSM->Voices[i].nSourceId);
+			alSourcei(pSM->Voices[i].nSourceId, AL_BUFFER, 0);
+			alDeleteSources(1, &pSM->Voices[i].nSourceId);
+		}
+	}
+
+	pSM->nVoices = 0;
+}
+
+/*!****************************************************************************
+* @brief	Checks if a voice is still playing
+* @param	pSM Pointer to the sound manager
+* @param	nVoice The voice index
+* @return	Returns true if the voice is playing
+******************************************************************************/
+static bool IsVoicePlaying(TSoundManager* pSM, int nVoice)
+{
+	if( pSM->pMixer ) return IsMixerVoicePlaying(pSM->pMixer, nVoice);
+
+	ALint nState = AL_STOPPED;
+	alGetSourcei(pSM->Voices[nVoice].nSourceId, AL_SOURCE_STATE, &nState);
+
+	return nState == AL_PLAYING;
+}
+
+/*!****************************************************************************
+* @brief	Stops a voice
+* @param	pSM Pointer to the sound manager
+* @param	nVoice The voice index
+******************************************************************************/
+static void StopTheVoice(TSoundManager* pSM, int nVoice)
+{
+	if( pSM->pMixer ) StopTheMixerVoice(pSM->pMixer, nVoice);
+	else alSourceStop(pSM->Voices[nVoice].nSourceId);
+}
+
+/*!****************************************************************************
+* @brief	Starts playing a sound on a voice (audio thread)
+* @param	pSM Pointer to the sound manager
+* @param	nSound The handle of the soundtrack to be played
+* @param	bLoop Flag for looping: true if must be played repeatedly
+* @param	Gain Gain of the sound
+* @note		The voice is picked, in order, among: the oldest instance
+*			of the same sound when its limit is reached, a free voice,
+*			the oldest voice with the lowest priority not above the
+*			sound one. If none is available the sound is dropped.
+******************************************************************************/
+static void StartTheSound(TSoundManager* pSM, int nSound, bool bLoop, double Gain)
+{
+	TSoundTrack& Track = pSM->SoundTracks[nSound];
+
+	if( !DecodeTheSound(pSM, nSound) ) return;
+
+	if( Track.bStream )
+	{
+		StartTheStream(pSM, nSound, bLoop);
+		return;
+	}
+
+	int nInstances = 0;
+	TVoice *pOldest = nullptr, *pFree = nullptr, *pVictim = nullptr;
+
+	for(int i=0; i<pSM->nVoices; ++i)
+	{
+		TVoice *pVoice = &pSM->Voices[i];
+
+		if( pVoice->nSound >= 0 && !pVoice->bLoop )
+		{
+											// one-shot voices are released
+											// lazily, once they have ended
+			if( !IsVoicePlaying(pSM, i) ) pVoice->nSound = -1;
+		}
+
+		if( pVoice->nSound < 0 )
+		{
+			if( !pFree ) pFree = pVoice;
+		}
+		else if( pVoice->nSound == nSound )
+		{
+			nInstances++;
+			if( !pOldest || pVoice->nStamp < pOldest->nStamp ) pOldest = pVoice;
+		}
+		else if( pVoice->nPriority <= Track.nPriority )
+		{
+			if( !pVictim
+				|| pVoice->nPriority < pVictim->nPriority
+				|| (pVoice->nPriority == pVictim->nPriority && pVoice->nStamp < pVictim->nStamp) )
+			{
+				pVictim = pVoice;
+			}
+		}
+	}
+
+	TVoice *pVoice = nullptr;
+
+	if( nInstances >= Track.nMaxVoices ) pVoice = pOldest;
+	else if( pFree ) pVoice = pFree;
+	else pVoice = pVictim;
+
+	if( pVoice && pSM->pMixer )
+	{
+		const TWavInfo& Wav = Track.Wav;
+
+		PlayTheMixerVoice(pSM->pMixer, int(pVoice - pSM->Voices),
+			Wav.pSamples, Wav.nSize, Wav.nChannels, Wav.nBps, Wav.nSampleRate, bLoop, float(Gain));
+	}
+	else if( pVoice )
+	{
+		alSourceStop(pVoice->nSourceId);
+
+		alSourcei(pVoice->nSourceId, AL_BUFFER, Track.nBufferId);
+		alSourcei(pVoice->nSourceId, AL_LOOPING, bLoop);
+		alSourcef(pVoice->nSourceId, AL_GAIN, ALfloat(Gain));
+		alSourcePlay(pVoice->nSourceId);
+	}
+
+	if( pVoice )
+	{
+		pVoice->nSound = nSound;
+		pVoice->nPriority = Track.nPriority;
+		pVoice->bLoop = bLoop;
+		pVoice->nStamp = ++pSM->nStamp;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Stops all the instances of a sound (audio thread)
+* @param	pSM Pointer to the sound manager
+* @param	nSound The handle of the sound to be stopped, -1 for all
+******************************************************************************/
+static void HaltTheSound(TSoundManager* pSM, int nSound)
+{
+	StopTheStream(pSM, nSound);
+
+	for(int i=0; i<pSM->nVoices; ++i)
+	{
+		if( nSound < 0 || pSM->Voices[i].nSound == nSound )
+		{
+			StopTheVoice(pSM, i);
+			pSM->Voices[i].nSound = -1;
+		}
+	}
+}
+
+/*!****************************************************************************
+* @brief	Executes a command of the game thread (audio thread)
+* @param	pSM Pointer to the sound manager
+* @param	Command The command
+******************************************************************************/
+static void ExecuteTheCommand(TSoundManager* pSM, const TAudioCommand& Command)
+{
+	switch( Command.nCommand )
+	{
+		case acPlay:
+			StartTheSound(pSM, Command.nSound, Command.bLoop, Command.Value);
+			break;
+
+		case acStop:
+			HaltTheSound(pSM, Command.nSound);
+			break;
+
+		case acStopAll:
+			HaltTheSound(pSM, -1);
+			break;
+
+		case acVolume:
+			if( pSM->pMixer )
+			{
+				std::lock_guard<std::mutex> Lock(pSM->pMixer->Mutex);
+
+				pSM->pMixer->Volume = Command.Value;
+			}
+			else
+			{
+				alListenerf(AL_GAIN, Command.Value);
+			}
+			break;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Audio thread body: runs the commands and refills the streams
+* @param	pSM Pointer to the sound manager
+* @note		Sleeps on hWake until a command is pushed or a refill of the
+*			streams is due: the commands run as soon as they are pushed,
+*			whatever the resolution of the system timer
+******************************************************************************/
+static void AudioLoop(TSoundManager* pSM)
+{
+	TAudioQueue* pQueue = &pSM->Queue;
+
+	double LastService = 0;
+
+	while( !pSM->bAudioQuit )
 	{
-		auto it = pSM->SoundTracks.find(strSound);
+		unsigned nHead = pQueue->nHead.load(std::memory_order_relaxed);
+		unsigned nTail = pQueue->nTail.load(std::memory_order_acquire);
+
+		while( nHead != nTail )
+		{
+			ExecuteTheCommand(pSM, pQueue->Commands[nHead % AUDIOQUEUESIZE]);
+			nHead++;
+		}
+
+		pQueue->nHead.store(nHead, std::memory_order_release);
+
+		double Now = GetTheTime();
 
-		//if( !it._Ptr->_Isnil )
-		if( it._M_node != nullptr)
+		if( Now - LastService >= STREAMPERIOD / 1000.0 )
 		{
-			alSourceStop(it->second.nSourceId);
+			ServiceTheStreams(pSM);
+			LastService = Now;
 		}
+											// the streams are refilled
+											// every STREAMPERIOD ms at most
+		double Wait = LastService + STREAMPERIOD / 1000.0 - GetTheTime();
+
+		::WaitForSingleObject(pSM->hWake, Wait > 0 ? DWORD(Wait * 1000.0) + 1 : 0);
 	}
 }
 
+/*!****************************************************************************
+* @brief	Starts the audio thread
+* @param	pSM Pointer to the sound manager
+* @note		The commands pushed so far (e.g. the volume) are run first
+******************************************************************************/
+void StartTheAudio(TSoundManager* pSM)
+{
+	assert(pSM);
+	assert(!pSM->AudioThread.joinable());
+
+	pSM->bAudioQuit = false;
+											// auto-reset: a push made while
+											// the thread runs is not lost
+	pSM->hWake = ::CreateEventA(NULL, FALSE, FALSE, NULL);
+	assert(pSM->hWake);
+
+	pSM->AudioThread = std::thread(AudioLoop, pSM);
+}
+
+/*!****************************************************************************
+* @brief	Stops the audio thread, the pending commands are lost
+* @param	pSM Pointer to the sound manager
+******************************************************************************/
+void StopTheAudio(TSoundManager* pSM)
+{
+	assert(pSM);
+
+	if( pSM->AudioThread.joinable() )
+	{
+		pSM->bAudioQuit = true;
+		::SetEvent(pSM->hWake);
+
+		pSM->AudioThread.join();
+
+		::CloseHandle(pSM->hWake);
+		pSM->hWake = NULL;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Sends a command to the audio thread
+* @param	pSM Pointer to the sound manager
+* @param	Command The command
+* @return	Returns false if the queue is full and the command is dropped
+* @note		Called by the game thread only: it never blocks, it wakes up
+*			the audio thread
+******************************************************************************/
+bool PushTheCommand(TSoundManager* pSM, const TAudioCommand& Command)
+{
+	assert(pSM);
+
+	TAudioQueue* pQueue = &pSM->Queue;
+
+	unsigned nTail = pQueue->nTail.load(std::memory_order_relaxed);
+	unsigned nHead = pQueue->nHead.load(std::memory_order_acquire);
+
+	if( nTail - nHead >= AUDIOQUEUESIZE )
+	{
+		pQueue->nDropped++;
+		return false;
+	}
+
+	pQueue->Commands[nTail % AUDIOQUEUESIZE] = Command;
+	pQueue->nTail.store(nTail + 1, std::memory_order_release);
+											// before the thread is started
+											// the commands just wait
+	if( pSM->hWake ) ::SetEvent(pSM->hWake);
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Play and audio track
+* @param	pSM Pointer to the sound manager
+* @param	nSound The handle of the soundtrack to be played
+* @param	bLoop Flag for looping: true if must be played repeatedly
+* @param	Gain Gain of the sound
+* @note		The sound is played by the audio thread
+******************************************************************************/
+void PlayTheSound(TSoundManager* pSM, int nSound, bool bLoop, double Gain)
+{
+	assert(pSM);
+
+	if( nSound < 0 || nSound >= int(pSM->SoundTracks.size()) || pSM->bMuted ) return;
+
+	PushTheCommand(pSM, TAudioCommand{ acPlay, nSound, bLoop, float(Gain) });
+}
+
+/*!****************************************************************************
+* @brief	Stops to playing a sound source
+* @param	pSM Pointer to the sound manager
+* @param	nSound The handle of the sound to be stopped (all its instances)
+******************************************************************************/
+void StopTheSound(TSoundManager* pSM, int nSound)
+{
+	assert(pSM);
+
+	if( nSound < 0 || nSound >= int(pSM->SoundTracks.size()) ) return;
+
+	PushTheCommand(pSM, TAudioCommand{ acStop, nSound, false, 0 });
+}
+
 /*!****************************************************************************
 * @brief	Stops to playing all sound sources
 * @param	pSM Pointer to the sound manager
@@ -313,62 +903,408 @@ void StopAllSounds(TSoundManager* pSM)
 {
 	assert(pSM);
 
-	for( auto it = pSM->SoundTracks.begin(); it != pSM->SoundTracks.end(); ++it )
+	PushTheCommand(pSM, TAudioCommand{ acStopAll, -1, false, 0 });
+
+	for(int i=0; i<pSM->SoundTracks.size(); ++i)
+	{
+		pSM->SoundTracks[i].nQueued = 0;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Queues a sound, to be played by FlushTheSounds()
+* @param	pSM Pointer to the sound manager
+* @param	nSound The handle of the sound
+* @param	bLoop Flag for looping: true if must be played repeatedly
+* @note		Nothing is sent to the audio backend here: the events of
+*			a tick are only counted
+******************************************************************************/
+void QueueTheSound(TSoundManager* pSM, int nSound, bool bLoop)
+{
+	assert(pSM);
+											// muted or not
+	CountThe(ctSounds, 1);
+
+	if( nSound < 0 || nSound >= int(pSM->SoundTracks.size()) ) return;
+
+	TSoundTrack& Track = pSM->SoundTracks[nSound];
+
+	Track.nQueued++;
+	Track.bQueuedLoop = Track.bQueuedLoop || bLoop;
+}
+
+/*!****************************************************************************
+* @brief	Plays the sounds queued in the current tick
+* @param	pSM Pointer to the sound manager
+* @note		Each queued sound is played once, whatever the number of
+*			its events, so the calls to the backend per tick are bounded
+*			by the number of sounds. Sounds played less than nMinTicks
+*			ago are dropped. A single event always plays at unit gain;
+*			the coalesced ones play louder up to the MaxGain of the
+*			backend, 1.0 on the devices that refuse AL_MAX_GAIN.
+******************************************************************************/
+void FlushTheSounds(TSoundManager* pSM)
+{
+	assert(pSM);
+
+	pSM->nTick++;
+
+	for(int i=0; i<pSM->SoundTracks.size(); ++i)
 	{
-		alSourceStop(it->second.nSourceId);
+		TSoundTrack& Track = pSM->SoundTracks[i];
+
+		if( !Track.nQueued ) continue;
+
+		if( !Track.nLastTick || pSM->nTick - Track.nLastTick >= unsigned(Track.nMinTicks) )
+		{
+			double Gain = 1.0;
+
+			if( Track.bScaleGain )
+			{
+				Gain = std::min(pSM->MaxGain, 1.0 + QUEUEGAINSTEP * (Track.nQueued - 1));
+			}
+
+			PlayTheSound(pSM, i, Track.bQueuedLoop, Gain);
+
+			Track.nLastTick = pSM->nTick;
+		}
+
+		Track.nQueued = 0;
+		Track.bQueuedLoop = false;
 	}
 }
 
 /*!****************************************************************************
-* @brief	Load raw data from an audio file in WAV PCM format
-* @param	strFileName The path to the file name to be open
-* @param[in,out] nChannels The number of channels: 1 for mono, 2 for stereo
-* @param[in,out] nSampleRate The Sample rate for audio data
-* @param[in,out] nBps The bits per sample
-* @param[in,out] nSize The size of raw audio buffer
-* @return	The pointer to the raw audio buffer data
+* @brief	Allocates the sources and the buffers for streaming
+* @param	pSM Pointer to the sound manager
+* @return	Returns true for success, false otherwise
+* @note		The memory used by a stream is fixed, whatever the
+*			length of the sound: STREAMBUFFERS * STREAMBUFFERSIZE
 ******************************************************************************/
-char* LoadWAV(std::string strFileName,
-	int& nChannels, int& nSampleRate, int& nBps, int& nSize)
+bool BuildTheStreams(TSoundManager* pSM)
 {
-    char buffer[4];
+	assert(pSM);
+	assert(pSM->nStreams == 0);
 
-    std::ifstream in(strFileName.c_str(), std::ios::binary);
+	alGetError();
+
+	for(int i=0; i<MAXSTREAMS; ++i)
+	{
+		TStream& Stream = pSM->Streams[pSM->nStreams];
 
-    in.read(buffer, 4);
+		alGenSources(1, &Stream.nSourceId);
 
-    if (strncmp(buffer, "RIFF", 4) != 0)
-    {
-        std::cout << "this is not a valid WAV file" << std::endl;
-        return NULL;
-    }
+		if( alGetError() != AL_NO_ERROR ) break;
 
-    in.read(buffer, 4);
-    in.read(buffer, 4);      // WAVE
-    in.read(buffer, 4);      // fmt
-    in.read(buffer, 4);      // 16
-    in.read(buffer, 2);      // 1
+		alGenBuffers(STREAMBUFFERS, Stream.nBufferIds);
+
+		if( alGetError() != AL_NO_ERROR )
+		{
+			alDeleteSources(1, &Stream.nSourceId);
+			break;
+		}
 
-    in.read(buffer, 2);
-    nChannels = ConvertToInt(buffer, 2);
+		Stream.nSound = -1;
+		Stream.bLoop = false;
+		Stream.nCursor = 0;
+		Stream.nStamp = 0;
 
-    in.read(buffer, 4);
-    nSampleRate = ConvertToInt(buffer, 4);
+		pSM->nStreams++;
+	}
 
-    in.read(buffer, 4);
-    in.read(buffer, 2);
+	return pSM->nStreams > 0;
+}
 
-    in.read(buffer, 2);
-    nBps = ConvertToInt(buffer, 2);
+/*!****************************************************************************
+* @brief	Releases the streams
+* @param	pSM Pointer to the sound manager
+******************************************************************************/
+void FreeTheStreams(TSoundManager* pSM)
+{
+	assert(pSM);
 
-    in.read(buffer, 4);      // data
-    in.read(buffer, 4);
-    nSize = ConvertToInt(buffer, 4);
+	StopTheStream(pSM, -1);
 
-    char* pData = new char[nSize];
-	assert(pData);
-    in.read(pData, nSize);
+	for(int i=0; i<pSM->nStreams; ++i)
+	{
+		alDeleteSources(1, &pSM->Streams[i].nSourceId);
+		alDeleteBuffers(STREAMBUFFERS, pSM->Streams[i].nBufferIds);
+	}
 
-    return pData;
+	pSM->nStreams = 0;
 }
 
+/*!****************************************************************************
+* @brief	Fills a stream buffer with the next samples of the sound
+* @param	pSM Pointer to the sound manager
+* @param	pStream Pointer to the stream
+* @param	nBufferId The buffer to be filled
+* @return	Returns false when the sound is over (and not looping)
+******************************************************************************/
+static bool FillTheBuffer(TSoundManager* pSM, TStream* pStream, ALuint nBufferId)
+{
+	const TWavInfo& Wav = pSM->SoundTracks[pStream->nSound].Wav;
+
+	unsigned nFilled = 0;
+											// at the end of a looping sound
+											// wraps around in the same buffer
+	while( nFilled < STREAMBUFFERSIZE )
+	{
+		if( pStream->nCursor >= Wav.nSize )
+		{
+			if( !pStream->bLoop ) break;
+
+			pStream->nCursor = 0;
+		}
+
+		unsigned nCount = std::min(unsigned(STREAMBUFFERSIZE) - nFilled, Wav.nSize - pStream->nCursor);
+
+		memcpy(pStream->Staging + nFilled, Wav.pSamples + pStream->nCursor, nCount);
+
+		nFilled += nCount;
+		pStream->nCursor += nCount;
+	}
+											// keeps whole sample frames
+	unsigned nFrame = Wav.nChannels * Wav.nBps / 8;
+	nFilled -= nFilled % nFrame;
+
+	if( !nFilled ) return false;
+
+	alBufferData(nBufferId, GetTheFormat(Wav), pStream->Staging, nFilled, Wav.nSampleRate);
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Starts streaming a sound
+* @param	pSM Pointer to the sound manager
+* @param	nSound The handle of a sound to be streamed
+* @param	bLoop Flag for looping: true if must be played repeatedly
+* @note		A sound already streaming is restarted. If all the streams
+*			are busy, the oldest one is taken.
+******************************************************************************/
+void StartTheStream(TSoundManager* pSM, int nSound, bool bLoop)
+{
+	assert(pSM);
+
+	if( !pSM->nStreams ) return;
+
+	TStream *pSame = nullptr, *pFree = nullptr, *pOldest = nullptr;
+
+	for(int i=0; i<pSM->nStreams; ++i)
+	{
+		TStream* pCur = &pSM->Streams[i];
+
+		if( pCur->nSound == nSound ) { pSame = pCur; break; }
+
+		if( pCur->nSound < 0 )
+		{
+			if( !pFree ) pFree = pCur;
+		}
+		else if( !pOldest || pCur->nStamp < pOldest->nStamp ) pOldest = pCur;
+	}
+
+	TStream* pStream = pSame ? pSame : pFree ? pFree : pOldest;
+
+	alSourceStop(pStream->nSourceId);
+	alSourcei(pStream->nSourceId, AL_BUFFER, 0);
+
+	pStream->nSound = nSound;
+	pStream->bLoop = bLoop;
+	pStream->nCursor = 0;
+	pStream->nStamp = ++pSM->nStamp;
+
+	int nQueued = 0;
+
+	while( nQueued < STREAMBUFFERS && FillTheBuffer(pSM, pStream, pStream->nBufferIds[nQueued]) )
+	{
+		nQueued++;
+	}
+
+	alSourceQueueBuffers(pStream->nSourceId, nQueued, pStream->nBufferIds);
+	alSourcePlay(pStream->nSourceId);
+}
+
+/*!****************************************************************************
+* @brief	Stops streaming a sound
+* @param	pSM Pointer to the sound manager
+* @param	nSound The handle of the sound, -1 to stop all the streams
+******************************************************************************/
+void StopTheStream(TSoundManager* pSM, int nSound)
+{
+	assert(pSM);
+
+	for(int i=0; i<pSM->nStreams; ++i)
+	{
+		TStream* pStream = &pSM->Streams[i];
+
+		if( pStream->nSound >= 0 && (nSound < 0 || pStream->nSound == nSound) )
+		{
+											// a stopped source releases
+											// all its queued buffers
+			alSourceStop(pStream->nSourceId);
+			alSourcei(pStream->nSourceId, AL_BUFFER, 0);
+
+			pStream->nSound = -1;
+		}
+	}
+}
+
+/*!****************************************************************************
+* @brief	Refills the buffers already played by the streams
+* @param	pSM Pointer to the sound manager
+* @note		Called every STREAMPERIOD ms by the audio thread
+******************************************************************************/
+void ServiceTheStreams(TSoundManager* pSM)
+{
+	assert(pSM);
+
+	for(int i=0; i<pSM->nStreams; ++i)
+	{
+		TStream* pStream = &pSM->Streams[i];
+
+		if( pStream->nSound < 0 ) continue;
+
+		ALint nProcessed = 0, nQueued = 0, nState = AL_STOPPED;
+
+		alGetSourcei(pStream->nSourceId, AL_BUFFERS_PROCESSED, &nProcessed);
+
+		while( nProcessed-- > 0 )
+		{
+			ALuint nBufferId;
+			alSourceUnqueueBuffers(pStream->nSourceId, 1, &nBufferId);
+
+			if( FillTheBuffer(pSM, pStream, nBufferId) )
+			{
+				alSourceQueueBuffers(pStream->nSourceId, 1, &nBufferId);
+			}
+		}
+
+		alGetSourcei(pStream->nSourceId, AL_BUFFERS_QUEUED, &nQueued);
+		alGetSourcei(pStream->nSourceId, AL_SOURCE_STATE, &nState);
+
+		if( nQueued == 0 )
+		{
+											// the sound is over
+			pStream->nSound = -1;
+		}
+		else if( nState != AL_PLAYING )
+		{
+											// recovers from an underrun
+			alSourcePlay(pStream->nSourceId);
+		}
+	}
+}
+
+/*!****************************************************************************
+* @brief	Reads a little-endian 16 bits value
+* @param	pData Pointer to the first byte
+* @return	The value read
+******************************************************************************/
+static unsigned ReadLE16(const unsigned char* pData)
+{
+	return unsigned(pData[0]) | (unsigned(pData[1]) << 8);
+}
+
+/*!****************************************************************************
+* @brief	Reads a little-endian 32 bits value
+* @param	pData Pointer to the first byte
+* @return	The value read
+******************************************************************************/
+static unsigned ReadLE32(const unsigned char* pData)
+{
+	return ReadLE16(pData) | (ReadLE16(pData + 2) << 16);
+}
+
+/*!****************************************************************************
+* @brief	Parses an in-memory image of a WAV PCM file
+* @param	pData Pointer to the file image (e.g. a file mapping)
+* @param	nSize Size of the file image
+* @param[out] pInfo The audio format and a pointer to the samples,
+*			inside of the file image: no data is copied
+* @return	Returns true for a valid 8/16 bits PCM or 32 bits float,
+*			mono/stereo file
+* @note		Walks all the RIFF chunks, so that "LIST", "fact" and any
+*			other chunk are skipped whatever their position. Chunks with
+*			odd size are padded to an even boundary. Chunks claiming
+*			more bytes than available make the file invalid.
+******************************************************************************/
+bool ParseWAV(const unsigned char* pData, unsigned nSize, TWavInfo* pInfo)
+{
+	assert(pInfo);
+
+	memset(pInfo, 0, sizeof(TWavInfo));
+
+	if( !pData || nSize < 12 ) return false;
+
+	if( memcmp(pData, "RIFF", 4) || memcmp(pData + 8, "WAVE", 4) ) return false;
+
+											// some writers do not update the
+											// RIFF size: trust the file size
+	unsigned nEnd = ReadLE32(pData + 4);
+	if( nEnd > nSize - 8 ) nEnd = nSize - 8;
+	nEnd += 8;
+
+	bool bFormat = false, bData = false, bFloat = false;
+	unsigned nBlockAlign = 0;
+	unsigned nPos = 12;
+
+	while( nEnd - nPos >= 8 )
+	{
+		const unsigned char* pChunk = pData + nPos;
+		unsigned nChunkSize = ReadLE32(pChunk + 4);
+
+		nPos += 8;
+
+		if( nChunkSize > nEnd - nPos ) return false;
+
+		if( !memcmp(pChunk, "fmt ", 4) )
+		{
+			if( nChunkSize < 16 ) return false;
+
+			unsigned nFormatTag = ReadLE16(pChunk + 8);
+
+			if( nFormatTag == WAVE_FORMAT_EXTENSIBLE )
+			{
+											// cbSize, valid bits, channel
+											// mask, then the sub-format GUID
+				if( nChunkSize < 40 ) return false;
+
+				nFormatTag = ReadLE16(pChunk + 8 + 24);
+			}
+
+			if( nFormatTag != WAVE_FORMAT_PCM && nFormatTag != WAVE_FORMAT_IEEE_FLOAT ) return false;
+
+			pInfo->nChannels = ReadLE16(pChunk + 10);
+			pInfo->nSampleRate = ReadLE32(pChunk + 12);
+			nBlockAlign = ReadLE16(pChunk + 20);
+			pInfo->nBps = ReadLE16(pChunk + 22);
+
+			bFloat = nFormatTag == WAVE_FORMAT_IEEE_FLOAT;
+
+			bFormat = true;
+		}
+		else if( !memcmp(pChunk, "data", 4) )
+		{
+			pInfo->pSamples = pChunk + 8;
+			pInfo->nSize = nChunkSize;
+
+			bData = true;
+		}
+											// chunks are word aligned
+		nPos += nChunkSize;
+		if( (nChunkSize & 1) && nPos < nEnd ) nPos++;
+	}
+
+	if( !bFormat || !bData ) return false;
+
+	if( pInfo->nChannels < 1 || pInfo->nChannels > 2 ) return false;
+	if( bFloat ? pInfo->nBps != 32 : pInfo->nBps != 8 && pInfo->nBps != 16 ) return false;
+	if( pInfo->nSampleRate <= 0 ) return false;
+	if( nBlockAlign != unsigned(pInfo->nChannels * pInfo->nBps / 8) ) return false;
+
+											// drops a trailing partial frame
+	pInfo->nSize -= pInfo->nSize % nBlockAlign;
+
+	return pInfo->nSize > 0;
+}
@@ -1,12 +1,34 @@
 #ifndef _SOUNDMANAGER_H_
 #define _SOUNDMANAGER_H_
 
+#include "platform.h"
+
 #include <al/al.h>
 #include <al/alc.h>
 
+#include <mutex>
+#include <atomic>
 #include <string>
+#include <thread>
 #include <vector>
-#include <map>
+
+#include "utils.h"
+#include "mixer.h"
+#include "archive.h"
+
+
+#define MAXVOICES		MIXVOICES	///< size of the shared pool of AL sources
+
+#define MAXSTREAMS			2
+#define STREAMBUFFERS		4
+#define STREAMBUFFERSIZE	(32 * 1024)
+#define STREAMTHRESHOLD		(1024 * 1024)	///< longer sounds are streamed
+#define STREAMPERIOD		20				///< ms between stream refills
+
+#define AUDIOQUEUESIZE		256				///< power of 2
+
+#define QUEUEGAINSTEP		0.25			///< gain added by each coalesced event
+#define QUEUEMAXGAIN		2.0
 
 
 struct TALSystem
@@ -15,22 +37,99 @@ struct TALSystem
 	ALCdevice *pAlcDevice;
 };
 
+struct TWavInfo
+{
+	int nChannels, nSampleRate, nBps;	///< 8 or 16 bits PCM, 32 bits float
+	const unsigned char* pSamples;	///< points inside the parsed image
+	unsigned nSize;					///< size of the samples, in bytes
+};
+
 struct TSoundTrack
 {
 	std::string strName;
-	ALuint nBufferId, nSourceId;
+	std::string strFileName;		///< WAV file, if not in memory
+	const unsigned char* pImage;	///< WAV image in memory (e.g. in the archive)
+	unsigned nImageSize;
+	bool bDecoded;					///< decoded on first play
+	ALuint nBufferId;
+	bool bStream;					///< long sounds are streamed, not decoded
+	TMappedFile File;				///< keeps the samples of streamed files
+	TWavInfo Wav;					///< samples of streamed sounds
+	int nPriority;					///< higher values steal lower ones
+	int nMaxVoices;					///< max simultaneous instances
+
+	unsigned nQueued;				///< events queued in the current tick
+	bool bQueuedLoop;
+	int nMinTicks;					///< min ticks between two plays
+	bool bScaleGain;				///< coalesced events play louder
+	unsigned nLastTick;				///< tick of the last play
 };
 
 typedef std::vector<TSoundTrack> TSoundTracks;
-typedef std::map< std::string, TSoundTrack > TMapSoundTracks;
+
+struct TVoice
+{
+	ALuint nSourceId;
+	int nSound;						///< sound handle, -1 if the voice is free
+	int nPriority;
+	bool bLoop;
+	unsigned nStamp;				///< play order, the oldest voice is stolen first
+};
+
+struct TStream
+{
+	ALuint nSourceId;
+	ALuint nBufferIds[STREAMBUFFERS];
+	int nSound;						///< sound handle, -1 if the stream is idle
+	bool bLoop;
+	unsigned nCursor;				///< offset of the next samples to be queued
+	unsigned nStamp;				///< start order, the oldest stream is taken first
+	unsigned char Staging[STREAMBUFFERSIZE];
+};
+
+enum enAudioCommand { acPlay, acStop, acStopAll, acVolume };
+
+struct TAudioCommand
+{
+	int nCommand;					///< see enAudioCommand
+	int nSound;
+	bool bLoop;
+	float Value;					///< gain or volume
+};
+
+struct TAudioQueue					///< single producer, single consumer
+{
+	TAudioCommand Commands[AUDIOQUEUESIZE];
+	std::atomic<unsigned> nHead;	///< next command to be read (audio thread)
+	std::atomic<unsigned> nTail;	///< next command to be written (game thread)
+	unsigned nDropped;				///< commands lost with the queue full
+};
 
 struct TSoundManager
 {
 	TALSystem *pALSystem;
-	TMapSoundTracks SoundTracks;
+	TMixer *pMixer;					///< software backend, used instead of OpenAL
+	TSoundTracks SoundTracks;		///< indexed by sound handle
+
+	TVoice Voices[MAXVOICES];
+	int nVoices;
+	unsigned nStamp;
+	unsigned nTick;					///< counts the flushes of the queued sounds
+
+	TStream Streams[MAXSTREAMS];
+	int nStreams;
+
+	TAudioQueue Queue;				///< commands from the game thread
+	std::thread AudioThread;		///< owns the voices, the streams, the backend
+	std::atomic<bool> bAudioQuit;
+	HANDLE hWake;					///< event set by the pushes, the audio thread waits on it
+	double Volume;					///< master volume, as seen by the game thread
+	double MaxGain;					///< max gain of a voice, QUEUEMAXGAIN or 1.0
+	bool bMuted;					///< the sounds are dropped, for the headless runs
 };
 
 bool SetupSoundManager(TALSystem *pALSystem);
+bool SetupSoftwareMixer(TSoundManager* pSM, int nDevice, std::string strFileName, bool bRealtime);
 void CleanupSoundManager(TSoundManager* pSM);
 
 double GetMasterVolume(TSoundManager* pSM);
@@ -39,14 +138,33 @@ void SetMasterVolume(TSoundManager* pSM, double Volume);
 void IncreaseMasterVolume(TSoundManager* pSM);
 void DecreaseMasterVolume(TSoundManager* pSM);
 
-bool LoadTheSounds(TSoundManager* pSM, std::vector<std::string> strSounds);
+bool LoadTheSounds(TSoundManager* pSM, const std::vector<std::string>& strSounds, TArchive* pArchive = nullptr);
 void FreeTheSounds(TSoundManager* pSM);
-bool LoadTheSound(TSoundManager* pSM, std::string strFileName);
-void PlayTheSound(TSoundManager* pSM, std::string strSound, bool bLoop = false);
-void StopTheSound(TSoundManager* pSM, std::string strSound);
+int RegisterTheSound(TSoundManager* pSM, std::string strName, std::string strFileName);
+int RegisterTheSound(TSoundManager* pSM, std::string strName, const unsigned char* pData, unsigned nSize);
+bool DecodeTheSound(TSoundManager* pSM, int nSound);
+void SetSoundPriority(TSoundManager* pSM, int nSound, int nPriority, int nMaxVoices);
+void SetSoundRateLimit(TSoundManager* pSM, int nSound, int nMinTicks, bool bScaleGain);
+void PlayTheSound(TSoundManager* pSM, int nSound, bool bLoop = false, double Gain = 1.0);
+void QueueTheSound(TSoundManager* pSM, int nSound, bool bLoop = false);
+void FlushTheSounds(TSoundManager* pSM);
+void StopTheSound(TSoundManager* pSM, int nSound);
 void StopAllSounds(TSoundManager* pSM);
 
-char* LoadWAV(std::string strFileName, int& nChannels, int& nSampleRate, int& nBps, int& nSize);
+bool BuildTheVoices(TSoundManager* pSM);
+void FreeTheVoices(TSoundManager* pSM);
+
+void StartTheAudio(TSoundManager* pSM);
+void StopTheAudio(TSoundManager* pSM);
+bool PushTheCommand(TSoundManager* pSM, const TAudioCommand& Command);
+
+bool BuildTheStreams(TSoundManager* pSM);
+void FreeTheStreams(TSoundManager* pSM);
+void StartTheStream(TSoundManager* pSM, int nSound, bool bLoop);
+void StopTheStream(TSoundManager* pSM, int nSound);
+void ServiceTheStreams(TSoundManager* pSM);
+
+bool ParseWAV(const unsigned char* pData, unsigned nSize, TWavInfo* pInfo);
 
 #endif
 
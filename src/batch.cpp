@@ -0,0 +1,422 @@
+/*!****************************************************************************
+
+	@file	batch.h
+	@file	batch.cpp
+
+	@brief	Batches of headless games stepped in lockstep, for the bots:
+			a call takes the actions of all the games and fills the
+			observations, the rewards and the ends of the episodes
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include "platform.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "game.h"
+#include "tasks.h"
+#include "utils.h"
+#include "maths.h"
+#include "commdefs.h"
+#include "batch.h"
+#include "allocs.h"
+#include "counters.h"
+
+
+#define BATCHREPORT			5.0				///< seconds between the reports of RunTheBatch()
+
+
+
+/*!****************************************************************************
+* @brief	Wraps a distance along an axis of the game area
+* @param	D The distance
+* @param	Size The size of the game area along the axis
+* @return	The shortest distance, in [-Size/2, Size/2]
+******************************************************************************/
+static inline double WrapTheDistance(double D, double Size)
+{
+	if( D > 0.5 * Size ) return D - Size;
+	if( D < -0.5 * Size ) return D + Size;
+
+	return D;
+}
+
+/*!****************************************************************************
+* @brief	Finds the nearest rows of an archetype to a point
+* @param	Archetype The archetype
+* @param	Pos The point
+* @param	Width, Height The size of the game area
+* @param	pItems The nearest rows found, nearest first, nMax at most
+* @param	nMax The rows to find
+* @return	The rows found
+* @note		An insertion into a sorted array of nMax: nMax is small
+******************************************************************************/
+static int FindTheNearest(const TArchetype& Archetype, TVector2 Pos,
+	double Width, double Height, TBatchItem* pItems, int nMax)
+{
+	int nFound = 0;
+
+	for(unsigned nRow=0; nRow<Archetype.nCount; ++nRow)
+	{
+		double DX = WrapTheDistance(Archetype.Pos[nRow].X - Pos.X, Width);
+		double DY = WrapTheDistance(Archetype.Pos[nRow].Y - Pos.Y, Height);
+		float Dist2 = float(DX*DX + DY*DY);
+
+		if( nFound == nMax && Dist2 >= pItems[nMax-1].Dist2 ) continue;
+
+		int k = nFound < nMax ? nFound++ : nMax - 1;
+
+		for(; k>0 && pItems[k-1].Dist2 > Dist2; --k) pItems[k] = pItems[k-1];
+
+		pItems[k] = TBatchItem{ Dist2, int(nRow) };
+	}
+
+	return nFound;
+}
+
+/*!****************************************************************************
+* @brief	Writes the observation of a game
+* @param	pGame Pointer to the game engine
+* @param	pObservation The observation, BATCHOBSERVATION floats
+* @note		The distances wrap around the game area, as the asteroids do
+******************************************************************************/
+static void ObserveTheGame(TGame* pGame, float* pObservation)
+{
+	assert(pGame);
+	assert(pObservation);
+
+	memset(pObservation, 0, BATCHOBSERVATION * sizeof(float));
+
+	unsigned nWidth, nHeight;
+	GetClientSize(pGame, nWidth, nHeight);
+
+	TShip* pShip = GetThePlayer(pGame, 0);
+	TVector2 Pos = GetPos(pShip);
+	TVector2 Vel = GetVel(pShip);
+	double Rot = GetRot(pShip);
+											// the bow, as the missiles
+											// are shot, see ShotTheMissile()
+	pObservation[bsAlive] = IsAlive(pShip) ? 1.0f : 0.0f;
+	pObservation[bsShield] = IsShieldActive(pShip) ? 1.0f : 0.0f;
+	pObservation[bsX] = float(Pos.X / nWidth);
+	pObservation[bsY] = float(Pos.Y / nHeight);
+	pObservation[bsVX] = float(Vel.X * DT);
+	pObservation[bsVY] = float(Vel.Y * DT);
+	pObservation[bsDirX] = float(cos(DEG2RAD(Rot - 90)));
+	pObservation[bsDirY] = float(sin(DEG2RAD(Rot + 90)));
+
+	TBatchItem Items[std::max(BATCHASTEROIDS, BATCHMISSILES)];
+
+	const int nKinds[2] = { arAsteroid, arMissile };
+	const int nMaxes[2] = { BATCHASTEROIDS, BATCHMISSILES };
+
+	float* pItem = pObservation + BATCHSHIPFIELDS;
+
+	for(int nKind=0; nKind<2; ++nKind)
+	{
+		const TArchetype& Archetype = pGame->World.Archetypes[nKinds[nKind]];
+
+		int nFound = FindTheNearest(Archetype, Pos, nWidth, nHeight, Items, nMaxes[nKind]);
+
+		for(int i=0; i<nFound; ++i, pItem += BATCHITEMFIELDS)
+		{
+			int nRow = Items[i].nRow;
+
+			pItem[biPresent] = 1.0f;
+			pItem[biDX] = float(WrapTheDistance(Archetype.Pos[nRow].X - Pos.X, nWidth) / nWidth);
+			pItem[biDY] = float(WrapTheDistance(Archetype.Pos[nRow].Y - Pos.Y, nHeight) / nHeight);
+			pItem[biVX] = float(Archetype.Vel[nRow].X * DT);
+			pItem[biVY] = float(Archetype.Vel[nRow].Y * DT);
+
+			if( nKinds[nKind] == arAsteroid ) pItem[biExtra] = float(Archetype.Radius[nRow]);
+			else pItem[biExtra] = GetClass(Archetype.Owner[nRow]) != scHuman ? 1.0f : 0.0f;
+		}
+
+		pItem += (nMaxes[nKind] - nFound) * BATCHITEMFIELDS;
+	}
+
+	assert(pItem == pObservation + BATCHOBSERVATION);
+}
+
+/*!****************************************************************************
+* @brief	Starts a new episode of a game of the batch
+* @param	pBatch Pointer to the batch
+* @param	nGame The game
+* @note		Every episode has its own seed, made from the seed of the batch,
+*			the game and the episode: a batch replays the same way
+******************************************************************************/
+static void StartTheEpisode(TBatch* pBatch, unsigned nGame)
+{
+	assert(pBatch);
+	assert(nGame < pBatch->nGames);
+
+	TGame* pGame = pBatch->pGames[nGame];
+
+	uint64_t nSeed = MixTheSeed(pBatch->nSeed ^ (uint64_t(nGame) << 32 | pBatch->nEpisodes[nGame]));
+
+	StartTheMatch(pGame, nSeed);
+
+	pBatch->nScores[nGame] = pGame->nScore;
+	pBatch->nLives[nGame] = pGame->nLives;
+	pBatch->nTicks[nGame] = 0;
+	pBatch->nEpisodes[nGame]++;
+}
+
+/*!****************************************************************************
+* @brief	Runs a tick of a game of the batch
+* @param	pBatch Pointer to the batch
+* @param	nGame The game
+* @param	nAction The commands of the ship, see enInput
+* @note		An episode over starts again at once: the observation is the
+*			first one of the new episode, the reward the last one of the
+*			old episode
+******************************************************************************/
+static void StepTheGame(TBatch* pBatch, unsigned nGame, unsigned char nAction)
+{
+	assert(pBatch);
+	assert(nGame < pBatch->nGames);
+
+	TGame* pGame = pBatch->pGames[nGame];
+											// a step is a frame, headless
+	ResetTheArena(&pGame->Arena);
+											// the actions go through the input
+											// queue, as the keys do; the clock
+											// of the bots is the game time
+	double Time = pGame->nTick * DT;
+
+	PushTheCommands(&pGame->Input, nAction & BATCHACTIONS, Time);
+	pGame->nInputs[0] = SampleTheInput(&pGame->Input, Time);
+
+	Run(pGame);
+	ConsumeTheInput(&pGame->Input);
+
+	pBatch->nTicks[nGame]++;
+											// the points scored, less the
+											// lives lost (not the ones won)
+	float Reward = float(pGame->nScore - pBatch->nScores[nGame]);
+
+	if( pGame->nLives < pBatch->nLives[nGame] )
+	{
+		Reward -= BATCHLIFECOST * (pBatch->nLives[nGame] - pGame->nLives);
+	}
+
+	pBatch->nScores[nGame] = pGame->nScore;
+	pBatch->nLives[nGame] = pGame->nLives;
+
+	unsigned char nDone = 0;
+
+	if( IsGameOver(pGame) ) nDone |= bdOver;
+	if( pBatch->nTicks[nGame] >= BATCHMAXTICKS ) nDone |= bdTruncated;
+
+	pBatch->Rewards[nGame] = Reward;
+	pBatch->Dones[nGame] = nDone;
+
+	if( nDone ) StartTheEpisode(pBatch, nGame);
+
+	ObserveTheGame(pGame, &pBatch->Observations[size_t(nGame) * BATCHOBSERVATION]);
+}
+
+/*!****************************************************************************
+* @brief	Sets-up a batch of games
+* @param	pBatch Pointer to the batch
+* @param	nGames The games of the batch
+* @param	nThreads The threads stepping the games, 0 for one per core
+* @param	nSeed The seed of the batch
+* @return	Returns true on success, false otherwise
+* @note		The arrays are sized here, once: the steps allocate nothing.
+*			The batch is ready: ResetTheBatch() has been called.
+******************************************************************************/
+bool SetupTheBatch(TBatch* pBatch, unsigned nGames, unsigned nThreads, uint64_t nSeed)
+{
+	assert(pBatch);
+	assert(nGames > 0);
+
+	pBatch->nGames = 0;
+	pBatch->nSeed = nSeed;
+	pBatch->nSteps = 0;
+	pBatch->StepTime = 0;
+
+	SetupJobSystem(&pBatch->Jobs, nThreads);
+
+	for(unsigned i=0; i<nGames; ++i)
+	{
+		TVecStrings strErrors;
+		TGame* pGame = CreateTheHeadlessGame(strErrors);
+
+		for(const std::string& strError : strErrors)
+		{
+			LogTheText(("batch: " + strError + "\n").c_str());
+		}
+
+		if( !pGame ) return false;
+
+		pBatch->pGames.push_back(pGame);
+		pBatch->nGames++;
+	}
+
+	pBatch->Observations.assign(size_t(nGames) * BATCHOBSERVATION, 0.0f);
+	pBatch->Rewards.assign(nGames, 0.0f);
+	pBatch->Dones.assign(nGames, 0);
+
+	pBatch->nScores.assign(nGames, 0);
+	pBatch->nLives.assign(nGames, 0);
+	pBatch->nTicks.assign(nGames, 0);
+	pBatch->nEpisodes.assign(nGames, 0);
+
+	ResetTheBatch(pBatch);
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Cleans-up a batch, with its games
+* @param	pBatch Pointer to the batch
+******************************************************************************/
+void CleanupTheBatch(TBatch* pBatch)
+{
+	assert(pBatch);
+
+	CleanupJobSystem(&pBatch->Jobs);
+
+	for(TGame* pGame : pBatch->pGames) DeleteTheHeadlessGame(pGame);
+
+	pBatch->pGames.clear();
+	pBatch->nGames = 0;
+}
+
+/*!****************************************************************************
+* @brief	Starts a new episode of all the games, and observes them
+* @param	pBatch Pointer to the batch
+******************************************************************************/
+void ResetTheBatch(TBatch* pBatch)
+{
+	assert(pBatch);
+
+	for(unsigned i=0; i<pBatch->nGames; ++i)
+	{
+		StartTheEpisode(pBatch, i);
+		ObserveTheGame(pBatch->pGames[i], &pBatch->Observations[size_t(i) * BATCHOBSERVATION]);
+	}
+
+	std::fill(pBatch->Rewards.begin(), pBatch->Rewards.end(), 0.0f);
+	std::fill(pBatch->Dones.begin(), pBatch->Dones.end(), 0);
+}
+
+/*!****************************************************************************
+* @brief	Runs a tick of all the games of the batch, in lockstep
+* @param	pBatch Pointer to the batch
+* @param	pActions The commands of the ships, a byte per game, see enInput
+* @note		The games are independent: they run in parallel, each one
+*			serially, and each one writes its own rows of the arrays.
+*			The results don't depend on the threads.
+******************************************************************************/
+void StepTheBatch(TBatch* pBatch, const unsigned char* pActions)
+{
+	assert(pBatch);
+	assert(pActions);
+
+	double Time = GetTheTime();
+
+	ParallelFor(&pBatch->Jobs, pBatch->nGames, BATCHGRAIN,
+		[pBatch, pActions](unsigned nFirst, unsigned nLast)
+		{
+			for(unsigned i=nFirst; i<nLast; ++i) StepTheGame(pBatch, i, pActions[i]);
+		});
+
+	pBatch->nSteps += pBatch->nGames;
+	pBatch->StepTime = GetTheTime() - Time;
+
+	PublishTheCounters();
+}
+
+/*!****************************************************************************
+* @brief	Steps a batch of games with random actions, and reports the
+*			steps per second, e.g. to size a training machine
+* @param	pConfig The batch: "games:steps[:threads]"
+* @return	Returns true on success, false otherwise
+* @note		Built with -D_TRACKALLOCS, each report counts the allocations
+*			of its steps too: none, after the first one
+******************************************************************************/
+bool RunTheBatch(const char* pConfig)
+{
+	assert(pConfig);
+
+	unsigned nGames = 0, nSteps = 0, nThreads = 0;
+
+	if( sscanf(pConfig, "%u:%u:%u", &nGames, &nSteps, &nThreads) < 2
+		|| nGames == 0 || nSteps == 0 ) return false;
+
+	TBatch* pBatch = new TBatch();
+	assert(pBatch);
+
+	bool bResult = SetupTheBatch(pBatch, nGames, nThreads);
+
+	if( bResult )
+	{
+		std::vector<unsigned char> Actions(nGames);
+
+		TRandom Random;
+		SeedTheRandom(&Random, RANDSEED);
+
+		double Start = GetTheTime(), Report = Start;
+		uint64_t nReported = 0, nOver = 0;
+		uint64_t nAllocations = GetTheAllocations().nCount;
+		double Rewards = 0;
+
+		for(unsigned nStep=0; nStep<nSteps; ++nStep)
+		{
+			for(unsigned char& nAction : Actions)
+			{
+				nAction = (unsigned char)(RandUnit(&Random) * 256.0) & BATCHACTIONS;
+			}
+
+			StepTheBatch(pBatch, Actions.data());
+
+			for(unsigned i=0; i<nGames; ++i)
+			{
+				Rewards += pBatch->Rewards[i];
+				if( pBatch->Dones[i] ) nOver++;
+			}
+
+			double Time = GetTheTime();
+
+			if( Time - Report >= BATCHREPORT || nStep + 1 == nSteps )
+			{
+				char Buffer[256];
+				sprintf(Buffer, "batch: %u games, %u threads, %llu steps: %.0f steps/s, "
+					"%.2f us of a core per step of a game, %llu episodes over, %.1f reward per episode\n",
+					nGames, GetTheThreads(&pBatch->Jobs), (unsigned long long)pBatch->nSteps,
+					double(pBatch->nSteps - nReported) / (Time - Report),
+					1e6 * (Time - Report) / double(pBatch->nSteps - nReported) * GetTheThreads(&pBatch->Jobs),
+					(unsigned long long)nOver, nOver ? Rewards / nOver : 0.0);
+				LogTheText(Buffer);
+
+				if( IsTrackingTheAllocations() )
+				{
+					uint64_t nCount = GetTheAllocations().nCount;
+
+					sprintf(Buffer, "batch: %llu allocations in the steps\n", (unsigned long long)(nCount - nAllocations));
+					LogTheText(Buffer);
+
+					nAllocations = nCount;
+				}
+
+				Report = Time;
+				nReported = pBatch->nSteps;
+			}
+		}
+	}
+
+	CleanupTheBatch(pBatch);
+	delete pBatch;
+
+	return bResult;
+}
@@ -0,0 +1,78 @@
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "game.h"
+#include "tasks.h"
+#include "commdefs.h"
+
+
+#define BATCHASTEROIDS		8				///< nearest asteroids observed
+#define BATCHMISSILES		4				///< nearest missiles observed
+#define BATCHSHIPFIELDS		8				///< see enBatchShipField
+#define BATCHITEMFIELDS		6				///< of an asteroid or a missile, see enBatchItemField
+#define BATCHOBSERVATION	(BATCHSHIPFIELDS + (BATCHASTEROIDS + BATCHMISSILES) * BATCHITEMFIELDS)
+#define BATCHMAXTICKS		(FPS * 60 * 5)	///< ticks of an episode, then it is truncated
+#define BATCHLIFECOST		100.0f			///< reward lost with a life, in points
+#define BATCHGRAIN			4				///< games stepped by a job, at least
+
+											// the actions of a game are
+											// enInput bits, inRestart ignored
+#define BATCHACTIONS		(inLeft | inRight | inThrust | inFire | inShield)
+
+
+enum enBatchShipField {						///< floats of the observation of the ship
+	bsAlive, bsShield,
+	bsX, bsY,								///< in the game area, [0, 1]
+	bsVX, bsVY,								///< px per tick
+	bsDirX, bsDirY							///< of the bow, unit vector
+};
+
+enum enBatchItemField {						///< floats of an asteroid or a missile
+	biPresent,								///< 0 if there are fewer items, the other fields 0
+	biDX, biDY,								///< from the ship, wrapped, in game areas
+	biVX, biVY,								///< px per tick
+	biExtra									///< asteroids: radius in px, missiles: 1 if alien
+};
+
+enum enBatchDone { bdOver = 1, bdTruncated = 2 };
+
+struct TBatchItem							///< scratch, a candidate of the nearest ones
+{
+	float Dist2;
+	int nRow;
+};
+
+struct TBatch
+{
+	unsigned nGames;
+	std::vector<TGame*> pGames;
+	TJobSystem Jobs;
+	uint64_t nSeed;							///< of the first episode of the first game
+
+											// a row per game, written by
+											// StepTheBatch()
+	std::vector<float> Observations;		///< nGames x BATCHOBSERVATION
+	std::vector<float> Rewards;
+	std::vector<unsigned char> Dones;		///< see enBatchDone
+
+	std::vector<int> nScores, nLives;		///< of the last step, for the rewards
+	std::vector<unsigned> nTicks;			///< of the episodes
+	std::vector<unsigned> nEpisodes;
+
+	uint64_t nSteps;						///< games times steps, since the setup
+	double StepTime;						///< seconds, of the last step
+};
+
+bool SetupTheBatch(TBatch* pBatch, unsigned nGames, unsigned nThreads=0, uint64_t nSeed=RANDSEED);
+void CleanupTheBatch(TBatch* pBatch);
+void ResetTheBatch(TBatch* pBatch);
+void StepTheBatch(TBatch* pBatch, const unsigned char* pActions);
+
+bool RunTheBatch(const char* pConfig);
+
+#endif
@@ -1,20 +1,42 @@
 #ifndef _COMMDEFS_H_
 #define _COMMDEFS_H_
 
-#include <windows.h>
+#include "platform.h"
 
 
 #define APPNAME			" Asteroids-2k rel 1.0.0 - (C) 2021 Francesco Settembrini - francesco.settembrini@poliba.it"
 
-#define DATAFOLDER		"\\data\\"
+#ifdef __linux__
+	#define PATHSEP		"/"
+#else
+	#define PATHSEP		"\\"
+#endif
+
+#define DATAFOLDER		PATHSEP "data" PATHSEP
 #define SCORESFILE		"hiscores.txt"
 #define HELPFILE		"help.txt"
+#define AUDIOFILE		"audio.wav"
+#define AUDIOVAR		"A2K_AUDIO"
+#define NETVAR			"A2K_NET"
+#define SERVERVAR		"A2K_SERVER"
+#define BATCHVAR		"A2K_BATCH"
+#define SPECTATEVAR		"A2K_SPECTATE"
+#define REPLAYVAR		"A2K_REPLAY"
+#define PROFILEVAR		"A2K_PROFILE"
+#define COUNTERSVAR		"A2K_COUNTERS"
+#define ALLOCCHECKVAR	"A2K_ALLOCCHECK"
+#define MIXCHECKVAR		"A2K_MIXCHECK"
+#define SNAPCHECKVAR	"A2K_SNAPCHECK"
+#define STRESSVAR		"A2K_STRESS"
+#define SNAPSHOTFILE	"snapshot.a2k"
+#define PROFILEFILE		"profile.json"
 
 #define FRAMEW			800
 #define FRAMEH			600
 
 #define FPS				60
 #define BESTSCORES		5
+#define KEPTSCORES		100		///< best scores kept in the scores file, BESTSCORES of them shown
 #define FONTSIZE		24
 
 #endif
@@ -0,0 +1,265 @@
+/*!****************************************************************************
+
+	@file	counters.h
+	@file	counters.cpp
+
+	@brief	Counters of the hot paths, published at every tick in a shared
+			memory block that tools/a2kstat reads live (/dev/shm on Linux,
+			a named file mapping on Windows)
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include "platform.h"
+
+#ifdef __linux__
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+#include <string>
+
+#include "tasks.h"
+#include "counters.h"
+
+
+static TCounterSlot g_Slots[COUNTERSLOTS + 1];		///< the last one is shared, by the threads without a slot
+static uint64_t g_nPublished[COUNTERSLOTS + 1][ctCount];	///< values of the slots at the last publication
+static std::atomic<int> g_nSlots(0);				///< slots taken so far, the high water mark
+static std::atomic<bool> g_bCounting(false);		///< a block is open
+static TCountersBlock* g_pCounters = nullptr;		///< the shared block, nullptr if none
+static double g_CountersStart = 0;
+
+static const char* g_pCounterNames[ctCount] = {
+	"ticks",
+	"pair tests", "hits",
+	"asteroids", "missiles",
+	"draw calls", "segments", "pens",
+	"sounds",
+	"allocations", "alloc bytes"
+};
+
+#ifndef __linux__
+	static HANDLE g_hCounters = NULL;
+#endif
+
+
+
+struct TCounterOwner						///< the slot of a thread, freed when it exits
+{
+	int nSlot = -1;
+
+	~TCounterOwner()
+	{
+		if( nSlot >= 0 && nSlot < COUNTERSLOTS )
+			g_Slots[nSlot].bUsed.store(false, std::memory_order_release);
+	}
+};
+
+static thread_local TCounterOwner t_Owner;
+
+
+
+/*!****************************************************************************
+* @brief	Takes a free slot for the calling thread
+* @return	The slot, COUNTERSLOTS (the shared one) if all of them are taken
+* @note		The values of a freed slot are kept, so the next owner goes on
+*			counting from them and PublishTheCounters() loses nothing
+******************************************************************************/
+static int TakeTheSlot()
+{
+	for(int i=0; i<COUNTERSLOTS; ++i)
+	{
+		if( g_Slots[i].bUsed.load(std::memory_order_relaxed) ) continue;
+		if( g_Slots[i].bUsed.exchange(true, std::memory_order_acquire) ) continue;
+
+		int nSlots = g_nSlots.load(std::memory_order_relaxed);
+		while( nSlots < i + 1 && !g_nSlots.compare_exchange_weak(nSlots, i + 1, std::memory_order_release) );
+
+		return i;
+	}
+
+	return COUNTERSLOTS;
+}
+
+/*!****************************************************************************
+* @brief	Counts events of a hot path
+* @param	nCounter The counter, see enCounter
+* @param	nEvents The events
+* @note		Lock-free, from any thread, and nothing without a block open.
+*			Each thread adds to a slot of its own, a cache line apart from
+*			the others, with no locked instruction; PublishTheCounters()
+*			sums the slots. The callers count locally and add once per
+*			call, not once per event.
+******************************************************************************/
+void CountThe(int nCounter, uint64_t nEvents)
+{
+	assert(nCounter >= 0 && nCounter < ctCount);
+
+	if( !g_bCounting.load(std::memory_order_relaxed) ) return;
+
+	if( t_Owner.nSlot < 0 ) t_Owner.nSlot = TakeTheSlot();
+
+	std::atomic<uint64_t>& nValue = g_Slots[t_Owner.nSlot].Values[nCounter];
+
+	if( t_Owner.nSlot == COUNTERSLOTS )
+		nValue.fetch_add(nEvents, std::memory_order_relaxed);
+	else
+		nValue.store(nValue.load(std::memory_order_relaxed) + nEvents, std::memory_order_relaxed);
+}
+
+/*!****************************************************************************
+* @brief	Creates the shared memory block of the counters
+* @param	pName The name of the block, e.g. COUNTERSNAME
+* @return	Returns true for success, false otherwise
+* @note		On Linux the block is /dev/shm/<name>, on Windows the file
+*			mapping Local\<name>
+******************************************************************************/
+bool OpenTheCounters(const char* pName)
+{
+	assert(pName);
+	assert(!g_pCounters);
+
+	void* pView = nullptr;
+
+#ifdef __linux__
+	std::string strName = std::string("/") + pName;
+
+	int fd = shm_open(strName.c_str(), O_CREAT | O_RDWR, 0644);
+	if( fd < 0 ) return false;
+
+	if( ftruncate(fd, sizeof(TCountersBlock)) == 0 )
+	{
+		pView = mmap(nullptr, sizeof(TCountersBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if( pView == MAP_FAILED ) pView = nullptr;
+	}
+
+	close(fd);
+
+	unsigned nProcess = unsigned(getpid());
+#else
+	std::string strName = std::string("Local\\") + pName;
+
+	g_hCounters = ::CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		0, sizeof(TCountersBlock), strName.c_str());
+
+	if( !g_hCounters ) return false;
+
+	pView = ::MapViewOfFile(g_hCounters, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(TCountersBlock));
+
+	if( !pView )
+	{
+		::CloseHandle(g_hCounters);
+		g_hCounters = NULL;
+	}
+
+	unsigned nProcess = unsigned(::GetCurrentProcessId());
+#endif
+
+	if( !pView ) return false;
+
+	TCountersBlock* pBlock = (TCountersBlock*) pView;
+											// a reader checks the magic
+											// number last
+	pBlock->nMagic = 0;
+	pBlock->nVersion = COUNTERSVERSION;
+	pBlock->nCount = ctCount;
+	pBlock->nProcess = nProcess;
+	pBlock->nSequence = 0;
+	pBlock->nReserved = 0;
+	pBlock->nPublished = 0;
+	pBlock->nTime = 0;
+
+	for(int i=0; i<ctCount; ++i)
+	{
+		strncpy(pBlock->Names[i], g_pCounterNames[i], COUNTERSNAMELEN - 1);
+		pBlock->Names[i][COUNTERSNAMELEN - 1] = 0;
+
+		pBlock->Values[i] = 0;
+		pBlock->Totals[i] = 0;
+	}
+
+	std::atomic_thread_fence(std::memory_order_release);
+	pBlock->nMagic = COUNTERSMAGIC;
+
+	g_pCounters = pBlock;
+	g_CountersStart = GetTheTime();
+	g_bCounting = true;
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Unmaps the shared memory block of the counters
+* @note		The block outlives the game on Linux, with its last values,
+*			until it is removed or the game runs again
+******************************************************************************/
+void CloseTheCounters()
+{
+	if( !g_pCounters ) return;
+
+	g_bCounting = false;
+
+#ifdef __linux__
+	munmap(g_pCounters, sizeof(TCountersBlock));
+#else
+	::UnmapViewOfFile(g_pCounters);
+	::CloseHandle(g_hCounters);
+	g_hCounters = NULL;
+#endif
+
+	g_pCounters = nullptr;
+}
+
+/*!****************************************************************************
+* @brief	Publishes the counters of the last tick, and starts counting
+*			the next one
+* @note		A sequence lock: the writer never waits, the readers copy the
+*			block again when the sequence is odd or has changed. The value
+*			of a counter is what its slots gained since the last call.
+******************************************************************************/
+void PublishTheCounters()
+{
+	TCountersBlock* pBlock = g_pCounters;
+
+	if( !pBlock ) return;
+
+	uint32_t nSequence = pBlock->nSequence.load(std::memory_order_relaxed);
+
+	pBlock->nSequence.store(nSequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	int nSlots = g_nSlots.load(std::memory_order_acquire);
+
+	for(int i=0; i<ctCount; ++i)
+	{
+		uint64_t nValue = 0;
+
+		for(int j=0; j<=COUNTERSLOTS; ++j)
+		{
+			if( j == nSlots ) j = COUNTERSLOTS;	// skip the slots never taken
+
+			uint64_t nSlot = g_Slots[j].Values[i].load(std::memory_order_relaxed);
+
+			nValue += nSlot - g_nPublished[j][i];
+			g_nPublished[j][i] = nSlot;
+		}
+
+		pBlock->Values[i].store(nValue, std::memory_order_relaxed);
+		pBlock->Totals[i].store(pBlock->Totals[i].load(std::memory_order_relaxed) + nValue,
+			std::memory_order_relaxed);
+	}
+
+	pBlock->nPublished.store(pBlock->nPublished.load(std::memory_order_relaxed) + 1,
+		std::memory_order_relaxed);
+	pBlock->nTime.store(uint64_t((GetTheTime() - g_CountersStart) * 1e6), std::memory_order_relaxed);
+
+	pBlock->nSequence.store(nSequence + 2, std::memory_order_release);
+}
@@ -0,0 +1,54 @@
+
+#ifndef _COUNTERS_H_
+#define _COUNTERS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+
+#define COUNTERSMAGIC		0x54434B32		///< "2KCT"
+#define COUNTERSVERSION		2
+#define COUNTERSNAME		"a2k-counters"	///< of the shared memory, by default
+#define COUNTERSNAMELEN		16
+#define COUNTERSLOTS		64				///< threads counting in a slot of their own
+#define CACHELINE			64
+
+
+enum enCounter {							///< events of the hot paths, counted per tick
+	ctTicks,								///< of all the games, see Run()
+	ctPairTests, ctHits,					///< of the collision detection
+	ctAsteroids, ctMissiles,				///< alive, summed over the games
+	ctDrawCalls, ctSegments, ctPens,		///< see DrawLines()
+	ctSounds,								///< queued, see QueueTheSound()
+	ctAllocations, ctAllocBytes,			///< of the heap, when built with -D_TRACKALLOCS
+	ctCount
+};
+
+struct alignas(CACHELINE) TCounterSlot	///< the counts of a thread, see CountThe()
+{
+	std::atomic<uint64_t> Values[ctCount];	///< since the start, written by the owner only
+	std::atomic<bool> bUsed;				///< owned by a running thread
+};
+
+struct TCountersBlock						///< the shared memory, read by tools/a2kstat
+{
+	uint32_t nMagic, nVersion;
+	uint32_t nCount;						///< counters, ctCount of the writer
+	uint32_t nProcess;						///< id of the writer
+	std::atomic<uint32_t> nSequence;		///< odd while the block is written
+	uint32_t nReserved;
+	std::atomic<uint64_t> nPublished;		///< publications since the start
+	std::atomic<uint64_t> nTime;			///< microseconds since the start, of the last one
+
+	char Names[ctCount][COUNTERSNAMELEN];
+	std::atomic<uint64_t> Values[ctCount];	///< since the last publication
+	std::atomic<uint64_t> Totals[ctCount];	///< since the start
+};
+
+void CountThe(int nCounter, uint64_t nEvents);
+bool OpenTheCounters(const char* pName);
+void CloseTheCounters();
+void PublishTheCounters();
+
+#endif
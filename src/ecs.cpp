@@ -0,0 +1,769 @@
+/*!****************************************************************************
+
+	@file	ecs.h
+	@file	ecs.cpp
+
+	@brief	Entities stored by archetype in dense component arrays,
+			and the systems that iterate over them
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include "platform.h"
+#include <assert.h>
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "ecs.h"
+#include "counters.h"
+
+
+/*!****************************************************************************
+* @brief	Reserves the rows of the components of an archetype
+* @param	A The archetype
+* @param	nRows The rows
+******************************************************************************/
+static void ReserveTheRows(TArchetype& A, unsigned nRows)
+{
+	if( A.nMask & cpPos ) A.Pos.reserve(nRows);
+	if( A.nMask & cpVel ) A.Vel.reserve(nRows);
+	if( A.nMask & cpSpin ) { A.Rot.reserve(nRows); A.DRot.reserve(nRows); }
+	if( A.nMask & cpShape ) { A.Shape.reserve(nRows); A.Vertices.reserve(nRows); }
+	if( A.nMask & cpRadius ) A.Radius.reserve(nRows);
+	if( A.nMask & cpColor ) A.Color.reserve(nRows);
+	if( A.nMask & cpClass ) A.Class.reserve(nRows);
+	if( A.nMask & cpOwner ) A.Owner.reserve(nRows);
+	if( A.nMask & cpLifetime ) A.Lifetime.reserve(nRows);
+}
+
+/*!****************************************************************************
+* @brief	Gives back the buffer of a shape, to be reused
+* @param	pWorld Pointer to the world
+* @param	Shape The shape, left empty
+******************************************************************************/
+static void FreeTheShape(TWorld* pWorld, TVecPoints& Shape)
+{
+	if( !Shape.capacity() ) return;
+
+	Shape.clear();
+	pWorld->FreeShapes.push_back(std::move(Shape));
+}
+
+/*!****************************************************************************
+* @brief	Setting-up the world: declares the components of each archetype
+* @param	pWorld Pointer to the world
+******************************************************************************/
+void SetupTheWorld(TWorld* pWorld)
+{
+	assert(pWorld);
+
+	pWorld->Archetypes[arAsteroid].nMask =
+		cpPos | cpVel | cpSpin | cpShape | cpRadius | cpColor | cpClass | cpWrap;
+
+	pWorld->Archetypes[arMissile].nMask =
+		cpPos | cpVel | cpColor | cpOwner | cpLifetime;
+
+	for(int i=0; i<arCount; ++i)
+	{
+		ClearTheArchetype(pWorld, i);
+		ReserveTheRows(pWorld->Archetypes[i], WORLDROWS);
+		pWorld->Kills[i].reserve(WORLDROWS);
+	}
+											// the ticks find the room ready
+	pWorld->Spawns.reserve(WORLDROWS);
+	pWorld->Dead.reserve(WORLDROWS);
+	pWorld->FreeShapes.reserve(2 * WORLDROWS);
+
+	pWorld->Grid.CellStart.reserve(4 * WORLDROWS);
+	pWorld->Grid.Cursor.reserve(4 * WORLDROWS);
+	pWorld->Grid.Items.reserve(4 * WORLDROWS);
+}
+
+/*!****************************************************************************
+* @brief	Adds an entity to its archetype, at once
+* @param	pWorld Pointer to the world
+* @param	Entity The components of the entity, moved: its shape is
+*			taken as it is
+* @return	The row of the entity in its archetype
+* @note		Must not be called while the systems iterate: use
+*			SpawnTheEntity() instead
+******************************************************************************/
+int AddTheEntity(TWorld* pWorld, TEntity Entity)
+{
+	assert(pWorld);
+	assert(Entity.nArchetype >= 0 && Entity.nArchetype < arCount);
+
+	TArchetype& A = pWorld->Archetypes[Entity.nArchetype];
+
+	if( A.nMask & cpPos ) A.Pos.push_back(Entity.Pos);
+	if( A.nMask & cpVel ) A.Vel.push_back(Entity.Vel);
+	if( A.nMask & cpSpin ) { A.Rot.push_back(Entity.Rot); A.DRot.push_back(Entity.DRot); }
+	if( A.nMask & cpShape )
+	{										// the vertices in a dead buffer
+		A.Shape.push_back(std::move(Entity.Shape));
+		A.Vertices.push_back(TakeTheShape(pWorld));
+	}
+	if( A.nMask & cpRadius ) A.Radius.push_back(Entity.Radius);
+	if( A.nMask & cpColor ) A.Color.push_back(Entity.Color);
+	if( A.nMask & cpClass ) A.Class.push_back(Entity.nClass);
+	if( A.nMask & cpOwner ) A.Owner.push_back(Entity.pOwner);
+	if( A.nMask & cpLifetime ) A.Lifetime.push_back(Entity.nLifetime);
+
+	return A.nCount++;
+}
+
+/*!****************************************************************************
+* @brief	Records an entity to be added by CommitTheWorld()
+* @param	pWorld Pointer to the world
+* @param	Entity The components of the entity, moved
+******************************************************************************/
+void SpawnTheEntity(TWorld* pWorld, TEntity Entity)
+{
+	assert(pWorld);
+
+	pWorld->Spawns.push_back(std::move(Entity));
+}
+
+/*!****************************************************************************
+* @brief	Records an entity to be removed by CommitTheWorld()
+* @param	pWorld Pointer to the world
+* @param	nArchetype The archetype of the entity
+* @param	nRow The row of the entity
+* @note		An entity can be killed more than once in a tick
+******************************************************************************/
+void KillTheEntity(TWorld* pWorld, int nArchetype, int nRow)
+{
+	assert(pWorld);
+	assert(nArchetype >= 0 && nArchetype < arCount);
+	assert(nRow >= 0 && nRow < int(pWorld->Archetypes[nArchetype].nCount));
+
+	pWorld->Kills[nArchetype].push_back(nRow);
+}
+
+/*!****************************************************************************
+* @brief	Removes all the entities of an archetype, at once
+* @param	pWorld Pointer to the world
+* @param	nArchetype The archetype
+* @note		The changes recorded for the archetype are discarded too. The
+*			buffers of the shapes are kept, to be reused
+******************************************************************************/
+void ClearTheArchetype(TWorld* pWorld, int nArchetype)
+{
+	assert(pWorld);
+	assert(nArchetype >= 0 && nArchetype < arCount);
+
+	TArchetype& A = pWorld->Archetypes[nArchetype];
+
+	for(TVecPoints& Shape : A.Shape) FreeTheShape(pWorld, Shape);
+	for(TVecPoints& Vertices : A.Vertices) FreeTheShape(pWorld, Vertices);
+
+	for(TEntity& Entity : pWorld->Spawns)
+	{
+		if( Entity.nArchetype == nArchetype ) FreeTheShape(pWorld, Entity.Shape);
+	}
+
+	A.Pos.clear(); A.Vel.clear();
+	A.Rot.clear(); A.DRot.clear(); A.Radius.clear();
+	A.Shape.clear(); A.Vertices.clear(); A.Color.clear();
+	A.Class.clear(); A.Lifetime.clear(); A.Owner.clear();
+	A.nCount = 0;
+
+	pWorld->Kills[nArchetype].clear();
+
+	pWorld->Spawns.erase(
+		std::remove_if(pWorld->Spawns.begin(), pWorld->Spawns.end(),
+			[nArchetype](const TEntity& E) { return E.nArchetype == nArchetype; }),
+		pWorld->Spawns.end());
+}
+
+/*!****************************************************************************
+* @brief	Removes the dead rows of a component array, keeping the order
+* @param	Items The component array
+* @param	Dead The flags of the dead rows
+******************************************************************************/
+template <typename T>
+static void Compact(std::vector<T>& Items, const TVecFlags& Dead)
+{
+	if( Items.empty() ) return;
+
+	size_t nOut = 0;
+
+	for(size_t i=0; i<Items.size(); ++i)
+	{
+		if( Dead[i] ) continue;
+
+		if( nOut != i ) Items[nOut] = std::move(Items[i]);
+		nOut++;
+	}
+
+	Items.resize(nOut);
+}
+
+/*!****************************************************************************
+* @brief	Removes the dead rows of a shape array, keeping the order; the
+*			buffers of the dead shapes are given back, to be reused
+* @param	pWorld Pointer to the world
+* @param	Shapes The shape array
+* @param	Dead The flags of the dead rows
+******************************************************************************/
+static void CompactTheShapes(TWorld* pWorld, std::vector<TVecPoints>& Shapes, const TVecFlags& Dead)
+{
+	size_t nOut = 0;
+											// the dead buffers go to the end
+	for(size_t i=0; i<Shapes.size(); ++i)
+	{
+		if( Dead[i] ) continue;
+
+		if( nOut != i ) Shapes[nOut].swap(Shapes[i]);
+		nOut++;
+	}
+
+	for(size_t i=nOut; i<Shapes.size(); ++i) FreeTheShape(pWorld, Shapes[i]);
+
+	Shapes.resize(nOut);
+}
+
+/*!****************************************************************************
+* @brief	Applies the structural changes recorded since the last call
+* @param	pWorld Pointer to the world
+* @note		The dead rows are removed keeping the order of the
+*			survivors, then the new entities are appended in the order
+*			they were spawned: the result is deterministic. The rows
+*			are stable from a call to the next one.
+******************************************************************************/
+void CommitTheWorld(TWorld* pWorld)
+{
+	assert(pWorld);
+
+	for(int n=0; n<arCount; ++n)
+	{
+		TArchetype& A = pWorld->Archetypes[n];
+		std::vector<int>& Kills = pWorld->Kills[n];
+
+		if( Kills.empty() ) continue;
+
+		pWorld->Dead.assign(A.nCount, 0);
+
+		for(int nRow : Kills) pWorld->Dead[nRow] = 1;
+
+		Compact(A.Pos, pWorld->Dead); Compact(A.Vel, pWorld->Dead);
+		Compact(A.Rot, pWorld->Dead); Compact(A.DRot, pWorld->Dead);
+		Compact(A.Radius, pWorld->Dead);
+		CompactTheShapes(pWorld, A.Shape, pWorld->Dead);
+		CompactTheShapes(pWorld, A.Vertices, pWorld->Dead);
+		Compact(A.Color, pWorld->Dead); Compact(A.Class, pWorld->Dead);
+		Compact(A.Lifetime, pWorld->Dead); Compact(A.Owner, pWorld->Dead);
+
+		A.nCount = unsigned(A.Pos.size());
+
+		Kills.clear();
+	}
+
+	for(TEntity& Entity : pWorld->Spawns)
+	{
+		AddTheEntity(pWorld, std::move(Entity));
+	}
+											// the buffers keep their capacity
+	pWorld->Spawns.clear();
+}
+
+/*!****************************************************************************
+* @brief	Gets the number of entities of an archetype
+* @param	pWorld Pointer to the world
+* @param	nArchetype The archetype
+* @return	The number of entities
+******************************************************************************/
+unsigned GetTheCount(TWorld* pWorld, int nArchetype)
+{
+	assert(pWorld);
+	assert(nArchetype >= 0 && nArchetype < arCount);
+
+	return pWorld->Archetypes[nArchetype].nCount;
+}
+
+/*!****************************************************************************
+* @brief	Takes the buffer of a dead shape, to build a new one without
+*			allocating
+* @param	pWorld Pointer to the world
+* @return	An empty shape, with the capacity of a dead one if any
+******************************************************************************/
+TVecPoints TakeTheShape(TWorld* pWorld)
+{
+	assert(pWorld);
+
+	if( pWorld->FreeShapes.empty() ) return TVecPoints();
+
+	TVecPoints Shape = std::move(pWorld->FreeShapes.back());
+	pWorld->FreeShapes.pop_back();
+
+	return Shape;
+}
+
+/*!****************************************************************************
+* @brief	Makes sure that the buffers of the dead shapes are enough for
+*			a number of new shapes
+* @param	pWorld Pointer to the world
+* @param	nShapes The shapes, counting their vertices in the game area
+* @param	nPoints The points of a shape
+* @note		E.g. at the start of a level, for all the pieces of its
+*			asteroids: then the ticks do not allocate
+******************************************************************************/
+void ReserveTheShapes(TWorld* pWorld, unsigned nShapes, unsigned nPoints)
+{
+	assert(pWorld);
+
+	size_t nTaken = 0;
+
+	for(const TArchetype& A : pWorld->Archetypes) nTaken += A.Shape.size() + A.Vertices.size();
+
+	pWorld->FreeShapes.reserve(nShapes + nTaken);
+
+	while( pWorld->FreeShapes.size() < nShapes )
+	{
+		pWorld->FreeShapes.emplace_back();
+		pWorld->FreeShapes.back().reserve(nPoints);
+	}
+}
+
+/*!****************************************************************************
+* @brief	Checks if an archetype has some components
+* @param	A The archetype
+* @param	nMask The components
+* @return	Returns true if the archetype has all the components
+******************************************************************************/
+static inline bool HasTheComponents(const TArchetype& A, unsigned nMask)
+{
+	return (A.nMask & nMask) == nMask;
+}
+
+/*!****************************************************************************
+* @brief	Moves the entities by their velocity
+* @param	pWorld Pointer to the world
+* @param	Dt The value for the delta time
+* @param	pJobs Pointer to the job system, nullptr to run serially
+******************************************************************************/
+void IntegrateSystem(TWorld* pWorld, double Dt, TJobSystem* pJobs)
+{
+	assert(pWorld);
+
+	for(TArchetype& A : pWorld->Archetypes)
+	{
+		if( !HasTheComponents(A, cpPos | cpVel) ) continue;
+
+		TVector2* pPos = A.Pos.data();
+		const TVector2* pVel = A.Vel.data();
+
+		ParallelFor(pJobs, A.nCount, ROWSPERJOB, [pPos, pVel, Dt](unsigned nBegin, unsigned nEnd)
+		{
+			for(unsigned i=nBegin; i<nEnd; ++i)
+			{
+				pPos[i].X += pVel[i].X * Dt;
+				pPos[i].Y += pVel[i].Y * Dt;
+			}
+		});
+	}
+}
+
+/*!****************************************************************************
+* @brief	Rotates the entities by their rotation speed
+* @param	pWorld Pointer to the world
+* @param	pJobs Pointer to the job system, nullptr to run serially
+******************************************************************************/
+void SpinSystem(TWorld* pWorld, TJobSystem* pJobs)
+{
+	assert(pWorld);
+
+	for(TArchetype& A : pWorld->Archetypes)
+	{
+		if( !HasTheComponents(A, cpSpin) ) continue;
+
+		double* pRot = A.Rot.data();
+		const double* pDRot = A.DRot.data();
+
+		ParallelFor(pJobs, A.nCount, ROWSPERJOB, [pRot, pDRot](unsigned nBegin, unsigned nEnd)
+		{
+			for(unsigned i=nBegin; i<nEnd; ++i)
+			{
+				pRot[i] += pDRot[i];
+			}
+		});
+	}
+}
+
+/*!****************************************************************************
+* @brief	Wraps the entities around the game area
+* @param	pWorld Pointer to the world
+* @param	Width The width of the game area
+* @param	Height The height of the game area
+* @param	pJobs Pointer to the job system, nullptr to run serially
+******************************************************************************/
+void WrapSystem(TWorld* pWorld, double Width, double Height, TJobSystem* pJobs)
+{
+	assert(pWorld);
+
+	for(TArchetype& A : pWorld->Archetypes)
+	{
+		if( !HasTheComponents(A, cpPos | cpWrap) ) continue;
+
+		TVector2* pPos = A.Pos.data();
+
+		ParallelFor(pJobs, A.nCount, ROWSPERJOB, [pPos, Width, Height](unsigned nBegin, unsigned nEnd)
+		{
+			for(unsigned i=nBegin; i<nEnd; ++i)
+			{
+				TVector2& Pos = pPos[i];
+
+				if( Pos.X < 0 ) Pos.X = Width;
+				else if( Pos.X > Width ) Pos.X = 0;
+
+				if( Pos.Y < 0 ) Pos.Y = Height;
+				else if( Pos.Y > Height ) Pos.Y = 0;
+			}
+		});
+	}
+}
+
+/*!****************************************************************************
+* @brief	Kills the entities whose time to live is over
+* @param	pWorld Pointer to the world
+* @param	pJobs Pointer to the job system, nullptr to run serially
+* @note		The countdown runs in parallel, the kills are recorded
+*			afterwards in row order, so they are deterministic
+******************************************************************************/
+void LifetimeSystem(TWorld* pWorld, TJobSystem* pJobs)
+{
+	assert(pWorld);
+
+	for(int n=0; n<arCount; ++n)
+	{
+		TArchetype& A = pWorld->Archetypes[n];
+
+		if( !HasTheComponents(A, cpLifetime) ) continue;
+
+		int* pLifetime = A.Lifetime.data();
+
+		ParallelFor(pJobs, A.nCount, ROWSPERJOB, [pLifetime](unsigned nBegin, unsigned nEnd)
+		{
+			for(unsigned i=nBegin; i<nEnd; ++i)
+			{
+				pLifetime[i]--;
+			}
+		});
+
+		for(unsigned i=0; i<A.nCount; ++i)
+		{
+			if( pLifetime[i] == 0 ) KillTheEntity(pWorld, n, i);
+		}
+	}
+}
+
+/*!****************************************************************************
+* @brief	Computes the vertices of the spinning shapes in the game area,
+*			to be drawn by DrawSystem()
+* @param	pWorld Pointer to the world
+* @param	pJobs Pointer to the job system, nullptr to run serially
+* @note		Same math as Rotate() and Translate(), with the sine and the
+*			cosine computed once per entity
+******************************************************************************/
+void TransformSystem(TWorld* pWorld, TJobSystem* pJobs)
+{
+	assert(pWorld);
+
+	for(TArchetype& A : pWorld->Archetypes)
+	{
+		if( !HasTheComponents(A, cpPos | cpSpin | cpShape) ) continue;
+
+		ParallelFor(pJobs, A.nCount, ROWSPERJOB / 4, [&A](unsigned nBegin, unsigned nEnd)
+		{
+			for(unsigned i=nBegin; i<nEnd; ++i)
+			{
+				const TVecPoints& Shape = A.Shape[i];
+				TVecPoints& Vertices = A.Vertices[i];
+											// the vertices keep their capacity
+				Vertices.resize(Shape.size());
+
+				double SinTheta = sin(A.Rot[i] * M_PI / 180.0f);
+				double CosTheta = cos(A.Rot[i] * M_PI / 180.0f);
+
+				for(unsigned k=0; k<Shape.size(); ++k)
+				{
+					Vertices[k].X = Shape[k].X * CosTheta + Shape[k].Y * SinTheta + A.Pos[i].X;
+					Vertices[k].Y = -Shape[k].X * SinTheta + Shape[k].Y * CosTheta + A.Pos[i].Y;
+				}
+			}
+		});
+	}
+}
+
+/*!****************************************************************************
+* @brief	Draws the entities: the ones with a shape as closed lines,
+*			the others as points
+* @param	pWorld Pointer to the world
+* @param	pVM Pointer to the video manager
+* @note		The shapes are drawn as computed by TransformSystem()
+******************************************************************************/
+void DrawSystem(TWorld* pWorld, TVideoManager* pVM)
+{
+	assert(pWorld);
+	assert(pVM);
+
+	for(TArchetype& A : pWorld->Archetypes)
+	{
+		if( !HasTheComponents(A, cpPos | cpColor) ) continue;
+
+		if( HasTheComponents(A, cpShape | cpSpin) )
+		{
+			for(unsigned i=0; i<A.nCount; ++i)
+			{
+				DrawLines(pVM, A.Vertices[i], 0, A.Color[i], true);
+			}
+		}
+		else
+		{
+			for(unsigned i=0; i<A.nCount; ++i)
+			{
+				DrawPoint(pVM, A.Pos[i], A.Color[i]);
+			}
+		}
+	}
+}
+
+/*!****************************************************************************
+* @brief	Gets the cell of a coordinate, clamped inside the grid
+* @param	Value The coordinate
+* @param	Origin The coordinate of the grid origin
+* @param	CellSize The size of a cell
+* @param	nCells The number of cells along the axis
+* @return	The cell index
+******************************************************************************/
+static inline int GetTheCell(double Value, double Origin, double CellSize, int nCells)
+{
+	int nCell = int(floor((Value - Origin) / CellSize));
+
+	return nCell < 0 ? 0 : (nCell >= nCells ? nCells - 1 : nCell);
+}
+
+/*!****************************************************************************
+* @brief	Builds the grid of the circle entities of an archetype
+* @param	Grid The grid
+* @param	C The archetype of the circles
+* @note		A circle is listed in every cell overlapped by its bounding
+*			box; the cells list the circles by row order. The cells are
+*			at least as large as the largest circle, and about as many
+*			as the circles.
+******************************************************************************/
+static void BuildTheGrid(TGrid& Grid, const TArchetype& C)
+{
+	Grid.Items.clear();
+
+	if( !C.nCount )
+	{
+		Grid.nCols = Grid.nRows = 0;
+		Grid.CellStart.assign(1, 0);
+		return;
+	}
+
+	double X0 = C.Pos[0].X, Y0 = C.Pos[0].Y, X1 = X0, Y1 = Y0, MaxRadius = 0;
+
+	for(unsigned j=0; j<C.nCount; ++j)
+	{
+		X0 = std::min(X0, C.Pos[j].X - C.Radius[j]);
+		Y0 = std::min(Y0, C.Pos[j].Y - C.Radius[j]);
+		X1 = std::max(X1, C.Pos[j].X + C.Radius[j]);
+		Y1 = std::max(Y1, C.Pos[j].Y + C.Radius[j]);
+		MaxRadius = std::max(MaxRadius, C.Radius[j]);
+	}
+
+	Grid.X0 = X0;
+	Grid.Y0 = Y0;
+	Grid.CellSize = std::max(1.0, std::max(2.0 * MaxRadius, sqrt((X1 - X0) * (Y1 - Y0) / C.nCount)));
+	Grid.nCols = int((X1 - X0) / Grid.CellSize) + 1;
+	Grid.nRows = int((Y1 - Y0) / Grid.CellSize) + 1;
+											// counting sort of the circles by cell
+	Grid.CellStart.assign(Grid.nCols * Grid.nRows + 1, 0);
+
+	for(int nPass=0; nPass<2; ++nPass)
+	{
+		for(unsigned j=0; j<C.nCount; ++j)
+		{
+			int nC0 = GetTheCell(C.Pos[j].X - C.Radius[j], Grid.X0, Grid.CellSize, Grid.nCols);
+			int nC1 = GetTheCell(C.Pos[j].X + C.Radius[j], Grid.X0, Grid.CellSize, Grid.nCols);
+			int nR0 = GetTheCell(C.Pos[j].Y - C.Radius[j], Grid.Y0, Grid.CellSize, Grid.nRows);
+			int nR1 = GetTheCell(C.Pos[j].Y + C.Radius[j], Grid.Y0, Grid.CellSize, Grid.nRows);
+
+			for(int nR=nR0; nR<=nR1; ++nR)
+			{
+				for(int nC=nC0; nC<=nC1; ++nC)
+				{
+					int nCell = nR * Grid.nCols + nC;
+
+					if( nPass == 0 ) Grid.CellStart[nCell + 1]++;
+					else Grid.Items[Grid.Cursor[nCell]++] = int(j);
+				}
+			}
+		}
+
+		if( nPass == 0 )
+		{
+			for(int i=0; i<Grid.nCols * Grid.nRows; ++i)
+			{
+				Grid.CellStart[i + 1] += Grid.CellStart[i];
+			}
+
+			Grid.Items.resize(Grid.CellStart.back());
+			Grid.Cursor.assign(Grid.CellStart.begin(), Grid.CellStart.end() - 1);
+		}
+	}
+}
+
+#ifdef _CHECKCOLLISIONS
+/*!****************************************************************************
+* @brief	Reference for CollideSystem(): tests all the pairs, serially
+* @param	P The archetype of the points
+* @param	C The archetype of the circles
+* @param	HitPoints Flags of the points already hit, updated
+* @param	HitCircles Flags of the circles already hit, updated
+* @param	Contacts The contacts found, appended
+******************************************************************************/
+static void CollideAllThePairs(const TArchetype& P, const TArchetype& C,
+	TVecFlags& HitPoints, TVecFlags& HitCircles, TVecContacts& Contacts)
+{
+	for(unsigned i=0; i<P.nCount; ++i)
+	{
+		if( HitPoints[i] ) continue;
+
+		for(unsigned j=0; j<C.nCount; ++j)
+		{
+			double DX = P.Pos[i].X - C.Pos[j].X;
+			double DY = P.Pos[i].Y - C.Pos[j].Y;
+
+			if( !HitCircles[j] && DX*DX + DY*DY <= C.Radius[j] * C.Radius[j] )
+			{
+				Contacts.push_back(TContact{ int(i), int(j) });
+
+				HitPoints[i] = HitCircles[j] = 1;
+				break;
+			}
+		}
+	}
+}
+#endif
+
+/*!****************************************************************************
+* @brief	Collisions between the point entities of an archetype and the
+*			circle entities of another one
+* @param	pWorld Pointer to the world
+* @param	nPoints The archetype of the points
+* @param	nCircles The archetype of the circles (with a radius)
+* @param	HitPoints Flags of the points already hit, updated
+* @param	HitCircles Flags of the circles already hit, updated
+* @param	Contacts The contacts found, appended
+* @param	pJobs Pointer to the job system, nullptr to run serially
+* @note		Each point hits the first circle not hit yet, in row order,
+*			so an entity is in one contact at most.
+*			The circles are sorted in a grid; the points test the circles
+*			of their cell, in parallel, and the overlapping pairs go to
+*			per-thread buffers. The pairs are then sorted by point and
+*			circle, and resolved in that order: the contacts are the same
+*			as testing all the pairs serially, whatever the scheduling.
+*			Built with -D_CHECKCOLLISIONS, the contacts are asserted to
+*			be the ones of CollideAllThePairs(), at a quadratic cost.
+******************************************************************************/
+void CollideSystem(TWorld* pWorld, int nPoints, int nCircles,
+	TVecFlags& HitPoints, TVecFlags& HitCircles, TVecContacts& Contacts,
+	TJobSystem* pJobs)
+{
+	assert(pWorld);
+
+	TArchetype& P = pWorld->Archetypes[nPoints];
+	TArchetype& C = pWorld->Archetypes[nCircles];
+
+	assert(HasTheComponents(C, cpPos | cpRadius));
+	assert(HitPoints.size() == P.nCount && HitCircles.size() == C.nCount);
+
+#ifdef _CHECKCOLLISIONS
+	TVecFlags RefHitPoints(HitPoints), RefHitCircles(HitCircles);
+	TVecContacts RefContacts(Contacts);
+
+	CollideAllThePairs(P, C, RefHitPoints, RefHitCircles, RefContacts);
+#endif
+											// broad-phase
+	TGrid& Grid = pWorld->Grid;
+	BuildTheGrid(Grid, C);
+											// narrow-phase, the flags are
+											// only read here
+	std::vector<TVecContacts>& Candidates = pWorld->Candidates;
+	Candidates.resize(GetTheThreads(pJobs));
+
+	for(TVecContacts& Buffer : Candidates)
+	{
+		Buffer.clear();
+		Buffer.reserve(WORLDROWS);
+	}
+
+	if( C.nCount ) ParallelFor(pJobs, P.nCount, ROWSPERJOB / 4, [&](unsigned nBegin, unsigned nEnd)
+	{
+		TVecContacts& Buffer = Candidates[GetTheThreadIndex(pJobs)];
+		unsigned nTests = 0;
+
+		for(unsigned i=nBegin; i<nEnd; ++i)
+		{
+			if( HitPoints[i] ) continue;
+
+			TVector2 Pt = P.Pos[i];
+
+			int nCell = GetTheCell(Pt.Y, Grid.Y0, Grid.CellSize, Grid.nRows) * Grid.nCols
+				+ GetTheCell(Pt.X, Grid.X0, Grid.CellSize, Grid.nCols);
+
+			nTests += Grid.CellStart[nCell + 1] - Grid.CellStart[nCell];
+
+			for(unsigned k=Grid.CellStart[nCell]; k<Grid.CellStart[nCell + 1]; ++k)
+			{
+				int j = Grid.Items[k];
+
+				double DX = Pt.X - C.Pos[j].X;
+				double DY = Pt.Y - C.Pos[j].Y;
+											// same test as Distance() <= Radius
+				if( !HitCircles[j] && DX*DX + DY*DY <= C.Radius[j] * C.Radius[j] )
+				{
+					Buffer.push_back(TContact{ int(i), j });
+				}
+			}
+		}
+
+		CountThe(ctPairTests, nTests);
+	});
+											// deterministic merge
+	TVecContacts& Pairs = Candidates[0];
+
+	for(int i=1; i<Candidates.size(); ++i)
+	{
+		Pairs.insert(Pairs.end(), Candidates[i].begin(), Candidates[i].end());
+	}
+
+	std::sort(Pairs.begin(), Pairs.end(), [](const TContact& A, const TContact& B)
+		{ return A.nPoint < B.nPoint || (A.nPoint == B.nPoint && A.nCircle < B.nCircle); });
+
+	for(const TContact& Pair : Pairs)
+	{
+		if( HitPoints[Pair.nPoint] || HitCircles[Pair.nCircle] ) continue;
+
+		Contacts.push_back(Pair);
+
+		HitPoints[Pair.nPoint] = HitCircles[Pair.nCircle] = 1;
+	}
+
+#ifdef _CHECKCOLLISIONS
+	assert(RefContacts.size() == Contacts.size());
+
+	for(int i=0; i<Contacts.size(); ++i)
+	{
+		assert(RefContacts[i].nPoint == Contacts[i].nPoint && RefContacts[i].nCircle == Contacts[i].nCircle);
+	}
+#endif
+}
@@ -0,0 +1,114 @@
+
+#ifndef _ECS_H_
+#define _ECS_H_
+
+#include "platform.h"
+#include <vector>
+
+#include "tasks.h"
+#include "video.h"
+#include "vectors.h"
+
+
+struct TShip;
+
+enum enComponent {
+	cpPos		= 1 << 0,
+	cpVel		= 1 << 1,
+	cpSpin		= 1 << 2,		///< rotation and its speed
+	cpShape		= 1 << 3,		///< polygon, drawn as a closed line
+	cpRadius	= 1 << 4,		///< collision circle
+	cpColor		= 1 << 5,
+	cpClass		= 1 << 6,		///< e.g. the asteroid class
+	cpOwner		= 1 << 7,		///< ship that has spawned the entity
+	cpLifetime	= 1 << 8,		///< ticks to live
+	cpWrap		= 1 << 9		///< tag: wraps around the game area
+};
+
+#define ROWSPERJOB		256			///< minimum rows of a chunk, for the parallel systems
+#define WORLDROWS		1024		///< rows reserved for each archetype, at the setup
+
+
+enum enArchetype { arAsteroid, arMissile, arCount };
+
+struct TEntity					///< all the components of an entity to be spawned
+{
+	int nArchetype;
+	TVector2 Pos, Vel;
+	double Rot, DRot, Radius;
+	TVecPoints Shape;
+	COLORREF Color;
+	int nClass;
+	TShip* pOwner;
+	int nLifetime;
+};
+
+struct TArchetype				///< dense arrays, one per component, a row per entity
+{
+	unsigned nMask;				///< components of the archetype
+	unsigned nCount;
+
+	std::vector<TVector2> Pos, Vel;
+	std::vector<double> Rot, DRot, Radius;
+	std::vector<TVecPoints> Shape;
+	std::vector<TVecPoints> Vertices;	///< the shape in the game area, see TransformSystem()
+	std::vector<COLORREF> Color;
+	std::vector<int> Class, Lifetime;
+	std::vector<TShip*> Owner;
+};
+
+struct TContact
+{
+	int nPoint, nCircle;		///< rows of the entities colliding
+};
+
+typedef std::vector<TContact> TVecContacts;
+typedef std::vector<unsigned char> TVecFlags;
+
+struct TGrid					///< uniform grid, the broad-phase of the collisions
+{
+	double X0, Y0, CellSize;
+	int nCols, nRows;
+	std::vector<unsigned> CellStart;	///< first item of each cell, plus the end
+	std::vector<unsigned> Cursor;		///< scratch, for the filling
+	std::vector<int> Items;				///< rows of the circles, grouped by cell
+};
+
+struct TWorld
+{
+	TArchetype Archetypes[arCount];
+								// structural changes, see CommitTheWorld()
+	std::vector<TEntity> Spawns;
+	std::vector<int> Kills[arCount];
+
+	TVecFlags Dead;				///< scratch, for the compaction
+
+	TGrid Grid;					///< scratch, for the collisions
+	std::vector<TVecContacts> Candidates;	///< per thread, for the collisions
+
+	std::vector<TVecPoints> FreeShapes;	///< buffers of the dead shapes, see TakeTheShape()
+};
+
+void SetupTheWorld(TWorld* pWorld);
+
+int AddTheEntity(TWorld* pWorld, TEntity Entity);
+void SpawnTheEntity(TWorld* pWorld, TEntity Entity);
+void KillTheEntity(TWorld* pWorld, int nArchetype, int nRow);
+void ClearTheArchetype(TWorld* pWorld, int nArchetype);
+void CommitTheWorld(TWorld* pWorld);
+unsigned GetTheCount(TWorld* pWorld, int nArchetype);
+
+TVecPoints TakeTheShape(TWorld* pWorld);
+void ReserveTheShapes(TWorld* pWorld, unsigned nShapes, unsigned nPoints);
+
+void IntegrateSystem(TWorld* pWorld, double Dt, TJobSystem* pJobs=nullptr);
+void SpinSystem(TWorld* pWorld, TJobSystem* pJobs=nullptr);
+void WrapSystem(TWorld* pWorld, double Width, double Height, TJobSystem* pJobs=nullptr);
+void LifetimeSystem(TWorld* pWorld, TJobSystem* pJobs=nullptr);
+void TransformSystem(TWorld* pWorld, TJobSystem* pJobs=nullptr);
+void DrawSystem(TWorld* pWorld, TVideoManager* pVM);
+void CollideSystem(TWorld* pWorld, int nPoints, int nCircles,
+	TVecFlags& HitPoints, TVecFlags& HitCircles, TVecContacts& Contacts,
+	TJobSystem* pJobs=nullptr);
+
+#endif
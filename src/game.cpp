@@ -11,9 +11,8 @@
 
 ******************************************************************************/
 
-#include <windows.h>
-#include <winuser.h>
-#include <mmsystem.h>
+#include "platform.h"
+#include <string.h>
 
 #include <locale>
 #include <codecvt>
@@ -39,12 +38,14 @@
 #include "utils.h"
 #include "vectors.h"
 #include "commdefs.h"
+#include "netplay.h"
+#include "spectator.h"
+#include "profiler.h"
+#include "counters.h"
 
 #include "resource.h"
 
 
-#define DT	0.1
-
 #define MAXLIVES		3
 #define STARTLEVEL		1
 #define STARTSCORE		0
@@ -59,6 +60,8 @@
 #define ASTEROIDBIGSIZE		30
 #define ASTEROIDMIDSIZE 	20
 #define ASTEROIDSMALLSIZE	10
+#define ASTEROIDSHAPES		12			///< pooled per big asteroid: 4 pieces, each with
+										///< its shape, its vertices and its spawn
 
 #define BIGASTEROIDSCORE	5
 #define MIDASTEROIDSCORE    10
@@ -73,6 +76,7 @@
 
 #define ALIENSHOTDELAY		20
 #define HUMANSHOTDELAY		100
+#define HUMANSHOTTICKS		(HUMANSHOTDELAY * FPS / 1000)
 
 #define MISSILESPEED		100.0
 
@@ -85,9 +89,32 @@
 
 
 
+#define STARTUPTHREADS		4
+#define STARTUPLOG			"startup.log"
+
+
 extern TGame* g_pGame;
 
 
+struct TSetupStep
+{
+	const char* pName;
+	bool (*pRun)(TGame*);
+	const char* pError;
+};
+											// independent steps, run in parallel
+static TSetupStep SetupSteps[] = {
+	{ "fonts", BuildTheFonts, "Cannot find FONTS data file!" },
+	{ "ships", BuildTheShips, "Cannot build the ships!" },
+	{ "sounds", LoadTheSounds, "Cannot load the sounds!" },
+	{ "help", LoadTheHelp, "Cannot open the help file!" },
+	{ "scores", LoadTheBestScores, "Cannot open SCORES data file!" },
+	{ "asteroids", BuildTheAsteroids, "Cannot build the asteroids!" }
+};
+
+
+#ifndef __linux__
+
 /*!****************************************************************************
 * @brief	Callback function for best scores input dialog
 * @param	hDlg Handle to parent window
@@ -129,15 +156,27 @@ BOOL CALLBACK BestScoresDlgProc(HWND hDlg, UINT nMessage, WPARAM wParam, LPARAM
 	return FALSE;
 }
 
+#endif
+
 
 /*!****************************************************************************
 * @brief	Setting up the game engine
 * @param	pGame Pointer to the game engine
 * @param	pVM Pointer to the VideoManager
 * @param	pSM Pointer to the SoundManager
+* @param	nSeed Seed of the generator of the game: RANDSEED for the runs
+*			to be repeated, MakeTheSeed() for a different game at every run
+* @param	bHeadless True for a game without the window, see
+*			CreateTheHeadlessGame(): no job system, and the setup done
+*			before returning
 * @return	Returns true for success, false otherwise
+* @note		Fonts, ships, sounds, help, scores and asteroids are set up
+*			by independent tasks, running in background: the game is
+*			ready once PollTheSetup() returns true. A headless game runs
+*			them on the calling thread instead: its callers run many
+*			games at once, each with no threads of its own.
 ******************************************************************************/
-bool Setup(TGame* pGame, TVideoManager* pVM, TSoundManager* pSM)
+bool Setup(TGame* pGame, TVideoManager* pVM, TSoundManager* pSM, uint64_t nSeed, bool bHeadless)
 {
 	assert(pGame);
 	assert(pVM);
@@ -147,6 +186,27 @@ bool Setup(TGame* pGame, TVideoManager* pVM, TSoundManager* pSM)
 
 	pGame->pVM = pVM;
 	pGame->pSM = pSM;
+											// the network game is set up
+											// by the caller, if any
+	pGame->nPlayers = pGame->pNetplay ? MAXPLAYERS : 1;
+	memset(pGame->nInputs, 0, sizeof(pGame->nInputs));
+	SetupTheInput(&pGame->Input);
+
+	SetupTheWorld(&pGame->World);
+	SetupTheWorld(&pGame->LoadedWorld);
+											// the events, the flags and the
+											// contacts of the collisions, as
+											// the rows
+	pGame->EventBus.Events.reserve(WORLDROWS);
+	pGame->EventBus.HitAsteroids.reserve(WORLDROWS);
+	pGame->EventBus.HitMissiles.reserve(WORLDROWS);
+	pGame->EventBus.Contacts.reserve(WORLDROWS);
+	SetupTheArena(&pGame->Arena, FRAMEARENASIZE);
+											// workers for the systems: one
+											// less than the cores
+	if( !bHeadless ) SetupJobSystem(&pGame->Jobs, 0);
+	pGame->bSerial = bHeadless;
+	BuildTheSystems(pGame);
 
 	pGame->nLevel = STARTLEVEL;
 	pGame->bRun = true;
@@ -155,59 +215,192 @@ bool Setup(TGame* pGame, TVideoManager* pVM, TSoundManager* pSM)
 	pGame->nScore = STARTSCORE;
 	pGame->nBonusCount = BONUSCOUNTER;
 	pGame->bBestScoreDlgActive = false;
+											// the whole run follows from the
+											// seed, see snapshot.cpp
+	pGame->nSeed = nSeed;
+	SeedTheRandom(&pGame->Random, nSeed);
+	UseTheRandom(&pGame->Random);
+
+	pGame->nTick = 0;
+	for(int i=0; i<MAXPLAYERS; ++i) pGame->nShotTick[i] = 0u - HUMANSHOTTICKS;
+	pGame->nAlienShotTicks = 0;
+	pGame->nAlienShipTick = ALIENSHIPTICK + Rand(ALIENSHIPTICK/2);
+	pGame->bHeadless = false;
 
+	pGame->pStartup = new TStartup;
+	assert(pGame->pStartup);
 
-	if( !BuildTheFonts(pGame) )
+	TStartup* pStartup = pGame->pStartup;
+	pStartup->bFirstFrame = false;
+
+	StartTheTimeline(&pStartup->Timeline);
+	double Time = GetTheTime();
+											// without the archive the assets
+											// are loaded from the data folder
+	OpenTheArchive(pGame);
+
+	AddTheEvent(&pStartup->Timeline, "archive", Time);
+
+	if( !bHeadless ) SetupTaskPool(&pStartup->Pool, STARTUPTHREADS);
+
+	for(int i=0; i<sizeof(SetupSteps)/sizeof(SetupSteps[0]); ++i)
 	{
-		::MessageBox(0,
-			TEXT("Error: Cannot find FONTS data file!\n\nPress any key to exit ..."),
-			TEXT("Fatal Error"),
-			MB_OK | MB_ICONSTOP | MB_TASKMODAL);
-		exit(-1);
+											// each step draws from its own
+											// generator, whatever the order
+											// the steps run in
+		uint64_t nStepSeed = MixTheSeed(pGame->Random.nState + i);
+
+		if( bHeadless )
+		{
+			RunTheSetupStep(pGame, i, nStepSeed);
+		}
+		else
+		{
+			PushTheTask(&pStartup->Pool, [pGame, i, nStepSeed] { RunTheSetupStep(pGame, i, nStepSeed); });
+		}
 	}
+											// a step leaves its thread on
+											// the default generator
+	if( bHeadless ) UseTheRandom(&pGame->Random);
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Runs a setup step, recording its timing and its failure
+* @param	pGame Pointer to the game engine
+* @param	nStep Index of the step in SetupSteps
+* @param	nSeed Seed of the generator bound to the step, derived from the
+*			one of the game
+* @note		The steps run in parallel: they cannot share the generator of
+*			the game, so each one draws from its own
+******************************************************************************/
+void RunTheSetupStep(TGame* pGame, int nStep, uint64_t nSeed)
+{
+	assert(pGame);
+	assert(pGame->pStartup);
+
+	TStartup* pStartup = pGame->pStartup;
+
+	TRandom Random;
+	SeedTheRandom(&Random, nSeed);
+	UseTheRandom(&Random);
+
+	double Time = GetTheTime();
 
+	bool bResult = SetupSteps[nStep].pRun(pGame);
 
-	if( !BuildTheShips(pGame) )
+	UseTheRandom(nullptr);
+
+	AddTheEvent(&pStartup->Timeline, SetupSteps[nStep].pName, Time);
+
+	if( !bResult )
 	{
-		::MessageBox(0,
-			TEXT("Error: Cannot build the ships!\n\nPress any key to exit ..."),
-			TEXT("Fatal Error"),
-			MB_OK | MB_ICONSTOP | MB_TASKMODAL);
-		exit(-1);
+		std::lock_guard<std::mutex> Lock(pStartup->Mutex);
+		pStartup->strErrors.push_back(SetupSteps[nStep].pError);
 	}
+}
+
+/*!****************************************************************************
+* @brief	Checks, without blocking, for the completion of the setup
+* @param	pGame Pointer to the game engine
+* @return	Returns true once the game is ready to run
+* @note		Must be called by the main thread, until it returns true.
+*			Any setup failure is reported here, and it is fatal.
+******************************************************************************/
+bool PollTheSetup(TGame* pGame)
+{
+	assert(pGame);
 
+	TStartup* pStartup = pGame->pStartup;
 
-	if( !LoadTheSounds(pGame) )
-	{
-		::MessageBox(0,
-			TEXT("Error: Cannot load the sounds!"),
-			TEXT("Fatal Error"),
-			MB_OK | MB_ICONERROR | MB_TASKMODAL);
+	if( !pStartup ) return true;
 
-		exit(-1);
+	if( !pStartup->bFirstFrame )
+	{
+		pStartup->bFirstFrame = true;
+		AddTheEvent(&pStartup->Timeline, "first frame", GetTheTime());
 	}
 
+	if( !IsIdle(&pStartup->Pool) ) return false;
 
-	if( !LoadTheHelp(pGame) )
+	CleanupTaskPool(&pStartup->Pool);
+
+	if( pStartup->strErrors.size() )
 	{
-		::MessageBox(0,
-			TEXT("Error: Cannot open the help file!"),
-			TEXT("Fatal Error"),
-			MB_OK | MB_ICONERROR | MB_TASKMODAL);
+		std::string strMsg;
+
+		for(int i=0; i<pStartup->strErrors.size(); i++)
+		{
+			strMsg += "Error: " + pStartup->strErrors[i] + "\n";
+		}
 
+		strMsg += "\nPress any key to exit ...";
+
+#ifdef __linux__
+		LogTheText(strMsg.c_str());
+#else
+		::MessageBoxA(0, strMsg.c_str(), "Fatal Error",
+			MB_OK | MB_ICONSTOP | MB_TASKMODAL);
+#endif
 		exit(-1);
 	}
+											// the DC belongs to this thread
+	SelectTheFont(pGame->pVM);
+
+	AddTheEvent(&pStartup->Timeline, "ready", pStartup->Timeline.Origin);
+	ReportTheTimeline(&pStartup->Timeline, GetExePath() + PATHSEP + STARTUPLOG);
+
+	delete pStartup;
+	pGame->pStartup = nullptr;
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Checks if the setup is still in progress
+* @param	pGame Pointer to the game engine
+* @return	Returns true until PollTheSetup() has completed the setup
+******************************************************************************/
+bool IsStarting(TGame* pGame)
+{
+	assert(pGame);
 
+	return pGame->pStartup != nullptr;
+}
+
+/*!****************************************************************************
+* @brief	Loads the best scores, from file or from the assets archive
+* @param	pGame Pointer to the game engine
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool LoadTheBestScores(TGame* pGame)
+{
+	assert(pGame);
+
+	const unsigned char* pScores = nullptr;
+	unsigned nScoresSize = 0;
+											// the scores file is written at
+											// run-time, thus it is kept out
+											// of the archive: the archived one
+											// is just the initial table
 	std::string strScoresFile = std::string(GetDataPath()) + std::string(SCORESFILE);
-	if( !LoadTheBestScores(pGame, (char*) strScoresFile.c_str()) )
+	if( GetTheAsset(pGame, SCORESFILE, &pScores, &nScoresSize) )
 	{
-		::MessageBox(0,
-			TEXT("Error: Cannot open SCORES data file!\n\nPress any key to exit ..."),
-			TEXT("Fatal Error"),
-			MB_OK | MB_ICONSTOP | MB_TASKMODAL);
-		exit(-1);
+		ParseTheBestScores(pGame, (const char*) pScores, nScoresSize);
 	}
 
+	return LoadTheBestScores(pGame, (char*) strScoresFile.c_str()) || pScores;
+}
+
+/*!****************************************************************************
+* @brief	Builds the asteroids of the first level
+* @param	pGame Pointer to the game engine
+* @return	Returns true
+******************************************************************************/
+bool BuildTheAsteroids(TGame* pGame)
+{
+	assert(pGame);
 
 #ifdef _DEVEL
 	BuildTheAsteroids(pGame, 1);
@@ -215,7 +408,7 @@ bool Setup(TGame* pGame, TVideoManager* pVM, TSoundManager* pSM)
 	BuildTheAsteroids(pGame, pGame->nLevel * MAXASTEROIDS );
 #endif
 
-	return bResult;
+	return true;
 }
 
 /*!****************************************************************************
@@ -228,6 +421,7 @@ bool LoadTheSounds(TGame* pGame)
 	assert(pGame);
 	assert(pGame->pSM);
 
+										// must match the enSoundId order
 	std::vector<std::string> strSounds = {
 		"bonus",
 		"shield",
@@ -242,7 +436,73 @@ bool LoadTheSounds(TGame* pGame)
 		"starwars-trails"
 	};
 
-	return LoadTheSounds(pGame->pSM, strSounds);
+										// voice policy: priority, max instances,
+										// min ticks between plays, gain scaling
+	int nPolicies[snCount][4] = {
+		{ 3, 1, 0, 0 },					// bonus
+		{ 2, 1, 0, 0 },					// shield
+		{ 1, 3, 0, 0 },					// ship_fire
+		{ 2, 4, 4, 1 },					// bang_large
+		{ 2, 4, 4, 1 },					// bang_medium
+		{ 1, 4, 3, 1 },					// bang_small
+		{ 3, 1, 0, 0 },					// saucer_big
+		{ 3, 1, 0, 0 },					// saucer_small
+		{ 0, 1, 0, 0 },					// ship_thrust
+		{ 3, 1, 0, 0 },					// ship_explosion
+		{ 4, 1, 0, 0 }					// starwars-trails
+	};
+
+	assert(strSounds.size() == snCount);
+	assert(pGame->pSM->SoundTracks.empty());
+											// nothing to play
+	if( pGame->pSM->bMuted ) return true;
+
+	bool bResult = LoadTheSounds(pGame->pSM, strSounds, pGame->pArchive);
+
+	for(int i=0; bResult && i<snCount; ++i)
+	{
+		SetSoundPriority(pGame->pSM, i, nPolicies[i][0], nPolicies[i][1]);
+		SetSoundRateLimit(pGame->pSM, i, nPolicies[i][2], nPolicies[i][3] != 0);
+	}
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Opens the packed assets archive, if available
+* @param	pGame Pointer to the game engine
+* @return	Returns true if the archive has been open, false otherwise
+******************************************************************************/
+bool OpenTheArchive(TGame* pGame)
+{
+	assert(pGame);
+
+	pGame->pArchive = new TArchive;
+	assert(pGame->pArchive);
+
+	if( !OpenTheArchive(pGame->pArchive, GetDataPath() + ARCHIVEFILE) )
+	{
+		delete pGame->pArchive;
+		pGame->pArchive = nullptr;
+	}
+
+	return pGame->pArchive != nullptr;
+}
+
+/*!****************************************************************************
+* @brief	Gets an asset from the packed assets archive
+* @param	pGame Pointer to the game engine
+* @param	pName The asset name (i.e. its file name)
+* @param[out] ppData Pointer to the asset data
+* @param[out] pnSize Size of the asset data
+* @return	Returns true for success, false if there is no archive
+*			or the asset is not in the archive
+******************************************************************************/
+bool GetTheAsset(TGame* pGame, const char* pName, const unsigned char** ppData, unsigned* pnSize)
+{
+	assert(pGame);
+
+	return pGame->pArchive && GetTheAsset(pGame->pArchive, pName, ppData, pnSize);
 }
 
 /*!****************************************************************************
@@ -256,26 +516,26 @@ bool LoadTheHelp(TGame* pGame)
 
 	bool bResult = false;
 
-	std::string strHelpFile = GetDataPath() + std::string(HELPFILE);
+	const unsigned char* pData = nullptr;
+	unsigned nSize = 0;
 
-	FILE* fp = fopen(strHelpFile.c_str(), "r");
+	if( GetTheAsset(pGame, HELPFILE, &pData, &nSize) )
+	{
+		pGame->strHelp = SplitTheLines((const char*) pData, nSize);
 
-	if( fp )
+		bResult = true;
+	}
+	else
 	{
-		pGame->strHelp.clear();
+		std::string strHelpFile = GetDataPath() + std::string(HELPFILE);
+		std::string strText;
 
-		while( !feof(fp) )
+		if( ReadTheFile(strHelpFile, strText) )
 		{
-			char Buffer[1024];
-
-			fgets(Buffer, sizeof(Buffer) - 1, fp);
+			pGame->strHelp = SplitTheLines(strText.c_str(), strText.size());
 
-			pGame->strHelp.push_back(Buffer);
+			bResult = true;
 		}
-
-		fclose(fp);
-
-		bResult = true;
 	}
 
 	return bResult;
@@ -294,51 +554,113 @@ bool LoadTheBestScores(TGame* pGame, char* pFileName)
 
 	bool bResult = false;
 
-	FILE *fp = fopen(pFileName, "r");
+	std::string strText;
 
-	if( fp )
+	if( ReadTheFile(pFileName, strText) )
 	{
-		pGame->BestScores.clear();
+		ParseTheBestScores(pGame, strText.c_str(), strText.size());
+											// compacts a file left by the
+											// older releases, which appended
+											// every score, or edited by hand;
+											// the headless games don't write
+		std::string strTable = FormatTheBestScores(pGame->BestScores);
 
-		while( !feof(fp) )
-		{
-			char Buffer[1024];
-
-			if( fgets(Buffer, sizeof(Buffer)-1, fp) )
-			{
+		if( strTable != strText && !pGame->pVM->bDisabled ) WriteTheFile(pFileName, strTable);
 
-				TRecordScores Score;
-				memset(&Score, 0, sizeof(Score));
-Score.strName = "best";
-Score.nScore = 100;
+		bResult = true;
+	}
 
+	return bResult;
+}
 
-				std::string strTemp(Buffer);
-				int nPos = strTemp.find(",");
+/*!****************************************************************************
+* @brief	Parses the best scores, one "name,score" record per line
+* @param	pGame Pointer to the game engine
+* @param	pText Pointer to the text of the best scores
+* @param	nSize Size of the text
+* @note		Only the KEPTSCORES best records are kept, in order
+******************************************************************************/
+void ParseTheBestScores(TGame* pGame, const char* pText, unsigned nSize)
+{
+	assert(pGame);
 
-//Score.strName = strTemp;
-		//pGame->BestScores.push_back(Score);
+	pGame->BestScores.clear();
+	pGame->BestScores.reserve(KEPTSCORES + 1);
 
-				//std::string strName = strTemp.substr(0, nPos);
-				//strcpy(Score.pName, strName.c_str());
-				Score.strName = strTemp.substr(0, nPos);
+	const char* pEnd = pText + nSize;
 
-				std::string strScore = strTemp.substr(nPos+1, strTemp.length()-nPos);
-				Score.nScore = atoi((char*) strScore.c_str());
+	for(const char* pLine = pText; pLine < pEnd; )
+	{
+		const char* pEol = (const char*) memchr(pLine, '\n', pEnd - pLine);
+		if( !pEol ) pEol = pEnd;
+											// the name may hold commas:
+											// the score follows the last one
+		const char* pComma = pEol;
+		while( pComma > pLine && *(pComma-1) != ',' ) pComma--;
+
+		if( pComma > pLine )
+		{
+			TRecordScores Score;
 
-				pGame->BestScores.push_back(Score);
+			Score.strName.assign(pLine, pComma - 1 - pLine);
+			Score.nScore = 0;
+											// blanks may come before the
+											// digits, as atoi() allowed
+			const char* pDigit = pComma;
+			while( pDigit < pEol && (*pDigit == ' ' || *pDigit == '\t') ) pDigit++;
 
+			for(const char* p = pDigit; p < pEol && *p >= '0' && *p <= '9'; ++p)
+			{
+				Score.nScore = Score.nScore * 10 + (*p - '0');
 			}
+
+			InsertTheScore(pGame->BestScores, Score);
 		}
 
-		fclose(fp);
+		pLine = pEol + 1;
+	}
+}
 
-		Sort(pGame->BestScores, false);
+/*!****************************************************************************
+* @brief	Formats the best scores, one "name,score" record per line
+* @param	Scores The best scores
+* @return	The text, as parsed by ParseTheBestScores()
+******************************************************************************/
+std::string FormatTheBestScores(const TVecRecordScores& Scores)
+{
+	std::string strText;
 
-		bResult = true;
+	for(const TRecordScores& Score : Scores)
+	{
+		strText += Score.strName + "," + std::to_string(Score.nScore) + "\n";
 	}
 
-	return bResult;
+	return strText;
+}
+
+/*!****************************************************************************
+* @brief	Inserts a score in the best scores, kept from the bigger to the
+*			lower, KEPTSCORES at most
+* @param	Scores The best scores
+* @param	Score The score to insert
+* @return	Returns true if the score is one of the best, false otherwise
+* @note		A binary search, O(log KEPTSCORES); a score equal to older
+*			ones goes after them. The insertion moves the later records,
+*			O(KEPTSCORES), which for the 100 records kept is a memmove of
+*			a few kB, below the cost of the nodes of an ordered container.
+******************************************************************************/
+bool InsertTheScore(TVecRecordScores& Scores, const TRecordScores& Score)
+{
+	if( Scores.size() >= KEPTSCORES && Score.nScore <= Scores.back().nScore ) return false;
+
+	TVecRecordScores::iterator Pos = std::upper_bound(Scores.begin(), Scores.end(), Score.nScore,
+		[](unsigned nScore, const TRecordScores& Other) { return nScore > Other.nScore; });
+
+	Scores.insert(Pos, Score);
+
+	if( Scores.size() > KEPTSCORES ) Scores.pop_back();
+
+	return true;
 }
 
 /*!****************************************************************************
@@ -351,7 +673,19 @@ bool BuildTheFonts(TGame* pGame)
 	assert(pGame);
 	assert(pGame->pVM);
 
+											// nothing to draw
+	if( pGame->pVM->bDisabled ) return true;
+
 	std::wstring strFontName = L"Techno LCD";
+
+	const unsigned char* pData = nullptr;
+	unsigned nSize = 0;
+
+	if( GetTheAsset(pGame, "technolcd.ttf", &pData, &nSize) )
+	{
+		return LoadFont(pGame->pVM, pData, nSize, strFontName, FONTSIZE);
+	}
+
 	std::string strFontPath = GetDataPath() + "\\technolcd.ttf";
 
 	return LoadFont(pGame->pVM, strFontPath, strFontName, FONTSIZE);
@@ -378,9 +712,11 @@ void Restart(TGame* pGame)
 
 		if( GetClass(pGame->pShips[i]) == scHuman )
 		{
+			double DX = i == PLAYER2SHIP ? 4.0*SHIP_SIZE : 0;
+
 			SetVel(pGame->pShips[i], TVector2{0,0});
 			SetRot(pGame->pShips[i], 180.0);
-			SetPos(pGame->pShips[i], TVector2{nWidth/2.0, nHeight/2.0} );
+			SetPos(pGame->pShips[i], TVector2{nWidth/2.0 + DX, nHeight/2.0} );
 
 			SetAlive(pGame->pShips[i], true);
 			SetVisible(pGame->pShips[i], true);
@@ -426,7 +762,7 @@ void GameOver(TGame* pGame)
 	}
 
 #ifndef _DEVEL
-	PlayTheSound(pGame->pSM, "starwars-trails", true);
+	PlayTheSound(pGame->pSM, snStarwarsTrails, true);
 #endif
 }
 
@@ -438,7 +774,7 @@ void NextLevel(TGame* pGame)
 {
 	assert(pGame);
 											// elimina i missili inesplosi
-	Clear(pGame->pMissiles);
+	ClearTheArchetype(&pGame->World, arMissile);
 
 	pGame->nLevel++;
 
@@ -485,6 +821,10 @@ bool BuildTheShips(TGame* pGame)
 		pGame->pShips.push_back(pShip);
 	}
 											// build the small alien ship
+											// N.B.: the alien ships are left
+											// hidden by Build(). SetVisible()
+											// would stop their sounds, that
+											// may be loaded concurrently
 	{
 		TShip *pShip = new TShip;
 		assert(pShip);
@@ -502,7 +842,6 @@ bool BuildTheShips(TGame* pGame)
 		//SetClass(pShip, scAlienSmall);
 
 		SetAlive(pShip, true);
-		SetVisible(pShip, false);
 		SetColor(pShip, RGB(255,255,255));
 
 		pGame->pShips.push_back(pShip);
@@ -525,15 +864,119 @@ bool BuildTheShips(TGame* pGame)
 		//SetClass(pShip, scAlienBig);
 
 		SetAlive(pShip, true);
-		SetVisible(pShip, false);
 		SetColor(pShip, RGB(255,255,255));
 
+		pGame->pShips.push_back(pShip);
+	}
+											// build the human ship of the
+											// second player, see PLAYER2SHIP
+	if( pGame->nPlayers > 1 )
+	{
+		TShip *pShip = new TShip;
+		assert(pShip);
+
+		Build(pShip,
+			pGame->pVM,
+			pGame->pSM,
+			scHuman,
+			TVector2 { SHIP_SIZE, SHIP_SIZE },
+			TVector2 { FRAMEW/2 + 4*SHIP_SIZE, FRAMEH/2 },
+			TVector2 { 0, 0 } );
+
+		SetRot(pShip, 180);
+		SetAlive(pShip, true);
+		SetVisible(pShip, true);
+		SetColor(pShip, RGB(128,255,128));
+
 		pGame->pShips.push_back(pShip);
 	}
 
 	return bResult;
 }
 
+/*!****************************************************************************
+* @brief	Runs the game with or without drawing and sounds
+* @param	pGame Pointer to the game engine
+* @param	bHeadless Flag: true to skip the drawing and the sounds
+* @note		The game state evolves the same way in both modes
+******************************************************************************/
+void SetHeadless(TGame* pGame, bool bHeadless)
+{
+	assert(pGame);
+	assert(pGame->pVM);
+	assert(pGame->pSM);
+
+	pGame->bHeadless = bHeadless;
+	pGame->pVM->bDisabled = bHeadless;
+	pGame->pSM->bMuted = bHeadless;
+}
+
+/*!****************************************************************************
+* @brief	Creates a game without the window, for the server and for the
+*			batches of the bots
+* @param	strErrors The failed setup steps, appended
+* @return	Pointer to the game, ready for StartTheMatch(), nullptr if
+*			the setup has failed
+* @note		The game runs its systems serially: the callers run many
+*			games in parallel instead
+******************************************************************************/
+TGame* CreateTheHeadlessGame(TVecStrings& strErrors)
+{
+	TVideoManager* pVM = new TVideoManager();
+	assert(pVM);
+
+	pVM->ClientArea = RECT{0, 0, FRAMEW, FRAMEH };
+	pVM->bDisabled = true;
+											// no backend: a muted game
+											// loads no sounds
+	TSoundManager* pSM = new TSoundManager();
+	assert(pSM);
+
+	pSM->bMuted = true;
+
+	TGame* pGame = new TGame();
+	assert(pGame);
+
+	Setup(pGame, pVM, pSM, RANDSEED, true);
+
+	TStartup* pStartup = pGame->pStartup;
+
+	bool bResult = pStartup->strErrors.empty();
+
+	strErrors.insert(strErrors.end(), pStartup->strErrors.begin(), pStartup->strErrors.end());
+
+	delete pStartup;
+	pGame->pStartup = nullptr;
+
+	if( !bResult )
+	{
+		DeleteTheHeadlessGame(pGame);
+		return nullptr;
+	}
+
+	SetHeadless(pGame, true);
+
+	return pGame;
+}
+
+/*!****************************************************************************
+* @brief	Deletes a game made by CreateTheHeadlessGame()
+* @param	pGame Pointer to the game engine
+******************************************************************************/
+void DeleteTheHeadlessGame(TGame* pGame)
+{
+	assert(pGame);
+
+	TVideoManager* pVM = pGame->pVM;
+	TSoundManager* pSM = pGame->pSM;
+
+	Cleanup(pGame);
+
+	delete pGame;
+	delete pSM;
+	delete pVM;
+}
+
 /*!****************************************************************************
 * @brief	Checks status for pausing
 * @param	pGame Pointer to the game engine
@@ -567,101 +1010,225 @@ void ShotTheMissile(TGame* pGame, TShip* pShip)
 {
 	assert(pGame);
 	assert(pShip);
-											// delay, in milliseconds,
+	unsigned& nShotTick = pGame->nShotTick[pShip == GetThePlayer(pGame, 1) ? 1 : 0];
+											// delay, in ticks,
 											// between sequential shots
-	unsigned nTickDelay = HUMANSHOTDELAY;				
-
-	static unsigned nCurTick = nTickDelay;			
-
-	if( (::GetTickCount() - nCurTick ) >= nTickDelay)
+	if( pGame->nTick - nShotTick >= HUMANSHOTTICKS )
 	{
-		nCurTick = GetTickCount();
-
-		PlayTheSound(pGame->pSM, "ship_fire");
+		nShotTick = pGame->nTick;
 
-		TMissile *pMissile = new TMissile;
-		assert(pMissile);
-		Build(pMissile, pGame->pVM);
+		QueueTheSound(pGame->pSM, snShipFire);
 
-		pMissile->pShip = pShip;
-
-		pGame->pMissiles.push_back(pMissile);
+		TVector2 Pos = GetPos(pShip);
+		TVector2 Vel{ 0, 0 };
 													// nel caso dell'astronave "umana" spara
 													// il missile lungo la direzione della prua
 		if( GetClass(pShip) == scHuman )
 		{
 			double Rot = GetRot(pShip);
 			double Mod = MISSILESPEED;
-			TVector2 Vel{ Mod*cos((Rot-90)*M_PI/180.0f), Mod*sin((Rot+90)*M_PI/180.0f) };
+			TVector2 Dir{ Mod*cos((Rot-90)*M_PI/180.0f), Mod*sin((Rot+90)*M_PI/180.0f) };
 
-			TVector2 Pos = GetPos(pShip);
 			TVector2 ShipVel = GetVel(pShip);
 
-			Arm(pMissile, Pos, Add( Vel, ShipVel) );
+			Vel = Add( Dir, ShipVel);
 		}
+											// enters the game at the end of
+											// the next tick
+		SpawnTheEntity(&pGame->World, MakeTheMissile(pShip, Pos, Vel));
 	}
 }
 
 /*!****************************************************************************
-* @brief	Inhibits game status for running
+* @brief	Gets the human ship of a player
 * @param	pGame Pointer to the game engine
+* @param	nPlayer The player, less than nPlayers
+* @return	Pointer to the ship
 ******************************************************************************/
-void EndTheGame(TGame* pGame)
+TShip* GetThePlayer(TGame* pGame, int nPlayer)
 {
 	assert(pGame);
+	assert(nPlayer >= 0 && nPlayer < MAXPLAYERS);
 
-	pGame->bRun = false;
+	if( nPlayer == 0 ) return pGame->pShips[scHuman];
+
+	return nPlayer < pGame->nPlayers ? pGame->pShips[PLAYER2SHIP] : nullptr;
 }
 
 /*!****************************************************************************
-* @brief	Cleanup resources
+* @brief	Sets the commands of the local player, read from the keyboard
 * @param	pGame Pointer to the game engine
+* @param	nInput The commands, see enInput
+* @note		Over the network the commands go to the netplay session,
+*			which schedules them for a later tick
 ******************************************************************************/
-void Cleanup(TGame* pGame)
+void SetTheInput(TGame* pGame, unsigned char nInput)
 {
 	assert(pGame);
 
-	DeleteShips(pGame);
-	DeleteAsteroids(pGame);
-	FreeTheSounds(pGame->pSM);
+	if( pGame->pNetplay ) pGame->pNetplay->nLocalInput = nInput;
+	else pGame->nInputs[0] = nInput;
 }
 
 /*!****************************************************************************
-* @brief	Deletes the ships
+* @brief	Applies the commands of the players, at the start of a tick
 * @param	pGame Pointer to the game engine
+* @note		The commands are part of the tick: the run of the game only
+*			depends on its state and on the commands
 ******************************************************************************/
-void DeleteShips(TGame* pGame)
+void ApplyTheInputs(TGame* pGame)
 {
 	assert(pGame);
 
-	for(int i=0; i<pGame->pShips.size(); ++i)
+	bool bRestart = false;
+
+	for(int i=0; i<pGame->nPlayers; ++i)
 	{
-		assert(pGame->pShips[i]);
-		delete pGame->pShips[i];
+		TShip* pShip = GetThePlayer(pGame, i);
+		unsigned char nInput = pGame->nInputs[i];
+
+		if( nInput & inRestart ) bRestart = true;
+
+		if( IsAlive(pShip) )
+		{
+			if( nInput & inShield ) ActivateTheShield(pShip);
+			if( nInput & inFire ) ShotTheMissile(pGame, pShip);
+			if( nInput & inLeft ) RotateLeft(pShip, SHIP_ROTSTEP);
+			if( nInput & inRight ) RotateRight(pShip, SHIP_ROTSTEP);
+			if( nInput & inThrust ) Impulse(pShip, SHIP_IMPULSE);
+		}
 	}
 
-	pGame->pShips.clear();
+	if( bRestart ) Restart(pGame);
 }
 
 /*!****************************************************************************
-* @brief	Pausing the game
+* @brief	Starts a new game from a well known state, the same on all
+*			the peers of a network game
 * @param	pGame Pointer to the game engine
+* @param	nSeed The seed of the match, RANDSEED on the network
 ******************************************************************************/
-void PauseTheGame(TGame* pGame)
+void StartTheMatch(TGame* pGame, uint64_t nSeed)
 {
 	assert(pGame);
 
-	pGame->bPause = !pGame->bPause;
+	SeedTheRandom(&pGame->Random, nSeed);
+	UseTheRandom(&pGame->Random);
+
+	pGame->nTick = 0;
+	for(int i=0; i<MAXPLAYERS; ++i) pGame->nShotTick[i] = 0u - HUMANSHOTTICKS;
+	pGame->nAlienShotTicks = 0;
+	pGame->nAlienShipTick = ALIENSHIPTICK;
+
+	memset(pGame->nInputs, 0, sizeof(pGame->nInputs));
+
+	ClearTheArchetype(&pGame->World, arMissile);
+	Restart(pGame);
 }
 
 /*!****************************************************************************
-* @brief	Shows game information
+* @brief	Inhibits game status for running
 * @param	pGame Pointer to the game engine
 ******************************************************************************/
-void ShowInfo(TGame* pGame)
+void EndTheGame(TGame* pGame)
 {
 	assert(pGame);
-	assert(pGame->pVM);
+
+	pGame->bRun = false;
+}
+
+/*!****************************************************************************
+* @brief	Cleanup resources
+* @param	pGame Pointer to the game engine
+******************************************************************************/
+void Cleanup(TGame* pGame)
+{
+	assert(pGame);
+											// the setup may be still running
+	if( pGame->pStartup )
+	{
+		CleanupTaskPool(&pGame->pStartup->Pool);
+		delete pGame->pStartup;
+		pGame->pStartup = nullptr;
+	}
+
+	ApplyTheCommands(pGame);
+	CleanupJobSystem(&pGame->Jobs);
+
+	if( pGame->pNetplay )
+	{
+		CleanupTheNetplay(pGame->pNetplay);
+		delete pGame->pNetplay;
+		pGame->pNetplay = nullptr;
+	}
+
+	if( pGame->pSpectator )
+	{
+		CleanupTheSpectator(pGame->pSpectator);
+		delete pGame->pSpectator;
+		pGame->pSpectator = nullptr;
+	}
+
+	if( pGame->pReplay )
+	{
+		CleanupTheReplay(pGame->pReplay);
+		delete pGame->pReplay;
+		pGame->pReplay = nullptr;
+	}
+
+	delete pGame->pProfiler;
+	pGame->pProfiler = nullptr;
+
+	CleanupTheArena(&pGame->Arena);
+
+	DeleteShips(pGame);
+	DeleteAsteroids(pGame);
+	FreeTheSounds(pGame->pSM);
+
+	if( pGame->pArchive )
+	{
+		CloseTheArchive(pGame->pArchive);
+		delete pGame->pArchive;
+		pGame->pArchive = nullptr;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Deletes the ships
+* @param	pGame Pointer to the game engine
+******************************************************************************/
+void DeleteShips(TGame* pGame)
+{
+	assert(pGame);
+
+	for(int i=0; i<pGame->pShips.size(); ++i)
+	{
+		assert(pGame->pShips[i]);
+		delete pGame->pShips[i];
+	}
+
+	pGame->pShips.clear();
+}
+
+/*!****************************************************************************
+* @brief	Pausing the game
+* @param	pGame Pointer to the game engine
+******************************************************************************/
+void PauseTheGame(TGame* pGame)
+{
+	assert(pGame);
+
+	pGame->bPause = !pGame->bPause;
+}
+
+/*!****************************************************************************
+* @brief	Shows game information
+* @param	pGame Pointer to the game engine
+******************************************************************************/
+void ShowInfo(TGame* pGame)
+{
+	assert(pGame);
+	assert(pGame->pVM);
 
 	unsigned nW, nH;
 	GetClientSize(pGame, nW, nH);
@@ -675,6 +1242,37 @@ void ShowInfo(TGame* pGame)
 
 	sprintf(Buffer, "Score: %d", pGame->nScore);
 	DrawText(pGame->pVM, Buffer, nW - 96, 16);
+
+#ifdef _DEBUG
+	sprintf(Buffer, "Systems: %.2f ms, %u threads, %u asteroids",
+		pGame->SystemsTime * 1000.0, pGame->bSerial ? 1 : GetTheThreads(&pGame->Jobs),
+		GetTheCount(&pGame->World, arAsteroid));
+	DrawText(pGame->pVM, Buffer, nW/2.0, nH - 16);
+
+	if( pGame->pNetplay )
+	{
+		TNetplay* pNetplay = pGame->pNetplay;
+
+		sprintf(Buffer, "Net: %u rollbacks, depth %u/%u, %u stalls",
+			pNetplay->nRollbacks, pNetplay->nMaxDepth, GetTheStallDepth(pNetplay), pNetplay->nStalls);
+		DrawText(pGame->pVM, Buffer, nW/2.0, nH - 40);
+	}
+
+	if( pGame->pSpectator )
+	{
+		TSpectator* pSpectator = pGame->pSpectator;
+
+		sprintf(Buffer, "Spectators: %u, encode %.1f us, %u frames",
+			unsigned(pSpectator->Clients.size()), pSpectator->EncodeTime * 1e6, pSpectator->nFrames);
+		DrawText(pGame->pVM, Buffer, nW/2.0, nH - 64);
+	}
+
+	sprintf(Buffer, "Input: %.1f ms latency, %u dropped",
+		pGame->Input.Latency * 1000.0, pGame->Input.nDropped);
+	DrawText(pGame->pVM, Buffer, nW/2.0, nH - 88);
+#endif
+
+	if( pGame->pProfiler ) ShowTheProfiler(pGame->pProfiler, pGame->pVM);
 }
 
 /*!****************************************************************************
@@ -685,25 +1283,20 @@ void DeleteAsteroids(TGame* pGame)
 {
 	assert(pGame);
 
-												// cleaun-up the asteroid array
-	for(unsigned i=0; i<pGame->pAsteroids.size(); i++)
-	{
-		if( pGame->pAsteroids[i] ) delete pGame->pAsteroids[i];
-	}
-
-	pGame->pAsteroids.clear();
+	ClearTheArchetype(&pGame->World, arAsteroid);
 }
 
 /*!****************************************************************************
 * @brief	Builds the asteroids
 * @param	pGame Pointer to the game engine
 * @param	nCount Number of asteroids to be created
+* @note		Draws from the generator bound to the calling thread: the one
+*			of the game in the ticks, the one of the step in the setup
 ******************************************************************************/
 void BuildTheAsteroids(TGame* pGame, unsigned nCount)
 {
 	assert(pGame);
 	assert(pGame->pVM);
-
 												// firstly, clear the list
 	DeleteAsteroids(pGame);
 												// rebuild the asteroid's list
@@ -712,14 +1305,12 @@ void BuildTheAsteroids(TGame* pGame, unsigned nCount)
 		TVector2 Pos{ AbsRand(pGame->pVM->ClientArea.right), AbsRand(pGame->pVM->ClientArea.bottom) };
 		TVector2 Vel { Rand(ASTEROIDVEL) + ASTEROIDVEL/5.0, Rand(ASTEROIDVEL) + ASTEROIDVEL/5.0 };
 
-		TAsteroid *pAsteroid = new TAsteroid;
-		assert(pAsteroid);
-
-		Build(pAsteroid, pGame->pVM, acBig, Pos, Vel, ASTEROIDBIGSIZE + AbsRand(ASTEROIDBIGSIZE/10.0) );
-
-		assert(pAsteroid);
-		pGame->pAsteroids.push_back(pAsteroid);
+		AddTheEntity(&pGame->World,
+			MakeTheAsteroid(&pGame->World, acBig, Pos, Vel, ASTEROIDBIGSIZE + AbsRand(ASTEROIDBIGSIZE/10.0)) );
 	}
+											// the pieces of the level come
+											// from the pool, not from the heap
+	ReserveTheShapes(&pGame->World, nCount * ASTEROIDSHAPES, ASTEROID_MAXVERTS);
 }
 
 /*!****************************************************************************
@@ -783,21 +1374,8 @@ void ForceInsideLimits(TGame* pGame)
 			}
 		}
 	}
-											// force asteroids inside the scenery limits
-	for(int i=0; i<pGame->pAsteroids.size(); ++i)
-	{
-		if( pGame->pAsteroids[i] && IsAlive(pGame->pAsteroids[i]) )
-		{
-			TVector2 Pos = GetPos(pGame->pAsteroids[i]);
-
-			if( Pos.X < 0 ) Pos.X = nWidth;
-			if( Pos.X > nWidth ) Pos.X = 0;
-			if( Pos.Y < 0 ) Pos.Y = nHeight;
-			if( Pos.Y > nHeight ) Pos.Y = 0;
-
-			SetPos(pGame->pAsteroids[i], Pos);
-		}
-	}
+											// the asteroids are wrapped
+											// by WrapSystem()
 }
 
 /*!****************************************************************************
@@ -808,23 +1386,10 @@ void LevelHandler(TGame* pGame)
 {
 	assert(pGame);
 
-	bool bLevelCompleted = true;
-
-	for( int i=0; i<pGame->pAsteroids.size(); i++)
-	{
-		if( pGame->pAsteroids[i] )
-		{
-			if( IsAlive(pGame->pAsteroids[i]) )
-			{
-				bLevelCompleted = false;
-			}
-		}
-	}
+	bool bLevelCompleted = GetTheCount(&pGame->World, arAsteroid) == 0;
 											// se non ci sono piu` asteroidi ...
 	if( bLevelCompleted )
 	{
-		pGame->pAsteroids.clear();
-
 		NextLevel(pGame);
 	}
 }
@@ -842,20 +1407,21 @@ void BonusHandler(TGame* pGame)
 		pGame->nLives++;
 		pGame->nBonusCount++;
 
-		PlayTheSound(pGame->pSM, "bonus");
+		QueueTheSound(pGame->pSM, snBonus);
 	}
 }
 
 /*!****************************************************************************
 * @brief	Collision detection between ships and asteroids
-* @param	pAsteroid Pointer to the asteroid object
+* @param	Pos The position of the asteroid
+* @param	Radius The radius of the asteroid
 * @param	pShip Pointer to the ship object
 * @return	Returns true if objects collides, false otherwise
 ******************************************************************************/
-bool Collide(TAsteroid* pAsteroid, TShip* pShip)
+bool Collide(TVector2 Pos, double Radius, TShip* pShip)
 {
-//	return bool( Distance(pShip->Pos, pAsteroid->Pos) <= pAsteroid->Radius );
-	return bool( Distance(pShip->Pos, pAsteroid->Pos) <= ( pAsteroid->Radius + pShip->Size.X / 2.0));
+//	return bool( Distance(pShip->Pos, Pos) <= Radius );
+	return bool( Distance(pShip->Pos, Pos) <= ( Radius + pShip->Size.X / 2.0));
 }
 
 /*!****************************************************************************
@@ -872,15 +1438,14 @@ bool IsSafetyPos(TGame* pGame, TVector2 Pos)
 
 	bool bResult = true;
 
-	for(int i=0; i<pGame->pAsteroids.size(); ++i)
+	TArchetype& Asteroids = pGame->World.Archetypes[arAsteroid];
+
+	for(unsigned i=0; i<Asteroids.nCount; ++i)
 	{
-		if( pGame->pAsteroids[i] )
+		if( Distance( Asteroids.Pos[i], Pos) <= SAFETYDISTANCE)
 		{
-			if( Distance( GetPos(pGame->pAsteroids[i]), Pos) <= SAFETYDISTANCE)
-			{
-				bResult = false;
-				break;
-			}
+			bResult = false;
+			break;
 		}
 	}
 
@@ -903,23 +1468,21 @@ void GameOverHandler(TGame* pGame)
 	
 	TVector2 ScreenCenter = GetScreenCenter(pGame->pVM);
 
-	std::vector<std::string> strBestScores;
+											// the lines live one frame
+	TArenaStrings strBestScores(&pGame->Arena);
 	int nItems = std::min(int(BESTSCORES), int(pGame->BestScores.size()));
 
+	strBestScores.reserve(nItems + 3);
 	strBestScores.push_back("Best Scores:");
 	strBestScores.push_back(" ");
 	strBestScores.push_back(" ");
 
 	for(int i=0; i<nItems; i++)
 	{
-		char Buffer[256];
-
-		sprintf(Buffer, "%s   %d",
-			(char*)pGame->BestScores[i].strName.c_str(),
+		strBestScores.push_back(PrintInTheArena(&pGame->Arena, "%s   %d",
+			pGame->BestScores[i].strName.c_str(),
 			pGame->BestScores[i].nScore
-		);
-
-		strBestScores.push_back(Buffer);
+		));
 	}
 
 	if( (::GetTickCount() - nCurTick ) >= nTickDelay)
@@ -947,208 +1510,457 @@ void GameOverHandler(TGame* pGame)
 }
 
 /*!****************************************************************************
-* @brief	Handles collisions between all objects of the scenario
+* @brief	Adds an event to the events of the tick
 * @param	pGame Pointer to the game engine
+* @param	nType The event type, see enGameEvent
+* @param	nClass The class of the asteroid or of the ship hit
+* @param	nIndex The asteroid or the ship hit, or the missile lost
+* @param	nOther The missile or the asteroid hitting, -1 if none
 ******************************************************************************/
-void CollisionHandler(TGame* pGame)
+void EmitTheEvent(TGame* pGame, int nType, int nClass, int nIndex, int nOther)
 {
 	assert(pGame);
-											// check for collisions between ...
+	assert(nType >= 0 && nType < geCount);
+
+	TEventBus& Bus = pGame->EventBus;
+
+	Bus.Events.push_back(TGameEvent{ (unsigned char)nType, (unsigned char)nClass, nIndex, nOther });
+	Bus.nCounts[nType]++;
+}
+
+/*!****************************************************************************
+* @brief	Collision detection between all objects of the scenario
+* @param	pGame Pointer to the game engine
+* @note		No side effect on the objects: each collision is emitted as
+*			an event and the actors involved are marked as hit, so
+*			they can't collide again in the same tick
+******************************************************************************/
+void DetectTheCollisions(TGame* pGame)
+{
+	assert(pGame);
+
+	TEventBus& Bus = pGame->EventBus;
+
+	TArchetype& Asteroids = pGame->World.Archetypes[arAsteroid];
+	TArchetype& Missiles = pGame->World.Archetypes[arMissile];
+
+	Bus.HitAsteroids.assign(Asteroids.nCount, 0);
+	Bus.HitMissiles.assign(Missiles.nCount, 0);
+	Bus.HitShips.assign(pGame->pShips.size(), 0);
 
+	size_t nEvents = Bus.Events.size();
+	unsigned nTests = 0;
 											// ... ships and asteroids
-	for(int i=0; i<pGame->pAsteroids.size(); ++i)
+	for(unsigned i=0; i<Asteroids.nCount; ++i)
 	{
 		for(int j=0; j<pGame->pShips.size(); ++j)
 		{
-			if( pGame->pAsteroids[i] && IsAlive(pGame->pShips[j]) )
+			TShip* pShip = pGame->pShips[j];
+			nTests++;
+
+			if( !Bus.HitShips[j] && IsAlive(pShip) && Collide(Asteroids.Pos[i], Asteroids.Radius[i], pShip) )
 			{
-				if( Collide(pGame->pAsteroids[i], pGame->pShips[j]) )
-				{
-					delete pGame->pAsteroids[i];
-					pGame->pAsteroids[i] = nullptr;
-
-					Explode(pGame->pShips[j]);
-
-					if( GetClass(pGame->pShips[j]) == scHuman )
-					{
-						pGame->nLives--;
-
-						if( pGame->nLives == 0 )
-						{
-							GameOver(pGame);
-
-							if( IsBestScore(pGame) )
-							{
-								RegisterBestScore(pGame);
-								//pGame->bBestScore = true;
-							}
-						}
-					}
-				}
+				EmitTheEvent(pGame, geShipCrash, GetClass(pShip), j, i);
+
+				Bus.HitShips[j] = Bus.HitAsteroids[i] = 1;
+				break;
 			}
 		}
 	}
 											// ... missiles and ships
-
-	for(int i=0; i<pGame->pMissiles.size(); ++i)
+	for(unsigned i=0; i<Missiles.nCount; ++i)
 	{
-		TMissile *pMissile = pGame->pMissiles[i];
-
-		if( pMissile && IsArmed(pMissile) )
+		for(int j=0; j<pGame->pShips.size(); ++j)
 		{
-			for(int j=0; j<pGame->pShips.size(); ++j)
-			{
-				TShip* pShip = pGame->pShips[j];
-											
-				if( IsAlive(pShip)
-					&& pMissile
+			TShip* pShip = pGame->pShips[j];
+			nTests++;
 											// avoids that the missile destroy
-											// the ship itself that has shooted it
-					&& pMissile->pShip != pShip
-				)
-				{
-					if( IsColliding(pShip, GetPos(pMissile)) && !IsShieldActive(pShip) )
-					{
-						Explode(pShip);
-
-						delete pMissile;
-						pMissile = nullptr;
-						pGame->pMissiles[i] = nullptr;
-
-						if( GetClass(pShip) == scHuman )
-						{
-							pGame->nLives--;
-
-							if( pGame->nLives == 0 )
-							{
-								GameOver(pGame);
-							}
-						}
-						else if( GetClass(pShip) == scAlienBig )
-						{
-							pGame->nScore += BIGALIENSHIPSCORE;
-						}
-						else if( GetClass(pShip) == scAlienSmall )
-						{
-							pGame->nScore += SMALLALIENSHIPSCORE;
-						}
-					}
-				}
+											// the ship itself that has shooted it,
+											// or the other human ship
+			if( !Bus.HitShips[j] && IsAlive(pShip) && GetClass(Missiles.Owner[i]) != GetClass(pShip)
+				&& IsColliding(pShip, Missiles.Pos[i]) && !IsShieldActive(pShip) )
+			{
+				EmitTheEvent(pGame, geShipShot, GetClass(pShip), j, i);
+
+				Bus.HitShips[j] = Bus.HitMissiles[i] = 1;
+				break;
 			}
 		}
 	}
-
 											// ... missiles and asteroids
-	for(int i=0; i<pGame->pMissiles.size(); i++)
+	Bus.Contacts.clear();
+
+	CollideSystem(&pGame->World, arMissile, arAsteroid, Bus.HitMissiles, Bus.HitAsteroids, Bus.Contacts,
+		pGame->bSerial ? nullptr : &pGame->Jobs);
+
+	for(const TContact& Contact : Bus.Contacts)
 	{
-		TMissile* pMissile = pGame->pMissiles[i];
+		EmitTheEvent(pGame, geAsteroidShot, Asteroids.Class[Contact.nCircle], Contact.nCircle, Contact.nPoint);
+	}
 
-		if( pMissile && IsArmed(pMissile) )
+	CountThe(ctPairTests, nTests);
+	CountThe(ctHits, Bus.Events.size() - nEvents);
+											// ... missiles gone out of range (screen area)
+	for(unsigned i=0; i<Missiles.nCount; i++)
+	{
+		if( !Bus.HitMissiles[i] && !IsInsideGameArea(pGame, Missiles.Pos[i]) )
 		{
-			for(int j=0; j<pGame->pAsteroids.size(); ++j)
-			{
-				TAsteroid *pRoid = pGame->pAsteroids[j];
+			EmitTheEvent(pGame, geMissileLost, 0, i, -1);
 
-				if( pRoid && pMissile && Collide(pRoid, GetPos(pMissile) ) )
-				{
-					if( GetClass(pRoid) == acBig )
-					{
-						pGame->nScore += BIGASTEROIDSCORE;
-						PlayTheSound(pGame->pSM, "bang_large");
+			Bus.HitMissiles[i] = 1;
+		}
+	}
+}
 
-						TVector2 Pos, Vel;
-						Pos = GetPos(pRoid);
-						Vel = GetVel(pRoid);
+/*!****************************************************************************
+* @brief	Adds the points of the asteroids and of the alien ships shot
+* @param	pGame Pointer to the game engine
+******************************************************************************/
+void ScoreHandler(TGame* pGame)
+{
+	assert(pGame);
 
-						TVector2 RndVel1 {  Rand(Vel.X)/ASTEROIDVELRATIO, Rand(Vel.Y)/ASTEROIDVELRATIO };
+	static const int nAsteroidScores[] = { BIGASTEROIDSCORE, MIDASTEROIDSCORE, SMALLASTEROIDSCORE };
 
-						TVector2 Vel1 = Add(Vel, RndVel1);
+	for(const TGameEvent& Event : pGame->EventBus.Events)
+	{
+		if( Event.nType == geAsteroidShot )
+		{
+			pGame->nScore += nAsteroidScores[Event.nClass];
+		}
+		else if( Event.nType == geShipShot )
+		{
+			if( Event.nClass == scAlienBig ) pGame->nScore += BIGALIENSHIPSCORE;
+			else if( Event.nClass == scAlienSmall ) pGame->nScore += SMALLALIENSHIPSCORE;
+		}
+	}
+}
 
-						TAsteroid *pAsteroid = new TAsteroid;
-						assert(pAsteroid);
-						Build(pAsteroid, pGame->pVM, acMedium, Pos, Add(Vel, Vel1), ASTEROIDMIDSIZE + AbsRand(ASTEROIDMIDSIZE/4.0));
+/*!****************************************************************************
+* @brief	Queues the sounds of the asteroids shot
+* @param	pGame Pointer to the game engine
+* @note		The ships play their own sounds when they explode
+******************************************************************************/
+void SoundHandler(TGame* pGame)
+{
+	assert(pGame);
 
-						pAsteroid->bAlive = true;
+	static const int nBangs[] = { snBangLarge, snBangMedium, snBangSmall };
 
-						pGame->pAsteroids.push_back(pAsteroid);
+	for(const TGameEvent& Event : pGame->EventBus.Events)
+	{
+		if( Event.nType == geAsteroidShot )
+		{
+			QueueTheSound(pGame->pSM, nBangs[Event.nClass]);
+		}
+	}
+}
 
+/*!****************************************************************************
+* @brief	Splits the big and medium asteroids shot in two smaller ones
+* @param	pGame Pointer to the game engine
+* @note		The fragments enter the game at the end of the tick, so
+*			they can't be hit by the missiles of the same tick
+******************************************************************************/
+void SpawnHandler(TGame* pGame)
+{
+	assert(pGame);
 
-						TVector2 RndVel2 { Rand(Vel.X)/ASTEROIDVELRATIO, Rand(Vel.Y)/ASTEROIDVELRATIO };
+	TVecGameEvents& Events = pGame->EventBus.Events;
 
-						TVector2 Vel2 = Add(Vel, RndVel2);
+	for(int i=0; i<Events.size(); ++i)
+	{
+		if( Events[i].nType != geAsteroidShot || Events[i].nClass == acSmall ) continue;
 
-						pAsteroid = new TAsteroid;
-							
-						Build(pAsteroid, pGame->pVM, acMedium, Pos, Add(Vel, Vel2), ASTEROIDMIDSIZE + AbsRand(ASTEROIDMIDSIZE/4.0));
-						assert(pAsteroid);
-							
-						pAsteroid->bAlive = true;
+		TArchetype& Asteroids = pGame->World.Archetypes[arAsteroid];
 
-						pGame->pAsteroids.push_back(pAsteroid);
-					}
-					else if( GetClass(pRoid) == acMedium )
-					{
-						pGame->nScore += MIDASTEROIDSCORE;
-						PlayTheSound(pGame->pSM, "bang_medium");
+		enAsteroidClass nClass = Events[i].nClass == acBig ? acMedium : acSmall;
 
-						TVector2 Pos, Vel;
-						Pos = GetPos(pRoid);
-						Vel = GetVel(pRoid);
+		TVector2 Pos, Vel;
+		Pos = Asteroids.Pos[Events[i].nIndex];
+		Vel = Asteroids.Vel[Events[i].nIndex];
 
-						TVector2 RndVel1 {  Rand(Vel.X)/ASTEROIDVELRATIO, Rand(Vel.Y)/ASTEROIDVELRATIO };
-							
-						TVector2 Vel1 = Add(Vel, RndVel1);
+		for(int k=0; k<2; ++k)
+		{
+			TVector2 RndVel { Rand(Vel.X)/ASTEROIDVELRATIO, Rand(Vel.Y)/ASTEROIDVELRATIO };
 
-						TAsteroid *pAsteroid = new TAsteroid;
-						assert(pAsteroid);
+			TVector2 NewVel = Add(Vel, RndVel);
 
-						Build(pAsteroid, pGame->pVM, acSmall, Pos, Add(Vel, Vel1), ASTEROIDSMALLSIZE + AbsRand(ASTEROIDSMALLSIZE/2.0) );
+			double Radius = nClass == acMedium
+				? ASTEROIDMIDSIZE + AbsRand(ASTEROIDMIDSIZE/4.0)
+				: ASTEROIDSMALLSIZE + AbsRand(ASTEROIDSMALLSIZE/2.0);
 
-						pAsteroid->bAlive = true;
+			SpawnTheEntity(&pGame->World, MakeTheAsteroid(&pGame->World, nClass, Pos, Add(Vel, NewVel), Radius));
+		}
+	}
+}
 
-						pGame->pAsteroids.push_back(pAsteroid);
+/*!****************************************************************************
+* @brief	Removes the objects hit, explodes the ships hit and handles
+*			the lives of the human ship
+* @param	pGame Pointer to the game engine
+******************************************************************************/
+void LifecycleHandler(TGame* pGame)
+{
+	assert(pGame);
 
-						TVector2 RndVel2 { Rand(Vel.X)/ASTEROIDVELRATIO, Rand(Vel.Y)/ASTEROIDVELRATIO };
+	bool bLifeLost = false;
 
-						TVector2 Vel2 = Add(Vel, RndVel2);
+	for(const TGameEvent& Event : pGame->EventBus.Events)
+	{
+		switch( Event.nType )
+		{
+			case geShipCrash:
+				KillTheEntity(&pGame->World, arAsteroid, Event.nOther);
+			break;
 
-						pAsteroid = new TAsteroid;
-						assert(pAsteroid);
+			case geAsteroidShot:
+				KillTheEntity(&pGame->World, arAsteroid, Event.nIndex);
+				KillTheEntity(&pGame->World, arMissile, Event.nOther);
+			break;
 
-						Build(pAsteroid, pGame->pVM, acSmall, Pos, Add(Vel, Vel2), ASTEROIDSMALLSIZE + AbsRand(ASTEROIDSMALLSIZE/2.0) );
+			case geShipShot:
+				KillTheEntity(&pGame->World, arMissile, Event.nOther);
+			break;
 
-						pAsteroid->bAlive = true;
+			case geMissileLost:
+				KillTheEntity(&pGame->World, arMissile, Event.nIndex);
+			break;
+		}
 
-						pGame->pAsteroids.push_back(pAsteroid);
-					}
-					else
-					{
-						PlayTheSound(pGame->pSM, "bang_small");
+		if( Event.nType == geShipCrash || Event.nType == geShipShot )
+		{
+			Explode(pGame->pShips[Event.nIndex]);
 
-						pGame->nScore += SMALLASTEROIDSCORE;
-					}
+			if( Event.nClass == scHuman )
+			{
+				pGame->nLives--;
+				bLifeLost = true;
+			}
+		}
+	}
+											// the dialog is modal: opened when
+											// all the events have been handled
+	if( bLifeLost && pGame->nLives == 0 )
+	{
+		GameOver(pGame);
+											// not while re-simulating
+		if( IsBestScore(pGame) && !pGame->bHeadless )
+		{
+			RegisterBestScore(pGame);
+		}
+	}
+}
 
-					delete pGame->pAsteroids[j];
-					pGame->pAsteroids[j] = nullptr;
+/*!****************************************************************************
+* @brief	Applies the structural changes recorded during the tick
+* @param	pGame Pointer to the game engine
+* @note		See CommitTheWorld()
+******************************************************************************/
+void ApplyTheCommands(TGame* pGame)
+{
+	assert(pGame);
 
-					delete pMissile;
-					pGame->pMissiles[i] = pMissile = nullptr;
-				}
-			}
+	CommitTheWorld(&pGame->World);
+}
+
+/*!****************************************************************************
+* @brief	Builds the graph of the world systems run at every tick
+* @param	pGame Pointer to the game engine
+* @note		Each system runs in parallel over the rows, and the systems
+*			not depending on each other run at the same time: wrapping
+*			needs the new positions, the vertices need the new positions
+*			and rotations. The drawing is left out, to the main thread.
+******************************************************************************/
+void BuildTheSystems(TGame* pGame)
+{
+	assert(pGame);
+
+	TJobGraph* pGraph = &pGame->Systems;
+	TWorld* pWorld = &pGame->World;
+
+	auto GetTheJobs = [pGame]() { return pGame->bSerial ? nullptr : &pGame->Jobs; };
+
+	int nIntegrate = AddTheNode(pGraph, "integrate",
+		[=] { IntegrateSystem(pWorld, DT, GetTheJobs()); });
+
+	int nSpin = AddTheNode(pGraph, "spin",
+		[=] { SpinSystem(pWorld, GetTheJobs()); });
+
+	int nWrap = AddTheNode(pGraph, "wrap", [=]
+	{
+		unsigned nWidth, nHeight;
+		GetClientSize(pGame, nWidth, nHeight);
+
+		WrapSystem(pWorld, nWidth, nHeight, GetTheJobs());
+	});
+
+	AddTheNode(pGraph, "lifetime",
+		[=] { LifetimeSystem(pWorld, GetTheJobs()); });
+
+	int nTransform = AddTheNode(pGraph, "transform",
+		[=] { TransformSystem(pWorld, GetTheJobs()); });
+
+	AddTheDependency(pGraph, nWrap, nIntegrate);
+	AddTheDependency(pGraph, nTransform, nWrap);
+	AddTheDependency(pGraph, nTransform, nSpin);
+}
+
+/*!****************************************************************************
+* @brief	Adds many small asteroids at once, to stress the systems
+* @param	pGame Pointer to the game engine
+* @param	nCount The number of asteroids
+* @note		For debug only purpose: compare the systems time shown by
+*			ShowInfo(), in parallel and serially
+******************************************************************************/
+void StressTheWorld(TGame* pGame, unsigned nCount)
+{
+	assert(pGame);
+	assert(pGame->pVM);
+
+	UseTheRandom(&pGame->Random);
+
+	for(unsigned int i=0; i<nCount; i++)
+	{
+		TVector2 Pos{ AbsRand(pGame->pVM->ClientArea.right), AbsRand(pGame->pVM->ClientArea.bottom) };
+		TVector2 Vel { Rand(ASTEROIDVEL), Rand(ASTEROIDVEL) };
+
+		SpawnTheEntity(&pGame->World, MakeTheAsteroid(&pGame->World, acSmall, Pos, Vel, ASTEROIDSMALLSIZE));
+	}
+}
+
+/*!****************************************************************************
+* @brief	Compares the asteroids of two worlds, bit by bit
+* @param	A The asteroids of the first world
+* @param	B The asteroids of the second world
+* @return	Returns true if positions, rotations and vertices are the same
+******************************************************************************/
+static bool IsTheSameWorld(const TArchetype& A, const TArchetype& B)
+{
+	if( A.nCount != B.nCount ) return false;
+
+	for(unsigned i=0; i<A.nCount; ++i)
+	{
+		if( A.Pos[i].X != B.Pos[i].X || A.Pos[i].Y != B.Pos[i].Y || A.Rot[i] != B.Rot[i] ) return false;
+		if( A.Vertices[i].size() != B.Vertices[i].size() ) return false;
+
+		for(size_t j=0; j<A.Vertices[i].size(); ++j)
+		{
+			if( A.Vertices[i][j].X != B.Vertices[i][j].X || A.Vertices[i][j].Y != B.Vertices[i][j].Y ) return false;
 		}
 	}
 
-											// deletes the missiles that have gone out of range (screen area)
-	for(int i=0; i<pGame->pMissiles.size(); i++)
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Times the world systems of a headless game, with a fixed
+*			number of asteroids, on 1 to N threads
+* @param	pConfig "threads[:asteroids[:ticks]]", e.g. "8:20000:300";
+*			empty for the cores, STRESSASTEROIDS and STRESSTICKS
+* @return	Returns true if every run ends in the world of the serial
+*			one, false otherwise
+* @note		Each run starts from the same world and runs only the
+*			graph of the systems, as timed by ShowInfo(): the speedup
+*			is against the serial run
+******************************************************************************/
+bool RunTheStress(const char* pConfig)
+{
+	assert(pConfig);
+
+	unsigned nThreads = std::max(1u, std::thread::hardware_concurrency());
+	unsigned nAsteroids = STRESSASTEROIDS;
+	unsigned nTicks = STRESSTICKS;
+
+	if( *pConfig && (sscanf(pConfig, "%u:%u:%u", &nThreads, &nAsteroids, &nTicks) < 1
+		|| nThreads == 0 || nTicks == 0) ) return false;
+
+	TVecStrings strErrors;
+	TGame* pGame = CreateTheHeadlessGame(strErrors);
+
+	if( !pGame )
 	{
-		TMissile *pMissile = pGame->pMissiles[i];
+		for(const std::string& strError : strErrors) LogTheText((strError + "\n").c_str());
+		return false;
+	}
+
+	StartTheMatch(pGame);
+	StressTheWorld(pGame, nAsteroids);
+	CommitTheWorld(&pGame->World);
+											// every run starts from here
+	TArchetype Start[arCount];
+	for(int i=0; i<arCount; ++i) Start[i] = pGame->World.Archetypes[i];
 
-		if( pMissile && !IsInsideGameArea(pGame, GetPos(pMissile)) )
+	TArchetype Serial;
+	double SerialTime = 0;
+	bool bResult = true;
+
+	for(unsigned nRun=1; nRun<=nThreads; ++nRun)
+	{
+		for(int i=0; i<arCount; ++i)
+		{
+			pGame->World.Archetypes[i] = Start[i];
+			pGame->World.Kills[i].clear();
+		}
+
+		if( nRun > 1 ) SetupJobSystem(&pGame->Jobs, nRun - 1);
+		pGame->bSerial = nRun == 1;
+
+		double Time = GetTheTime();
+
+		for(unsigned i=0; i<nTicks; ++i)
 		{
-			delete pGame->pMissiles[i];
-			pGame->pMissiles[i] = nullptr;
+			RunTheGraph(pGame->bSerial ? nullptr : &pGame->Jobs, &pGame->Systems);
 		}
+
+		Time = (GetTheTime() - Time) / nTicks;
+
+		CleanupJobSystem(&pGame->Jobs);
+
+		bool bSame = true;
+
+		if( nRun == 1 )
+		{
+			Serial = pGame->World.Archetypes[arAsteroid];
+			SerialTime = Time;
+		}
+		else
+		{
+			bSame = IsTheSameWorld(Serial, pGame->World.Archetypes[arAsteroid]);
+		}
+
+		char Buffer[256];
+		sprintf(Buffer, "stress: %u asteroids, %u threads, %u ticks: %.3f ms per tick, %.2fx, %s\n",
+			GetTheCount(&pGame->World, arAsteroid), nRun, nTicks, Time * 1000.0, SerialTime / Time,
+			bSame ? "deterministic" : "DIFFERENT");
+		LogTheText(Buffer);
+
+		bResult = bSame && bResult;
 	}
+
+	DeleteTheHeadlessGame(pGame);
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Handles collisions between all objects of the scenario
+* @param	pGame Pointer to the game engine
+* @note		The detection emits the events of the tick, then each
+*			system handles them in batch
+******************************************************************************/
+void CollisionHandler(TGame* pGame)
+{
+	assert(pGame);
+
+	pGame->EventBus.Events.clear();
+
+	DetectTheCollisions(pGame);
+
+	ScoreHandler(pGame);
+	SoundHandler(pGame);
+	SpawnHandler(pGame);
+	LifecycleHandler(pGame);
 }
 
 /*!****************************************************************************
@@ -1175,32 +1987,31 @@ void Run(TGame* pGame)
 	assert(pGame->pShips[scAlienBig]);
 	assert(pGame->pShips[scAlienSmall]);
 
+	UseTheRandom(&pGame->Random);
+	pGame->nTick++;
 
-											// update the ships
-	for(int i=0; i<pGame->pShips.size(); ++i)
+	TProfiler* pProfiler = pGame->pProfiler;
+											// the stages of the tick are
+											// timed while profiling
 	{
-		Update(pGame->pShips[i], DT);
-	}
+		TProfileScope Scope(pProfiler, psShips);
+											// the commands of the players
+		ApplyTheInputs(pGame);
+											// update the ships
+		for(int i=0; i<pGame->pShips.size(); ++i)
+		{
+			Update(pGame->pShips[i], DT);
+		}
 											// if alien ships are active (visibles)
 											// then make many shoots against humans
-	{
-		static int nTickCount = 0;
-		nTickCount++;
+		pGame->nAlienShotTicks++;
 
-		if( nTickCount >= ALIENSHOTDELAY)
+		if( pGame->nAlienShotTicks >= ALIENSHOTDELAY)
 		{
-			nTickCount = 0;
+			pGame->nAlienShotTicks = 0;
 
 			if( IsVisible(pGame->pShips[scAlienBig]) )
 			{
-				TMissile *pMissile = new TMissile;
-				assert(pMissile);
-				Build(pMissile, pGame->pVM);
-
-				pMissile->pShip = pGame->pShips[scAlienBig];
-
-				pGame->pMissiles.push_back(pMissile);
-
 				{
 					TVector2 AlienPos = GetPos(pGame->pShips[scAlienBig]);
 					TVector2 HumanPos = GetPos(pGame->pShips[scHuman]);
@@ -1217,20 +2028,12 @@ void Run(TGame* pGame)
 
 					//TVector2 ShipVel = GetVel(pGame->pShips[scAlienBig]);
 
-					Arm(pMissile, AlienPos, Vel );
+					SpawnTheEntity(&pGame->World, MakeTheMissile(pGame->pShips[scAlienBig], AlienPos, Vel));
 				}
 			}
 			
 			if( IsVisible(pGame->pShips[scAlienSmall]) )
 			{
-				TMissile *pMissile = new TMissile;
-				assert(pMissile);
-				Build(pMissile, pGame->pVM);
-
-				pMissile->pShip = pGame->pShips[scAlienSmall];
-
-				pGame->pMissiles.push_back(pMissile);
-
 				{
 					TVector2 AlienPos = GetPos(pGame->pShips[scAlienSmall]);
 					TVector2 HumanPos = GetPos(pGame->pShips[scHuman]);
@@ -1247,78 +2050,108 @@ void Run(TGame* pGame)
 
 					//TVector2 ShipVel = GetVel(pGame->pShips[scAlienSmall]);
 
-					Arm(pMissile, AlienPos, Vel );
+					SpawnTheEntity(&pGame->World, MakeTheMissile(pGame->pShips[scAlienSmall], AlienPos, Vel));
 				}
 			}
 		}
 	}
-											// update the missiles
-	for(int i=0; i<pGame->pMissiles.size(); i++)
+											// update the asteroids and the missiles
 	{
-		TMissile* pMissile = pGame->pMissiles[i];
+		TProfileScope Scope(pProfiler, psWorld);
 
-		if ( pMissile && IsArmed(pMissile) )
-		{
-			Update(pMissile, DT);
-		}
-	}
-											// update the asteroids
-	unsigned nWidth, nHeight;
-	GetClientSize(pGame, nWidth, nHeight);
-
-	for(int i=0; i<pGame->pAsteroids.size(); ++i)
-	{
-		TAsteroid *pAsteroid = pGame->pAsteroids[i];
+		double Time = GetTheTime();
 
-		if( pAsteroid && IsAlive(pAsteroid) )
-		{
-			Update(pAsteroid, DT);
-
-			TVector2 Pos = GetPos(pAsteroid);
+		RunTheGraph(pGame->bSerial ? nullptr : &pGame->Jobs, &pGame->Systems);
 
-			if( Pos.X < 0 ) Pos.X = nWidth;
-			if( Pos.X > nWidth ) Pos.X = 0;
-			if( Pos.Y < 0 ) Pos.Y = nHeight;
-			if( Pos.Y > nHeight ) Pos.Y = 0;
+		pGame->SystemsTime += 0.05 * (GetTheTime() - Time - pGame->SystemsTime);
+	}
+											// GDI wants a single thread
+	if( !pGame->bHeadless )
+	{
+		TProfileScope Scope(pProfiler, psDraw);
 
-			SetPos(pAsteroid, Pos);
-		}
+		DrawSystem(&pGame->World, pGame->pVM);
 	}
 											// forces actors inside of scenery limits
-	ForceInsideLimits(pGame);
+	{
+		TProfileScope Scope(pProfiler, psLimits);
+
+		ForceInsideLimits(pGame);
+	}
 
 	if( !IsGameOver(pGame) )
 	{
 		TVector2 ScreenCenter = GetScreenCenter(pGame->pVM);
 
-		if ( IsSafetyPos(pGame, ScreenCenter)
-			&& !IsAlive(pGame->pShips[scHuman])
-			&& !IsExploding(pGame->pShips[scHuman]) )
+		for(int i=0; i<pGame->nPlayers; ++i)
 		{
-			Reset(pGame->pShips[scHuman]);
-			SetPos(pGame->pShips[scHuman], ScreenCenter );
-			SetRot(pGame->pShips[scHuman], 180.0);
-			SetVel(pGame->pShips[scHuman], TVector2{0,0} );
-			SetAlive(pGame->pShips[scHuman], true);
-			SetVisible(pGame->pShips[scHuman], true);
+			TShip* pShip = GetThePlayer(pGame, i);
+			TVector2 Pos{ ScreenCenter.X + i * 4.0*SHIP_SIZE, ScreenCenter.Y };
+
+			if ( IsSafetyPos(pGame, Pos)
+				&& !IsAlive(pShip)
+				&& !IsExploding(pShip) )
+			{
+				Reset(pShip);
+				SetPos(pShip, Pos );
+				SetRot(pShip, 180.0);
+				SetVel(pShip, TVector2{0,0} );
+				SetAlive(pShip, true);
+				SetVisible(pShip, true);
+			}
 		}
 
 		AlienShipsHandler(pGame);
 
-		CollisionHandler(pGame);
+		{
+			TProfileScope Scope(pProfiler, psCollisions);
+
+			CollisionHandler(pGame);
+		}
 
-		BonusHandler(pGame);
+		{
+			TProfileScope Scope(pProfiler, psBonus);
 
-		LevelHandler(pGame);
+			BonusHandler(pGame);
+		}
 	}
 	else
 	{
 #ifndef _DEVEL
-		GameOverHandler(pGame);
+		if( !pGame->bHeadless ) GameOverHandler(pGame);
 #endif
+	}
+											// applies the spawns and the
+											// removals of the tick
+	{
+		TProfileScope Scope(pProfiler, psCommit);
+
+		ApplyTheCommands(pGame);
+	}
+
+	if( !IsGameOver(pGame) )
+	{
+		TProfileScope Scope(pProfiler, psLevel);
+
+		LevelHandler(pGame);
 	}
 											// show info (help, ships, score, etc...)
-	ShowInfo(pGame);
+	if( !pGame->bHeadless )
+	{
+		TProfileScope Scope(pProfiler, psInfo);
+
+		ShowInfo(pGame);
+	}
+											// plays the sounds of the tick, once
+	{
+		TProfileScope Scope(pProfiler, psSounds);
+
+		FlushTheSounds(pGame->pSM);
+	}
+
+	CountThe(ctTicks, 1);
+	CountThe(ctAsteroids, GetTheCount(&pGame->World, arAsteroid));
+	CountThe(ctMissiles, GetTheCount(&pGame->World, arMissile));
 }
 
 /*!****************************************************************************
@@ -1329,16 +2162,14 @@ void AlienShipsHandler(TGame* pGame)
 {
 	assert(pGame);
 
-	static int nAlienShipTick = ALIENSHIPTICK + Rand(ALIENSHIPTICK/2);
-
-	nAlienShipTick--;
+	pGame->nAlienShipTick--;
 
 	TShip* pShip = RandSign() >= 0 ? pGame->pShips[scAlienBig] : pGame->pShips[scAlienSmall];
 	assert(pShip);
 
-	if( nAlienShipTick == 0 )
+	if( pGame->nAlienShipTick == 0 )
 	{
-		nAlienShipTick = ALIENSHIPTICK + Rand(ALIENSHIPTICK/2);
+		pGame->nAlienShipTick = ALIENSHIPTICK + Rand(ALIENSHIPTICK/2);
 
 		if( !IsVisible(pShip) )
 		{
@@ -1374,22 +2205,12 @@ HWND GetMainWnd(TGame* pGame)
 bool IsBestScore(TGame* pGame)
 {
 	assert(pGame);
-	
-	bool bResult = false;
 
 	int nCount = std::min(int(BESTSCORES), int(pGame->BestScores.size()));
 
-											// linear search
-	for(int i=0; i<nCount; i++)
-	{
-		if( pGame->nScore > pGame->BestScores[i].nScore )
-		{
-			bResult = true;
-			break;
-		}
-	}
-
-	return bResult;
+											// sorted: the last one shown
+											// is the one to beat
+	return nCount > 0 && pGame->nScore > int(pGame->BestScores[nCount-1].nScore);
 }
 
 /*!****************************************************************************
@@ -1400,6 +2221,7 @@ void RegisterBestScore(TGame* pGame)
 {
 	assert(pGame);
 
+#ifndef __linux__							// no window on Linux
 	pGame->bBestScoreDlgActive = true;
 		::DialogBox(NULL, MAKEINTRESOURCE(IDD_RECORDS), GetMainWnd(pGame), (DLGPROC) BestScoresDlgProc);
 	pGame->bBestScoreDlgActive = false;
@@ -1408,6 +2230,7 @@ void RegisterBestScore(TGame* pGame)
 	{
 		SaveBestScores(pGame);
 	}
+#endif
 }
 
 /*!****************************************************************************
@@ -1437,74 +2260,16 @@ void SaveBestScores(TGame* pGame)
 	BestScore.strName = strName;
 	BestScore.nScore = pGame->nScore;
 
-	pGame->BestScores.push_back(BestScore);
-
-											// false -> sort from bigger to lower
-	Sort(pGame->BestScores, false);	
-
-											// save (append) the score to file
-	std::string strScoresFile = std::string(GetDataPath()) + std::string(SCORESFILE);
-
-											// "a" -> open in "append" mode
-	FILE *fp = fopen(strScoresFile.c_str(), "a");
-
-	if( fp )
+											// the whole table is written
+											// again, atomically
+	if( InsertTheScore(pGame->BestScores, BestScore) )
 	{
-		fprintf(fp, "%s,%d\n", BestScore.strName.c_str(), BestScore.nScore);
+		std::string strScoresFile = std::string(GetDataPath()) + std::string(SCORESFILE);
 
-		fclose(fp);
+		WriteTheFile(strScoresFile, FormatTheBestScores(pGame->BestScores));
 	}
 }
 
-/*!****************************************************************************
-* @brief	Reorder best scores
-* @param	Scores	Reference to a vector of best scores data structures
-* @param	bAscending Sets the reordering mode, true for ascending order
-******************************************************************************/
-void Sort(TVecRecordScores& Scores, bool bAscending)
-{
-
-	for(int i=0; i<Scores.size(); i++)
-	{
-		for(int j=i+1; j<Scores.size(); j++)
-		{
-			if( bAscending )
-			{
-				if( Scores[i].nScore> Scores[j].nScore)
-				{
-#ifdef _MSC_VER
-					std::swap(Scores[i], Scores[j]);
-#else
-					Swap(Scores[i], Scores[j]);
-#endif
-				}
-			}
-			else
-			{
-				if( Scores[i].nScore< Scores[j].nScore)
-				{
-#ifdef _MSC_VER
-					std::swap(Scores[i], Scores[j]);
-#else
-					Swap(Scores[i], Scores[j]);
-#endif
-				}
-			}
-		}
-	}
-
-}
-
-#ifndef _MSC_VER
-	void Swap(TRecordScores& T1, TRecordScores& T2)
-	{
-		TRecordScores Temp = T1;
-
-		T1 = T2;
-		T2 = Temp;
-	}
-#endif
-
 /*!****************************************************************************
 * @brief	Gets the size of the client area
 * @param	pGame Pointer to the game engine
@@ -1,7 +1,7 @@
 #ifndef _GAME_H_
 #define _GAME_H_
 
-#include <windows.h>
+#include "platform.h"
 #include <map>
 #include <string>
 #include <vector>
@@ -13,12 +13,83 @@
 
 #include "audio.h"
 #include "video.h"
+#include "tasks.h"
+#include "archive.h"
+#include "arena.h"
+#include "input.h"
 
+#include "ecs.h"
 #include "ships.h"
 #include "weapons.h"
 #include "asteroids.h"
 
 
+#define STRESSASTEROIDS		20000	///< asteroids added by the stress test
+#define STRESSTICKS			300		///< ticks timed by RunTheStress(), per run
+
+#define DT					0.1		///< seconds of game time per tick
+
+#define MAXPLAYERS			2
+#define PLAYER2SHIP			3		///< index of the second human ship, in pShips
+
+
+struct TNetplay;
+struct TSpectator;
+struct TReplay;
+struct TProfiler;
+
+
+							// sound handles, in the same order
+							// as they are loaded by LoadTheSounds()
+enum enSoundId {
+	snBonus, snShield, snShipFire,
+	snBangLarge, snBangMedium, snBangSmall,
+	snSaucerBig, snSaucerSmall,
+	snShipThrust, snShipExplosion,
+	snStarwarsTrails,
+	snCount
+};
+
+							// commands of a player for a tick,
+							// see ApplyTheInputs()
+enum enInput {
+	inLeft		= 1 << 0,
+	inRight		= 1 << 1,
+	inThrust	= 1 << 2,
+	inFire		= 1 << 3,
+	inShield	= 1 << 4,
+	inRestart	= 1 << 5
+};
+
+							// events of a tick, emitted by the
+							// collision detection
+enum enGameEvent {
+	geAsteroidShot,				///< asteroid hit by a missile
+	geShipShot,					///< ship hit by a missile
+	geShipCrash,				///< ship hit by an asteroid
+	geMissileLost,				///< missile gone out of the game area
+	geCount
+};
+
+struct TGameEvent
+{
+	unsigned char nType;		///< see enGameEvent
+	unsigned char nClass;		///< class of the asteroid or of the ship hit
+	int nIndex;					///< asteroid or ship hit, or the missile lost
+	int nOther;					///< missile or asteroid hitting, -1 if none
+};
+
+typedef std::vector<TGameEvent> TVecGameEvents;
+
+struct TEventBus
+{
+	TVecGameEvents Events;		///< cleared at every tick, keeps its capacity
+								// actors already hit in the tick
+	TVecFlags HitAsteroids, HitMissiles, HitShips;
+	TVecContacts Contacts;
+	unsigned nCounts[geCount];	///< events since the start, for telemetry
+};
+
 struct TRecordScores
 {
 	unsigned nScore;
@@ -28,18 +99,53 @@ struct TRecordScores
 typedef std::vector<std::string> TVecStrings;
 typedef std::vector<TRecordScores> TVecRecordScores;
 
+struct TStartup
+{
+	TTaskPool Pool;
+	TTimeline Timeline;
+
+	std::mutex Mutex;
+	TVecStrings strErrors;			///< failed setup steps
+	bool bFirstFrame;
+};
+
 struct TGame
 {
 	TVideoManager* pVM;
 	TSoundManager* pSM;
+	TArchive* pArchive;				///< packed assets, nullptr for loose files
+	TStartup* pStartup;				///< not null while the setup is running
 
 	bool bRun, bPause, bGameOver;
 	TVecPtrShips pShips;
 
-	TVecPtrMissiles pMissiles;
-	TVecPtrAsteroids pAsteroids;
+	TWorld World;					///< asteroids and missiles
+	TWorld LoadedWorld;				///< scratch, decoded by LoadTheSnapshot() then swapped in
+	TEventBus EventBus;
+
+	TJobSystem Jobs;
+	TJobGraph Systems;				///< the world systems of a tick, see BuildTheSystems()
+	bool bSerial;					///< runs the systems on the main thread only
+	double SystemsTime;				///< seconds, smoothed
 	int nScore, nLevel, nDifficulty, nLives, nBonusCount;
 
+	int nPlayers;					///< human ships, 2 when playing over the network
+	unsigned char nInputs[MAXPLAYERS];	///< of the next tick, see enInput
+	TInputQueue Input;				///< events of the local player, sampled into nInputs
+	TNetplay* pNetplay;				///< nullptr when playing alone
+	TSpectator* pSpectator;			///< nullptr when nobody watches
+	TReplay* pReplay;				///< not null when watching a stream, instead of playing
+	TProfiler* pProfiler;			///< nullptr when not profiling
+	TArena Arena;					///< data of a frame, emptied by MainLoop()
+
+	TRandom Random;					///< used by Rand() while the game runs
+	uint64_t nSeed;					///< of the generator, at the setup or at the match
+	unsigned nTick;					///< ticks since the setup
+	unsigned nShotTick[MAXPLAYERS];	///< tick of the last shot of each human ship
+	int nAlienShotTicks;			///< ticks since the last shots of the alien ships
+	int nAlienShipTick;				///< ticks to the next appearance of an alien ship
+	bool bHeadless;					///< runs without drawing and without sounds
+
 	TVecStrings strHelp;
 								// best score dialog
 	WCHAR pBestScoresName[256];
@@ -49,7 +155,10 @@ struct TGame
 };
 
 
-bool Setup(TGame* pGame, TVideoManager* pVM, TSoundManager* pSM);
+bool Setup(TGame* pGame, TVideoManager* pVM, TSoundManager* pSM, uint64_t nSeed=RANDSEED, bool bHeadless=false);
+void RunTheSetupStep(TGame* pGame, int nStep, uint64_t nSeed);
+bool PollTheSetup(TGame* pGame);
+bool IsStarting(TGame* pGame);
 
 void Cleanup(TGame* pGame);
 void Restart(TGame* pGame);
@@ -64,8 +173,17 @@ bool IsSafetyPos(TGame* pGame, TVector2 Pos);
 
 void ShotTheMissile(TGame* pGame, TShip* pShip);
 
+TShip* GetThePlayer(TGame* pGame, int nPlayer);
+void SetTheInput(TGame* pGame, unsigned char nInput);
+void ApplyTheInputs(TGame* pGame);
+void StartTheMatch(TGame* pGame, uint64_t nSeed=RANDSEED);
+
 void GetClientSize(TGame* pGame, unsigned& nW, unsigned& nH);
 
+void SetHeadless(TGame* pGame, bool bHeadless);
+TGame* CreateTheHeadlessGame(TVecStrings& strErrors);
+void DeleteTheHeadlessGame(TGame* pGame);
+
 void EndTheGame(TGame* pGame);
 void PauseTheGame(TGame* pGame);
 bool IsPausing(TGame* pGame);
@@ -79,9 +197,17 @@ bool LoadTheSounds(TGame* pGame);
 bool IsBestScore(TGame* pGame);
 void RegisterBestScore(TGame* pGame);
 void SaveBestScores(TGame* pGame);
+bool LoadTheBestScores(TGame* pGame);
 bool LoadTheBestScores(TGame* pGame, char* pFileName);
+void ParseTheBestScores(TGame* pGame, const char* pText, unsigned nSize);
+std::string FormatTheBestScores(const TVecRecordScores& Scores);
+bool InsertTheScore(TVecRecordScores& Scores, const TRecordScores& Score);
+
+bool OpenTheArchive(TGame* pGame);
+bool GetTheAsset(TGame* pGame, const char* pName, const unsigned char** ppData, unsigned* pnSize);
 
 bool BuildTheFonts(TGame* pGame);
+bool BuildTheAsteroids(TGame* pGame);
 void BuildTheAsteroids(TGame* pGame, unsigned nCount);
 void DeleteAsteroids(TGame* pGame);
 
@@ -96,8 +222,20 @@ void LevelHandler(TGame* pGame);
 void BonusHandler(TGame* pGame);
 void CollisionHandler(TGame* pGame);
 
-bool Collide(TMissile* pMissile, TShip* pShip);
-bool Collide(TAsteroid* pAsteroid, TShip* pShip);
+void EmitTheEvent(TGame* pGame, int nType, int nClass, int nIndex, int nOther);
+void DetectTheCollisions(TGame* pGame);
+void ScoreHandler(TGame* pGame);
+void SoundHandler(TGame* pGame);
+void SpawnHandler(TGame* pGame);
+void LifecycleHandler(TGame* pGame);
+
+void ApplyTheCommands(TGame* pGame);
+
+void BuildTheSystems(TGame* pGame);
+void StressTheWorld(TGame* pGame, unsigned nCount);
+bool RunTheStress(const char* pConfig);
+
+bool Collide(TVector2 Pos, double Radius, TShip* pShip);
 
 bool IsInputDialog(TGame* pGame);
 
@@ -107,11 +245,5 @@ void AlienShipsHandler(TGame* pGame);
 
 HWND GetMainWnd(TGame* pGame);
 
-#ifndef _MSC_VER
-	void Swap(TRecordScores& T1, TRecordScores& T2);
-#endif
-
-void Sort(TVecRecordScores& Scores, bool bAscending=true);
-
 #endif
 
@@ -0,0 +1,116 @@
+/*!****************************************************************************
+
+	@file	headless.cpp
+
+	@brief	The Linux build: the headless modes of asteroids-2k.cpp (the
+			server, the batches and the checks), with a null video and
+			a null audio backend in place of GDI and OpenAL
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#ifdef __linux__
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "audio.h"
+#include "video.h"
+
+#include "game.h"
+#include "utils.h"
+#include "commdefs.h"
+#include "server.h"
+#include "batch.h"
+#include "mixer.h"
+#include "snapshot.h"
+#include "counters.h"
+#include "allocs.h"
+
+
+
+/*!****************************************************************************
+* @noop	The null video backend: the headless games draw nothing
+******************************************************************************/
+TVector2 GetScreenCenter(TVideoManager* pVM)
+{
+	assert(pVM);
+
+	return TVector2 { pVM->ClientArea.right/2.0, pVM->ClientArea.bottom/2.0 };
+}
+
+void DrawLines(TVideoManager* pVM, TVecPoints& Pts, int nLineWidth, COLORREF Color, bool bClosed) {}
+void DrawLines(TVideoManager* pVM, TVecVecPoints& Pts, int nLineWidth, COLORREF Color, bool bClosed) {}
+void DrawPoint(TVideoManager* pVM, TVector2& Pt, COLORREF Color) {}
+void ClearScreen(TVideoManager* pVM, COLORREF Color) {}
+
+bool LoadFont(TVideoManager* pVM, std::string strFontPath, std::wstring strName, int nSize) { return true; }
+bool LoadFont(TVideoManager* pVM, const unsigned char* pData, unsigned nDataSize, std::wstring strName, int nSize) { return true; }
+void SelectTheFont(TVideoManager* pVM) {}
+
+void DrawText(TVideoManager* pVM, char* pText, int nX, int nY, COLORREF nColor, UINT nAlign) {}
+void DrawText(TVideoManager* pVM, const std::vector<std::string>& StringList, int nX, int nY,
+	int nTextH, COLORREF nColor, UINT nAlign) {}
+void DrawText(TVideoManager* pVM, const TArenaStrings& StringList, int nX, int nY,
+	int nTextH, COLORREF nColor, UINT nAlign) {}
+
+/*!****************************************************************************
+* @noop	The null audio backend: the headless games are muted, and
+*		load no sounds
+******************************************************************************/
+bool LoadTheSounds(TSoundManager* pSM, const std::vector<std::string>& strSounds, TArchive* pArchive) { return true; }
+void FreeTheSounds(TSoundManager* pSM) {}
+void SetSoundPriority(TSoundManager* pSM, int nSound, int nPriority, int nMaxVoices) {}
+void SetSoundRateLimit(TSoundManager* pSM, int nSound, int nMinTicks, bool bScaleGain) {}
+void PlayTheSound(TSoundManager* pSM, int nSound, bool bLoop, double Gain) {}
+void QueueTheSound(TSoundManager* pSM, int nSound, bool bLoop) {}
+void FlushTheSounds(TSoundManager* pSM) {}
+void StopTheSound(TSoundManager* pSM, int nSound) {}
+void StopAllSounds(TSoundManager* pSM) {}
+
+/*!****************************************************************************
+* @brief	The Linux entry point: runs the headless mode chosen by the
+*			environment, as WinMain() does before opening the window
+* @return	0 for success, 1 otherwise
+******************************************************************************/
+int main()
+{
+											// the counters of the hot paths,
+											// for tools/a2kstat, in any mode
+	const char* pCounters = getenv(COUNTERSVAR);
+
+	if( pCounters ) OpenTheCounters(*pCounters ? pCounters : COUNTERSNAME);
+
+	const char* pServer = getenv(SERVERVAR);
+	const char* pBatch = getenv(BATCHVAR);
+	const char* pAllocCheck = getenv(ALLOCCHECKVAR);
+	const char* pMixCheck = getenv(MIXCHECKVAR);
+	const char* pSnapCheck = getenv(SNAPCHECKVAR);
+	const char* pStress = getenv(STRESSVAR);
+
+	if( !pServer && !pBatch && !pAllocCheck && !pMixCheck && !pSnapCheck && !pStress )
+	{
+		LogTheText("no window on Linux: set " SERVERVAR ", " BATCHVAR ", "
+			ALLOCCHECKVAR ", " MIXCHECKVAR ", " SNAPCHECKVAR " or " STRESSVAR "\n");
+
+		CloseTheCounters();
+		return 1;
+	}
+
+	bool bResult = pServer ? RunTheServer(pServer)
+		: pBatch ? RunTheBatch(pBatch)
+		: pAllocCheck ? RunTheAllocCheck(pAllocCheck)
+		: pMixCheck ? VerifyTheMixer(*pMixCheck ? pMixCheck : MIXCHECKFILE)
+		: pSnapCheck ? RunTheSnapshotCheck(pSnapCheck)
+		: RunTheStress(pStress);
+
+	CloseTheCounters();
+
+	return bResult ? 0 : 1;
+}
+
+#endif
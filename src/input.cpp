@@ -0,0 +1,159 @@
+/*!****************************************************************************
+
+	@file	input.h
+	@file	input.cpp
+
+	@brief	Queue of the input events, with their timestamps: pushed as
+			they happen (by the window messages, or by a bot) and sampled
+			at the start of a tick, as levels (held down) and as edges
+			(pressed), so that a tap between two ticks is not lost.
+			Platform neutral.
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include <assert.h>
+
+#include "input.h"
+
+
+#define LATENCYWEIGHT		0.05			///< of a sample, in the smoothed latency
+
+
+
+/*!****************************************************************************
+* @brief	Sets-up an empty queue, nothing held
+* @param	pQueue Pointer to the queue
+******************************************************************************/
+void SetupTheInput(TInputQueue* pQueue)
+{
+	assert(pQueue);
+
+	pQueue->nHead = 0;
+	pQueue->nTail = 0;
+	pQueue->nPushed = 0;
+	pQueue->nDropped = 0;
+
+	pQueue->nHeld = 0;
+	pQueue->nPressed = 0;
+	pQueue->Latency = 0;
+}
+
+/*!****************************************************************************
+* @brief	Pushes the press or the release of a command
+* @param	pQueue Pointer to the queue
+* @param	nCommand The command, a single bit (see enInput)
+* @param	bDown True for a press, false for a release
+* @param	Time When it happened, in seconds, see GetTheTime()
+* @return	Returns true if queued, false if it changes nothing (e.g. the
+*			auto-repeat of a key) or if the queue is full
+* @note		Lock-free, from the producer thread only
+******************************************************************************/
+bool PushTheInput(TInputQueue* pQueue, unsigned char nCommand, bool bDown, double Time)
+{
+	assert(pQueue);
+	assert(nCommand && !(nCommand & (nCommand - 1)));
+
+	if( bool(pQueue->nPushed & nCommand) == bDown ) return false;
+
+	unsigned nTail = pQueue->nTail.load(std::memory_order_relaxed);
+
+	if( nTail - pQueue->nHead.load(std::memory_order_acquire) >= INPUTQUEUESIZE )
+	{
+		pQueue->nDropped++;
+		return false;
+	}
+
+	TInputEvent& Event = pQueue->Events[nTail & (INPUTQUEUESIZE - 1)];
+
+	Event.Time = Time;
+	Event.nCommand = nCommand;
+	Event.bDown = bDown;
+
+	pQueue->nTail.store(nTail + 1, std::memory_order_release);
+
+	if( bDown ) pQueue->nPushed |= nCommand;
+	else pQueue->nPushed &= ~nCommand;
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Pushes the commands held down by a bot, as the presses and the
+*			releases that lead to them
+* @param	pQueue Pointer to the queue
+* @param	nCommands The commands held, see enInput
+* @param	Time When they are held, in seconds
+* @note		Sampled at the same time they give back nCommands, as if
+*			they were set directly
+******************************************************************************/
+void PushTheCommands(TInputQueue* pQueue, unsigned char nCommands, double Time)
+{
+	assert(pQueue);
+
+	unsigned char nChanged = nCommands ^ pQueue->nPushed;
+
+	for(unsigned nBit=1; nBit<256; nBit<<=1)
+	{
+		if( nChanged & nBit ) PushTheInput(pQueue, (unsigned char) nBit, (nCommands & nBit) != 0, Time);
+	}
+}
+
+/*!****************************************************************************
+* @brief	Samples the commands of a tick
+* @param	pQueue Pointer to the queue
+* @param	Time The start of the tick, in seconds
+* @return	The commands of the tick: the ones held, and the ones pressed
+*			since a tick last took them, even if already released
+* @note		Consumes the events up to Time, in their order; the later
+*			ones are left to the next tick. The edges add up until a
+*			tick takes them, see ConsumeTheInput(), so a tap sampled on
+*			a frame that runs no tick (a stall of the netplay, a pause)
+*			is not lost. Lock-free, from the consumer thread only.
+******************************************************************************/
+unsigned char SampleTheInput(TInputQueue* pQueue, double Time)
+{
+	assert(pQueue);
+
+	unsigned nHead = pQueue->nHead.load(std::memory_order_relaxed);
+	unsigned nTail = pQueue->nTail.load(std::memory_order_acquire);
+
+	for(; nHead != nTail; ++nHead)
+	{
+		const TInputEvent& Event = pQueue->Events[nHead & (INPUTQUEUESIZE - 1)];
+
+		if( Event.Time > Time ) break;
+
+		if( Event.bDown )
+		{
+			pQueue->nHeld |= Event.nCommand;
+			pQueue->nPressed |= Event.nCommand;
+
+			pQueue->Latency += LATENCYWEIGHT * (Time - Event.Time - pQueue->Latency);
+		}
+		else
+		{
+			pQueue->nHeld &= ~Event.nCommand;
+		}
+	}
+
+	pQueue->nHead.store(nHead, std::memory_order_release);
+
+	return pQueue->nHeld | pQueue->nPressed;
+}
+
+/*!****************************************************************************
+* @brief	Clears the edges sampled so far, once a tick has taken them
+* @param	pQueue Pointer to the queue
+* @note		From the consumer thread only, after the commands returned by
+*			SampleTheInput() went into a tick
+******************************************************************************/
+void ConsumeTheInput(TInputQueue* pQueue)
+{
+	assert(pQueue);
+
+	pQueue->nPressed = 0;
+}
@@ -0,0 +1,38 @@
+
+#ifndef _INPUT_H_
+#define _INPUT_H_
+
+#include <atomic>
+
+
+#define INPUTQUEUESIZE		256				///< events in the queue, a power of 2
+
+
+struct TInputEvent
+{
+	double Time;							///< seconds, see GetTheTime()
+	unsigned char nCommand;					///< a single bit, see enInput
+	bool bDown;								///< pressed, or released
+};
+
+struct TInputQueue							///< commands of a player, as events: one producer
+{											///< (the window, a bot), one consumer (the ticks)
+	TInputEvent Events[INPUTQUEUESIZE];		///< a ring
+	std::atomic<unsigned> nHead;			///< next event to be sampled (the ticks)
+	std::atomic<unsigned> nTail;			///< next event to be pushed (the producer)
+	unsigned char nPushed;					///< held, as pushed so far: the producer's
+	unsigned nDropped;						///< events lost, the queue being full
+
+	unsigned char nHeld;					///< level: held down, as of the last sample
+	unsigned char nPressed;					///< edges: since a tick last took them
+	double Latency;							///< seconds, from a press to its sample, smoothed
+};
+
+void SetupTheInput(TInputQueue* pQueue);
+
+bool PushTheInput(TInputQueue* pQueue, unsigned char nCommand, bool bDown, double Time);
+void PushTheCommands(TInputQueue* pQueue, unsigned char nCommands, double Time);
+unsigned char SampleTheInput(TInputQueue* pQueue, double Time);
+void ConsumeTheInput(TInputQueue* pQueue);
+
+#endif
@@ -13,6 +13,8 @@
 
 #include <assert.h>
 #include <algorithm>
+#include <chrono>
+#include <random>
 
 #include <math.h>
 
@@ -20,13 +22,104 @@
 #include "maths.h"
 
 
+											// generator of the calling thread,
+											// see UseTheRandom()
+static thread_local TRandom DefaultRandom = { RANDSEED };
+static thread_local TRandom* pCurRandom = nullptr;
+
+
+/*!****************************************************************************
+* @brief	Seeds a pseudo-random generator
+* @param	pRandom Pointer to the generator
+* @param	nSeed The seed, any value
+******************************************************************************/
+void SeedTheRandom(TRandom* pRandom, uint64_t nSeed)
+{
+	assert(pRandom);
+
+	pRandom->nState = nSeed ? nSeed : RANDSEED;
+}
+
+/*!****************************************************************************
+* @brief	Scrambles a seed (splitmix64), so that the generators seeded
+*			from nearby values (e.g. consecutive ones) don't start close
+*			to each other
+* @param	nSeed The seed
+* @return	The seed scrambled
+******************************************************************************/
+uint64_t MixTheSeed(uint64_t nSeed)
+{
+	nSeed += 0x9E3779B97F4A7C15ULL;
+	nSeed = (nSeed ^ (nSeed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	nSeed = (nSeed ^ (nSeed >> 27)) * 0x94D049BB133111EBULL;
+
+	return nSeed ^ (nSeed >> 31);
+}
+
+/*!****************************************************************************
+* @brief	Makes a seed that differs at every run
+* @return	The seed, never zero
+* @note		From the entropy of the system, mixed with the clock: some
+*			std::random_device (e.g. of the older MinGW) always give the
+*			same values
+******************************************************************************/
+uint64_t MakeTheSeed()
+{
+	std::random_device Device;
+
+	uint64_t nSeed = (uint64_t(Device()) << 32) ^ Device();
+	nSeed ^= uint64_t(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+
+	return nSeed ? nSeed : RANDSEED;
+}
+
+/*!****************************************************************************
+* @brief	Selects the generator used by the random functions on the
+*			calling thread
+* @param	pRandom Pointer to the generator, nullptr for the default one
+* @note		The state of the generator is owned by the caller (e.g. by
+*			the game), so that it can be saved and restored
+******************************************************************************/
+void UseTheRandom(TRandom* pRandom)
+{
+	pCurRandom = pRandom;
+}
+
+/*!****************************************************************************
+* @brief	Generates a random value in [0, 1]
+* @return	The value, from the generator selected by UseTheRandom()
+******************************************************************************/
+double RandUnit()
+{
+	return RandUnit(pCurRandom ? pCurRandom : &DefaultRandom);
+}
+
+/*!****************************************************************************
+* @brief	Generates a random value in [0, 1] from a given generator
+* @param	pRandom Pointer to the generator
+* @return	The value
+******************************************************************************/
+double RandUnit(TRandom* pRandom)
+{
+	assert(pRandom);
+
+	pRandom->nState ^= pRandom->nState >> 12;
+	pRandom->nState ^= pRandom->nState << 25;
+	pRandom->nState ^= pRandom->nState >> 27;
+
+	uint64_t nValue = pRandom->nState * 0x2545F4914F6CDD1DULL;
+
+	return double(nValue >> 11) / double((1ULL << 53) - 1);
+}
+
+
 /*!****************************************************************************
 * @brief	Generates a random value in a specified range
 * @param	Val The interval absolute limits in which a value can be generated
 ******************************************************************************/
 double Rand(double Val)
 {
-	return double( Val -  2.0 * rand()/double(RAND_MAX) * Val );
+	return double( Val -  2.0 * RandUnit() * Val );
 }
 
 /*!****************************************************************************
@@ -35,7 +128,7 @@ double Rand(double Val)
 ******************************************************************************/
 double AbsRand(double Val)
 {
-	return double( rand() / double(RAND_MAX) * Val );
+	return double( RandUnit() * Val );
 }
 
 /*!****************************************************************************
@@ -44,7 +137,7 @@ double AbsRand(double Val)
 ******************************************************************************/
 int RandSign()
 {
-	double RandVal = -1.0 + 2.0*rand()/double(RAND_MAX);
+	double RandVal = -1.0 + 2.0*RandUnit();
 	
 	return Sign(RandVal);
 }
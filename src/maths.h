@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <math.h>
+#include <stdint.h>
 
 #include <assert.h>
 
@@ -14,8 +15,23 @@
 #define DEG2RAD(Val)  ((Val) * M_PI / 180.0 )
 #define RAD2DEG(Val)  ((Val) * 180.0 / M_PI )
 
+#define RANDSEED	0x2545F4914F6CDD1DULL	///< fixed seed, for the runs to be repeated
+
+
 typedef std::vector<int> TVecIntegers;
 
+struct TRandom					///< pseudo-random generator (xorshift64*)
+{
+	uint64_t nState;			///< never zero
+};
+
+
+void SeedTheRandom(TRandom* pRandom, uint64_t nSeed);
+uint64_t MixTheSeed(uint64_t nSeed);
+uint64_t MakeTheSeed();
+void UseTheRandom(TRandom* pRandom);
+double RandUnit();
+double RandUnit(TRandom* pRandom);
 
 int RandSign();
 int Sign(double Val);
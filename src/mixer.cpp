@@ -0,0 +1,748 @@
+/*!****************************************************************************
+
+	@file	mixer.h
+	@file	mixer.cpp
+
+	@brief	Software audio mixer, with a null and a WAV file output device
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIXER_SSE2
+#endif
+
+#include "mixer.h"
+
+
+#define MIXLEAD			(MIXFRAMES * 2)		///< frames rendered ahead of time
+#define MIXPERIOD		5					///< ms between two renderings
+
+#define MIXCHECKBLOCKS	344					///< blocks of the check, about 4 s
+#define MIXTOLERANCE	2					///< max error of a sample, in 16 bits steps
+
+
+struct TMixCheckSound						///< a tone, in one of the voice formats
+{
+	std::vector<unsigned char> Samples;
+	int nChannels, nBps, nSampleRate;
+};
+
+struct TMixCheckEvent						///< a step of the script of the check
+{
+	unsigned nBlock;
+	int nVoice;
+	int nSound;								///< -1 stops the voice
+	bool bLoop;
+	float Gain;								///< the volume, with nVoice -1
+};
+
+
+/*!****************************************************************************
+* @brief	Writes a little-endian 16 bits value
+* @param	pFile Pointer to the file
+* @param	nValue The value to be written
+******************************************************************************/
+static void WriteLE16(FILE* pFile, unsigned nValue)
+{
+	fputc(nValue & 0xFF, pFile);
+	fputc((nValue >> 8) & 0xFF, pFile);
+}
+
+/*!****************************************************************************
+* @brief	Writes a little-endian 32 bits value
+* @param	pFile Pointer to the file
+* @param	nValue The value to be written
+******************************************************************************/
+static void WriteLE32(FILE* pFile, unsigned nValue)
+{
+	WriteLE16(pFile, nValue & 0xFFFF);
+	WriteLE16(pFile, nValue >> 16);
+}
+
+/*!****************************************************************************
+* @brief	Writes the header of the WAV file device
+* @param	pMixer Pointer to the mixer
+* @note		Rewritten on cleanup, when the size of the samples is known
+******************************************************************************/
+static void WriteTheHeader(TMixer* pMixer)
+{
+	FILE* pFile = pMixer->pFile;
+
+	fseek(pFile, 0, SEEK_SET);
+
+	fwrite("RIFF", 1, 4, pFile);
+	WriteLE32(pFile, 36 + pMixer->nWritten);
+	fwrite("WAVE", 1, 4, pFile);
+
+	fwrite("fmt ", 1, 4, pFile);
+	WriteLE32(pFile, 16);
+	WriteLE16(pFile, 1);									// PCM
+	WriteLE16(pFile, 2);									// channels
+	WriteLE32(pFile, MIXRATE);
+	WriteLE32(pFile, MIXRATE * 4);							// bytes per second
+	WriteLE16(pFile, 4);									// block align
+	WriteLE16(pFile, 16);									// bits per sample
+
+	fwrite("data", 1, 4, pFile);
+	WriteLE32(pFile, pMixer->nWritten);
+
+	fseek(pFile, 0, SEEK_END);
+}
+
+/*!****************************************************************************
+* @brief	Gets a sample of a voice, as a float between -1..1
+* @param	pVoice Pointer to the voice
+* @param	nFrame The frame of the sample
+* @param	nChannel The channel of the sample
+* @return	The value of the sample
+******************************************************************************/
+static inline float GetTheSample(const TMixVoice* pVoice, unsigned nFrame, int nChannel)
+{
+	if( pVoice->nBps == 32 )
+	{
+		float Value;
+		memcpy(&Value, pVoice->pSamples + (nFrame * pVoice->nChannels + nChannel) * 4, sizeof(Value));
+
+		return Value;
+	}
+	else if( pVoice->nBps == 16 )
+	{
+		const unsigned char* p = pVoice->pSamples + (nFrame * pVoice->nChannels + nChannel) * 2;
+
+		return int16_t(p[0] | (p[1] << 8)) * (1.0f / 32768.0f);
+	}
+	else
+	{
+		const unsigned char* p = pVoice->pSamples + nFrame * pVoice->nChannels + nChannel;
+
+		return (int(p[0]) - 128) * (1.0f / 128.0f);
+	}
+}
+
+/*!****************************************************************************
+* @brief	Converts stereo 16 bits samples to float
+* @param	pIn Pointer to the interleaved samples
+* @param	pOut Pointer to the interleaved floats
+* @param	nFrames Number of frames to be converted
+******************************************************************************/
+static void ConvertStereo16(const unsigned char* pIn, float* pOut, unsigned nFrames)
+{
+	unsigned nCount = nFrames * 2, i = 0;
+
+#ifdef MIXER_SSE2
+	const __m128 Scale = _mm_set1_ps(1.0f / 32768.0f);
+
+	for(; i + 8 <= nCount; i += 8)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)(pIn + i * 2));
+											// sign extends to 32 bits
+		__m128i Lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		__m128i Hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+
+		_mm_storeu_ps(pOut + i, _mm_mul_ps(_mm_cvtepi32_ps(Lo), Scale));
+		_mm_storeu_ps(pOut + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(Hi), Scale));
+	}
+#endif
+
+	for(; i < nCount; ++i)
+	{
+		pOut[i] = int16_t(pIn[i * 2] | (pIn[i * 2 + 1] << 8)) * (1.0f / 32768.0f);
+	}
+}
+
+/*!****************************************************************************
+* @brief	Renders the next frames of a voice, as stereo floats
+* @param	pVoice Pointer to the voice
+* @param	pOut Pointer to the interleaved floats
+* @param	nFrames Number of frames to be rendered
+* @note		The voice is resampled to MIXRATE with a linear interpolation,
+*			unless it already plays at that rate. Past the end of a
+*			one-shot voice the output is silence.
+******************************************************************************/
+static void RenderTheVoice(TMixVoice* pVoice, float* pOut, unsigned nFrames)
+{
+	unsigned nDone = 0;
+	const uint64_t nEnd = uint64_t(pVoice->nFrames) << 32;
+
+	if( pVoice->nStep == (uint64_t(1) << 32) && pVoice->nChannels == 2 && pVoice->nBps >= 16 )
+	{
+											// same rate, no interpolation
+		while( nDone < nFrames )
+		{
+			if( pVoice->nPosition >= nEnd )
+			{
+				if( !pVoice->bLoop ) break;
+
+				pVoice->nPosition -= nEnd;
+			}
+
+			unsigned nFrame = unsigned(pVoice->nPosition >> 32);
+			unsigned nCount = std::min(nFrames - nDone, pVoice->nFrames - nFrame);
+
+			if( pVoice->nBps == 32 )
+			{
+				memcpy(pOut + nDone * 2, pVoice->pSamples + nFrame * 8, nCount * 2 * sizeof(float));
+			}
+			else
+			{
+				ConvertStereo16(pVoice->pSamples + nFrame * 4, pOut + nDone * 2, nCount);
+			}
+
+			nDone += nCount;
+			pVoice->nPosition += uint64_t(nCount) << 32;
+		}
+	}
+	else
+	{
+		int nRight = pVoice->nChannels == 2 ? 1 : 0;
+
+		for(; nDone < nFrames; ++nDone)
+		{
+			if( pVoice->nPosition >= nEnd )
+			{
+				if( !pVoice->bLoop ) break;
+
+				pVoice->nPosition -= nEnd;
+			}
+
+			unsigned nFrame = unsigned(pVoice->nPosition >> 32);
+			unsigned nNext = nFrame + 1;
+
+			if( nNext >= pVoice->nFrames ) nNext = pVoice->bLoop ? 0 : nFrame;
+
+			float Frac = float(pVoice->nPosition & 0xFFFFFFFF) * (1.0f / 4294967296.0f);
+
+			float L0 = GetTheSample(pVoice, nFrame, 0), L1 = GetTheSample(pVoice, nNext, 0);
+			float R0 = GetTheSample(pVoice, nFrame, nRight), R1 = GetTheSample(pVoice, nNext, nRight);
+
+			pOut[nDone * 2] = L0 + (L1 - L0) * Frac;
+			pOut[nDone * 2 + 1] = R0 + (R1 - R0) * Frac;
+
+			pVoice->nPosition += pVoice->nStep;
+		}
+	}
+
+	if( nDone < nFrames )
+	{
+		pVoice->bPlaying = false;
+
+		memset(pOut + nDone * 2, 0, (nFrames - nDone) * 2 * sizeof(float));
+	}
+}
+
+/*!****************************************************************************
+* @brief	Adds a voice to the mix
+* @param	pMix Pointer to the mix
+* @param	pVoice Pointer to the voice samples
+* @param	Gain Gain of the voice
+* @param	nCount Number of floats, multiple of 4
+******************************************************************************/
+static void AddTheVoice(float* pMix, const float* pVoice, float Gain, unsigned nCount)
+{
+#ifdef MIXER_SSE2
+	const __m128 G = _mm_set1_ps(Gain);
+
+	for(unsigned i=0; i<nCount; i+=4)
+	{
+		__m128 m = _mm_load_ps(pMix + i);
+		__m128 v = _mm_load_ps(pVoice + i);
+
+		_mm_store_ps(pMix + i, _mm_add_ps(m, _mm_mul_ps(v, G)));
+	}
+#else
+	for(unsigned i=0; i<nCount; ++i)
+	{
+		pMix[i] += pVoice[i] * Gain;
+	}
+#endif
+}
+
+/*!****************************************************************************
+* @brief	Converts the mix to 16 bits samples, saturating them
+* @param	pMix Pointer to the mix
+* @param	pOut Pointer to the 16 bits samples
+* @param	Volume Master volume
+* @param	nCount Number of floats, multiple of 8
+******************************************************************************/
+static void OutputTheMix(const float* pMix, int16_t* pOut, float Volume, unsigned nCount)
+{
+#ifdef MIXER_SSE2
+	const __m128 V = _mm_set1_ps(Volume * 32767.0f);
+
+	for(unsigned i=0; i<nCount; i+=8)
+	{
+		__m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(pMix + i), V));
+		__m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(pMix + i + 4), V));
+
+		_mm_store_si128((__m128i*)(pOut + i), _mm_packs_epi32(a, b));
+	}
+#else
+	for(unsigned i=0; i<nCount; ++i)
+	{
+		float Value = pMix[i] * Volume * 32767.0f;
+
+		if( Value > 32767.0f ) Value = 32767.0f;
+		if( Value < -32768.0f ) Value = -32768.0f;
+
+		pOut[i] = int16_t(Value);
+	}
+#endif
+}
+
+/*!****************************************************************************
+* @brief	Mixer thread body: keeps the rendering in step with real time
+* @param	pMixer Pointer to the mixer
+******************************************************************************/
+static void MixerLoop(TMixer* pMixer)
+{
+	auto Start = std::chrono::steady_clock::now();
+
+	while( !pMixer->bQuit )
+	{
+		std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - Start;
+
+		uint64_t nTarget = uint64_t(Elapsed.count() * MIXRATE) + MIXLEAD;
+
+		if( pMixer->nFrames < nTarget )
+		{
+			RenderTheMixer(pMixer, unsigned(nTarget - pMixer->nFrames));
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(MIXPERIOD));
+	}
+}
+
+/*!****************************************************************************
+* @brief	Setting-up the software mixer
+* @param	pMixer Pointer to the mixer
+* @param	nDevice The output device, see enMixerDevice
+* @param	strFileName Path of the output file, for the WAV file device
+* @param	bRealtime If true a thread renders the mix in real time,
+*			otherwise the frames are rendered by calling RenderTheMixer()
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool SetupTheMixer(TMixer* pMixer, int nDevice, std::string strFileName, bool bRealtime)
+{
+	assert(pMixer);
+
+	pMixer->nDevice = nDevice;
+	pMixer->pFile = nullptr;
+	pMixer->nWritten = 0;
+	pMixer->Volume = 1.0f;
+	pMixer->nFrames = 0;
+
+	memset(pMixer->Voices, 0, sizeof(pMixer->Voices));
+
+	if( nDevice == mdWavFile )
+	{
+		pMixer->pFile = fopen(strFileName.c_str(), "wb");
+
+		if( !pMixer->pFile ) return false;
+
+		WriteTheHeader(pMixer);
+	}
+
+	if( bRealtime )
+	{
+		pMixer->bQuit = false;
+		pMixer->Thread = std::thread(MixerLoop, pMixer);
+	}
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Cleanup the software mixer
+* @param	pMixer Pointer to the mixer
+******************************************************************************/
+void CleanupTheMixer(TMixer* pMixer)
+{
+	assert(pMixer);
+
+	if( pMixer->Thread.joinable() )
+	{
+		pMixer->bQuit = true;
+		pMixer->Thread.join();
+	}
+
+	if( pMixer->pFile )
+	{
+		WriteTheHeader(pMixer);
+
+		fclose(pMixer->pFile);
+		pMixer->pFile = nullptr;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Plays a sound on a voice of the mixer
+* @param	pMixer Pointer to the mixer
+* @param	nVoice The voice, between 0..MIXVOICES-1
+* @param	pSamples Pointer to the samples
+* @param	nSize Size of the samples, in bytes
+* @param	nChannels Number of channels, 1 or 2
+* @param	nBps Bits per sample: 8 or 16 for PCM, 32 for float
+* @param	nSampleRate Sample rate of the sound
+* @param	bLoop Flag for looping: true if must be played repeatedly
+* @param	Gain Gain of the voice
+* @note		The samples must stay in memory while the voice plays
+******************************************************************************/
+void PlayTheMixerVoice(TMixer* pMixer, int nVoice, const unsigned char* pSamples, unsigned nSize,
+	int nChannels, int nBps, int nSampleRate, bool bLoop, float Gain)
+{
+	assert(pMixer);
+	assert(nVoice >= 0 && nVoice < MIXVOICES);
+
+	std::lock_guard<std::mutex> Lock(pMixer->Mutex);
+
+	TMixVoice& Voice = pMixer->Voices[nVoice];
+
+	Voice.pSamples = pSamples;
+	Voice.nFrames = nSize / (nChannels * nBps / 8);
+	Voice.nChannels = nChannels;
+	Voice.nBps = nBps;
+	Voice.nPosition = 0;
+	Voice.nStep = (uint64_t(nSampleRate) << 32) / MIXRATE;
+	Voice.Gain = Gain;
+	Voice.bLoop = bLoop;
+	Voice.bPlaying = Voice.nFrames > 0;
+}
+
+/*!****************************************************************************
+* @brief	Stops a voice of the mixer
+* @param	pMixer Pointer to the mixer
+* @param	nVoice The voice, between 0..MIXVOICES-1
+******************************************************************************/
+void StopTheMixerVoice(TMixer* pMixer, int nVoice)
+{
+	assert(pMixer);
+	assert(nVoice >= 0 && nVoice < MIXVOICES);
+
+	std::lock_guard<std::mutex> Lock(pMixer->Mutex);
+
+	pMixer->Voices[nVoice].bPlaying = false;
+}
+
+/*!****************************************************************************
+* @brief	Checks if a voice of the mixer is playing
+* @param	pMixer Pointer to the mixer
+* @param	nVoice The voice, between 0..MIXVOICES-1
+* @return	Returns true if the voice is playing
+******************************************************************************/
+bool IsMixerVoicePlaying(TMixer* pMixer, int nVoice)
+{
+	assert(pMixer);
+	assert(nVoice >= 0 && nVoice < MIXVOICES);
+
+	std::lock_guard<std::mutex> Lock(pMixer->Mutex);
+
+	return pMixer->Voices[nVoice].bPlaying;
+}
+
+/*!****************************************************************************
+* @brief	Mixes the playing voices and sends the frames to the device
+* @param	pMixer Pointer to the mixer
+* @param	nFrames Number of frames to be rendered
+* @note		Frames are rendered in blocks of MIXFRAMES
+******************************************************************************/
+void RenderTheMixer(TMixer* pMixer, unsigned nFrames)
+{
+	assert(pMixer);
+
+	unsigned nBlocks = (nFrames + MIXFRAMES - 1) / MIXFRAMES;
+
+	for(unsigned n=0; n<nBlocks; ++n)
+	{
+		{
+			std::lock_guard<std::mutex> Lock(pMixer->Mutex);
+
+			memset(pMixer->Mix, 0, sizeof(pMixer->Mix));
+
+			for(int i=0; i<MIXVOICES; ++i)
+			{
+				TMixVoice* pVoice = &pMixer->Voices[i];
+
+				if( !pVoice->bPlaying ) continue;
+
+				RenderTheVoice(pVoice, pMixer->Scratch, MIXFRAMES);
+				AddTheVoice(pMixer->Mix, pMixer->Scratch, pVoice->Gain, MIXFRAMES * 2);
+			}
+
+			OutputTheMix(pMixer->Mix, pMixer->Output, pMixer->Volume, MIXFRAMES * 2);
+		}
+
+		pMixer->nFrames += MIXFRAMES;
+
+		if( pMixer->pFile )
+		{
+											// the device is a little-endian
+											// 16 bits stereo WAV file
+			fwrite(pMixer->Output, sizeof(int16_t), MIXFRAMES * 2, pMixer->pFile);
+			pMixer->nWritten += MIXFRAMES * 2 * sizeof(int16_t);
+		}
+	}
+}
+
+/*!****************************************************************************
+* @brief	Makes a tone for the check of the mixer
+* @param	pSound Pointer to the sound, whose format is set
+* @param	Frequency Frequency of the tone, in Hz
+* @param	Seconds Length of the tone
+* @note		The right channel is out of phase with the left one
+******************************************************************************/
+static void MakeTheTone(TMixCheckSound* pSound, double Frequency, double Seconds)
+{
+	unsigned nFrames = unsigned(Seconds * pSound->nSampleRate);
+	unsigned nBytes = pSound->nBps / 8;
+
+	pSound->Samples.resize(nFrames * pSound->nChannels * nBytes);
+
+	unsigned char* p = pSound->Samples.data();
+
+	for(unsigned i=0; i<nFrames; ++i)
+	{
+		for(int c=0; c<pSound->nChannels; ++c)
+		{
+			double Value = 0.9 * sin(2.0 * M_PI * Frequency * i / pSound->nSampleRate + c * M_PI / 2.0);
+
+			if( pSound->nBps == 32 )
+			{
+				float Sample = float(Value);
+				memcpy(p, &Sample, sizeof(Sample));
+			}
+			else if( pSound->nBps == 16 )
+			{
+				int16_t Sample = int16_t(lrint(Value * 32767.0));
+				p[0] = Sample & 0xFF;
+				p[1] = (Sample >> 8) & 0xFF;
+			}
+			else
+			{
+				*p = (unsigned char)(128 + lrint(Value * 127.0));
+			}
+
+			p += nBytes;
+		}
+	}
+}
+
+/*!****************************************************************************
+* @brief	Renders the frames the mixer should render, one at a time and in
+*			double precision
+* @param	pVoices The voices, as set-up by PlayTheMixerVoice()
+* @param	Volume Master volume
+* @param	pOut Pointer to the 16 bits samples
+* @param	nFrames Number of frames to be rendered
+******************************************************************************/
+static void RenderTheReference(TMixVoice* pVoices, float Volume, int16_t* pOut, unsigned nFrames)
+{
+	for(unsigned n=0; n<nFrames; ++n)
+	{
+		double Mix[2] = { 0, 0 };
+
+		for(int i=0; i<MIXVOICES; ++i)
+		{
+			TMixVoice* pVoice = &pVoices[i];
+
+			if( !pVoice->bPlaying ) continue;
+
+			const uint64_t nEnd = uint64_t(pVoice->nFrames) << 32;
+
+			if( pVoice->nPosition >= nEnd )
+			{
+				if( !pVoice->bLoop )
+				{
+					pVoice->bPlaying = false;
+					continue;
+				}
+
+				pVoice->nPosition -= nEnd;
+			}
+
+			unsigned nFrame = unsigned(pVoice->nPosition >> 32);
+			unsigned nNext = nFrame + 1;
+
+			if( nNext >= pVoice->nFrames ) nNext = pVoice->bLoop ? 0 : nFrame;
+
+			double Frac = double(pVoice->nPosition & 0xFFFFFFFF) / 4294967296.0;
+
+			for(int c=0; c<2; ++c)
+			{
+				int nChannel = pVoice->nChannels == 2 ? c : 0;
+
+				double Value0 = GetTheSample(pVoice, nFrame, nChannel);
+				double Value1 = GetTheSample(pVoice, nNext, nChannel);
+
+				Mix[c] += pVoice->Gain * (Value0 + (Value1 - Value0) * Frac);
+			}
+
+			pVoice->nPosition += pVoice->nStep;
+		}
+
+		for(int c=0; c<2; ++c)
+		{
+			double Value = floor(Mix[c] * Volume * 32767.0 + 0.5);
+
+			pOut[n * 2 + c] = int16_t(std::max(-32768.0, std::min(32767.0, Value)));
+		}
+	}
+}
+
+/*!****************************************************************************
+* @brief	Checks the mixer: renders a script of voices to a WAV file and
+*			compares it with a reference rendering
+* @param	strFileName Path of the WAV file written, e.g. MIXCHECKFILE
+* @return	Returns true if the file matches the reference, false otherwise
+* @note		Needs no sound hardware and no sound file: the voices are
+*			tones in all the formats (8 and 16 bits PCM, float, mono and
+*			stereo, resampled or not), some looping, some saturating the
+*			mix. The outcome and the speed of the mixer go to the console.
+******************************************************************************/
+bool VerifyTheMixer(std::string strFileName)
+{
+	TMixCheckSound Sounds[] = {
+		{ {}, 2, 16, MIXRATE }, { {}, 1, 8, 11025 }, { {}, 1, 32, 22050 },
+		{ {}, 2, 32, MIXRATE }, { {}, 1, 16, 48000 }
+	};
+
+	double Frequencies[] = { 440, 220, 330, 880, 1000 };
+	double Lengths[] = { 1.5, 1.0, 0.25, 2.0, 1.2 };
+
+	for(int i=0; i<sizeof(Sounds)/sizeof(Sounds[0]); ++i)
+	{
+		MakeTheTone(&Sounds[i], Frequencies[i], Lengths[i]);
+	}
+
+	static const TMixCheckEvent Script[] = {
+		{ 0, 0, 0, false, 0.5f },
+		{ 20, 1, 1, false, 0.8f },
+		{ 40, 2, 2, true, 0.6f },
+		{ 60, 3, 3, true, 0.7f },
+		{ 80, 4, 4, false, 1.0f },			// the mix saturates
+		{ 120, -1, 0, false, 0.5f },		// the master volume
+		{ 200, 2, -1, false, 0 },
+		{ 220, 0, 0, false, 0.9f },
+		{ 300, 3, -1, false, 0 }
+	};
+
+	TMixer* pMixer = new TMixer();
+	assert(pMixer);
+
+	if( !SetupTheMixer(pMixer, mdWavFile, strFileName, false) )
+	{
+		printf("mixer: cannot write %s\n", strFileName.c_str());
+
+		delete pMixer;
+		return false;
+	}
+
+	TMixVoice Reference[MIXVOICES];
+	memset(Reference, 0, sizeof(Reference));
+
+	float Volume = 1.0f;
+	std::vector<int16_t> Expected(MIXCHECKBLOCKS * MIXFRAMES * 2);
+
+	unsigned nEvent = 0;
+	double Elapsed = 0;
+
+	for(unsigned n=0; n<MIXCHECKBLOCKS; ++n)
+	{
+		for(; nEvent < sizeof(Script)/sizeof(Script[0]) && Script[nEvent].nBlock == n; ++nEvent)
+		{
+			const TMixCheckEvent& Event = Script[nEvent];
+
+			if( Event.nVoice < 0 )
+			{
+				std::lock_guard<std::mutex> Lock(pMixer->Mutex);
+
+				pMixer->Volume = Volume = Event.Gain;
+			}
+			else if( Event.nSound < 0 )
+			{
+				StopTheMixerVoice(pMixer, Event.nVoice);
+				Reference[Event.nVoice].bPlaying = false;
+			}
+			else
+			{
+				const TMixCheckSound& Sound = Sounds[Event.nSound];
+				unsigned nSize = Sound.Samples.size();
+
+				PlayTheMixerVoice(pMixer, Event.nVoice, Sound.Samples.data(), nSize,
+					Sound.nChannels, Sound.nBps, Sound.nSampleRate, Event.bLoop, Event.Gain);
+
+				TMixVoice& Voice = Reference[Event.nVoice];
+
+				Voice.pSamples = Sound.Samples.data();
+				Voice.nFrames = nSize / (Sound.nChannels * Sound.nBps / 8);
+				Voice.nChannels = Sound.nChannels;
+				Voice.nBps = Sound.nBps;
+				Voice.nPosition = 0;
+				Voice.nStep = (uint64_t(Sound.nSampleRate) << 32) / MIXRATE;
+				Voice.Gain = Event.Gain;
+				Voice.bLoop = Event.bLoop;
+				Voice.bPlaying = true;
+			}
+		}
+
+		auto Start = std::chrono::steady_clock::now();
+
+		RenderTheMixer(pMixer, MIXFRAMES);
+
+		Elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+		RenderTheReference(Reference, Volume, &Expected[n * MIXFRAMES * 2], MIXFRAMES);
+	}
+
+	CleanupTheMixer(pMixer);
+	delete pMixer;
+											// the file, as written by the
+											// device
+	std::vector<unsigned char> File;
+	FILE* pFile = fopen(strFileName.c_str(), "rb");
+
+	if( pFile )
+	{
+		File.resize(44 + Expected.size() * sizeof(int16_t) + 1);
+		File.resize(fread(File.data(), 1, File.size(), pFile));
+		fclose(pFile);
+	}
+
+	unsigned nData = Expected.size() * sizeof(int16_t);
+
+	bool bResult = File.size() == 44 + nData
+		&& !memcmp(File.data(), "RIFF", 4) && !memcmp(File.data() + 8, "WAVE", 4)
+		&& !memcmp(File.data() + 36, "data", 4)
+		&& (File[40] | (File[41] << 8) | (File[42] << 16) | (unsigned(File[43]) << 24)) == nData;
+
+	int nMaxError = 0;
+
+	for(unsigned i=0; bResult && i<Expected.size(); ++i)
+	{
+		const unsigned char* p = File.data() + 44 + i * 2;
+
+		nMaxError = std::max(nMaxError, abs(int16_t(p[0] | (p[1] << 8)) - Expected[i]));
+	}
+
+	bResult = bResult && nMaxError <= MIXTOLERANCE;
+
+	double Seconds = double(MIXCHECKBLOCKS * MIXFRAMES) / MIXRATE;
+
+	printf("mixer: %.1f s of audio in %.2f ms, %.0fx real time, max error %d: %s\n",
+		Seconds, Elapsed * 1000.0, Elapsed > 0 ? Seconds / Elapsed : 0.0, nMaxError,
+		bResult ? "ok" : "FAILED");
+
+	return bResult;
+}
@@ -0,0 +1,65 @@
+
+#ifndef _MIXER_H_
+#define _MIXER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+
+
+#define MIXVOICES		24				///< one per sound manager voice
+#define MIXRATE			44100			///< output rate, stereo 16 bits
+#define MIXFRAMES		512				///< frames mixed in a block
+#define MIXCHECKFILE	"mixcheck.wav"	///< output of the check of the mixer
+
+
+enum enMixerDevice { mdNull, mdWavFile };
+
+struct TMixVoice
+{
+	const unsigned char* pSamples;	///< PCM samples of 8 or 16 bits, or floats of 32
+	unsigned nFrames;
+	int nChannels, nBps;
+	uint64_t nPosition;				///< fixed point 32.32, in source frames
+	uint64_t nStep;					///< source frames per output frame, 32.32
+	float Gain;
+	bool bLoop;
+	bool bPlaying;
+};
+
+struct TMixer
+{
+	int nDevice;
+	FILE* pFile;					///< output of the WAV file device
+	unsigned nWritten;				///< bytes of samples written to the file
+
+	float Volume;
+	TMixVoice Voices[MIXVOICES];
+
+	alignas(16) float Mix[MIXFRAMES * 2];
+	alignas(16) float Scratch[MIXFRAMES * 2];
+	alignas(16) int16_t Output[MIXFRAMES * 2];
+
+	uint64_t nFrames;				///< frames rendered since the setup
+	std::thread Thread;				///< renders the blocks in real time
+	std::mutex Mutex;
+	std::atomic<bool> bQuit;
+};
+
+bool SetupTheMixer(TMixer* pMixer, int nDevice, std::string strFileName, bool bRealtime);
+void CleanupTheMixer(TMixer* pMixer);
+
+void PlayTheMixerVoice(TMixer* pMixer, int nVoice, const unsigned char* pSamples, unsigned nSize,
+	int nChannels, int nBps, int nSampleRate, bool bLoop, float Gain);
+void StopTheMixerVoice(TMixer* pMixer, int nVoice);
+bool IsMixerVoicePlaying(TMixer* pMixer, int nVoice);
+
+void RenderTheMixer(TMixer* pMixer, unsigned nFrames);
+
+bool VerifyTheMixer(std::string strFileName);
+
+#endif
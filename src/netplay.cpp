@@ -0,0 +1,457 @@
+/*!****************************************************************************
+
+	@file	netplay.h
+	@file	netplay.cpp
+
+	@brief	Two players over UDP, with rollback: the inputs are exchanged
+			by tick, the remote ones are predicted and the ticks are run
+			again from a snapshot when a prediction was wrong
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include "sockets.h"						// before windows.h
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "game.h"
+#include "tasks.h"
+#include "utils.h"
+#include "netplay.h"
+
+
+
+/*!****************************************************************************
+* @brief	Sends a packet to the peer, after the latency and unless lost
+* @param	pLink Pointer to the link
+* @param	Packet The packet
+******************************************************************************/
+static void SendThePacket(TNetLink* pLink, const TNetPacket& Packet)
+{
+	assert(pLink);
+
+	if( RandUnit(&pLink->Random) * 100.0 < pLink->nLoss )
+	{
+		pLink->nDropped++;
+		return;
+	}
+
+	pLink->Outgoing.push_back(TDelayedPacket{ GetTheTime() + pLink->Latency, Packet });
+}
+
+/*!****************************************************************************
+* @brief	Sends the packets whose latency has elapsed
+* @param	pLink Pointer to the link
+******************************************************************************/
+static void FlushThePackets(TNetLink* pLink)
+{
+	assert(pLink);
+
+	double Time = GetTheTime();
+											// same latency for all: the
+											// queue is ordered by due time
+	while( !pLink->Outgoing.empty() && pLink->Outgoing.front().Due <= Time )
+	{
+		const TNetPacket& Packet = pLink->Outgoing.front().Packet;
+
+		::sendto(SOCKET(pLink->nSocket), (const char*)&Packet, int(NETHEADERSIZE + Packet.nCount), 0,
+			(const sockaddr*)pLink->Peer, sizeof(sockaddr_in));
+
+		pLink->nSent++;
+		pLink->Outgoing.pop_front();
+	}
+}
+
+/*!****************************************************************************
+* @brief	Receives a packet from the peer, without waiting
+* @param	pLink Pointer to the link
+* @param	Packet The packet received
+* @return	Returns false if no valid packet is pending
+******************************************************************************/
+static bool ReceiveThePacket(TNetLink* pLink, TNetPacket& Packet)
+{
+	assert(pLink);
+
+	for(;;)
+	{
+		int nSize = ::recvfrom(SOCKET(pLink->nSocket), (char*)&Packet, sizeof(Packet), 0, nullptr, nullptr);
+											// WSAECONNRESET is reported on
+											// loopback while the peer is not
+											// listening yet: skip it
+		if( nSize == SOCKET_ERROR )
+		{
+			if( ::WSAGetLastError() == WSAECONNRESET ) continue;
+			return false;
+		}
+
+		if( nSize >= int(NETHEADERSIZE) && Packet.nMagic == NETMAGIC
+			&& Packet.nCount <= NETMAXINPUTS && nSize >= int(NETHEADERSIZE + Packet.nCount) )
+		{
+			pLink->nReceived++;
+			return true;
+		}
+	}
+}
+
+/*!****************************************************************************
+* @brief	Sends the local inputs not acknowledged by the peer yet
+* @param	pNetplay Pointer to the netplay session
+******************************************************************************/
+static void SendTheInputs(TNetplay* pNetplay)
+{
+	assert(pNetplay);
+
+	TNetPacket Packet;
+	memset(&Packet, 0, sizeof(Packet));
+
+	unsigned nFirst = std::max(pNetplay->nPeerAck, pNetplay->nLocalTick - std::min(pNetplay->nLocalTick, unsigned(NETHISTORY)));
+
+	Packet.nMagic = NETMAGIC;
+	Packet.nType = npInputs;
+	Packet.nTick = nFirst;
+	Packet.nAck = pNetplay->nRemoteTick;
+	Packet.nCount = uint8_t(std::min(pNetplay->nLocalTick - nFirst, unsigned(NETMAXINPUTS)));
+
+	for(unsigned i=0; i<Packet.nCount; ++i)
+	{
+		Packet.nInputs[i] = pNetplay->Inputs[(nFirst + i) % NETHISTORY][pNetplay->nLocal];
+	}
+
+	SendThePacket(&pNetplay->Link, Packet);
+}
+
+/*!****************************************************************************
+* @brief	Takes the inputs of a packet from the peer
+* @param	pNetplay Pointer to the netplay session
+* @param	Packet The packet
+* @note		The inputs are taken in order only: the ones following a
+*			gap wait for the next packet, which repeats them
+******************************************************************************/
+static void TakeTheInputs(TNetplay* pNetplay, const TNetPacket& Packet)
+{
+	assert(pNetplay);
+
+	pNetplay->nPeerAck = std::max(pNetplay->nPeerAck, unsigned(Packet.nAck));
+
+	if( Packet.nType != npInputs ) return;
+											// the oldest tick still needed
+											// must not be overwritten
+	unsigned nLimit = pNetplay->nTick + NETHISTORY - ROLLBACKWINDOW;
+
+	for(unsigned i=0; i<Packet.nCount; ++i)
+	{
+		unsigned nTick = Packet.nTick + i;
+
+		if( nTick != pNetplay->nRemoteTick || nTick >= nLimit ) continue;
+
+		unsigned char& nInput = pNetplay->Inputs[nTick % NETHISTORY][pNetplay->nRemote];
+											// the tick has been run with
+											// a different prediction
+		if( nTick < pNetplay->nTick && nInput != Packet.nInputs[i] )
+		{
+			pNetplay->nRollback = std::min(pNetplay->nRollback, nTick);
+		}
+
+		nInput = Packet.nInputs[i];
+		pNetplay->nRemoteTick++;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Sets the inputs of a tick into the game, predicting the remote
+*			one if not received yet
+* @param	pNetplay Pointer to the netplay session
+* @param	pGame Pointer to the game engine
+* @param	nTick The tick
+******************************************************************************/
+static void SetTheInputs(TNetplay* pNetplay, TGame* pGame, unsigned nTick)
+{
+	assert(pNetplay);
+	assert(pGame);
+
+	unsigned char* pInputs = pNetplay->Inputs[nTick % NETHISTORY];
+											// predicted: the remote input
+											// is the same as the last one
+	if( nTick >= pNetplay->nRemoteTick )
+	{
+		pInputs[pNetplay->nRemote] = pNetplay->Inputs[(pNetplay->nRemoteTick - 1) % NETHISTORY][pNetplay->nRemote];
+	}
+
+	for(int i=0; i<MAXPLAYERS; ++i) pGame->nInputs[i] = pInputs[i];
+}
+
+/*!****************************************************************************
+* @brief	Runs again the ticks from the first one mispredicted, with the
+*			inputs received meanwhile
+* @param	pNetplay Pointer to the netplay session
+* @param	pGame Pointer to the game engine
+******************************************************************************/
+static void RollBack(TNetplay* pNetplay, TGame* pGame)
+{
+	assert(pNetplay);
+	assert(pGame);
+
+	unsigned nDepth = pNetplay->nTick - pNetplay->nRollback;
+	assert(nDepth <= ROLLBACKWINDOW);
+
+	double Time = GetTheTime();
+											// neither drawing nor sounds
+											// while catching up
+	bool bHeadless = pGame->bHeadless;
+	SetHeadless(pGame, true);
+
+	bool bResult = LoadTheSnapshot(pGame, pNetplay->Snapshots[pNetplay->nRollback % ROLLBACKWINDOW]);
+	assert(bResult);
+
+	for(unsigned nTick=pNetplay->nRollback; nTick<pNetplay->nTick; ++nTick)
+	{
+		if( nTick > pNetplay->nRollback )
+		{
+			SaveTheSnapshot(pGame, pNetplay->Snapshots[nTick % ROLLBACKWINDOW]);
+		}
+
+		SetTheInputs(pNetplay, pGame, nTick);
+		Run(pGame);
+	}
+
+	SetHeadless(pGame, bHeadless);
+
+	Time = GetTheTime() - Time;
+
+	pNetplay->TickTime += 0.1 * (Time / nDepth - pNetplay->TickTime);
+	pNetplay->MaxRollbackTime = std::max(pNetplay->MaxRollbackTime, Time);
+	pNetplay->nMaxDepth = std::max(pNetplay->nMaxDepth, nDepth);
+	pNetplay->nRollbacks++;
+
+	pNetplay->nRollback = pNetplay->nTick;
+}
+
+/*!****************************************************************************
+* @brief	Sets-up a netplay session
+* @param	pNetplay Pointer to the netplay session
+* @param	nLocal The local player, 0 or 1
+* @param	nLocalPort UDP port of the local player
+* @param	nRemotePort UDP port of the remote player, on the loopback
+* @param	nLatency Milliseconds added to every packet sent
+* @param	nLoss Percentage of the packets sent to be dropped
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool SetupTheNetplay(TNetplay* pNetplay, int nLocal, int nLocalPort, int nRemotePort,
+	unsigned nLatency, unsigned nLoss)
+{
+	assert(pNetplay);
+	assert(nLocal >= 0 && nLocal < MAXPLAYERS);
+
+	TNetLink* pLink = &pNetplay->Link;
+
+	if( !StartTheSockets() ) return false;
+
+	SOCKET nSocket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	if( nSocket == INVALID_SOCKET )
+	{
+		StopTheSockets();
+		return false;
+	}
+
+	sockaddr_in Local;
+	memset(&Local, 0, sizeof(Local));
+	Local.sin_family = AF_INET;
+	Local.sin_port = htons(u_short(nLocalPort));
+	Local.sin_addr.s_addr = inet_addr(NETHOST);
+
+	if( ::bind(nSocket, (sockaddr*)&Local, sizeof(Local)) == SOCKET_ERROR
+		|| !SetNonBlocking(nSocket) )
+	{
+		::closesocket(nSocket);
+		StopTheSockets();
+		return false;
+	}
+
+	sockaddr_in Peer;
+	memset(&Peer, 0, sizeof(Peer));
+	Peer.sin_family = AF_INET;
+	Peer.sin_port = htons(u_short(nRemotePort));
+	Peer.sin_addr.s_addr = inet_addr(NETHOST);
+
+	static_assert(sizeof(Peer) <= sizeof(pLink->Peer), "TNetLink::Peer too small");
+	memcpy(pLink->Peer, &Peer, sizeof(Peer));
+
+	pLink->nSocket = uintptr_t(nSocket);
+	pLink->Latency = nLatency / 1000.0;
+	pLink->nLoss = std::min(nLoss, 100u);
+	SeedTheRandom(&pLink->Random, RANDSEED + nLocalPort);
+	pLink->Outgoing.clear();
+	pLink->nSent = pLink->nDropped = pLink->nReceived = 0;
+
+	pNetplay->nLocal = nLocal;
+	pNetplay->nRemote = 1 - nLocal;
+	pNetplay->bStarted = false;
+	pNetplay->nLocalInput = 0;
+											// the first ticks have no inputs
+	memset(pNetplay->Inputs, 0, sizeof(pNetplay->Inputs));
+	pNetplay->nTick = 0;
+	pNetplay->nLocalTick = INPUTDELAY;
+	pNetplay->nRemoteTick = INPUTDELAY;
+	pNetplay->nPeerAck = INPUTDELAY;
+	pNetplay->nRollback = 0;
+
+	pNetplay->TickTime = 0;
+	pNetplay->MaxRollbackTime = 0;
+	pNetplay->nRollbacks = pNetplay->nMaxDepth = pNetplay->nStalls = 0;
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Sets-up a netplay session from its description
+* @param	pNetplay Pointer to the netplay session
+* @param	pConfig "player:localport:remoteport[:latency_ms[:loss_pct]]",
+*			e.g. "0:7000:7001:50:10"
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool SetupTheNetplay(TNetplay* pNetplay, const char* pConfig)
+{
+	assert(pNetplay);
+
+	int nLocal = 0, nLocalPort = 0, nRemotePort = 0;
+	unsigned nLatency = 0, nLoss = 0;
+
+	if( !pConfig || sscanf(pConfig, "%d:%d:%d:%u:%u",
+		&nLocal, &nLocalPort, &nRemotePort, &nLatency, &nLoss) < 3 ) return false;
+
+	if( nLocal < 0 || nLocal >= MAXPLAYERS ) return false;
+
+	return SetupTheNetplay(pNetplay, nLocal, nLocalPort, nRemotePort, nLatency, nLoss);
+}
+
+/*!****************************************************************************
+* @brief	Cleans-up a netplay session, reporting its statistics
+* @param	pNetplay Pointer to the netplay session
+******************************************************************************/
+void CleanupTheNetplay(TNetplay* pNetplay)
+{
+	assert(pNetplay);
+
+	TNetLink* pLink = &pNetplay->Link;
+
+	char Buffer[256];
+	sprintf(Buffer, "netplay: %u ticks, %u rollbacks, max depth %u (bound %u), max %.2f ms, "
+		"tick %.3f ms, %u stalls, packets %u sent %u dropped %u received\n",
+		pNetplay->nTick, pNetplay->nRollbacks, pNetplay->nMaxDepth, GetTheStallDepth(pNetplay),
+		pNetplay->MaxRollbackTime * 1e3, pNetplay->TickTime * 1e3, pNetplay->nStalls,
+		pLink->nSent, pLink->nDropped, pLink->nReceived);
+
+	LogTheText(Buffer);
+
+	::closesocket(SOCKET(pLink->nSocket));
+	StopTheSockets();
+
+	pLink->Outgoing.clear();
+}
+
+/*!****************************************************************************
+* @brief	Gets the upper bound on the rollback depth
+* @param	pNetplay Pointer to the netplay session
+* @return	Ticks the local player can run ahead of the remote inputs
+* @note		The bound is the smallest of the snapshots kept and of the
+*			ticks that can be re-simulated in ROLLBACKBUDGET, as measured
+*			by the last rollbacks: beyond it the session stalls
+******************************************************************************/
+unsigned GetTheStallDepth(TNetplay* pNetplay)
+{
+	assert(pNetplay);
+
+	unsigned nDepth = ROLLBACKWINDOW - 1 - INPUTDELAY;
+
+	if( pNetplay->TickTime > 0 )
+	{
+		nDepth = std::min(nDepth, unsigned(ROLLBACKBUDGET / pNetplay->TickTime));
+	}
+
+	return std::max(nDepth, 1u);
+}
+
+/*!****************************************************************************
+* @brief	Advances the session by a frame: exchanges the inputs, rolls
+*			back if needed and runs the next tick
+* @param	pNetplay Pointer to the netplay session
+* @param	pGame Pointer to the game engine
+* @return	Returns true if a tick has been run, false if waiting for
+*			the peer
+* @note		Replaces Run() in the main loop
+******************************************************************************/
+bool AdvanceTheNetplay(TNetplay* pNetplay, TGame* pGame)
+{
+	assert(pNetplay);
+	assert(pGame);
+
+	TNetLink* pLink = &pNetplay->Link;
+
+	FlushThePackets(pLink);
+
+	TNetPacket Packet;
+
+	while( ReceiveThePacket(pLink, Packet) )
+	{
+											// the first packet from the
+											// peer starts the match
+		if( !pNetplay->bStarted )
+		{
+			pNetplay->bStarted = true;
+			StartTheMatch(pGame);
+		}
+
+		TakeTheInputs(pNetplay, Packet);
+	}
+
+	if( !pNetplay->bStarted )
+	{
+		memset(&Packet, 0, sizeof(Packet));
+		Packet.nMagic = NETMAGIC;
+		Packet.nType = npHello;
+
+		SendThePacket(pLink, Packet);
+
+		return false;
+	}
+
+	if( pNetplay->nRollback < pNetplay->nTick ) RollBack(pNetplay, pGame);
+											// too far ahead of the peer: waits,
+											// repeating the inputs not acked
+	if( pNetplay->nTick >= pNetplay->nRemoteTick + GetTheStallDepth(pNetplay) )
+	{
+		pNetplay->nStalls++;
+		SendTheInputs(pNetplay);
+
+		return false;
+	}
+
+	pNetplay->Inputs[pNetplay->nLocalTick % NETHISTORY][pNetplay->nLocal] = pNetplay->nLocalInput;
+	pNetplay->nLocalTick++;
+											// the taps sampled while stalled
+											// are in this tick: done with them
+	ConsumeTheInput(&pGame->Input);
+
+	SendTheInputs(pNetplay);
+
+	SaveTheSnapshot(pGame, pNetplay->Snapshots[pNetplay->nTick % ROLLBACKWINDOW]);
+
+	SetTheInputs(pNetplay, pGame, pNetplay->nTick);
+
+	ClearScreen(pGame->pVM, RGB(0,0,0));
+	Run(pGame);
+
+	pNetplay->nTick++;
+	pNetplay->nRollback = pNetplay->nTick;
+
+	return true;
+}
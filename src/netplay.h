@@ -0,0 +1,83 @@
+
+#ifndef _NETPLAY_H_
+#define _NETPLAY_H_
+
+#include <stdint.h>
+#include <deque>
+
+#include "game.h"
+#include "maths.h"
+#include "snapshot.h"
+
+
+#define NETHOST				"127.0.0.1"		///< the peer, over the loopback
+#define NETMAGIC			0x4E324B41		///< "A2KN"
+#define NETMAXINPUTS		32				///< inputs of a packet, the ones not acked yet
+#define NETHISTORY			128				///< ticks of inputs kept
+
+#define INPUTDELAY			2				///< ticks from the key press to its tick
+#define ROLLBACKWINDOW		16				///< snapshots kept, bounds the rollback depth
+#define ROLLBACKBUDGET		0.008			///< seconds of a frame for the re-simulation
+
+
+enum enNetPacket { npHello, npInputs };
+
+struct TNetPacket							///< as sent on the wire, the unused inputs excluded
+{
+	uint32_t nMagic;
+	uint32_t nTick;							///< tick of the first input
+	uint32_t nAck;							///< inputs of the peer received, up to this tick
+	uint8_t nType;							///< see enNetPacket
+	uint8_t nCount;							///< inputs in the packet
+	uint8_t nInputs[NETMAXINPUTS];
+};
+
+#define NETHEADERSIZE		offsetof(TNetPacket, nInputs)
+
+struct TDelayedPacket
+{
+	double Due;								///< time to send it, see GetTheTime()
+	TNetPacket Packet;
+};
+
+struct TNetLink								///< UDP socket, with latency and loss injected
+{
+	uintptr_t nSocket;						///< a SOCKET
+	unsigned char Peer[16];					///< a sockaddr_in
+	double Latency;							///< seconds, added to the outgoing packets
+	unsigned nLoss;							///< percentage of the outgoing packets dropped
+	TRandom Random;							///< for the losses, not the one of the game
+	std::deque<TDelayedPacket> Outgoing;
+	unsigned nSent, nDropped, nReceived;
+};
+
+struct TNetplay
+{
+	TNetLink Link;
+	int nLocal, nRemote;					///< players
+	bool bStarted;							///< the peer has answered
+
+	unsigned char nLocalInput;				///< read from the keyboard, see SetTheInput()
+	unsigned char Inputs[NETHISTORY][MAXPLAYERS];	///< by tick, the remote ones predicted
+	unsigned nTick;							///< next tick to be run
+	unsigned nLocalTick;					///< local inputs known, up to this tick
+	unsigned nRemoteTick;					///< remote inputs received, up to this tick
+	unsigned nPeerAck;						///< local inputs received by the peer, up to this tick
+	unsigned nRollback;						///< first tick mispredicted, nTick if none
+
+	TSnapshot Snapshots[ROLLBACKWINDOW];	///< by tick, taken before the tick is run
+											// statistics
+	double TickTime;						///< seconds to re-simulate a tick, smoothed
+	double MaxRollbackTime;					///< seconds, of the longest re-simulation
+	unsigned nRollbacks, nMaxDepth, nStalls;
+};
+
+bool SetupTheNetplay(TNetplay* pNetplay, int nLocal, int nLocalPort, int nRemotePort,
+	unsigned nLatency=0, unsigned nLoss=0);
+bool SetupTheNetplay(TNetplay* pNetplay, const char* pConfig);
+void CleanupTheNetplay(TNetplay* pNetplay);
+
+bool AdvanceTheNetplay(TNetplay* pNetplay, TGame* pGame);
+unsigned GetTheStallDepth(TNetplay* pNetplay);
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef _PLATFORM_H_
+#define _PLATFORM_H_
+
+/*!****************************************************************************
+
+	@file	platform.h
+
+	@brief	The few Win32 types and calls the headless game needs, so that
+			the game, the server and the batches build on Linux too: on
+			Windows just <windows.h>
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#ifdef __linux__
+
+#include <stdint.h>
+#include <strings.h>
+#include <time.h>
+
+typedef int				BOOL;
+typedef unsigned char	BYTE;
+typedef unsigned short	WORD;
+typedef uint32_t		DWORD;
+typedef unsigned int	UINT;
+typedef int32_t			LONG;
+typedef DWORD			COLORREF;
+typedef wchar_t			WCHAR;
+typedef const char*		LPCSTR;
+
+typedef void*	HANDLE;							///< of the GDI and of the OS,
+typedef void*	HWND;							///< never used without a window
+typedef void*	HDC;
+typedef void*	HBITMAP;
+typedef void*	HPEN;
+typedef void*	HBRUSH;
+typedef void*	HFONT;
+typedef void*	HINSTANCE;
+
+struct RECT { LONG left, top, right, bottom; };
+struct POINT { LONG x, y; };
+
+#define TRUE			1
+#define FALSE			0
+#define MAX_PATH		260
+
+#define TA_LEFT			0
+#define TA_RIGHT		2
+#define TA_CENTER		6
+
+#define RGB(r,g,b)		((COLORREF)(((BYTE)(r) | ((WORD)((BYTE)(g)) << 8)) | (((DWORD)(BYTE)(b)) << 16)))
+#define GetRValue(rgb)	((BYTE)(rgb))
+#define GetGValue(rgb)	((BYTE)((rgb) >> 8))
+#define GetBValue(rgb)	((BYTE)((rgb) >> 16))
+
+#define _strcmpi		strcasecmp
+
+/*!****************************************************************************
+* @brief	Milliseconds since an arbitrary epoch, as on Windows
+******************************************************************************/
+inline DWORD GetTickCount()
+{
+	timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+
+	return DWORD(uint64_t(Now.tv_sec) * 1000 + Now.tv_nsec / 1000000);
+}
+
+/*!****************************************************************************
+* @brief	Suspends the calling thread
+* @param	nMilliseconds The time to wait
+******************************************************************************/
+inline void Sleep(DWORD nMilliseconds)
+{
+	timespec Wait = { time_t(nMilliseconds / 1000), long(nMilliseconds % 1000) * 1000000 };
+
+	while( nanosleep(&Wait, &Wait) != 0 ) {}
+}
+
+#else
+
+#include <windows.h>
+
+#endif
+
+#endif
@@ -0,0 +1,248 @@
+/*!****************************************************************************
+
+	@file	profiler.h
+	@file	profiler.cpp
+
+	@brief	Frame profiler: scoped timers of the stages of a frame, kept in
+			a lock-free ring, shown as rolling percentiles and dumped as a
+			Chrome trace (chrome://tracing, or ui.perfetto.dev)
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include "platform.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "video.h"
+#include "tasks.h"
+#include "commdefs.h"
+#include "profiler.h"
+
+
+static const char* g_pStageNames[psCount] = {
+	"frame",
+	"input", "ships", "world", "draw", "limits", "collisions",
+	"bonus", "commit", "level", "info", "sounds",
+	"clear", "blit", "sleep"
+};
+
+
+
+/*!****************************************************************************
+* @brief	Starts timing a scope
+* @param	pProfiler Pointer to the profiler, nullptr for none
+* @param	nStage The stage timed, see enProfileStage
+* @note		Without a profiler the clock is not even read
+******************************************************************************/
+TProfileScope::TProfileScope(TProfiler* pProfiler, int nStage)
+	: pProfiler(pProfiler), nStage(nStage), Start(pProfiler ? GetTheTime() : 0)
+{
+}
+
+/*!****************************************************************************
+* @brief	Ends timing a scope, and records it
+******************************************************************************/
+TProfileScope::~TProfileScope()
+{
+	if( pProfiler ) AddTheSample(pProfiler, nStage, Start, GetTheTime());
+}
+
+/*!****************************************************************************
+* @brief	Gets the name of a stage
+* @param	nStage The stage, see enProfileStage
+* @return	The name, as shown and as traced
+******************************************************************************/
+const char* GetTheStageName(int nStage)
+{
+	assert(nStage >= 0 && nStage < psCount);
+
+	return g_pStageNames[nStage];
+}
+
+/*!****************************************************************************
+* @brief	Sets-up the profiler
+* @param	pProfiler Pointer to the profiler
+* @param	strTraceFile The file written by DumpTheTrace()
+******************************************************************************/
+void SetupTheProfiler(TProfiler* pProfiler, std::string strTraceFile)
+{
+	assert(pProfiler);
+
+	for(int i=0; i<PROFILERSIZE; ++i) pProfiler->Samples[i].bReady = false;
+
+	pProfiler->nHead = 0;
+	pProfiler->nFrame = 0;
+	pProfiler->Origin = GetTheTime();
+	pProfiler->strTraceFile = strTraceFile;
+	pProfiler->bOverlay = false;
+
+	for(int i=0; i<psCount; ++i)
+	{
+		pProfiler->P50[i] = pProfiler->P99[i] = 0;
+		pProfiler->Times[i].reserve(PROFILERSIZE);
+	}
+}
+
+/*!****************************************************************************
+* @brief	Records a sample
+* @param	pProfiler Pointer to the profiler
+* @param	nStage The stage, see enProfileStage
+* @param	Start, End The times of the stage, see GetTheTime()
+* @note		Lock-free: a writer takes a slot with an atomic increment, and
+*			publishes it with its ready flag. The oldest samples are
+*			overwritten.
+******************************************************************************/
+void AddTheSample(TProfiler* pProfiler, int nStage, double Start, double End)
+{
+	assert(pProfiler);
+	assert(nStage >= 0 && nStage < psCount);
+
+	uint64_t nIndex = pProfiler->nHead.fetch_add(1, std::memory_order_relaxed);
+	TProfileSample* pSample = &pProfiler->Samples[nIndex & (PROFILERSIZE - 1)];
+
+	pSample->bReady.store(false, std::memory_order_relaxed);
+
+	pSample->Start = Start;
+	pSample->End = End;
+	pSample->nFrame = pProfiler->nFrame;
+	pSample->nStage = (unsigned char) nStage;
+
+	pSample->bReady.store(true, std::memory_order_release);
+}
+
+/*!****************************************************************************
+* @brief	Updates the percentiles of the stages, over the last frames
+* @param	pProfiler Pointer to the profiler
+* @note		Walks the ring from the newest sample back; the scratch arrays
+*			hold a whole ring, so nothing is allocated
+******************************************************************************/
+static void UpdateThePercentiles(TProfiler* pProfiler)
+{
+	assert(pProfiler);
+
+	for(int i=0; i<psCount; ++i) pProfiler->Times[i].clear();
+
+	uint64_t nHead = pProfiler->nHead.load(std::memory_order_acquire);
+	uint64_t nCount = std::min<uint64_t>(nHead, PROFILERSIZE);
+
+	for(uint64_t n=0; n<nCount; ++n)
+	{
+		const TProfileSample* pSample = &pProfiler->Samples[(nHead - 1 - n) & (PROFILERSIZE - 1)];
+
+		if( !pSample->bReady.load(std::memory_order_acquire) ) continue;
+		if( pSample->nFrame + PROFILERWINDOW < pProfiler->nFrame ) break;
+
+		pProfiler->Times[pSample->nStage].push_back(pSample->End - pSample->Start);
+	}
+
+	for(int i=0; i<psCount; ++i)
+	{
+		std::vector<double>& Times = pProfiler->Times[i];
+
+		if( Times.empty() )
+		{
+			pProfiler->P50[i] = pProfiler->P99[i] = 0;
+			continue;
+		}
+
+		size_t n50 = Times.size() / 2;
+		size_t n99 = std::min(Times.size() - 1, Times.size() * 99 / 100);
+
+		std::nth_element(Times.begin(), Times.begin() + n50, Times.end());
+		pProfiler->P50[i] = Times[n50];
+
+		std::nth_element(Times.begin() + n50, Times.begin() + n99, Times.end());
+		pProfiler->P99[i] = Times[n99];
+	}
+}
+
+/*!****************************************************************************
+* @brief	Ends a frame: the next samples belong to the next one
+* @param	pProfiler Pointer to the profiler
+******************************************************************************/
+void EndTheFrame(TProfiler* pProfiler)
+{
+	assert(pProfiler);
+
+	pProfiler->nFrame++;
+
+	if( pProfiler->bOverlay && pProfiler->nFrame % PROFILERREFRESH == 0 )
+	{
+		UpdateThePercentiles(pProfiler);
+	}
+}
+
+/*!****************************************************************************
+* @brief	Draws the percentiles of the stages, over the game
+* @param	pProfiler Pointer to the profiler
+* @param	pVM Pointer to the video manager
+******************************************************************************/
+void ShowTheProfiler(TProfiler* pProfiler, TVideoManager* pVM)
+{
+	assert(pProfiler);
+	assert(pVM);
+
+	if( !pProfiler->bOverlay ) return;
+
+	char Buffer[256];
+	int nY = 48;
+
+	sprintf(Buffer, "%-10s %7s %7s", "ms", "p50", "p99");
+	DrawText(pVM, Buffer, 16, nY, RGB(255,255,0), TA_LEFT);
+
+	for(int i=0; i<psCount; ++i)
+	{
+		nY += 20;
+
+		sprintf(Buffer, "%-10s %7.3f %7.3f", g_pStageNames[i],
+			pProfiler->P50[i] * 1000.0, pProfiler->P99[i] * 1000.0);
+		DrawText(pVM, Buffer, 16, nY, RGB(255,255,0), TA_LEFT);
+	}
+}
+
+/*!****************************************************************************
+* @brief	Writes the samples in the ring as a Chrome trace
+* @param	pProfiler Pointer to the profiler
+* @return	Returns true for success, false otherwise
+* @note		Complete events ("ph":"X"), in microseconds: the stages nest
+*			in their frames
+******************************************************************************/
+bool DumpTheTrace(TProfiler* pProfiler)
+{
+	assert(pProfiler);
+
+	FILE* fp = fopen(pProfiler->strTraceFile.c_str(), "w");
+	if( !fp ) return false;
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", fp);
+
+	uint64_t nHead = pProfiler->nHead.load(std::memory_order_acquire);
+	uint64_t nCount = std::min<uint64_t>(nHead, PROFILERSIZE);
+	bool bFirst = true;
+											// the oldest first
+	for(uint64_t n=nHead-nCount; n<nHead; ++n)
+	{
+		const TProfileSample* pSample = &pProfiler->Samples[n & (PROFILERSIZE - 1)];
+
+		if( !pSample->bReady.load(std::memory_order_acquire) ) continue;
+
+		fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+			"\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+			bFirst ? "" : ",\n", g_pStageNames[pSample->nStage],
+			(pSample->Start - pProfiler->Origin) * 1e6,
+			(pSample->End - pSample->Start) * 1e6, pSample->nFrame);
+
+		bFirst = false;
+	}
+
+	fputs("\n]}\n", fp);
+
+	return fclose(fp) == 0;
+}
@@ -0,0 +1,69 @@
+
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "video.h"
+#include "tasks.h"
+#include "commdefs.h"
+
+
+#define PROFILERSIZE		8192			///< samples in the ring, a power of 2
+#define PROFILERWINDOW		(2 * FPS)		///< frames of the percentiles
+#define PROFILERREFRESH		(FPS / 4)		///< frames between two updates of the percentiles
+
+
+enum enProfileStage {						///< the stages of a frame, in their order
+	psFrame,								///< the whole frame, see MainLoop()
+	psInput, psShips, psWorld, psDraw, psLimits, psCollisions,
+	psBonus, psCommit, psLevel, psInfo, psSounds,
+	psClear, psBlit, psSleep,
+	psCount
+};
+
+struct TProfileSample
+{
+	double Start, End;						///< seconds, see GetTheTime()
+	unsigned nFrame;
+	unsigned char nStage;					///< see enProfileStage
+	std::atomic<bool> bReady;				///< written, for the readers
+};
+
+struct TProfiler
+{
+	TProfileSample Samples[PROFILERSIZE];	///< a ring, the oldest overwritten
+	std::atomic<uint64_t> nHead;			///< samples taken since the setup
+
+	unsigned nFrame;
+	double Origin;							///< of the trace
+	std::string strTraceFile;
+	bool bOverlay;							///< the percentiles are drawn
+
+	double P50[psCount], P99[psCount];		///< seconds, over the last PROFILERWINDOW frames
+	std::vector<double> Times[psCount];		///< scratch, for the percentiles
+};
+
+struct TProfileScope						///< times the scope it lives in
+{
+	TProfiler* pProfiler;
+	int nStage;
+	double Start;
+
+	TProfileScope(TProfiler* pProfiler, int nStage);
+	~TProfileScope();
+};
+
+void SetupTheProfiler(TProfiler* pProfiler, std::string strTraceFile);
+void AddTheSample(TProfiler* pProfiler, int nStage, double Start, double End);
+void EndTheFrame(TProfiler* pProfiler);
+void ShowTheProfiler(TProfiler* pProfiler, TVideoManager* pVM);
+bool DumpTheTrace(TProfiler* pProfiler);
+
+const char* GetTheStageName(int nStage);
+
+#endif
@@ -0,0 +1,1159 @@
+/*!****************************************************************************
+
+	@file	server.h
+	@file	server.cpp
+
+	@brief	Headless game server: many sessions stepped in parallel on a
+			shared job system, clients over TCP or UDP sending their
+			inputs and receiving the states as deltas
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#ifdef __linux__
+	#include <sys/epoll.h>
+#elif !defined(_WIN32_WINNT)
+	#define _WIN32_WINNT	0x0600				// for WSAPoll()
+#endif
+
+#include "sockets.h"							// before windows.h
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "game.h"
+#include "tasks.h"
+#include "utils.h"
+#include "commdefs.h"
+#include "snapshot.h"
+#include "server.h"
+#include "counters.h"
+
+
+#define LISTENTAG			0				///< poller tags, the clients use their address
+#define UDPTAG				1
+#define STANDINTIMEOUT		2.0				///< seconds, for the stand-ins to drain
+
+
+
+/*!****************************************************************************
+* @brief	Makes an IPv4 address
+* @param	pHost The host, nullptr for any
+* @param	nPort The port
+* @return	The address
+******************************************************************************/
+static sockaddr_in MakeTheAddress(const char* pHost, int nPort)
+{
+	sockaddr_in Addr;
+	memset(&Addr, 0, sizeof(Addr));
+
+	Addr.sin_family = AF_INET;
+	Addr.sin_port = htons((unsigned short)nPort);
+	Addr.sin_addr.s_addr = pHost ? inet_addr(pHost) : htonl(INADDR_ANY);
+
+	return Addr;
+}
+
+/*!****************************************************************************
+* @brief	Appends a message to a stream
+* @param	Stream The stream
+* @param	Header The header, its size and magic are set here
+* @param	Payload The payload, may be empty
+******************************************************************************/
+static void PutTheMessage(std::vector<unsigned char>& Stream, TMessageHeader Header,
+	const std::vector<unsigned char>& Payload)
+{
+	Header.nMagic = SERVERMAGIC;
+	Header.nSize = uint32_t(sizeof(Header) + Payload.size());
+
+	const unsigned char* pHeader = (const unsigned char*)&Header;
+
+	Stream.insert(Stream.end(), pHeader, pHeader + sizeof(Header));
+	Stream.insert(Stream.end(), Payload.begin(), Payload.end());
+}
+
+/*!****************************************************************************
+* @brief	Takes the first message out of a TCP stream
+* @param	Stream The stream, the message is removed
+* @param	Header The header of the message
+* @param	Payload The payload of the message
+* @return	1 for a message, 0 if it is not complete yet, -1 if the
+*			stream is corrupted
+******************************************************************************/
+static int GetTheMessage(std::vector<unsigned char>& Stream, TMessageHeader& Header,
+	std::vector<unsigned char>& Payload)
+{
+	if( Stream.size() < sizeof(Header) ) return 0;
+
+	memcpy(&Header, Stream.data(), sizeof(Header));
+
+	if( Header.nMagic != SERVERMAGIC || Header.nSize < sizeof(Header)
+		|| Header.nSize > sizeof(Header) + MAXSNAPSHOTSIZE ) return -1;
+
+	if( Stream.size() < Header.nSize ) return 0;
+
+	Payload.assign(Stream.begin() + sizeof(Header), Stream.begin() + Header.nSize);
+	Stream.erase(Stream.begin(), Stream.begin() + Header.nSize);
+
+	return 1;
+}
+
+/*!****************************************************************************
+* @brief	Sets-up a poller
+* @param	pPoller Pointer to the poller
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool SetupThePoller(TPoller* pPoller)
+{
+	assert(pPoller);
+
+	pPoller->Items.clear();
+	pPoller->Ready.clear();
+
+#ifdef __linux__
+	pPoller->nEpoll = ::epoll_create1(0);
+
+	return pPoller->nEpoll >= 0;
+#else
+	pPoller->nEpoll = -1;
+
+	return true;
+#endif
+}
+
+/*!****************************************************************************
+* @brief	Cleans-up a poller, the sockets are left open
+* @param	pPoller Pointer to the poller
+******************************************************************************/
+void CleanupThePoller(TPoller* pPoller)
+{
+	assert(pPoller);
+
+#ifdef __linux__
+	if( pPoller->nEpoll >= 0 ) ::close(pPoller->nEpoll);
+#endif
+
+	pPoller->nEpoll = -1;
+	pPoller->Items.clear();
+}
+
+/*!****************************************************************************
+* @brief	Watches a socket, or changes the events watched
+* @param	pPoller Pointer to the poller
+* @param	nSocket The socket
+* @param	nTag Reported with the events of the socket
+* @param	nEvents The events to be watched, see enPollerEvent
+* @param	bNew True for a socket not watched yet
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool WatchTheSocket(TPoller* pPoller, uintptr_t nSocket, uintptr_t nTag, unsigned nEvents, bool bNew)
+{
+	assert(pPoller);
+
+#ifdef __linux__
+	epoll_event Event;
+	memset(&Event, 0, sizeof(Event));
+
+	Event.events = (nEvents & peRead ? EPOLLIN : 0) | (nEvents & peWrite ? EPOLLOUT : 0);
+	Event.data.u64 = nTag;
+
+	return ::epoll_ctl(pPoller->nEpoll, bNew ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, int(nSocket), &Event) == 0;
+#else
+	for(TPollItem& Item : pPoller->Items)
+	{
+		if( Item.nSocket == nSocket )
+		{
+			Item.nTag = nTag;
+			Item.nEvents = nEvents;
+			return !bNew;
+		}
+	}
+
+	pPoller->Items.push_back(TPollItem{ nSocket, nTag, nEvents });
+
+	return bNew;
+#endif
+}
+
+/*!****************************************************************************
+* @brief	Stops watching a socket
+* @param	pPoller Pointer to the poller
+* @param	nSocket The socket, still open
+******************************************************************************/
+void ForgetTheSocket(TPoller* pPoller, uintptr_t nSocket)
+{
+	assert(pPoller);
+
+#ifdef __linux__
+	epoll_event Event;						// ignored, but not null before 2.6.9
+	::epoll_ctl(pPoller->nEpoll, EPOLL_CTL_DEL, int(nSocket), &Event);
+#else
+	for(size_t i=0; i<pPoller->Items.size(); ++i)
+	{
+		if( pPoller->Items[i].nSocket == nSocket )
+		{
+			pPoller->Items[i] = pPoller->Items.back();
+			pPoller->Items.pop_back();
+			break;
+		}
+	}
+#endif
+}
+
+/*!****************************************************************************
+* @brief	Waits for the events of the sockets watched
+* @param	pPoller Pointer to the poller
+* @param	nTimeout Milliseconds, 0 for not waiting
+* @return	The number of sockets with events, in Ready, -1 on error
+******************************************************************************/
+int WaitThePoller(TPoller* pPoller, int nTimeout)
+{
+	assert(pPoller);
+
+	pPoller->Ready.clear();
+
+#ifdef __linux__
+	epoll_event Events[256];
+
+	int nCount = ::epoll_wait(pPoller->nEpoll, Events, 256, nTimeout);
+
+	if( nCount < 0 ) return errno == EINTR ? 0 : -1;
+
+	for(int i=0; i<nCount; ++i)
+	{
+		unsigned nEvents = 0;
+
+		if( Events[i].events & EPOLLIN ) nEvents |= peRead;
+		if( Events[i].events & EPOLLOUT ) nEvents |= peWrite;
+		if( Events[i].events & (EPOLLERR | EPOLLHUP) ) nEvents |= peError | peRead;
+
+		pPoller->Ready.push_back(TPollEvent{ uintptr_t(Events[i].data.u64), nEvents });
+	}
+#else
+	static thread_local std::vector<WSAPOLLFD> Fds;
+
+	Fds.resize(pPoller->Items.size());
+
+	for(size_t i=0; i<Fds.size(); ++i)
+	{
+		Fds[i].fd = SOCKET(pPoller->Items[i].nSocket);
+		Fds[i].events = (pPoller->Items[i].nEvents & peRead ? POLLRDNORM : 0)
+			| (pPoller->Items[i].nEvents & peWrite ? POLLWRNORM : 0);
+		Fds[i].revents = 0;
+	}
+											// WSAPoll() wants a socket at least
+	if( Fds.empty() )
+	{
+		::Sleep(nTimeout);
+		return 0;
+	}
+
+	int nCount = ::WSAPoll(Fds.data(), ULONG(Fds.size()), nTimeout);
+
+	if( nCount < 0 ) return -1;
+
+	for(size_t i=0; i<Fds.size() && nCount > 0; ++i)
+	{
+		if( !Fds[i].revents ) continue;
+
+		unsigned nEvents = 0;
+
+		if( Fds[i].revents & POLLRDNORM ) nEvents |= peRead;
+		if( Fds[i].revents & POLLWRNORM ) nEvents |= peWrite;
+		if( Fds[i].revents & (POLLERR | POLLHUP) ) nEvents |= peError | peRead;
+
+		pPoller->Ready.push_back(TPollEvent{ pPoller->Items[i].nTag, nEvents });
+	}
+#endif
+
+	return int(pPoller->Ready.size());
+}
+
+/*!****************************************************************************
+* @brief	Creates a session: a headless game, ready to run
+* @return	Pointer to the session, nullptr on failure
+* @note		The systems of the game run serially: the sessions run in
+*			parallel instead
+******************************************************************************/
+static TSession* CreateTheSession()
+{
+	TVecStrings strErrors;
+	TGame* pGame = CreateTheHeadlessGame(strErrors);
+
+	for(const std::string& strError : strErrors)
+	{
+		LogTheText(("server: " + strError + "\n").c_str());
+	}
+
+	if( !pGame ) return nullptr;
+
+	StartTheMatch(pGame);
+
+	TSession* pSession = new TSession();
+	assert(pSession);
+
+	pSession->pGame = pGame;
+	pSession->nInput = 0;
+	pSession->StepTime = 0;
+
+	for(int i=0; i<SERVERHISTORY; ++i) pSession->nTicks[i] = NOBASE;
+
+	return pSession;
+}
+
+/*!****************************************************************************
+* @brief	Deletes a session, with its game
+* @param	pSession Pointer to the session
+******************************************************************************/
+static void DeleteTheSession(TSession* pSession)
+{
+	assert(pSession);
+
+	DeleteTheHeadlessGame(pSession->pGame);
+	delete pSession;
+}
+
+/*!****************************************************************************
+* @brief	Queues the last state of a session for a client, as a delta
+*			from the last state the client has received
+* @param	pSession Pointer to the session
+* @param	pClient Pointer to the client
+* @note		Called by the job running the session: the client belongs
+*			to the session only
+******************************************************************************/
+static void QueueTheState(TSession* pSession, TServerClient* pClient)
+{
+	assert(pSession);
+	assert(pClient);
+
+	static const TSnapshot Empty;
+
+	uint32_t nTick = pSession->pGame->nTick;
+	uint32_t nBase = pClient->nAck;
+											// the base must be still kept
+	if( nBase == NOBASE || nTick - nBase >= SERVERHISTORY
+		|| pSession->nTicks[nBase % SERVERHISTORY] != nBase ) nBase = NOBASE;
+
+	const TSnapshot& Base = nBase == NOBASE ? Empty : pSession->Snapshots[nBase % SERVERHISTORY];
+
+	EncodeTheDelta(Base, pSession->Snapshots[nTick % SERVERHISTORY], pClient->Delta);
+
+	TMessageHeader Header;
+	memset(&Header, 0, sizeof(Header));
+
+	Header.nType = smState;
+	Header.nTick = nTick;
+	Header.nBase = nBase;
+	Header.nSession = uint16_t(pClient->nSession);
+											// a slow client skips states,
+											// the next delta catches up
+	if( pClient->nTransport == trTcp )
+	{
+		if( pClient->Output.size() > SERVERMAXOUTPUT )
+		{
+			pClient->nSkipped++;
+			return;
+		}
+
+		PutTheMessage(pClient->Output, Header, pClient->Delta);
+	}
+	else
+	{
+		if( sizeof(Header) + pClient->Delta.size() > SERVERMAXDATAGRAM )
+		{
+			pClient->nSkipped++;
+			return;
+		}
+
+		pClient->Datagrams.emplace_back();
+		PutTheMessage(pClient->Datagrams.back(), Header, pClient->Delta);
+	}
+
+	pClient->nStates++;
+}
+
+/*!****************************************************************************
+* @brief	Runs a tick of a session and queues its state for its clients
+* @param	pSession Pointer to the session
+******************************************************************************/
+static void StepTheSession(TSession* pSession)
+{
+	assert(pSession);
+
+	double Time = GetTheTime();
+
+	TGame* pGame = pSession->pGame;
+											// a tick is a frame, headless
+	ResetTheArena(&pGame->Arena);
+											// a new match as soon as the
+											// last one is over
+	pGame->nInputs[0] = pSession->nInput;
+	if( IsGameOver(pGame) ) pGame->nInputs[0] |= inRestart;
+
+	Run(pGame);
+
+	unsigned nSlot = pGame->nTick % SERVERHISTORY;
+
+	SaveTheSnapshot(pGame, pSession->Snapshots[nSlot]);
+	pSession->nTicks[nSlot] = pGame->nTick;
+
+	for(TServerClient* pClient : pSession->pClients)
+	{
+		if( !pClient->bClosed ) QueueTheState(pSession, pClient);
+	}
+
+	pSession->StepTime = GetTheTime() - Time;
+}
+
+/*!****************************************************************************
+* @brief	Adds a client
+* @param	pServer Pointer to the server
+* @param	nTransport The transport, see enTransport
+* @param	nSocket The connection, or the UDP socket
+* @return	Pointer to the client
+******************************************************************************/
+static TServerClient* AddTheClient(TServer* pServer, int nTransport, SOCKET nSocket)
+{
+	assert(pServer);
+
+	TServerClient* pClient = new TServerClient();
+	assert(pClient);
+
+	pClient->nTransport = nTransport;
+	pClient->nSocket = uintptr_t(nSocket);
+	pClient->nKey = 0;
+	pClient->nSession = -1;
+	pClient->bPlayer = false;
+	pClient->nAck = NOBASE;
+	pClient->LastSeen = GetTheTime();
+	pClient->bWriting = false;
+	pClient->nStates = pClient->nSkipped = 0;
+	pClient->bClosed = false;
+
+	pServer->pClients.push_back(pClient);
+
+	return pClient;
+}
+
+/*!****************************************************************************
+* @brief	Makes a client join a session, once
+* @param	pServer Pointer to the server
+* @param	pClient Pointer to the client
+* @param	nSession The session
+* @return	Returns true if the client is in the session
+******************************************************************************/
+static bool JoinTheSession(TServer* pServer, TServerClient* pClient, unsigned nSession)
+{
+	assert(pServer);
+	assert(pClient);
+
+	if( pClient->nSession >= 0 ) return pClient->nSession == int(nSession);
+
+	if( nSession >= pServer->pSessions.size() ) return false;
+
+	TSession* pSession = pServer->pSessions[nSession];
+											// the first client drives the
+											// ship, the others watch
+	pClient->nSession = int(nSession);
+	pClient->bPlayer = std::none_of(pSession->pClients.begin(), pSession->pClients.end(),
+		[](TServerClient* p) { return p->bPlayer; });
+
+	pSession->pClients.push_back(pClient);
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Handles a message from a client
+* @param	pServer Pointer to the server
+* @param	pClient Pointer to the client
+* @param	Header The header of the message
+******************************************************************************/
+static void HandleTheMessage(TServer* pServer, TServerClient* pClient, const TMessageHeader& Header)
+{
+	assert(pServer);
+	assert(pClient);
+
+	pClient->LastSeen = GetTheTime();
+
+	switch( Header.nType )
+	{
+		case smJoin:
+		{
+			JoinTheSession(pServer, pClient, Header.nSession);
+		}
+		break;
+											// also joins, e.g. if the join
+											// datagram has been lost
+		case smInput:
+		{
+			if( !JoinTheSession(pServer, pClient, Header.nSession) ) break;
+
+			if( pClient->bPlayer ) pServer->pSessions[pClient->nSession]->nInput = Header.nInput;
+
+			pClient->nAck = Header.nTick;
+		}
+		break;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Marks a client as closed, it is removed by SweepTheClients()
+* @param	pServer Pointer to the server
+* @param	pClient Pointer to the client
+******************************************************************************/
+static void CloseTheClient(TServer* pServer, TServerClient* pClient)
+{
+	assert(pServer);
+	assert(pClient);
+
+	if( pClient->bClosed ) return;
+
+	pClient->bClosed = true;
+
+	if( pClient->nTransport == trTcp )
+	{
+		ForgetTheSocket(&pServer->Poller, pClient->nSocket);
+		closesocket(SOCKET(pClient->nSocket));
+	}
+	else pServer->UdpClients.erase(pClient->nKey);
+
+	if( pClient->nSession < 0 ) return;
+
+	TSession* pSession = pServer->pSessions[pClient->nSession];
+
+	pSession->pClients.erase(std::find(pSession->pClients.begin(), pSession->pClients.end(), pClient));
+											// the next one drives the ship
+	if( pClient->bPlayer )
+	{
+		pSession->nInput = 0;
+		if( !pSession->pClients.empty() ) pSession->pClients.front()->bPlayer = true;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Deletes the clients closed, and drops the UDP clients silent
+*			for too long
+* @param	pServer Pointer to the server
+******************************************************************************/
+static void SweepTheClients(TServer* pServer)
+{
+	assert(pServer);
+
+	double Time = GetTheTime();
+
+	for(TServerClient* pClient : pServer->pClients)
+	{
+		if( pClient->nTransport == trUdp && Time - pClient->LastSeen > SERVERTIMEOUT )
+		{
+			CloseTheClient(pServer, pClient);
+		}
+	}
+
+	std::vector<TServerClient*>& pClients = pServer->pClients;
+
+	for(size_t i=0; i<pClients.size(); )
+	{
+		if( pClients[i]->bClosed )
+		{
+			delete pClients[i];
+			pClients[i] = pClients.back();
+			pClients.pop_back();
+		}
+		else ++i;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Sends the states queued for a client
+* @param	pServer Pointer to the server
+* @param	pClient Pointer to the client
+******************************************************************************/
+static void FlushTheClient(TServer* pServer, TServerClient* pClient)
+{
+	assert(pServer);
+	assert(pClient);
+
+	if( pClient->bClosed ) return;
+
+	if( pClient->nTransport == trUdp )
+	{
+		for(std::vector<unsigned char>& Datagram : pClient->Datagrams)
+		{
+			::sendto(SOCKET(pClient->nSocket), (const char*)Datagram.data(), int(Datagram.size()), 0,
+				(const sockaddr*)pClient->Addr, sizeof(sockaddr_in));
+
+			pServer->Stats.nBytes += Datagram.size();
+		}
+
+		pClient->Datagrams.clear();
+		return;
+	}
+
+	size_t nSize = pClient->Output.size();
+
+	if( !SendTheStream(pClient->nSocket, pClient->Output) )
+	{
+		CloseTheClient(pServer, pClient);
+		return;
+	}
+
+	pServer->Stats.nBytes += nSize - pClient->Output.size();
+											// waits for the room to send
+											// the rest, if any
+	bool bWriting = !pClient->Output.empty();
+
+	if( bWriting != pClient->bWriting )
+	{
+		pClient->bWriting = bWriting;
+		WatchTheSocket(&pServer->Poller, pClient->nSocket, uintptr_t(pClient), peRead | (bWriting ? peWrite : 0), false);
+	}
+}
+
+/*!****************************************************************************
+* @brief	Handles the network events, until a timeout
+* @param	pServer Pointer to the server
+* @param	nTimeout Milliseconds to wait for the first event
+******************************************************************************/
+static void PollTheServer(TServer* pServer, int nTimeout)
+{
+	assert(pServer);
+
+	if( WaitThePoller(&pServer->Poller, nTimeout) <= 0 ) return;
+
+	TMessageHeader Header;
+	std::vector<unsigned char> Payload;
+
+	for(const TPollEvent& Event : pServer->Poller.Ready)
+	{
+		if( Event.nTag == LISTENTAG )
+		{
+			for(;;)
+			{
+				SOCKET nSocket = ::accept(SOCKET(pServer->nListen), nullptr, nullptr);
+
+				if( nSocket == INVALID_SOCKET ) break;
+
+				int nNoDelay = 1;
+				::setsockopt(nSocket, IPPROTO_TCP, TCP_NODELAY, (const char*)&nNoDelay, sizeof(nNoDelay));
+
+				if( !SetNonBlocking(nSocket) )
+				{
+					closesocket(nSocket);
+					continue;
+				}
+
+				TServerClient* pClient = AddTheClient(pServer, trTcp, nSocket);
+				WatchTheSocket(&pServer->Poller, uintptr_t(nSocket), uintptr_t(pClient), peRead, true);
+			}
+		}
+		else if( Event.nTag == UDPTAG )
+		{
+			for(;;)
+			{
+				sockaddr_in Addr;
+				socklen_t nAddrSize = sizeof(Addr);
+
+				int nSize = ::recvfrom(SOCKET(pServer->nUdp), (char*)pServer->Datagram.data(),
+					int(pServer->Datagram.size()), 0, (sockaddr*)&Addr, &nAddrSize);
+
+				if( nSize == SOCKET_ERROR ) break;
+				if( nSize < int(sizeof(Header)) ) continue;
+
+				memcpy(&Header, pServer->Datagram.data(), sizeof(Header));
+
+				if( Header.nMagic != SERVERMAGIC ) continue;
+											// a client by address and port
+				uint64_t nKey = (uint64_t(Addr.sin_addr.s_addr) << 16) | Addr.sin_port;
+
+				auto It = pServer->UdpClients.find(nKey);
+				TServerClient* pClient = nullptr;
+
+				if( It != pServer->UdpClients.end() ) pClient = It->second;
+				else
+				{
+					pClient = AddTheClient(pServer, trUdp, SOCKET(pServer->nUdp));
+					pClient->nKey = nKey;
+					memcpy(pClient->Addr, &Addr, sizeof(Addr));
+
+					pServer->UdpClients[nKey] = pClient;
+				}
+
+				HandleTheMessage(pServer, pClient, Header);
+			}
+		}
+		else
+		{
+			TServerClient* pClient = (TServerClient*)Event.nTag;
+
+			if( pClient->bClosed ) continue;
+
+			if( Event.nEvents & peWrite ) FlushTheClient(pServer, pClient);
+
+			if( pClient->bClosed || !(Event.nEvents & peRead) ) continue;
+
+			bool bOpen = ReceiveTheStream(pClient->nSocket, pClient->Input);
+
+			int nResult;
+
+			while( (nResult = GetTheMessage(pClient->Input, Header, Payload)) > 0 )
+			{
+				HandleTheMessage(pServer, pClient, Header);
+			}
+
+			if( !bOpen || nResult < 0 ) CloseTheClient(pServer, pClient);
+		}
+	}
+}
+
+/*!****************************************************************************
+* @brief	Sets-up the server
+* @param	pServer Pointer to the server
+* @param	nPort The TCP and UDP port
+* @param	nSessions The number of sessions
+* @param	nThreads Worker threads, 0 for one less than the cores
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool SetupTheServer(TServer* pServer, int nPort, unsigned nSessions, unsigned nThreads)
+{
+	assert(pServer);
+	assert(nSessions > 0 && nSessions <= 65535);
+
+	if( !StartTheSockets() ) return false;
+
+	pServer->nPort = nPort;
+	pServer->nTick = 0;
+	pServer->Datagram.resize(65536);
+
+	SOCKET nListen = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	SOCKET nUdp = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	pServer->nListen = uintptr_t(nListen);
+	pServer->nUdp = uintptr_t(nUdp);
+
+	sockaddr_in Addr = MakeTheAddress(nullptr, nPort);
+											// no other process can take
+											// the port
+	bool bResult = nListen != INVALID_SOCKET && nUdp != INVALID_SOCKET
+		&& SetExclusive(nListen)
+		&& ::bind(nListen, (sockaddr*)&Addr, sizeof(Addr)) == 0
+		&& ::listen(nListen, SOMAXCONN) == 0
+		&& ::bind(nUdp, (sockaddr*)&Addr, sizeof(Addr)) == 0
+		&& SetNonBlocking(nListen) && SetNonBlocking(nUdp)
+		&& SetupThePoller(&pServer->Poller)
+		&& WatchTheSocket(&pServer->Poller, pServer->nListen, LISTENTAG, peRead, true)
+		&& WatchTheSocket(&pServer->Poller, pServer->nUdp, UDPTAG, peRead, true);
+
+	if( !bResult )
+	{
+		LogTheText("server: cannot open the sockets\n");
+		return false;
+	}
+
+	SetupJobSystem(&pServer->Jobs, nThreads);
+
+	for(unsigned i=0; i<nSessions; ++i)
+	{
+		TSession* pSession = CreateTheSession();
+		if( !pSession ) return false;
+
+		pServer->pSessions.push_back(pSession);
+	}
+
+	pServer->Stats.Start = GetTheTime();
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Cleans-up the server
+* @param	pServer Pointer to the server
+******************************************************************************/
+void CleanupTheServer(TServer* pServer)
+{
+	assert(pServer);
+
+	for(TServerClient* pClient : pServer->pClients) CloseTheClient(pServer, pClient);
+	SweepTheClients(pServer);
+
+	for(TSession* pSession : pServer->pSessions) DeleteTheSession(pSession);
+	pServer->pSessions.clear();
+
+	CleanupJobSystem(&pServer->Jobs);
+	CleanupThePoller(&pServer->Poller);
+
+	if( SOCKET(pServer->nListen) != INVALID_SOCKET ) closesocket(SOCKET(pServer->nListen));
+	if( SOCKET(pServer->nUdp) != INVALID_SOCKET ) closesocket(SOCKET(pServer->nUdp));
+
+	StopTheSockets();
+}
+
+/*!****************************************************************************
+* @brief	Runs a tick of all the sessions, then sends their states
+* @param	pServer Pointer to the server
+* @note		The sessions are independent: they run in parallel, each one
+*			serially, and each one encodes the states of its clients
+******************************************************************************/
+void StepTheServer(TServer* pServer)
+{
+	assert(pServer);
+
+	SweepTheClients(pServer);
+
+	double Time = GetTheTime();
+
+	ParallelFor(&pServer->Jobs, unsigned(pServer->pSessions.size()), 1,
+		[pServer](unsigned nFirst, unsigned nLast)
+		{
+			for(unsigned i=nFirst; i<nLast; ++i) StepTheSession(pServer->pSessions[i]);
+		});
+
+	TServerStats* pStats = &pServer->Stats;
+
+	pStats->TickTimes.push_back(GetTheTime() - Time);
+
+	for(TSession* pSession : pServer->pSessions) pStats->CpuTime += pSession->StepTime;
+
+	for(TServerClient* pClient : pServer->pClients)
+	{
+		pStats->nStates += pClient->nStates;
+		pStats->nSkipped += pClient->nSkipped;
+		pClient->nStates = pClient->nSkipped = 0;
+
+		FlushTheClient(pServer, pClient);
+	}
+
+	pServer->nTick++;
+
+	PublishTheCounters();
+}
+
+/*!****************************************************************************
+* @brief	Reports the statistics of the last period, then restarts them
+* @param	pServer Pointer to the server
+* @note		The capacity is the number of sessions a core can run in a
+*			tick, from the mean cost of a session; the tail latency is
+*			the time to step all the sessions, that must stay below a
+*			tick (1/FPS)
+******************************************************************************/
+void ReportTheServer(TServer* pServer)
+{
+	assert(pServer);
+
+	TServerStats* pStats = &pServer->Stats;
+	std::vector<double>& Times = pStats->TickTimes;
+
+	double Period = GetTheTime() - pStats->Start;
+
+	if( Times.empty() || Period <= 0 ) return;
+
+	std::sort(Times.begin(), Times.end());
+
+	double P50 = Times[Times.size() / 2];
+	double P99 = Times[std::min(Times.size() - 1, size_t(ceil(Times.size() * 0.99)) - 1)];
+
+	unsigned nSessions = unsigned(pServer->pSessions.size());
+	double SessionTime = pStats->CpuTime / (double(Times.size()) * nSessions);
+	unsigned nClients = unsigned(pServer->pClients.size());
+
+	char Buffer[512];
+	sprintf(Buffer, "server: %u sessions, %u clients, %u threads, %u ticks in %.1f s: "
+		"tick p50 %.3f ms p99 %.3f ms max %.3f ms, session %.1f us, %.0f sessions/core, "
+		"%.2f cores busy, %llu states (%llu skipped), %.1f kB/s per client\n",
+		nSessions, nClients, GetTheThreads(&pServer->Jobs), unsigned(Times.size()), Period,
+		P50 * 1e3, P99 * 1e3, Times.back() * 1e3, SessionTime * 1e6,
+		SessionTime > 0 ? 1.0 / (FPS * SessionTime) : 0.0, pStats->CpuTime / Period,
+		(unsigned long long)pStats->nStates, (unsigned long long)pStats->nSkipped,
+		nClients ? pStats->nBytes / Period / nClients / 1024.0 : 0.0);
+
+	LogTheText(Buffer);
+
+	Times.clear();
+	pStats->CpuTime = 0;
+	pStats->nBytes = pStats->nStates = pStats->nSkipped = 0;
+	pStats->Start = GetTheTime();
+}
+
+/*!****************************************************************************
+* @brief	Runs the server, at FPS ticks per second
+* @param	pConfig "port:sessions[:standins[:seconds]]", e.g. "7100:64:128:30",
+*			with the stand-in clients run by the server itself and the
+*			seconds to run, 0 for ever
+* @return	Returns false if the server could not start
+******************************************************************************/
+bool RunTheServer(const char* pConfig)
+{
+	assert(pConfig);
+
+	int nPort = 0;
+	unsigned nSessions = 0, nStandIns = 0;
+	double Seconds = 0;
+
+	if( sscanf(pConfig, "%d:%u:%u:%lf", &nPort, &nSessions, &nStandIns, &Seconds) < 2
+		|| nSessions == 0 || nSessions > 65535 ) return false;
+
+	TServer* pServer = new TServer();
+	assert(pServer);
+
+	bool bResult = SetupTheServer(pServer, nPort, nSessions);
+
+	if( bResult )
+	{
+		std::thread StandIns;
+
+		if( nStandIns )
+		{
+			StandIns = std::thread(RunTheStandIns, nPort, nStandIns, nSessions, Seconds);
+		}
+
+		double Start = GetTheTime();
+		double Next = Start;
+											// the network in between the
+											// ticks, then a tick
+		while( Seconds <= 0 || GetTheTime() - Start < Seconds )
+		{
+			Next += 1.0 / FPS;
+
+			double Wait;
+
+			while( (Wait = Next - GetTheTime()) > 0 )
+			{
+				PollTheServer(pServer, int(ceil(Wait * 1000.0)));
+			}
+
+			StepTheServer(pServer);
+											// too late: the ticks lost
+											// are not run again
+			if( GetTheTime() - Next > 1.0 / FPS ) Next = GetTheTime();
+
+			if( GetTheTime() - pServer->Stats.Start >= SERVERREPORT ) ReportTheServer(pServer);
+		}
+
+		ReportTheServer(pServer);
+											// the stand-ins leave first
+		if( StandIns.joinable() )
+		{
+			double Drain = GetTheTime() + STANDINTIMEOUT;
+			while( GetTheTime() < Drain ) PollTheServer(pServer, 10);
+
+			StandIns.join();
+		}
+	}
+
+	CleanupTheServer(pServer);
+	delete pServer;
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Handles a state received by a stand-in client
+* @param	pStandIn Pointer to the stand-in
+* @param	Header The header of the message
+* @param	Payload The delta
+******************************************************************************/
+static void TakeTheState(TStandIn* pStandIn, const TMessageHeader& Header, const TSnapshot& Payload)
+{
+	assert(pStandIn);
+
+	static const TSnapshot Empty;
+
+	if( Header.nType != smState ) return;
+
+	pStandIn->nBytes += Header.nSize;
+
+	bool bBase = Header.nBase == NOBASE || pStandIn->nTicks[Header.nBase % SERVERHISTORY] == Header.nBase;
+	const TSnapshot& Base = Header.nBase == NOBASE ? Empty : pStandIn->States[Header.nBase % SERVERHISTORY];
+
+	TSnapshot& State = pStandIn->States[Header.nTick % SERVERHISTORY];
+											// the state must be a valid
+											// snapshot of that tick
+	TSnapshotHeader Snapshot;
+
+	bool bResult = bBase && DecodeTheDelta(Base, Payload, pStandIn->Delta)
+		&& pStandIn->Delta.size() >= sizeof(Snapshot);
+
+	if( bResult )
+	{
+		memcpy(&Snapshot, pStandIn->Delta.data(), sizeof(Snapshot));
+
+		bResult = Snapshot.nMagic == SNAPSHOTMAGIC && Snapshot.nVersion == SNAPSHOTVERSION
+			&& Snapshot.nSize == pStandIn->Delta.size() && Snapshot.nTick == Header.nTick;
+	}
+
+	if( !bResult )
+	{
+		pStandIn->nErrors++;
+		return;
+	}
+
+	State.swap(pStandIn->Delta);
+	pStandIn->nTicks[Header.nTick % SERVERHISTORY] = Header.nTick;
+	pStandIn->nAck = Header.nTick;
+	pStandIn->nStates++;
+}
+
+/*!****************************************************************************
+* @brief	Runs the stand-in clients of a load test, half over TCP and
+*			half over UDP, until the time is over
+* @param	nPort The port of the server, on the loopback
+* @param	nClients The number of clients
+* @param	nSessions The number of sessions, joined round-robin
+* @param	Seconds The seconds to run, 0 for ever
+* @return	Returns true if all the states have been decoded
+* @note		Each stand-in sends random inputs at FPS and decodes all
+*			the states it receives
+******************************************************************************/
+bool RunTheStandIns(int nPort, unsigned nClients, unsigned nSessions, double Seconds)
+{
+	TPoller Poller;
+	if( !SetupThePoller(&Poller) ) return false;
+
+	std::vector<TStandIn*> pStandIns;
+	sockaddr_in Server = MakeTheAddress(SERVERHOST, nPort);
+
+	TMessageHeader Header, Message;
+	memset(&Message, 0, sizeof(Message));
+
+	for(unsigned i=0; i<nClients; ++i)
+	{
+		TStandIn* pStandIn = new TStandIn();
+		assert(pStandIn);
+
+		pStandIn->nTransport = i % 2 ? trUdp : trTcp;
+		pStandIn->nSession = i % nSessions;
+		pStandIn->nAck = NOBASE;
+		pStandIn->nInput = 0;
+		SeedTheRandom(&pStandIn->Random, RANDSEED + i);
+		for(int j=0; j<SERVERHISTORY; ++j) pStandIn->nTicks[j] = NOBASE;
+
+		SOCKET nSocket = pStandIn->nTransport == trTcp
+			? ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)
+			: ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+											// a connected UDP socket only
+											// hears from the server
+		if( nSocket == INVALID_SOCKET
+			|| ::connect(nSocket, (sockaddr*)&Server, sizeof(Server)) != 0
+			|| !SetNonBlocking(nSocket) )
+		{
+			if( nSocket != INVALID_SOCKET ) closesocket(nSocket);
+			delete pStandIn;
+			continue;
+		}
+
+		pStandIn->nSocket = uintptr_t(nSocket);
+		WatchTheSocket(&Poller, pStandIn->nSocket, uintptr_t(pStandIn), peRead, true);
+											// over UDP the inputs join
+		if( pStandIn->nTransport == trTcp )
+		{
+			Message.nType = smJoin;
+			Message.nSession = uint16_t(pStandIn->nSession);
+			PutTheMessage(pStandIn->Output, Message, TSnapshot());
+		}
+
+		pStandIns.push_back(pStandIn);
+	}
+
+	double Start = GetTheTime();
+	double Next = Start;
+
+	TSnapshot Payload;
+	std::vector<unsigned char> Datagram(65536);
+
+	while( Seconds <= 0 || GetTheTime() - Start < Seconds )
+	{
+		Next += 1.0 / FPS;
+											// inputs held for a while, as
+											// a player does
+		for(TStandIn* pStandIn : pStandIns)
+		{
+			if( RandUnit(&pStandIn->Random) < 0.1 )
+			{
+				pStandIn->nInput = (unsigned char)(RandUnit(&pStandIn->Random) * 32) & ~inRestart;
+			}
+
+			Message.nType = smInput;
+			Message.nSession = uint16_t(pStandIn->nSession);
+			Message.nInput = pStandIn->nInput;
+			Message.nTick = pStandIn->nAck;
+			PutTheMessage(pStandIn->Output, Message, TSnapshot());
+											// a datagram per message
+			if( pStandIn->nTransport == trUdp )
+			{
+				::send(SOCKET(pStandIn->nSocket), (const char*)pStandIn->Output.data(), int(pStandIn->Output.size()), 0);
+				pStandIn->Output.clear();
+			}
+			else SendTheStream(pStandIn->nSocket, pStandIn->Output);
+		}
+
+		double Wait;
+
+		while( (Wait = Next - GetTheTime()) > 0 )
+		{
+			if( WaitThePoller(&Poller, int(ceil(Wait * 1000.0))) <= 0 ) continue;
+
+			for(const TPollEvent& Event : Poller.Ready)
+			{
+				TStandIn* pStandIn = (TStandIn*)Event.nTag;
+
+				if( pStandIn->nTransport == trUdp )
+				{
+					int nSize;
+
+					while( (nSize = ::recv(SOCKET(pStandIn->nSocket), (char*)Datagram.data(), int(Datagram.size()), 0)) >= int(sizeof(Header)) )
+					{
+						memcpy(&Header, Datagram.data(), sizeof(Header));
+
+						if( Header.nMagic != SERVERMAGIC || Header.nSize != unsigned(nSize) ) continue;
+
+						Payload.assign(Datagram.begin() + sizeof(Header), Datagram.begin() + nSize);
+						TakeTheState(pStandIn, Header, Payload);
+					}
+				}
+				else
+				{
+					ReceiveTheStream(pStandIn->nSocket, pStandIn->Input);
+
+					while( GetTheMessage(pStandIn->Input, Header, Payload) > 0 )
+					{
+						TakeTheState(pStandIn, Header, Payload);
+					}
+				}
+			}
+		}
+	}
+
+	unsigned nStates = 0, nErrors = 0;
+	uint64_t nBytes = 0;
+
+	for(TStandIn* pStandIn : pStandIns)
+	{
+		nStates += pStandIn->nStates;
+		nErrors += pStandIn->nErrors;
+		nBytes += pStandIn->nBytes;
+
+		ForgetTheSocket(&Poller, pStandIn->nSocket);
+		closesocket(SOCKET(pStandIn->nSocket));
+		delete pStandIn;
+	}
+
+	CleanupThePoller(&Poller);
+
+	char Buffer[256];
+	sprintf(Buffer, "stand-ins: %u clients, %u states decoded, %u errors, %.1f kB/s per client\n",
+		unsigned(pStandIns.size()), nStates, nErrors,
+		pStandIns.size() ? nBytes / (GetTheTime() - Start) / pStandIns.size() / 1024.0 : 0.0);
+
+	LogTheText(Buffer);
+
+	return nErrors == 0;
+}
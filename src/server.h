@@ -0,0 +1,152 @@
+
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+#include "game.h"
+#include "tasks.h"
+#include "snapshot.h"
+
+
+#define SERVERHOST			"127.0.0.1"		///< of the stand-in clients
+#define SERVERMAGIC			0x5632324B		///< "K22V"
+#define SERVERHISTORY		32				///< snapshots kept per session, the delta bases
+#define SERVERMAXOUTPUT		(256u << 10)	///< bytes queued to a TCP client before skipping states
+#define SERVERMAXDATAGRAM	60000			///< bytes, the bigger states are not sent over UDP
+#define SERVERTIMEOUT		5.0				///< seconds of silence before dropping a UDP client
+#define SERVERREPORT		5.0				///< seconds between the reports
+#define NOBASE				0xFFFFFFFFu		///< a state not encoded as a delta
+
+
+enum enServerMessage {
+	smJoin,									///< client: joins nSession
+	smInput,								///< client: nInput, and the last state received in nTick
+	smState									///< server: the state of nTick, as a delta from nBase
+};
+
+struct TMessageHeader						///< followed by the payload, nSize bytes in all
+{
+	uint32_t nMagic;
+	uint32_t nSize;
+	uint32_t nTick;
+	uint32_t nBase;
+	uint16_t nSession;
+	uint8_t nType;							///< see enServerMessage
+	uint8_t nInput;							///< see enInput
+};
+
+enum enPollerEvent { peRead = 1, peWrite = 2, peError = 4 };
+
+struct TPollEvent
+{
+	uintptr_t nTag;
+	unsigned nEvents;						///< see enPollerEvent
+};
+
+struct TPollItem
+{
+	uintptr_t nSocket, nTag;
+	unsigned nEvents;
+};
+
+struct TPoller								///< epoll on Linux, WSAPoll() elsewhere
+{
+	int nEpoll;
+	std::vector<TPollItem> Items;			///< the sockets watched, without epoll
+	std::vector<TPollEvent> Ready;			///< filled by WaitThePoller()
+};
+
+enum enTransport { trTcp, trUdp };
+
+struct TServerClient
+{
+	int nTransport;							///< see enTransport
+	uintptr_t nSocket;						///< the connection, or the shared UDP socket
+	unsigned char Addr[16];					///< the sockaddr_in of a UDP client
+	uint64_t nKey;							///< address and port of a UDP client
+	int nSession;							///< -1 until joined
+	bool bPlayer;							///< drives the ship, the others watch
+	uint32_t nAck;							///< last state received, NOBASE for none
+	double LastSeen;						///< see GetTheTime()
+
+	std::vector<unsigned char> Input;		///< TCP stream, not parsed yet
+	std::vector<unsigned char> Output;		///< TCP stream, not sent yet
+	std::vector<std::vector<unsigned char>> Datagrams;	///< UDP, to be sent
+	bool bWriting;							///< watched for writing
+
+	TSnapshot Delta;						///< scratch
+	unsigned nStates, nSkipped;
+	bool bClosed;							///< to be removed, see SweepTheClients()
+};
+
+struct TSession
+{
+	TGame* pGame;
+	TSnapshot Snapshots[SERVERHISTORY];		///< by tick, after the tick is run
+	uint32_t nTicks[SERVERHISTORY];
+	unsigned char nInput;					///< of the player, for the next tick
+	std::vector<TServerClient*> pClients;
+	double StepTime;						///< seconds, of the last tick, the encoding included
+};
+
+struct TServerStats							///< over a report period
+{
+	std::vector<double> TickTimes;			///< seconds, to step all the sessions
+	double CpuTime;							///< seconds, the steps of the sessions summed up
+	uint64_t nBytes, nStates, nSkipped;
+	double Start;
+};
+
+struct TServer
+{
+	uintptr_t nListen, nUdp;
+	int nPort;
+	TPoller Poller;
+	TJobSystem Jobs;
+
+	std::vector<TSession*> pSessions;
+	std::vector<TServerClient*> pClients;
+	std::map<uint64_t, TServerClient*> UdpClients;
+
+	unsigned nTick;
+	TServerStats Stats;
+	std::vector<unsigned char> Datagram;	///< scratch, for the receiving
+};
+
+struct TStandIn								///< a stand-in client, for the load tests
+{
+	int nTransport;							///< see enTransport
+	uintptr_t nSocket;
+	int nSession;
+	uint32_t nAck;							///< last state decoded
+	unsigned char nInput;
+	TRandom Random;
+
+	std::vector<unsigned char> Input, Output;	///< TCP streams
+	TSnapshot States[SERVERHISTORY];		///< by tick, the delta bases
+	uint32_t nTicks[SERVERHISTORY];
+	TSnapshot Delta;						///< scratch
+
+	unsigned nStates, nErrors;
+	uint64_t nBytes;
+};
+
+bool SetupThePoller(TPoller* pPoller);
+void CleanupThePoller(TPoller* pPoller);
+bool WatchTheSocket(TPoller* pPoller, uintptr_t nSocket, uintptr_t nTag, unsigned nEvents, bool bNew);
+void ForgetTheSocket(TPoller* pPoller, uintptr_t nSocket);
+int WaitThePoller(TPoller* pPoller, int nTimeout);
+
+bool SetupTheServer(TServer* pServer, int nPort, unsigned nSessions, unsigned nThreads=0);
+void CleanupTheServer(TServer* pServer);
+void StepTheServer(TServer* pServer);
+void ReportTheServer(TServer* pServer);
+
+bool RunTheServer(const char* pConfig);
+bool RunTheStandIns(int nPort, unsigned nClients, unsigned nSessions, double Seconds);
+
+#endif
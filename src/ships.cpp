@@ -11,10 +11,10 @@
 
 ******************************************************************************/
 
-#include <windows.h>
-#include <mmsystem.h>
+#include "platform.h"
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 //#include <sdl2/sdl.h>
 
@@ -57,6 +57,9 @@ void Build(TShip* pShip, TVideoManager *pVM, TSoundManager* pSM,
 
 	pShip->bShield = false;
 	pShip->nShieldTick = 0;
+	pShip->nWanderTicks = 0;
+	pShip->nThrustTime = 0;
+	pShip->nShieldBlink = 0;
 
 	pShip->nClass = nClass;
 
@@ -160,6 +163,11 @@ void Build(TShip* pShip, TVideoManager *pVM, TSoundManager* pSM,
 			pShip->Shape.push_back(WShield);
 		}
 	}
+											// the scratch copies take their
+											// capacity now, not in a tick
+	pShip->DrawnShape = pShip->Shape;
+	pShip->DrawnEngine = pShip->Engine;
+	pShip->DrawnShield = pShip->Shield;
 }
 
 /*!****************************************************************************
@@ -199,6 +207,11 @@ void Reset(TShip* pShip)
 	pShip->Rot = 0;
 	pShip->nExplosionTicks = -1;
 	pShip->nImpulseTicks = 0;
+	pShip->nWanderTicks = 0;
+											// left by the last explosion
+	pShip->nDebris = 0;
+	memset(pShip->Debris, 0, sizeof(pShip->Debris));
+	memset(pShip->DebrisScales, 0, sizeof(pShip->DebrisScales));
 
 	pShip->bShield = false;
 	pShip->nShieldTick = 0;
@@ -365,22 +378,22 @@ void SetVisible(TShip* pShip, bool bVisible)
 	{
 		if( GetClass(pShip) == scAlienBig )
 		{
-			PlayTheSound(pShip->pSM, "saucer_big", true);
+			PlayTheSound(pShip->pSM, snSaucerBig, true);
 		}
 		else if( GetClass(pShip) == scAlienSmall )
 		{
-			PlayTheSound(pShip->pSM, "saucer_small", true);
+			PlayTheSound(pShip->pSM, snSaucerSmall, true);
 		}
 	}
 	else
 	{
 		if( GetClass(pShip) == scAlienBig )
 		{
-			StopTheSound(pShip->pSM, "saucer_big");
+			StopTheSound(pShip->pSM, snSaucerBig);
 		}
 		else if( GetClass(pShip) == scAlienSmall )
 		{
-			StopTheSound(pShip->pSM, "saucer_small");
+			StopTheSound(pShip->pSM, snSaucerSmall);
 		}
 	}
 
@@ -421,13 +434,12 @@ void Impulse(TShip* pShip, double Impulse)
 
 											// plays the thrust sound
 	unsigned nDelay = 250;
-	static unsigned nCurTick = nDelay;
 
-	if( (::GetTickCount() - nCurTick ) >= nDelay )
+	if( (::GetTickCount() - pShip->nThrustTime ) >= nDelay )
 	{
-		nCurTick = GetTickCount();
+		pShip->nThrustTime = GetTickCount();
 
-		PlayTheSound(pShip->pSM, "ship_thrust");
+		PlayTheSound(pShip->pSM, snShipThrust);
 	}
 }
 
@@ -461,7 +473,7 @@ void Explode(TShip* pShip)
 
 	pShip->nExplosionTicks = SHIP_EXPLOSIONTICKS;
 
-	PlayTheSound(pShip->pSM, "ship_explosion");
+	PlayTheSound(pShip->pSM, snShipExplosion);
 
 	DoExplosion(pShip);
 }
@@ -518,8 +530,10 @@ void Update(TShip* pShip, double Dt)
 			{
 				pShip->bShield = false;
 			}
-
-			TVecVecPoints Shape = pShip->Shape;
+											// placed in a scratch copy, which
+											// keeps its capacity: no allocation
+			TVecVecPoints& Shape = pShip->DrawnShape;
+			Shape = pShip->Shape;
 
 			Rotate(Shape, pShip->Rot);
 			TVector2 Vel = GetVel(pShip);
@@ -534,7 +548,8 @@ void Update(TShip* pShip, double Dt)
 
 			if (pShip->nImpulseTicks > 0)
 			{
-				TVecVecPoints Engine = pShip->Engine;
+				TVecVecPoints& Engine = pShip->DrawnEngine;
+				Engine = pShip->Engine;
 
 				Rotate(Engine, pShip->Rot);
 				Translate(Engine, pShip->Pos);
@@ -545,15 +560,16 @@ void Update(TShip* pShip, double Dt)
 											// draw the shield
 			if( IsShieldActive(pShip) )
 			{
-				TVecVecPoints Shield = pShip->Shield;
+				TVecVecPoints& Shield = pShip->DrawnShield;
+				Shield = pShip->Shield;
 
 				Translate(Shield, pShip->Pos);
 
 											// some special effects ...
 				{
-					static int nCounter = 0, nMaxCount = 4;
-					if( nCounter++ > nMaxCount ) nCounter = 0;
-					double ShadeLevel = double(nCounter) / double(nMaxCount);
+					int nMaxCount = 4;
+					if( pShip->nShieldBlink++ > nMaxCount ) pShip->nShieldBlink = 0;
+					double ShadeLevel = double(pShip->nShieldBlink) / double(nMaxCount);
 
 											// ... blink the shield when time is running out
 					if( pShip->nShieldTick > SHIELDTICKS*3.0/4.0)
@@ -569,18 +585,18 @@ void Update(TShip* pShip, double Dt)
 		}
 		else
 		{
-			static int nCounter = 0;
-			nCounter++;
+			pShip->nWanderTicks++;
 
-			TVecVecPoints Shape = pShip->Shape;
+			TVecVecPoints& Shape = pShip->DrawnShape;
+			Shape = pShip->Shape;
 
 			TVector2 Vel = GetVel(pShip);
 
 			double Module = 5.0;
 
-			if( nCounter > 25 )
+			if( pShip->nWanderTicks > 25 )
 			{
-				nCounter = 0;
+				pShip->nWanderTicks = 0;
 
 				Vel.Y += Rand(2.0*Module);
 				Vel.X += AbsRand(Module);
@@ -599,7 +615,8 @@ void Update(TShip* pShip, double Dt)
 
 			if (pShip->nImpulseTicks > 0)
 			{
-				TVecVecPoints Engine = pShip->Engine;
+				TVecVecPoints& Engine = pShip->DrawnEngine;
+				Engine = pShip->Engine;
 
 				Rotate(Engine, pShip->Rot);
 				Translate(Engine, pShip->Pos);
@@ -639,7 +656,7 @@ void ActivateTheShield(TShip* pShip)
 		pShip->nShieldTick = 0;
 		pShip->bShield = true;
 
-		PlayTheSound(pShip->pSM, "shield");	
+		PlayTheSound(pShip->pSM, snShield);	
 	}
 }
 
@@ -8,7 +8,7 @@
 #ifndef _SHIPS_H_
 #define _SHIPS_H_
 
-#include <windows.h>
+#include "platform.h"
 #include <vector>
 //#include <sdl2/sdl.h>
 
@@ -45,6 +45,7 @@ struct TShip
 	bool bAlive, bVisible;
 	TVector2 Size, Pos, Vel;
 	TVecVecPoints Shape, Engine, Shield;
+	TVecVecPoints DrawnShape, DrawnEngine, DrawnShield;	///< scratch, placed for the drawing
 	int nImpulseTicks, nExplosionTicks;
 
 	TVector2 Debris[SHIP_NDEBRIS];
@@ -53,6 +54,10 @@ struct TShip
 
 	bool bShield;
 	unsigned nShieldTick;
+
+	int nWanderTicks;			///< alien ships: ticks since the last change of course
+	unsigned nThrustTime;		///< GetTickCount() of the last thrust sound
+	int nShieldBlink;			///< cycles the shade of the shield, when drawn
 };
 
 
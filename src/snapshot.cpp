@@ -0,0 +1,767 @@
+/*!****************************************************************************
+
+	@file	snapshot.h
+	@file	snapshot.cpp
+
+	@brief	Binary snapshot of the whole game state: save states, bug
+			repros and rollback
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include "platform.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "game.h"
+#include "maths.h"
+#include "tasks.h"
+#include "utils.h"
+#include "snapshot.h"
+
+
+											// the layout of the snapshot is:
+											// header, game, ships, then for each
+											// archetype its count and its columns,
+											// then the entities not committed yet.
+											// Any change must bump SNAPSHOTVERSION
+struct TGameState
+{
+	int32_t nScore, nLevel, nDifficulty, nLives, nBonusCount;
+	uint32_t nTick, nShotTick[MAXPLAYERS];
+	int32_t nAlienShotTicks, nAlienShipTick;
+	uint64_t nRandState, nSeed;
+	uint32_t nShips, nSpawns;
+	uint8_t bGameOver;
+};
+
+struct TShipState
+{
+	int32_t nClass;
+	uint32_t Color;
+	double Rot, Impulse;
+	TVector2 Size, Pos, Vel;
+	int32_t nImpulseTicks, nExplosionTicks;
+	TVector2 Debris[SHIP_NDEBRIS];
+	double DebrisScales[SHIP_NDEBRIS];
+	int32_t nDebris;
+	uint32_t nShieldTick;
+	int32_t nWanderTicks;
+	uint8_t bAlive, bVisible, bShield;
+};
+
+struct TSpawnState
+{
+	int32_t nArchetype;
+	TVector2 Pos, Vel;
+	double Rot, DRot, Radius;
+	uint32_t Color;
+	int32_t nClass, nOwner, nLifetime;
+	uint32_t nShapeSize;
+};
+
+struct TSnapshotReader
+{
+	const unsigned char* pData;
+	size_t nSize, nPos;
+	bool bOk;
+};
+
+
+/*!****************************************************************************
+* @brief	Appends raw data to a snapshot
+* @param	Snapshot The snapshot
+* @param	pData Pointer to the items
+* @param	nCount Number of items
+******************************************************************************/
+template <typename T>
+static void Put(TSnapshot& Snapshot, const T* pData, size_t nCount)
+{
+	size_t nPos = Snapshot.size();
+
+	Snapshot.resize(nPos + sizeof(T) * nCount);
+
+	if( nCount ) memcpy(&Snapshot[nPos], pData, sizeof(T) * nCount);
+}
+
+/*!****************************************************************************
+* @brief	Reads raw data from a snapshot
+* @param	Reader The reader of the snapshot
+* @param	pData Pointer to the items
+* @param	nCount Number of items
+* @return	Returns false if the snapshot is too short
+******************************************************************************/
+template <typename T>
+static bool Get(TSnapshotReader& Reader, T* pData, size_t nCount)
+{
+	if( !Reader.bOk || nCount > (Reader.nSize - Reader.nPos) / sizeof(T) ) return Reader.bOk = false;
+
+	if( nCount ) memcpy(pData, Reader.pData + Reader.nPos, sizeof(T) * nCount);
+	Reader.nPos += sizeof(T) * nCount;
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Reads a column of an archetype from a snapshot
+* @param	Reader The reader of the snapshot
+* @param	Column The column, resized
+* @param	nCount Number of rows
+* @return	Returns false if the snapshot is too short
+******************************************************************************/
+template <typename T, typename A>
+static bool GetColumn(TSnapshotReader& Reader, std::vector<T, A>& Column, size_t nCount)
+{
+	if( !Reader.bOk || nCount > (Reader.nSize - Reader.nPos) / sizeof(T) ) return Reader.bOk = false;
+
+	Column.resize(nCount);
+
+	return Get(Reader, Column.data(), nCount);
+}
+
+/*!****************************************************************************
+* @brief	Gets the index of a ship, to be saved instead of its pointer
+* @param	pGame Pointer to the game engine
+* @param	pShip Pointer to the ship, may be nullptr
+* @return	The index of the ship, -1 if none
+******************************************************************************/
+static int32_t GetTheShipIndex(TGame* pGame, TShip* pShip)
+{
+	for(int i=0; i<pGame->pShips.size(); ++i)
+	{
+		if( pGame->pShips[i] == pShip ) return i;
+	}
+
+	return -1;
+}
+
+/*!****************************************************************************
+* @brief	Saves the whole game state
+* @param	pGame Pointer to the game engine
+* @param	Snapshot The snapshot, overwritten
+* @note		To be called between two ticks. The snapshot keeps its
+*			capacity, so the saves after the first one do not allocate.
+*			The padding is zeroed: the same state always gives the same
+*			bytes, so two snapshots can be compared with memcmp().
+******************************************************************************/
+void SaveTheSnapshot(TGame* pGame, TSnapshot& Snapshot)
+{
+	assert(pGame);
+
+	TWorld* pWorld = &pGame->World;
+
+	Snapshot.clear();
+
+	TSnapshotHeader Header;
+	memset(&Header, 0, sizeof(Header));
+	Put(Snapshot, &Header, 1);
+											// the game
+	TGameState State;
+	memset(&State, 0, sizeof(State));
+
+	State.nScore = pGame->nScore;
+	State.nLevel = pGame->nLevel;
+	State.nDifficulty = pGame->nDifficulty;
+	State.nLives = pGame->nLives;
+	State.nBonusCount = pGame->nBonusCount;
+	State.nTick = pGame->nTick;
+	memcpy(State.nShotTick, pGame->nShotTick, sizeof(State.nShotTick));
+	State.nAlienShotTicks = pGame->nAlienShotTicks;
+	State.nAlienShipTick = pGame->nAlienShipTick;
+	State.nRandState = pGame->Random.nState;
+	State.nSeed = pGame->nSeed;
+	State.nShips = uint32_t(pGame->pShips.size());
+	State.nSpawns = uint32_t(pWorld->Spawns.size());
+	State.bGameOver = pGame->bGameOver;
+
+	Put(Snapshot, &State, 1);
+											// the ships
+	for(TShip* pShip : pGame->pShips)
+	{
+		TShipState Ship;
+		memset(&Ship, 0, sizeof(Ship));
+
+		Ship.nClass = pShip->nClass;
+		Ship.Color = pShip->Color;
+		Ship.Rot = pShip->Rot;
+		Ship.Impulse = pShip->Impulse;
+		Ship.Size = pShip->Size;
+		Ship.Pos = pShip->Pos;
+		Ship.Vel = pShip->Vel;
+		Ship.nImpulseTicks = pShip->nImpulseTicks;
+		Ship.nExplosionTicks = pShip->nExplosionTicks;
+		memcpy(Ship.Debris, pShip->Debris, sizeof(Ship.Debris));
+		memcpy(Ship.DebrisScales, pShip->DebrisScales, sizeof(Ship.DebrisScales));
+		Ship.nDebris = pShip->nDebris;
+		Ship.nShieldTick = pShip->nShieldTick;
+		Ship.nWanderTicks = pShip->nWanderTicks;
+		Ship.bAlive = pShip->bAlive;
+		Ship.bVisible = pShip->bVisible;
+		Ship.bShield = pShip->bShield;
+
+		Put(Snapshot, &Ship, 1);
+	}
+											// the entities, column by column
+	for(int n=0; n<arCount; ++n)
+	{
+		TArchetype& A = pWorld->Archetypes[n];
+
+		assert(pWorld->Kills[n].empty());
+
+		uint32_t nCount = A.nCount;
+		Put(Snapshot, &nCount, 1);
+
+		if( A.nMask & cpPos ) Put(Snapshot, A.Pos.data(), nCount);
+		if( A.nMask & cpVel ) Put(Snapshot, A.Vel.data(), nCount);
+		if( A.nMask & cpSpin ) { Put(Snapshot, A.Rot.data(), nCount); Put(Snapshot, A.DRot.data(), nCount); }
+		if( A.nMask & cpRadius ) Put(Snapshot, A.Radius.data(), nCount);
+		if( A.nMask & cpColor ) Put(Snapshot, A.Color.data(), nCount);
+		if( A.nMask & cpClass ) Put(Snapshot, A.Class.data(), nCount);
+		if( A.nMask & cpLifetime ) Put(Snapshot, A.Lifetime.data(), nCount);
+
+		if( A.nMask & cpOwner )
+		{
+			for(unsigned i=0; i<nCount; ++i)
+			{
+				int32_t nOwner = GetTheShipIndex(pGame, A.Owner[i]);
+				Put(Snapshot, &nOwner, 1);
+			}
+		}
+
+		if( A.nMask & cpShape )
+		{
+			for(unsigned i=0; i<nCount; ++i)
+			{
+				uint32_t nSize = uint32_t(A.Shape[i].size());
+				Put(Snapshot, &nSize, 1);
+			}
+
+			for(unsigned i=0; i<nCount; ++i)
+			{
+				Put(Snapshot, A.Shape[i].data(), A.Shape[i].size());
+			}
+		}
+	}
+											// the entities spawned by the input
+											// handlers, entering at the next tick
+	for(const TEntity& Entity : pWorld->Spawns)
+	{
+		TSpawnState Spawn;
+		memset(&Spawn, 0, sizeof(Spawn));
+
+		Spawn.nArchetype = Entity.nArchetype;
+		Spawn.Pos = Entity.Pos;
+		Spawn.Vel = Entity.Vel;
+		Spawn.Rot = Entity.Rot;
+		Spawn.DRot = Entity.DRot;
+		Spawn.Radius = Entity.Radius;
+		Spawn.Color = Entity.Color;
+		Spawn.nClass = Entity.nClass;
+		Spawn.nOwner = GetTheShipIndex(pGame, Entity.pOwner);
+		Spawn.nLifetime = Entity.nLifetime;
+		Spawn.nShapeSize = uint32_t(Entity.Shape.size());
+
+		Put(Snapshot, &Spawn, 1);
+		Put(Snapshot, Entity.Shape.data(), Entity.Shape.size());
+	}
+
+	Header.nMagic = SNAPSHOTMAGIC;
+	Header.nVersion = SNAPSHOTVERSION;
+	Header.nSize = uint32_t(Snapshot.size());
+	Header.nTick = pGame->nTick;
+
+	memcpy(&Snapshot[0], &Header, sizeof(Header));
+}
+
+/*!****************************************************************************
+* @brief	Reads the archetypes and the spawns of a snapshot
+* @param	pGame Pointer to the game engine
+* @param	Reader The reader of the snapshot, after the ships
+* @param	State The state of the game, already read
+* @param	World The world to be filled, empty; its shapes are taken
+*			from its pool, see TakeTheShape()
+* @return	Returns false if the snapshot is not valid
+******************************************************************************/
+static bool ReadTheWorld(TGame* pGame, TSnapshotReader& Reader, const TGameState& State, TWorld& World)
+{
+	TArenaVector<int32_t> Owners(&pGame->Arena);
+	TArenaVector<uint32_t> Sizes(&pGame->Arena);
+
+	for(int n=0; n<arCount && Reader.bOk; ++n)
+	{
+		TArchetype& A = World.Archetypes[n];
+
+		uint32_t nCount = 0;
+		Get(Reader, &nCount, 1);
+
+		A.nCount = nCount;
+
+		if( A.nMask & cpPos ) GetColumn(Reader, A.Pos, nCount);
+		if( A.nMask & cpVel ) GetColumn(Reader, A.Vel, nCount);
+		if( A.nMask & cpSpin ) { GetColumn(Reader, A.Rot, nCount); GetColumn(Reader, A.DRot, nCount); }
+		if( A.nMask & cpRadius ) GetColumn(Reader, A.Radius, nCount);
+		if( A.nMask & cpColor ) GetColumn(Reader, A.Color, nCount);
+		if( A.nMask & cpClass ) GetColumn(Reader, A.Class, nCount);
+		if( A.nMask & cpLifetime ) GetColumn(Reader, A.Lifetime, nCount);
+
+		if( (A.nMask & cpOwner) && GetColumn(Reader, Owners, nCount) )
+		{
+			A.Owner.resize(nCount);
+
+			for(unsigned i=0; i<nCount; ++i)
+			{
+				if( Owners[i] >= int32_t(State.nShips) ) return false;
+
+				A.Owner[i] = Owners[i] < 0 ? nullptr : pGame->pShips[Owners[i]];
+			}
+		}
+
+		if( (A.nMask & cpShape) && GetColumn(Reader, Sizes, nCount) )
+		{
+			A.Shape.resize(nCount);
+			A.Vertices.resize(nCount);
+
+			for(unsigned i=0; i<nCount && Reader.bOk; ++i)
+			{
+				A.Shape[i] = TakeTheShape(&World);
+				A.Vertices[i] = TakeTheShape(&World);
+
+				GetColumn(Reader, A.Shape[i], Sizes[i]);
+			}
+		}
+	}
+
+	for(unsigned i=0; i<State.nSpawns && Reader.bOk; ++i)
+	{
+		TSpawnState Spawn;
+
+		if( !Get(Reader, &Spawn, 1) ) break;
+
+		if( Spawn.nArchetype < 0 || Spawn.nArchetype >= arCount
+			|| Spawn.nOwner >= int32_t(State.nShips) ) return false;
+
+		TEntity Entity;
+
+		Entity.nArchetype = Spawn.nArchetype;
+		Entity.Pos = Spawn.Pos;
+		Entity.Vel = Spawn.Vel;
+		Entity.Rot = Spawn.Rot;
+		Entity.DRot = Spawn.DRot;
+		Entity.Radius = Spawn.Radius;
+		Entity.Color = Spawn.Color;
+		Entity.nClass = Spawn.nClass;
+		Entity.pOwner = Spawn.nOwner < 0 ? nullptr : pGame->pShips[Spawn.nOwner];
+		Entity.nLifetime = Spawn.nLifetime;
+
+		Entity.Shape = TakeTheShape(&World);
+		GetColumn(Reader, Entity.Shape, Spawn.nShapeSize);
+
+		World.Spawns.push_back(std::move(Entity));
+	}
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Applies the state of the game and of the ships of a snapshot
+* @param	pGame Pointer to the game engine
+* @param	State The state of the game
+* @param	Ships The states of the ships, one per ship of the game
+******************************************************************************/
+static void ApplyTheState(TGame* pGame, const TGameState& State, const TArenaVector<TShipState>& Ships)
+{
+	pGame->nScore = State.nScore;
+	pGame->nLevel = State.nLevel;
+	pGame->nDifficulty = State.nDifficulty;
+	pGame->nLives = State.nLives;
+	pGame->nBonusCount = State.nBonusCount;
+	pGame->nTick = State.nTick;
+	memcpy(pGame->nShotTick, State.nShotTick, sizeof(State.nShotTick));
+	pGame->nAlienShotTicks = State.nAlienShotTicks;
+	pGame->nAlienShipTick = State.nAlienShipTick;
+	pGame->Random.nState = State.nRandState;
+	pGame->nSeed = State.nSeed;
+	pGame->bGameOver = State.bGameOver;
+
+	for(int i=0; i<Ships.size(); ++i)
+	{
+		TShip* pShip = pGame->pShips[i];
+		const TShipState& Ship = Ships[i];
+
+		pShip->nClass = enShipClass(Ship.nClass);
+		pShip->Color = Ship.Color;
+		pShip->Rot = Ship.Rot;
+		pShip->Impulse = Ship.Impulse;
+		pShip->Size = Ship.Size;
+		pShip->Pos = Ship.Pos;
+		pShip->Vel = Ship.Vel;
+		pShip->nImpulseTicks = Ship.nImpulseTicks;
+		pShip->nExplosionTicks = Ship.nExplosionTicks;
+		memcpy(pShip->Debris, Ship.Debris, sizeof(Ship.Debris));
+		memcpy(pShip->DebrisScales, Ship.DebrisScales, sizeof(Ship.DebrisScales));
+		pShip->nDebris = Ship.nDebris;
+		pShip->nShieldTick = Ship.nShieldTick;
+		pShip->nWanderTicks = Ship.nWanderTicks;
+		pShip->bAlive = Ship.bAlive;
+		pShip->bVisible = Ship.bVisible;
+		pShip->bShield = Ship.bShield;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Restores the whole game state
+* @param	pGame Pointer to the game engine
+* @param	Snapshot The snapshot, as saved by SaveTheSnapshot()
+* @return	Returns false if the snapshot is not valid: the game is
+*			left unchanged
+* @note		To be called between two ticks
+******************************************************************************/
+bool LoadTheSnapshot(TGame* pGame, const TSnapshot& Snapshot)
+{
+	assert(pGame);
+
+	TSnapshotReader Reader = { Snapshot.data(), Snapshot.size(), 0, true };
+
+	TSnapshotHeader Header;
+
+	if( !Get(Reader, &Header, 1) ) return false;
+
+	if( Header.nMagic != SNAPSHOTMAGIC || Header.nVersion != SNAPSHOTVERSION
+		|| Header.nSize != Snapshot.size() ) return false;
+
+	TGameState State;
+
+	if( !Get(Reader, &State, 1) || State.nShips != pGame->pShips.size() ) return false;
+
+											// the scratch columns live in the
+											// arena of the frame
+	TArenaVector<TShipState> Ships(&pGame->Arena);
+	GetColumn(Reader, Ships, State.nShips);
+											// decoded aside, then swapped in;
+											// the shapes come from the pool of
+											// the game and go back to it
+	TWorld& World = pGame->LoadedWorld;
+
+	World.FreeShapes.swap(pGame->World.FreeShapes);
+
+	bool bResult = ReadTheWorld(pGame, Reader, State, World)
+		&& Reader.bOk && Reader.nPos == Reader.nSize;
+
+	if( bResult )
+	{
+		ApplyTheState(pGame, State, Ships);
+
+		for(int n=0; n<arCount; ++n)
+		{
+			std::swap(pGame->World.Archetypes[n], World.Archetypes[n]);
+			pGame->World.Kills[n].clear();
+		}
+
+		pGame->World.Spawns.swap(World.Spawns);
+	}
+											// the replaced columns (or the ones
+											// decoded, on failure) are emptied
+	for(int n=0; n<arCount; ++n) ClearTheArchetype(&World, n);
+
+	World.FreeShapes.swap(pGame->World.FreeShapes);
+											// e.g. the game over music
+	if( bResult && !pGame->bHeadless ) StopAllSounds(pGame->pSM);
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Encodes a snapshot as the difference from a previous one
+* @param	Base The previous snapshot, empty for none
+* @param	Snapshot The snapshot to be encoded
+* @param	Delta The encoded difference, overwritten
+* @note		The bytes are XOR-ed with the ones of the base, then stored
+*			as runs: a varint count of unchanged bytes, a varint count
+*			of changed bytes and the changed bytes. Between two ticks
+*			most of the snapshot is unchanged
+******************************************************************************/
+void EncodeTheDelta(const TSnapshot& Base, const TSnapshot& Snapshot, TSnapshot& Delta)
+{
+	Delta.clear();
+
+	PutTheVarint(Delta, Snapshot.size());
+
+	size_t nSize = Snapshot.size();
+	size_t i = 0;
+
+	while( i < nSize )
+	{
+		size_t nSame = i;
+		while( nSame < nSize && nSame < Base.size() && Snapshot[nSame] == Base[nSame] ) nSame++;
+											// short unchanged runs are cheaper
+											// as changed bytes
+		size_t nDiff = nSame;
+		while( nDiff < nSize )
+		{
+			if( nDiff >= Base.size() || Snapshot[nDiff] != Base[nDiff] ) { nDiff++; continue; }
+
+			size_t nRun = nDiff;
+			while( nRun < nSize && nRun < Base.size() && nRun - nDiff < 3 && Snapshot[nRun] == Base[nRun] ) nRun++;
+
+			if( nRun - nDiff < 3 && nRun < nSize ) nDiff = nRun;
+			else break;
+		}
+
+		PutTheVarint(Delta, nSame - i);
+		PutTheVarint(Delta, nDiff - nSame);
+
+		for(size_t j=nSame; j<nDiff; ++j)
+		{
+			Delta.push_back(Snapshot[j] ^ (j < Base.size() ? Base[j] : 0));
+		}
+
+		i = nDiff;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Decodes a snapshot encoded by EncodeTheDelta()
+* @param	Base The previous snapshot, the same used by the encoding
+* @param	Delta The encoded difference
+* @param	Snapshot The snapshot, overwritten
+* @return	Returns false if the delta is corrupted
+* @note		The result is to be validated by LoadTheSnapshot()
+******************************************************************************/
+bool DecodeTheDelta(const TSnapshot& Base, const TSnapshot& Delta, TSnapshot& Snapshot)
+{
+	const unsigned char* pData = Delta.data();
+	const unsigned char* pEnd = pData + Delta.size();
+
+	uint64_t nSize;
+	if( !GetTheVarint(pData, pEnd, nSize) || nSize > MAXSNAPSHOTSIZE ) return false;
+
+	Snapshot.assign(Base.begin(), Base.begin() + std::min(Base.size(), size_t(nSize)));
+	Snapshot.resize(nSize, 0);
+
+	for(uint64_t i=0; i<nSize; )
+	{
+		uint64_t nSame, nDiff;
+
+		if( !GetTheVarint(pData, pEnd, nSame) || !GetTheVarint(pData, pEnd, nDiff) ) return false;
+		if( nSame > nSize - i || nDiff > nSize - i - nSame || nDiff > uint64_t(pEnd - pData) ) return false;
+
+		i += nSame;
+
+		for(uint64_t j=0; j<nDiff; ++j) Snapshot[i++] ^= *pData++;
+	}
+
+	return pData == pEnd;
+}
+
+/*!****************************************************************************
+* @brief	Writes a snapshot to file
+* @param	Snapshot The snapshot
+* @param	strFileName The file name
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool WriteTheSnapshot(const TSnapshot& Snapshot, std::string strFileName)
+{
+	FILE* fp = fopen(strFileName.c_str(), "wb");
+
+	if( !fp ) return false;
+
+	bool bResult = fwrite(Snapshot.data(), 1, Snapshot.size(), fp) == Snapshot.size();
+
+	return (fclose(fp) == 0) && bResult;
+}
+
+/*!****************************************************************************
+* @brief	Reads a snapshot from file
+* @param	Snapshot The snapshot, overwritten
+* @param	strFileName The file name
+* @return	Returns true for success, false otherwise
+* @note		The content is validated by LoadTheSnapshot()
+******************************************************************************/
+bool ReadTheSnapshot(TSnapshot& Snapshot, std::string strFileName)
+{
+	FILE* fp = fopen(strFileName.c_str(), "rb");
+
+	if( !fp ) return false;
+
+	fseek(fp, 0, SEEK_END);
+	long nSize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	bool bResult = nSize > 0;
+
+	if( bResult )
+	{
+		Snapshot.resize(nSize);
+		bResult = fread(Snapshot.data(), 1, nSize, fp) == size_t(nSize);
+	}
+
+	fclose(fp);
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Checks that a restored game runs exactly as the original one
+* @param	pGame Pointer to the game engine
+* @param	nTicks Number of ticks to be run
+* @return	Returns true if the two runs end in the same state, bit for bit
+* @note		Runs the game headless for nTicks, restores the start state
+*			and runs it again; the game is left at the end of the runs.
+*			The outcome and the timing of the save and of the load go to
+*			the console and to the debugger.
+******************************************************************************/
+bool VerifyTheSnapshot(TGame* pGame, unsigned nTicks)
+{
+	assert(pGame);
+
+	bool bHeadless = pGame->bHeadless;
+	SetHeadless(pGame, true);
+
+	TSnapshot Start, End, Replay;
+											// the first save allocates
+	SaveTheSnapshot(pGame, Start);
+
+	double Time = GetTheTime();
+	SaveTheSnapshot(pGame, Start);
+	double SaveTime = GetTheTime() - Time;
+
+	for(unsigned i=0; i<nTicks; ++i) Run(pGame);
+
+	SaveTheSnapshot(pGame, End);
+
+	Time = GetTheTime();
+	bool bResult = LoadTheSnapshot(pGame, Start);
+	double LoadTime = GetTheTime() - Time;
+
+	for(unsigned i=0; i<nTicks && bResult; ++i) Run(pGame);
+
+	SaveTheSnapshot(pGame, Replay);
+
+	SetHeadless(pGame, bHeadless);
+
+	bResult = bResult && End == Replay;
+
+	char Buffer[256];
+	sprintf(Buffer, "snapshot: %u bytes, save %.1f us, load %.1f us, %u ticks replayed: %s\n",
+		unsigned(Start.size()), SaveTime * 1e6, LoadTime * 1e6, nTicks, bResult ? "identical" : "DIFFERENT");
+
+	LogTheText(Buffer);
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Checks that the deltas between two snapshots decode back to
+*			the snapshots, bit for bit
+* @param	Base The older snapshot
+* @param	Snapshot The newer snapshot
+* @return	Returns true if all the round trips passed, false otherwise
+* @note		Both directions are checked, so that the snapshot grows and
+*			shrinks, and the empty and the same base too; a truncated
+*			delta has to be rejected. The sizes go to the console and to
+*			the debugger.
+******************************************************************************/
+static bool VerifyTheDelta(const TSnapshot& Base, const TSnapshot& Snapshot)
+{
+	const TSnapshot Empty;
+	const TSnapshot* pPairs[][2] = {
+		{ &Base, &Snapshot }, { &Snapshot, &Base }, { &Empty, &Snapshot }, { &Snapshot, &Snapshot }
+	};
+
+	TSnapshot Delta, Decoded;
+	size_t nSizes[4];
+	bool bResult = true;
+
+	for(int i=0; i<4; ++i)
+	{
+		const TSnapshot& From = *pPairs[i][0];
+		const TSnapshot& To = *pPairs[i][1];
+
+		EncodeTheDelta(From, To, Delta);
+		nSizes[i] = Delta.size();
+
+		bResult = bResult && DecodeTheDelta(From, Delta, Decoded) && Decoded == To;
+
+		Delta.pop_back();
+		bResult = bResult && !DecodeTheDelta(From, Delta, Decoded);
+	}
+
+	char Buffer[256];
+	sprintf(Buffer, "delta: %u bytes from the last state, %u back, %u from none, %u from the same: %s\n",
+		unsigned(nSizes[0]), unsigned(nSizes[1]), unsigned(nSizes[2]), unsigned(nSizes[3]),
+		bResult ? "identical" : "DIFFERENT");
+
+	LogTheText(Buffer);
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Checks, in a headless game, that the snapshots restore the
+*			runs exactly, e.g. after a change of the game state
+* @param	pConfig The ticks replayed by each check, a number; empty for
+*			SNAPSHOTTICKS
+* @return	Returns true if all the checks passed, false otherwise
+* @note		A bot plays from RANDSEED, and the state is checked
+*			SNAPSHOTROUNDS times along the way, with the deltas from the
+*			state of the last round: the outcome is the same at every run
+******************************************************************************/
+bool RunTheSnapshotCheck(const char* pConfig)
+{
+	assert(pConfig);
+
+	unsigned nTicks = SNAPSHOTTICKS;
+
+	if( *pConfig && (sscanf(pConfig, "%u", &nTicks) != 1 || nTicks == 0) ) return false;
+
+	TVecStrings strErrors;
+	TGame* pGame = CreateTheHeadlessGame(strErrors);
+
+	if( !pGame )
+	{
+		for(const std::string& strError : strErrors) LogTheText((strError + "\n").c_str());
+		return false;
+	}
+
+	StartTheMatch(pGame);
+
+	TRandom Random;
+	SeedTheRandom(&Random, RANDSEED);
+
+	TSnapshot Last, Snapshot;
+	SaveTheSnapshot(pGame, Last);
+
+	bool bResult = true;
+
+	for(unsigned n=0; n<SNAPSHOTROUNDS && bResult; ++n)
+	{
+											// the bot reaches a new state
+		for(unsigned i=0; i<SNAPSHOTTICKS; ++i)
+		{
+			if( IsGameOver(pGame) ) StartTheMatch(pGame, RANDSEED + n);
+
+			SetTheInput(pGame, (unsigned char)(RandUnit(&Random) * 256.0)
+				& (inLeft | inRight | inThrust | inFire | inShield));
+
+			ResetTheArena(&pGame->Arena);
+			Run(pGame);
+		}
+
+		SaveTheSnapshot(pGame, Snapshot);
+		bResult = VerifyTheDelta(Last, Snapshot);
+		Last.swap(Snapshot);
+											// then holds its commands for
+											// the two runs of the check
+		bResult = bResult && VerifyTheSnapshot(pGame, nTicks);
+	}
+
+	DeleteTheHeadlessGame(pGame);
+
+	return bResult;
+}
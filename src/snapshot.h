@@ -0,0 +1,42 @@
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+#define SNAPSHOTMAGIC		0x534B3241		///< "A2KS"
+#define SNAPSHOTVERSION		3
+#define SNAPSHOTTICKS		300				///< ticks run by VerifyTheSnapshot()
+#define SNAPSHOTROUNDS		10				///< checks run by RunTheSnapshotCheck()
+#define MAXSNAPSHOTSIZE		(64u << 20)		///< bytes, a sanity limit on the decoding
+
+
+struct TGame;
+
+typedef std::vector<unsigned char> TSnapshot;
+
+struct TSnapshotHeader
+{
+	uint32_t nMagic;
+	uint32_t nVersion;
+	uint32_t nSize;					///< bytes, the header included
+	uint32_t nTick;					///< tick of the game when saved
+};
+
+void SaveTheSnapshot(TGame* pGame, TSnapshot& Snapshot);
+bool LoadTheSnapshot(TGame* pGame, const TSnapshot& Snapshot);
+
+void EncodeTheDelta(const TSnapshot& Base, const TSnapshot& Snapshot, TSnapshot& Delta);
+bool DecodeTheDelta(const TSnapshot& Base, const TSnapshot& Delta, TSnapshot& Snapshot);
+
+bool WriteTheSnapshot(const TSnapshot& Snapshot, std::string strFileName);
+bool ReadTheSnapshot(TSnapshot& Snapshot, std::string strFileName);
+
+bool VerifyTheSnapshot(TGame* pGame, unsigned nTicks);
+bool RunTheSnapshotCheck(const char* pConfig);
+
+#endif
@@ -0,0 +1,140 @@
+/*!****************************************************************************
+
+	@file	sockets.h
+	@file	sockets.cpp
+
+	@brief	Helpers for the sockets and the non-blocking TCP streams,
+			shared by the network play, the game server and the
+			spectator stream, over Winsock or the BSD sockets of Linux
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include "sockets.h"
+
+#ifdef __linux__
+	#include <fcntl.h>
+	#include <signal.h>
+#endif
+
+
+
+/*!****************************************************************************
+* @brief	Starts Winsock, before the first socket of a module
+* @return	Returns true for success, false otherwise
+* @note		Counted: each successful call is matched by StopTheSockets()
+******************************************************************************/
+bool StartTheSockets()
+{
+#ifdef __linux__
+											// a peer gone is an error of
+											// send(), not a signal
+	::signal(SIGPIPE, SIG_IGN);
+
+	return true;
+#else
+	WSADATA WsaData;
+
+	return ::WSAStartup(MAKEWORD(2, 2), &WsaData) == 0;
+#endif
+}
+
+/*!****************************************************************************
+* @brief	Stops Winsock, after the last socket of a module is closed
+******************************************************************************/
+void StopTheSockets()
+{
+#ifndef __linux__
+	::WSACleanup();
+#endif
+}
+
+/*!****************************************************************************
+* @brief	Sets a socket in non-blocking mode
+* @param	nSocket The socket
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool SetNonBlocking(uintptr_t nSocket)
+{
+#ifdef __linux__
+	int nFlags = ::fcntl(SOCKET(nSocket), F_GETFL, 0);
+
+	return nFlags != -1 && ::fcntl(SOCKET(nSocket), F_SETFL, nFlags | O_NONBLOCK) == 0;
+#else
+	u_long nNonBlocking = 1;
+
+	return ::ioctlsocket(SOCKET(nSocket), FIONBIO, &nNonBlocking) == 0;
+#endif
+}
+
+/*!****************************************************************************
+* @brief	Keeps the port of a socket to be bound from other processes
+* @param	nSocket The socket, not bound yet
+* @return	Returns true for success, false otherwise
+* @note		The default on Linux, unless SO_REUSEADDR or SO_REUSEPORT
+*			are set, which they are not
+******************************************************************************/
+bool SetExclusive(uintptr_t nSocket)
+{
+#ifdef __linux__
+	return true;
+#else
+	int nExclusive = 1;
+
+	return ::setsockopt(SOCKET(nSocket), SOL_SOCKET, SO_EXCLUSIVEADDRUSE,
+		(const char*)&nExclusive, sizeof(nExclusive)) == 0;
+#endif
+}
+
+/*!****************************************************************************
+* @brief	Sends as much as possible of a TCP stream, without waiting
+* @param	nSocket The socket
+* @param	Stream The stream, the bytes sent are removed
+* @return	Returns false if the connection is lost
+******************************************************************************/
+bool SendTheStream(uintptr_t nSocket, std::vector<unsigned char>& Stream)
+{
+	size_t nSent = 0;
+
+	while( nSent < Stream.size() )
+	{
+		int nSize = ::send(SOCKET(nSocket), (const char*)Stream.data() + nSent, int(Stream.size() - nSent), 0);
+
+		if( nSize == SOCKET_ERROR )
+		{
+			if( ::WSAGetLastError() == WSAEWOULDBLOCK ) break;
+			return false;
+		}
+
+		nSent += nSize;
+	}
+
+	Stream.erase(Stream.begin(), Stream.begin() + nSent);
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Receives all the pending bytes of a TCP stream, without waiting
+* @param	nSocket The socket
+* @param	Stream The stream, the bytes are appended
+* @return	Returns false if the connection is closed or lost
+******************************************************************************/
+bool ReceiveTheStream(uintptr_t nSocket, std::vector<unsigned char>& Stream)
+{
+	unsigned char Buffer[16384];
+
+	for(;;)
+	{
+		int nSize = ::recv(SOCKET(nSocket), (char*)Buffer, sizeof(Buffer), 0);
+
+		if( nSize == 0 ) return false;
+
+		if( nSize == SOCKET_ERROR ) return ::WSAGetLastError() == WSAEWOULDBLOCK;
+
+		Stream.insert(Stream.end(), Buffer, Buffer + nSize);
+	}
+}
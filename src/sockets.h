@@ -0,0 +1,40 @@
+#ifndef _SOCKETS_H_
+#define _SOCKETS_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#ifdef __linux__
+	#include <arpa/inet.h>
+	#include <errno.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <sys/socket.h>
+	#include <unistd.h>
+
+	typedef int SOCKET;						///< the few Winsock names used
+
+	#define INVALID_SOCKET		(-1)
+	#define SOCKET_ERROR		(-1)
+	#define WSAEWOULDBLOCK		EWOULDBLOCK
+	#define WSAECONNRESET		ECONNRESET
+	#define closesocket			close
+
+	inline int WSAGetLastError() { return errno; }
+#else
+	#include <winsock2.h>					// before windows.h
+	#include <ws2tcpip.h>
+#endif
+
+
+bool StartTheSockets();
+void StopTheSockets();
+
+bool SetNonBlocking(uintptr_t nSocket);
+bool SetExclusive(uintptr_t nSocket);
+
+bool SendTheStream(uintptr_t nSocket, std::vector<unsigned char>& Stream);
+bool ReceiveTheStream(uintptr_t nSocket, std::vector<unsigned char>& Stream);
+
+#endif
@@ -0,0 +1,1418 @@
+/*!****************************************************************************
+
+	@file	spectator.h
+	@file	spectator.cpp
+
+	@brief	Spectator stream: the world state of every tick, quantized and
+			delta-encoded with periodic keyframes, written to a file or
+			to the spectators connected over TCP, and its viewer
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include "sockets.h"						// before windows.h
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "game.h"
+#include "tasks.h"
+#include "utils.h"
+#include "commdefs.h"
+#include "spectator.h"
+
+
+#define SPECTATORHOST		"127.0.0.1"		///< of the game, when no host is given
+
+#define FIXBITS				16				///< of the model: 1/65536 px and degree
+#define POSBITS				8				///< sent: 1/256 px and degree
+#define FULLTURN			(int64_t(360) << FIXBITS)
+#define POSTOLERANCE		(1 << (FIXBITS - 3))	///< 1/8 px of error before a correction
+#define ROTTOLERANCE		(1 << (FIXBITS - 2))	///< 1/4 degree
+
+#define SHIPPOS				8.0				///< ships: 1/8 px
+#define SHIPROT				16.0			///< ships: 1/16 degree
+#define SHIPTURN			(360 * 16)
+#define DEBRISSCALE			32.0
+#define MAXSHIPS			64				///< sanity limits on the decoding
+#define MAXVERTICES			256
+
+
+enum enFrameFlag { ffKey = 1 };			///< with the ticks advanced, shifted by one
+enum enGameField { gfScore = 1, gfLevel = 2, gfLives = 4, gfGameOver = 8 };
+enum enShipField {
+	sdFlags = 1, sdPos = 2, sdRot = 4, sdImpulse = 8,
+	sdShield = 16, sdExplosion = 32, sdDebris = 64, sdColor = 128
+};
+enum enTrackFix { tfPos = 1, tfRot = 2 };
+
+struct TFrameReader
+{
+	const unsigned char* pData;
+	const unsigned char* pEnd;
+	bool bOk;								///< false after the first error
+};
+
+
+
+/*!****************************************************************************
+* @brief	Appends a signed integer, zigzag and varint encoded
+* @param	Buffer The buffer
+* @param	nValue The value
+******************************************************************************/
+static void PutTheSigned(std::vector<unsigned char>& Buffer, int64_t nValue)
+{
+	PutTheVarint(Buffer, (uint64_t(nValue) << 1) ^ uint64_t(nValue >> 63));
+}
+
+/*!****************************************************************************
+* @brief	Reads an unsigned integer
+* @param	Reader The reader, failed at the end of the data
+* @return	The value, 0 if the reader has failed
+******************************************************************************/
+static uint64_t GetTheUnsigned(TFrameReader& Reader)
+{
+	uint64_t nValue = 0;
+
+	if( Reader.bOk && !GetTheVarint(Reader.pData, Reader.pEnd, nValue) ) Reader.bOk = false;
+
+	return Reader.bOk ? nValue : 0;
+}
+
+/*!****************************************************************************
+* @brief	Reads a signed integer, see PutTheSigned()
+* @param	Reader The reader, failed at the end of the data
+* @return	The value, 0 if the reader has failed
+******************************************************************************/
+static int64_t GetTheSigned(TFrameReader& Reader)
+{
+	uint64_t nValue = GetTheUnsigned(Reader);
+
+	return int64_t(nValue >> 1) ^ -int64_t(nValue & 1);
+}
+
+/*!****************************************************************************
+* @brief	Brings an angle in [0, nTurn)
+* @param	nAngle The angle
+* @param	nTurn The full turn, in the units of the angle
+* @return	The angle wrapped
+******************************************************************************/
+static inline int64_t WrapTheAngle(int64_t nAngle, int64_t nTurn)
+{
+	nAngle %= nTurn;
+
+	return nAngle < 0 ? nAngle + nTurn : nAngle;
+}
+
+/*!****************************************************************************
+* @brief	Gets the shortest rotation from an angle to another
+* @param	nTo The angle reached
+* @param	nFrom The angle of start
+* @param	nTurn The full turn, in the units of the angles
+* @return	The rotation, in (-nTurn/2, nTurn/2]
+******************************************************************************/
+static inline int64_t AngleBetween(int64_t nTo, int64_t nFrom, int64_t nTurn)
+{
+	int64_t nAngle = WrapTheAngle(nTo - nFrom, nTurn);
+
+	return nAngle > nTurn / 2 ? nAngle - nTurn : nAngle;
+}
+
+/*!****************************************************************************
+* @brief	Converts a fixed point value of the model in the units sent
+******************************************************************************/
+static inline int64_t Coarse(int64_t nValue) { return nValue >> (FIXBITS - POSBITS); }
+
+/*!****************************************************************************
+* @brief	Converts a value in the units sent in a fixed point one
+******************************************************************************/
+static inline int64_t Fine(int64_t nValue) { return nValue * (1 << (FIXBITS - POSBITS)); }
+
+/*!****************************************************************************
+* @brief	Quantizes a coordinate or an angle
+* @param	Value The value
+* @param	nBits The fractional bits kept
+* @return	The value in fixed point
+******************************************************************************/
+static inline int64_t Quantize(double Value, int nBits)
+{
+	return llround(Value * double(int64_t(1) << nBits));
+}
+
+/*!****************************************************************************
+* @brief	Quantizes an angle in degrees
+* @param	Angle The angle, not wrapped
+* @param	nBits The fractional bits kept
+* @return	The angle in fixed point, in [0, 360)
+******************************************************************************/
+static inline int64_t QuantizeTheAngle(double Angle, int nBits)
+{
+	return WrapTheAngle(Quantize(fmod(Angle, 360.0), nBits), int64_t(360) << nBits);
+}
+
+/*!****************************************************************************
+* @brief	Quantizes a ship, as seen by the spectators
+* @param	pShip Pointer to the ship
+* @param	Ship The quantized ship
+* @note		The countdowns are clamped and the debris are kept only
+*			while exploding, so an idle ship does not change
+******************************************************************************/
+static void QuantizeTheShip(TShip* pShip, TSpectatorShip& Ship)
+{
+	assert(pShip);
+
+	memset(&Ship, 0, sizeof(Ship));
+
+	Ship.nFlags = (pShip->bAlive ? sfAlive : 0) | (pShip->bVisible ? sfVisible : 0)
+		| (pShip->bShield ? sfShield : 0);
+
+	Ship.nX = lround(pShip->Pos.X * SHIPPOS);
+	Ship.nY = lround(pShip->Pos.Y * SHIPPOS);
+	Ship.nRot = int32_t(WrapTheAngle(llround(fmod(pShip->Rot, 360.0) * SHIPROT), SHIPTURN));
+
+	Ship.nImpulseTicks = std::max(pShip->nImpulseTicks, 0);
+	Ship.nShieldTick = pShip->bShield ? int(std::min(pShip->nShieldTick, 1u << 20)) : 0;
+	Ship.nExplosionTicks = std::max(pShip->nExplosionTicks, 0);
+
+	if( Ship.nExplosionTicks > 0 )
+	{
+		Ship.nDebris = std::min(std::max(pShip->nDebris, 0), SHIP_NDEBRIS);
+
+		for(int i=0; i<Ship.nDebris; ++i)
+		{
+			Ship.Debris[i][0] = lround((pShip->Debris[i].X - pShip->Pos.X) * SHIPPOS);
+			Ship.Debris[i][1] = lround((pShip->Debris[i].Y - pShip->Pos.Y) * SHIPPOS);
+			Ship.DebrisScales[i] = lround(pShip->DebrisScales[i] * DEBRISSCALE);
+		}
+	}
+
+	Ship.Color = pShip->Color;
+}
+
+/*!****************************************************************************
+* @brief	Empties the model, before a keyframe
+* @param	pModel Pointer to the model
+******************************************************************************/
+static void ResetTheModel(TSpectatorModel* pModel)
+{
+	assert(pModel);
+
+	pModel->bValid = false;
+	pModel->nTick = 0;
+	pModel->nWidth = pModel->nHeight = 0;
+	memset(pModel->nMasks, 0, sizeof(pModel->nMasks));
+	memset(pModel->Colors, 0, sizeof(pModel->Colors));
+	pModel->nScore = pModel->nLevel = pModel->nLives = 0;
+	pModel->bGameOver = false;
+
+	pModel->Ships.clear();
+
+	for(int n=0; n<arCount; ++n) pModel->Tracks[n].clear();
+}
+
+/*!****************************************************************************
+* @brief	Moves the tracks of the model as the game would move them,
+*			and runs the countdowns of the ships
+* @param	pModel Pointer to the model
+* @param	nTicks The ticks elapsed
+* @note		Integer arithmetic only, so the encoder and the viewers
+*			predict exactly the same, see IntegrateSystem(),
+*			SpinSystem() and WrapSystem()
+******************************************************************************/
+static void AdvanceTheModel(TSpectatorModel* pModel, unsigned nTicks)
+{
+	assert(pModel);
+
+	int64_t nWidth = int64_t(pModel->nWidth) << FIXBITS;
+	int64_t nHeight = int64_t(pModel->nHeight) << FIXBITS;
+
+	for(int n=0; n<arCount; ++n)
+	{
+		unsigned nMask = pModel->nMasks[n];
+
+		for(TSpectatorTrack& Track : pModel->Tracks[n])
+		{
+			for(unsigned k=0; k<nTicks; ++k)
+			{
+				if( nMask & cpVel )
+				{
+					Track.nX += Track.nVX;
+					Track.nY += Track.nVY;
+				}
+
+				if( nMask & cpWrap )
+				{
+					if( Track.nX < 0 ) Track.nX = nWidth;
+					else if( Track.nX > nWidth ) Track.nX = 0;
+
+					if( Track.nY < 0 ) Track.nY = nHeight;
+					else if( Track.nY > nHeight ) Track.nY = 0;
+				}
+			}
+
+			if( nMask & cpSpin )
+			{
+				Track.nRot = WrapTheAngle(Track.nRot + int64_t(Track.nDRot) * nTicks, FULLTURN);
+			}
+		}
+	}
+											// the countdowns of the ships, as
+											// run by Update()
+	int nCount = int(nTicks);
+
+	for(TSpectatorShip& Ship : pModel->Ships)
+	{
+		if( Ship.nFlags & sfAlive ) Ship.nImpulseTicks = std::max(Ship.nImpulseTicks - nCount, 0);
+		else Ship.nExplosionTicks = std::max(Ship.nExplosionTicks - nCount, 0);
+
+		if( Ship.nFlags & sfShield ) Ship.nShieldTick += nCount;
+	}
+
+	pModel->nTick += nTicks;
+}
+
+/*!****************************************************************************
+* @brief	Applies the changes of a ship
+* @param	Reader The reader of the frame
+* @param	Ship The ship of the model
+******************************************************************************/
+static void ApplyTheShip(TFrameReader& Reader, TSpectatorShip& Ship)
+{
+	unsigned nFields = unsigned(GetTheUnsigned(Reader));
+
+	if( nFields & sdFlags ) Ship.nFlags = unsigned(GetTheUnsigned(Reader));
+
+	if( nFields & sdPos )
+	{
+		Ship.nX += int32_t(GetTheSigned(Reader));
+		Ship.nY += int32_t(GetTheSigned(Reader));
+	}
+
+	if( nFields & sdRot ) Ship.nRot = int32_t(WrapTheAngle(Ship.nRot + GetTheSigned(Reader), SHIPTURN));
+	if( nFields & sdImpulse ) Ship.nImpulseTicks = int(GetTheUnsigned(Reader));
+	if( nFields & sdShield ) Ship.nShieldTick = int(GetTheUnsigned(Reader));
+	if( nFields & sdExplosion ) Ship.nExplosionTicks = int(GetTheUnsigned(Reader));
+
+	if( nFields & sdDebris )
+	{
+		uint64_t nDebris = GetTheUnsigned(Reader);
+
+		if( nDebris > SHIP_NDEBRIS ) { Reader.bOk = false; return; }
+											// the unused ones are zero, as
+											// in QuantizeTheShip()
+		memset(Ship.Debris, 0, sizeof(Ship.Debris));
+		memset(Ship.DebrisScales, 0, sizeof(Ship.DebrisScales));
+		Ship.nDebris = int(nDebris);
+
+		for(int i=0; i<Ship.nDebris; ++i)
+		{
+			Ship.Debris[i][0] = int32_t(GetTheSigned(Reader));
+			Ship.Debris[i][1] = int32_t(GetTheSigned(Reader));
+			Ship.DebrisScales[i] = int32_t(GetTheUnsigned(Reader));
+		}
+	}
+
+	if( nFields & sdColor ) Ship.Color = COLORREF(GetTheUnsigned(Reader));
+}
+
+/*!****************************************************************************
+* @brief	Applies the changes of the tracks of an archetype
+* @param	pModel Pointer to the model
+* @param	nArchetype The archetype
+* @param	Reader The reader of the frame
+* @note		The tracks removed go first, then the corrections of the
+*			ones left, then the new ones, appended
+******************************************************************************/
+static void ApplyTheTracks(TSpectatorModel* pModel, int nArchetype, TFrameReader& Reader)
+{
+	assert(pModel);
+
+	std::vector<TSpectatorTrack>& Tracks = pModel->Tracks[nArchetype];
+	unsigned nMask = pModel->nMasks[nArchetype];
+											// removes the dead tracks, keeping
+											// the order of the others
+	uint64_t nDead = GetTheUnsigned(Reader);
+	if( nDead > Tracks.size() ) { Reader.bOk = false; return; }
+
+	size_t nOut = 0, nNext = 0;
+
+	for(uint64_t k=0; k<nDead; ++k)
+	{
+		uint64_t nTrack = nNext + GetTheUnsigned(Reader);
+		if( !Reader.bOk || nTrack >= Tracks.size() ) { Reader.bOk = false; return; }
+
+		for(; nNext < nTrack; ++nNext, ++nOut)
+		{
+			if( nOut != nNext ) Tracks[nOut] = std::move(Tracks[nNext]);
+		}
+
+		nNext = nTrack + 1;
+	}
+
+	for(; nNext < Tracks.size(); ++nNext, ++nOut)
+	{
+		if( nOut != nNext ) Tracks[nOut] = std::move(Tracks[nNext]);
+	}
+
+	Tracks.resize(nOut);
+											// the corrections
+	uint64_t nFixes = GetTheUnsigned(Reader);
+	if( nFixes > Tracks.size() ) { Reader.bOk = false; return; }
+
+	nNext = 0;
+
+	for(uint64_t k=0; k<nFixes; ++k)
+	{
+		uint64_t nTrack = nNext + GetTheUnsigned(Reader);
+		if( !Reader.bOk || nTrack >= Tracks.size() ) { Reader.bOk = false; return; }
+
+		TSpectatorTrack& Track = Tracks[nTrack];
+		unsigned nFix = unsigned(GetTheUnsigned(Reader));
+
+		if( nFix & tfPos )
+		{
+			Track.nX = Fine(Coarse(Track.nX) + GetTheSigned(Reader));
+			Track.nY = Fine(Coarse(Track.nY) + GetTheSigned(Reader));
+		}
+
+		if( nFix & tfRot )
+		{
+			Track.nRot = Fine(WrapTheAngle(Coarse(Track.nRot) + GetTheSigned(Reader),
+				Coarse(FULLTURN)));
+		}
+
+		nNext = nTrack + 1;
+	}
+											// the new ones
+	uint64_t nNew = GetTheUnsigned(Reader);
+	if( nNew > uint64_t(Reader.pEnd - Reader.pData) ) { Reader.bOk = false; return; }
+
+	COLORREF& Color = pModel->Colors[nArchetype];
+
+	for(uint64_t k=0; k<nNew && Reader.bOk; ++k)
+	{
+		Tracks.emplace_back();
+		TSpectatorTrack& Track = Tracks.back();
+
+		Track.nClass = (nMask & cpClass) ? int(GetTheUnsigned(Reader)) : 0;
+											// most of the times the same
+		if( nMask & cpColor ) Color ^= COLORREF(GetTheUnsigned(Reader));
+		Track.Color = Color;
+
+		Track.nX = Fine(GetTheSigned(Reader));
+		Track.nY = Fine(GetTheSigned(Reader));
+
+		Track.nVX = Track.nVY = 0;
+
+		if( nMask & cpVel )
+		{
+			Track.nVX = int32_t(GetTheSigned(Reader));
+			Track.nVY = int32_t(GetTheSigned(Reader));
+		}
+
+		Track.nRot = 0;
+		Track.nDRot = 0;
+
+		if( nMask & cpSpin )
+		{
+			Track.nRot = Fine(WrapTheAngle(GetTheSigned(Reader), Coarse(FULLTURN)));
+			Track.nDRot = int32_t(GetTheSigned(Reader));
+		}
+
+		if( nMask & cpShape )
+		{
+			uint64_t nVertices = GetTheUnsigned(Reader);
+			if( nVertices > MAXVERTICES ) { Reader.bOk = false; return; }
+
+			Track.Shape.resize(size_t(nVertices));
+
+			for(TVector2& Vertex : Track.Shape)
+			{
+				Vertex.X = double(GetTheSigned(Reader));
+				Vertex.Y = double(GetTheSigned(Reader));
+			}
+		}
+	}
+}
+
+/*!****************************************************************************
+* @brief	Applies the body of a frame: the game, the ships, the tracks
+* @param	pModel Pointer to the model, already advanced to the tick
+* @param	Reader The reader of the frame
+* @return	Returns false if the frame is corrupted
+******************************************************************************/
+static bool ApplyTheBody(TSpectatorModel* pModel, TFrameReader& Reader)
+{
+	assert(pModel);
+
+	unsigned nFields = unsigned(GetTheUnsigned(Reader));
+
+	if( nFields & gfScore ) pModel->nScore = int(GetTheSigned(Reader));
+	if( nFields & gfLevel ) pModel->nLevel = int(GetTheSigned(Reader));
+	if( nFields & gfLives ) pModel->nLives = int(GetTheSigned(Reader));
+	if( nFields & gfGameOver ) pModel->bGameOver = GetTheUnsigned(Reader) != 0;
+
+	uint64_t nShips = GetTheUnsigned(Reader);		// the ones changed
+
+	for(size_t i=0; i<pModel->Ships.size(); ++i)
+	{
+		if( nShips & (uint64_t(1) << i) ) ApplyTheShip(Reader, pModel->Ships[i]);
+	}
+
+	unsigned nArchetypes = unsigned(GetTheUnsigned(Reader));
+
+	for(int n=0; n<arCount && Reader.bOk; ++n)
+	{
+		if( nArchetypes & (1 << n) ) ApplyTheTracks(pModel, n, Reader);
+	}
+
+	return Reader.bOk && Reader.pData == Reader.pEnd;
+}
+
+/*!****************************************************************************
+* @brief	Decodes a frame of the stream into the model
+* @param	pModel Pointer to the model
+* @param	pData The frame, without its size
+* @param	nSize The bytes of the frame
+* @return	Returns false if the frame is corrupted, or if it is a delta
+*			frame and no keyframe has been decoded: the model is then
+*			valid again from the next keyframe
+******************************************************************************/
+bool DecodeTheFrame(TSpectatorModel* pModel, const unsigned char* pData, size_t nSize)
+{
+	assert(pModel);
+
+	TFrameReader Reader = { pData, pData + nSize, true };
+
+	uint64_t nFlags = GetTheUnsigned(Reader);
+
+	if( nFlags & ffKey )
+	{
+		ResetTheModel(pModel);
+
+		pModel->nTick = unsigned(GetTheUnsigned(Reader));
+		pModel->nWidth = int(GetTheUnsigned(Reader));
+		pModel->nHeight = int(GetTheUnsigned(Reader));
+
+		uint64_t nShips = GetTheUnsigned(Reader);
+
+		if( !Reader.bOk || nShips > MAXSHIPS || pModel->nWidth > 65535 || pModel->nHeight > 65535 )
+		{
+			return false;
+		}
+
+		pModel->Ships.resize(size_t(nShips));
+		memset(pModel->Ships.data(), 0, pModel->Ships.size() * sizeof(TSpectatorShip));
+
+		for(int n=0; n<arCount; ++n) pModel->nMasks[n] = unsigned(GetTheUnsigned(Reader));
+	}
+	else
+	{
+		uint64_t nTicks = nFlags >> 1;
+
+		if( !pModel->bValid || !Reader.bOk || nTicks > SPECTATORMAXSKIP ) return false;
+
+		AdvanceTheModel(pModel, unsigned(nTicks));
+	}
+
+	pModel->bValid = ApplyTheBody(pModel, Reader);
+
+	return pModel->bValid;
+}
+
+/*!****************************************************************************
+* @brief	Gets the fields of a ship that have changed
+* @param	Ship The ship, quantized
+* @param	Model The ship, as known by the viewers
+* @return	The fields, see enShipField
+******************************************************************************/
+static unsigned GetTheShipFields(const TSpectatorShip& Ship, const TSpectatorShip& Model)
+{
+	bool bDebris = Ship.nDebris != Model.nDebris
+		|| memcmp(Ship.Debris, Model.Debris, sizeof(Ship.Debris)) != 0
+		|| memcmp(Ship.DebrisScales, Model.DebrisScales, sizeof(Ship.DebrisScales)) != 0;
+
+	unsigned nFields =
+		(Ship.nFlags != Model.nFlags ? sdFlags : 0)
+		| (Ship.nX != Model.nX || Ship.nY != Model.nY ? sdPos : 0)
+		| (Ship.nRot != Model.nRot ? sdRot : 0)
+		| (Ship.nImpulseTicks != Model.nImpulseTicks ? sdImpulse : 0)
+		| (Ship.nShieldTick != Model.nShieldTick ? sdShield : 0)
+		| (Ship.nExplosionTicks != Model.nExplosionTicks ? sdExplosion : 0)
+		| (bDebris ? sdDebris : 0)
+		| (Ship.Color != Model.Color ? sdColor : 0);
+
+	return nFields;
+}
+
+/*!****************************************************************************
+* @brief	Appends the changes of a ship
+* @param	Frame The frame
+* @param	Ship The ship, quantized
+* @param	Model The ship, as known by the viewers
+******************************************************************************/
+static void PutTheShip(std::vector<unsigned char>& Frame, const TSpectatorShip& Ship,
+	const TSpectatorShip& Model)
+{
+	unsigned nFields = GetTheShipFields(Ship, Model);
+
+	PutTheVarint(Frame, nFields);
+
+	if( nFields & sdFlags ) PutTheVarint(Frame, Ship.nFlags);
+
+	if( nFields & sdPos )
+	{
+		PutTheSigned(Frame, int64_t(Ship.nX) - Model.nX);
+		PutTheSigned(Frame, int64_t(Ship.nY) - Model.nY);
+	}
+
+	if( nFields & sdRot ) PutTheSigned(Frame, AngleBetween(Ship.nRot, Model.nRot, SHIPTURN));
+	if( nFields & sdImpulse ) PutTheVarint(Frame, Ship.nImpulseTicks);
+	if( nFields & sdShield ) PutTheVarint(Frame, Ship.nShieldTick);
+	if( nFields & sdExplosion ) PutTheVarint(Frame, Ship.nExplosionTicks);
+
+	if( nFields & sdDebris )
+	{
+		PutTheVarint(Frame, Ship.nDebris);
+
+		for(int i=0; i<Ship.nDebris; ++i)
+		{
+			PutTheSigned(Frame, Ship.Debris[i][0]);
+			PutTheSigned(Frame, Ship.Debris[i][1]);
+			PutTheVarint(Frame, uint64_t(std::max(Ship.DebrisScales[i], 0)));
+		}
+	}
+
+	if( nFields & sdColor ) PutTheVarint(Frame, Ship.Color);
+}
+
+/*!****************************************************************************
+* @brief	Checks if a row is the entity of a track
+* @param	A The archetype
+* @param	nRow The row
+* @param	Track The track
+* @return	Returns true if they match
+* @note		The velocity of an asteroid or of a missile never changes:
+*			with the class it tells the entities apart, as the rows keep
+*			their order, see CommitTheWorld()
+******************************************************************************/
+static bool IsTheTrack(const TArchetype& A, unsigned nRow, const TSpectatorTrack& Track)
+{
+	if( (A.nMask & cpClass) && A.Class[nRow] != Track.nClass ) return false;
+
+	if( A.nMask & cpVel )
+	{
+		return Quantize(A.Vel[nRow].X * DT, FIXBITS) == Track.nVX
+			&& Quantize(A.Vel[nRow].Y * DT, FIXBITS) == Track.nVY;
+	}
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Appends the changes of the entities of an archetype
+* @param	pSpectator Pointer to the spectator stream
+* @param	pWorld Pointer to the world
+* @param	nArchetype The archetype
+* @return	Returns false if nothing has changed: nothing is appended
+* @note		The tracks predicted close enough to their entities cost
+*			nothing
+******************************************************************************/
+static bool PutTheTracks(TSpectator* pSpectator, TWorld* pWorld, int nArchetype)
+{
+	assert(pSpectator);
+	assert(pWorld);
+
+	std::vector<unsigned char>& Frame = pSpectator->Frame;
+	const TArchetype& A = pWorld->Archetypes[nArchetype];
+	const std::vector<TSpectatorTrack>& Tracks = pSpectator->Model.Tracks[nArchetype];
+
+	pSpectator->Dead.clear();
+	pSpectator->Fixes.clear();
+											// walks the rows and the tracks
+											// together, both in order
+	unsigned nRow = 0, nKept = 0;
+
+	for(unsigned nTrack=0; nTrack<Tracks.size(); ++nTrack)
+	{
+		const TSpectatorTrack& Track = Tracks[nTrack];
+
+		if( nRow >= A.nCount || !IsTheTrack(A, nRow, Track) )
+		{
+			pSpectator->Dead.push_back(nTrack);
+			continue;
+		}
+
+		TSpectatorFix Fix = { nKept, 0, 0, 0, 0 };
+
+		if( A.nMask & cpPos )
+		{
+			int64_t nX = Quantize(A.Pos[nRow].X, FIXBITS);
+			int64_t nY = Quantize(A.Pos[nRow].Y, FIXBITS);
+
+			if( llabs(nX - Track.nX) > POSTOLERANCE || llabs(nY - Track.nY) > POSTOLERANCE )
+			{
+				Fix.nMask |= tfPos;
+				Fix.nDX = Quantize(A.Pos[nRow].X, POSBITS) - Coarse(Track.nX);
+				Fix.nDY = Quantize(A.Pos[nRow].Y, POSBITS) - Coarse(Track.nY);
+			}
+		}
+
+		if( A.nMask & cpSpin )
+		{
+			int64_t nRot = QuantizeTheAngle(A.Rot[nRow], FIXBITS);
+
+			if( llabs(AngleBetween(nRot, Track.nRot, FULLTURN)) > ROTTOLERANCE )
+			{
+				Fix.nMask |= tfRot;
+				Fix.nDRot = AngleBetween(QuantizeTheAngle(A.Rot[nRow], POSBITS),
+					Coarse(Track.nRot), Coarse(FULLTURN));
+			}
+		}
+
+		if( Fix.nMask ) pSpectator->Fixes.push_back(Fix);
+
+		nRow++;
+		nKept++;
+	}
+
+	if( pSpectator->Dead.empty() && pSpectator->Fixes.empty() && nRow == A.nCount ) return false;
+
+	unsigned nPrevious = 0;
+
+	PutTheVarint(Frame, pSpectator->Dead.size());
+
+	for(unsigned nTrack : pSpectator->Dead)
+	{
+		PutTheVarint(Frame, nTrack - nPrevious);
+		nPrevious = nTrack + 1;
+	}
+
+	nPrevious = 0;
+
+	PutTheVarint(Frame, pSpectator->Fixes.size());
+
+	for(const TSpectatorFix& Fix : pSpectator->Fixes)
+	{
+		PutTheVarint(Frame, Fix.nTrack - nPrevious);
+		PutTheVarint(Frame, Fix.nMask);
+
+		if( Fix.nMask & tfPos ) { PutTheSigned(Frame, Fix.nDX); PutTheSigned(Frame, Fix.nDY); }
+		if( Fix.nMask & tfRot ) PutTheSigned(Frame, Fix.nDRot);
+
+		nPrevious = Fix.nTrack + 1;
+	}
+											// the rows left are the entities
+											// spawned, see ApplyTheTracks()
+	PutTheVarint(Frame, A.nCount - nRow);
+
+	COLORREF Color = pSpectator->Model.Colors[nArchetype];
+
+	for(; nRow<A.nCount; ++nRow)
+	{
+		if( A.nMask & cpClass ) PutTheVarint(Frame, unsigned(A.Class[nRow]));
+
+		if( A.nMask & cpColor )
+		{
+			PutTheVarint(Frame, A.Color[nRow] ^ Color);
+			Color = A.Color[nRow];
+		}
+
+		PutTheSigned(Frame, Quantize(A.Pos[nRow].X, POSBITS));
+		PutTheSigned(Frame, Quantize(A.Pos[nRow].Y, POSBITS));
+
+		if( A.nMask & cpVel )
+		{
+			PutTheSigned(Frame, Quantize(A.Vel[nRow].X * DT, FIXBITS));
+			PutTheSigned(Frame, Quantize(A.Vel[nRow].Y * DT, FIXBITS));
+		}
+
+		if( A.nMask & cpSpin )
+		{
+			PutTheSigned(Frame, QuantizeTheAngle(A.Rot[nRow], POSBITS));
+			PutTheSigned(Frame, Quantize(A.DRot[nRow], FIXBITS));
+		}
+
+		if( A.nMask & cpShape )
+		{
+			const TVecPoints& Shape = A.Shape[nRow];
+
+			PutTheVarint(Frame, std::min(Shape.size(), size_t(MAXVERTICES)));
+
+			for(size_t k=0; k<Shape.size() && k<MAXVERTICES; ++k)
+			{
+				PutTheSigned(Frame, llround(Shape[k].X));
+				PutTheSigned(Frame, llround(Shape[k].Y));
+			}
+		}
+	}
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Encodes the state of the game after a tick
+* @param	pSpectator Pointer to the spectator stream
+* @param	pGame Pointer to the game engine
+* @param	bKey Encodes a keyframe, else a delta from the model
+* @note		The model is then updated as the viewers will do
+******************************************************************************/
+static void EncodeTheFrame(TSpectator* pSpectator, TGame* pGame, bool bKey)
+{
+	assert(pSpectator);
+	assert(pGame);
+	assert(pGame->pShips.size() <= MAXSHIPS);
+
+	TSpectatorModel* pModel = &pSpectator->Model;
+	std::vector<unsigned char>& Frame = pSpectator->Frame;
+
+	Frame.clear();
+
+	unsigned nTicks = bKey ? 0 : pGame->nTick - pModel->nTick;
+
+	PutTheVarint(Frame, (uint64_t(nTicks) << 1) | (bKey ? ffKey : 0));
+											// a keyframe is a delta from
+											// an empty model
+	if( bKey )
+	{
+		unsigned nWidth, nHeight;
+		GetClientSize(pGame, nWidth, nHeight);
+
+		ResetTheModel(pModel);
+
+		pModel->nTick = pGame->nTick;
+		pModel->nWidth = int(nWidth);
+		pModel->nHeight = int(nHeight);
+		pModel->Ships.resize(pGame->pShips.size());
+		memset(pModel->Ships.data(), 0, pModel->Ships.size() * sizeof(TSpectatorShip));
+
+		PutTheVarint(Frame, pModel->nTick);
+		PutTheVarint(Frame, nWidth);
+		PutTheVarint(Frame, nHeight);
+		PutTheVarint(Frame, pModel->Ships.size());
+
+		for(int n=0; n<arCount; ++n)
+		{
+			pModel->nMasks[n] = pGame->World.Archetypes[n].nMask;
+			PutTheVarint(Frame, pModel->nMasks[n]);
+		}
+	}
+	else AdvanceTheModel(pModel, nTicks);
+
+	size_t nBody = Frame.size();
+											// the game
+	unsigned nFields =
+		(pGame->nScore != pModel->nScore ? gfScore : 0)
+		| (pGame->nLevel != pModel->nLevel ? gfLevel : 0)
+		| (pGame->nLives != pModel->nLives ? gfLives : 0)
+		| (pGame->bGameOver != pModel->bGameOver ? gfGameOver : 0);
+
+	PutTheVarint(Frame, nFields);
+
+	if( nFields & gfScore ) PutTheSigned(Frame, pGame->nScore);
+	if( nFields & gfLevel ) PutTheSigned(Frame, pGame->nLevel);
+	if( nFields & gfLives ) PutTheSigned(Frame, pGame->nLives);
+	if( nFields & gfGameOver ) PutTheVarint(Frame, pGame->bGameOver ? 1 : 0);
+											// the ships changed, flagged first
+	std::vector<TSpectatorShip>& Ships = pSpectator->Ships;
+	uint64_t nShips = 0;
+
+	Ships.resize(pModel->Ships.size());
+
+	for(size_t i=0; i<Ships.size(); ++i)
+	{
+		QuantizeTheShip(pGame->pShips[i], Ships[i]);
+
+		if( GetTheShipFields(Ships[i], pModel->Ships[i]) ) nShips |= uint64_t(1) << i;
+	}
+
+	PutTheVarint(Frame, nShips);
+
+	for(size_t i=0; i<Ships.size(); ++i)
+	{
+		if( nShips & (uint64_t(1) << i) ) PutTheShip(Frame, Ships[i], pModel->Ships[i]);
+	}
+											// the entities: the flags of the
+											// archetypes changed take a byte,
+											// filled in afterwards
+	static_assert(arCount < 8, "the archetypes do not fit a varint byte");
+
+	size_t nArchetypes = Frame.size();
+	Frame.push_back(0);
+
+	for(int n=0; n<arCount; ++n)
+	{
+		if( PutTheTracks(pSpectator, &pGame->World, n) ) Frame[nArchetypes] |= 1 << n;
+	}
+
+	TFrameReader Reader = { Frame.data() + nBody, Frame.data() + Frame.size(), true };
+
+	pModel->bValid = ApplyTheBody(pModel, Reader);
+	assert(pModel->bValid);
+}
+
+/*!****************************************************************************
+* @brief	Appends the header of the stream
+* @param	Stream The stream
+******************************************************************************/
+static void PutTheHeader(std::vector<unsigned char>& Stream)
+{
+	uint32_t nHeader[2] = { SPECTATORMAGIC, SPECTATORVERSION };
+
+	const unsigned char* pHeader = (const unsigned char*)nHeader;
+
+	Stream.insert(Stream.end(), pHeader, pHeader + sizeof(nHeader));
+}
+
+/*!****************************************************************************
+* @brief	Parses "tcp:port" or "tcp:host:port"
+* @param	pTarget The text
+* @param	Addr The address
+* @return	Returns false if the text is not a TCP address
+******************************************************************************/
+static bool ParseTheAddress(const char* pTarget, sockaddr_in& Addr)
+{
+	char Host[64];
+	int nPort = 0;
+
+	memset(&Addr, 0, sizeof(Addr));
+	Addr.sin_family = AF_INET;
+
+	if( strncmp(pTarget, "tcp:", 4) != 0 ) return false;
+
+	if( sscanf(pTarget + 4, "%63[^:]:%d", Host, &nPort) == 2 )
+	{
+		Addr.sin_addr.s_addr = inet_addr(Host);
+	}
+	else if( sscanf(pTarget + 4, "%d", &nPort) == 1 )
+	{
+		Addr.sin_addr.s_addr = inet_addr(SPECTATORHOST);
+	}
+	else return false;
+
+	Addr.sin_port = htons(u_short(nPort));
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Sets-up the spectator stream
+* @param	pSpectator Pointer to the spectator stream
+* @param	pTarget A file name, or "tcp:port" to accept the spectators
+*			on that port
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool SetupTheSpectator(TSpectator* pSpectator, const char* pTarget)
+{
+	assert(pSpectator);
+	assert(pTarget);
+
+	pSpectator->fp = nullptr;
+	pSpectator->nListen = uintptr_t(INVALID_SOCKET);
+	pSpectator->Clients.clear();
+	pSpectator->bNeedKey = true;
+	pSpectator->nKeyTick = 0;
+
+	ResetTheModel(&pSpectator->Model);
+
+	pSpectator->nFrames = pSpectator->nKeyframes = pSpectator->nDropped = pSpectator->nTicks = 0;
+	pSpectator->nBytes = 0;
+	pSpectator->EncodeTime = pSpectator->MaxEncodeTime = pSpectator->TotalEncodeTime = 0;
+
+	sockaddr_in Addr;
+
+	if( !ParseTheAddress(pTarget, Addr) )
+	{
+		pSpectator->fp = fopen(pTarget, "wb");
+		if( !pSpectator->fp ) return false;
+
+		std::vector<unsigned char> Header;
+		PutTheHeader(Header);
+
+		return fwrite(Header.data(), 1, Header.size(), pSpectator->fp) == Header.size();
+	}
+											// the spectators can be anywhere
+	Addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if( !StartTheSockets() ) return false;
+
+	SOCKET nListen = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+											// no other process can take
+											// the port
+	if( nListen == INVALID_SOCKET
+		|| !SetExclusive(nListen)
+		|| ::bind(nListen, (sockaddr*)&Addr, sizeof(Addr)) != 0
+		|| ::listen(nListen, SOMAXCONN) != 0
+		|| !SetNonBlocking(nListen) )
+	{
+		if( nListen != INVALID_SOCKET ) ::closesocket(nListen);
+		StopTheSockets();
+		return false;
+	}
+
+	pSpectator->nListen = uintptr_t(nListen);
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Cleans-up the spectator stream, reporting its statistics
+* @param	pSpectator Pointer to the spectator stream
+* @note		The bandwidth is over the game time streamed, at FPS ticks
+*			per second
+******************************************************************************/
+void CleanupTheSpectator(TSpectator* pSpectator)
+{
+	assert(pSpectator);
+
+	double Seconds = double(pSpectator->nTicks) / FPS;
+
+	char Buffer[256];
+	sprintf(Buffer, "spectator: %u frames (%u keyframes) over %.1f s, %.2f kB/s, "
+		"encode %.1f us mean %.1f us max, %u spectators dropped\n",
+		pSpectator->nFrames, pSpectator->nKeyframes, Seconds,
+		Seconds > 0 ? pSpectator->nBytes / Seconds / 1024.0 : 0.0,
+		pSpectator->nFrames ? pSpectator->TotalEncodeTime / pSpectator->nFrames * 1e6 : 0.0,
+		pSpectator->MaxEncodeTime * 1e6, pSpectator->nDropped);
+
+	LogTheText(Buffer);
+
+	if( pSpectator->fp )
+	{
+		fclose(pSpectator->fp);
+		pSpectator->fp = nullptr;
+	}
+
+	if( SOCKET(pSpectator->nListen) != INVALID_SOCKET )
+	{
+		for(TSpectatorClient& Client : pSpectator->Clients) ::closesocket(SOCKET(Client.nSocket));
+		pSpectator->Clients.clear();
+
+		::closesocket(SOCKET(pSpectator->nListen));
+		pSpectator->nListen = uintptr_t(INVALID_SOCKET);
+
+		StopTheSockets();
+	}
+}
+
+/*!****************************************************************************
+* @brief	Accepts the spectators connected since the last tick
+* @param	pSpectator Pointer to the spectator stream
+* @note		A new spectator gets the header at once, then the frames
+*			from the next keyframe, asked for here
+******************************************************************************/
+static void AcceptTheSpectators(TSpectator* pSpectator)
+{
+	assert(pSpectator);
+
+	for(;;)
+	{
+		SOCKET nSocket = ::accept(SOCKET(pSpectator->nListen), nullptr, nullptr);
+		if( nSocket == INVALID_SOCKET ) break;
+
+		SetNonBlocking(nSocket);
+
+		TSpectatorClient Client;
+		Client.nSocket = uintptr_t(nSocket);
+		Client.bWaiting = true;
+		PutTheHeader(Client.Output);
+
+		pSpectator->Clients.push_back(Client);
+		pSpectator->bNeedKey = true;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Streams the state of the game after a tick
+* @param	pSpectator Pointer to the spectator stream
+* @param	pGame Pointer to the game engine
+* @note		Nothing is encoded if no tick has been run since the last
+*			call, or if nobody watches. A keyframe is sent every
+*			SPECTATORKEYFRAME ticks, for a new spectator, and when the
+*			game restarts; the spectators too slow are dropped.
+******************************************************************************/
+void StreamTheTick(TSpectator* pSpectator, TGame* pGame)
+{
+	assert(pSpectator);
+	assert(pGame);
+
+	TSpectatorModel* pModel = &pSpectator->Model;
+
+	if( SOCKET(pSpectator->nListen) != INVALID_SOCKET ) AcceptTheSpectators(pSpectator);
+
+	if( !pSpectator->fp && pSpectator->Clients.empty() )
+	{
+		pSpectator->bNeedKey = true;
+		return;
+	}
+
+	if( pModel->bValid && pGame->nTick == pModel->nTick ) return;
+
+	unsigned nWidth, nHeight;
+	GetClientSize(pGame, nWidth, nHeight);
+
+	bool bKey = pSpectator->bNeedKey || !pModel->bValid
+		|| pGame->nTick < pModel->nTick
+		|| pGame->nTick - pModel->nTick > SPECTATORMAXSKIP
+		|| pGame->nTick - pSpectator->nKeyTick >= SPECTATORKEYFRAME
+		|| pGame->pShips.size() != pModel->Ships.size()
+		|| int(nWidth) != pModel->nWidth || int(nHeight) != pModel->nHeight;
+
+	unsigned nTicks = bKey ? 1 : pGame->nTick - pModel->nTick;
+
+	double Time = GetTheTime();
+
+	EncodeTheFrame(pSpectator, pGame, bKey);
+
+	Time = GetTheTime() - Time;
+											// statistics
+	pSpectator->EncodeTime += 0.05 * (Time - pSpectator->EncodeTime);
+	pSpectator->MaxEncodeTime = std::max(pSpectator->MaxEncodeTime, Time);
+	pSpectator->TotalEncodeTime += Time;
+	pSpectator->nFrames++;
+	pSpectator->nTicks += nTicks;
+
+	if( bKey )
+	{
+		pSpectator->nKeyframes++;
+		pSpectator->nKeyTick = pGame->nTick;
+		pSpectator->bNeedKey = false;
+	}
+											// the size, then the frame
+	std::vector<unsigned char> Size;
+	PutTheVarint(Size, pSpectator->Frame.size());
+
+	pSpectator->nBytes += Size.size() + pSpectator->Frame.size();
+
+	if( pSpectator->fp )
+	{
+		fwrite(Size.data(), 1, Size.size(), pSpectator->fp);
+		fwrite(pSpectator->Frame.data(), 1, pSpectator->Frame.size(), pSpectator->fp);
+	}
+
+	std::vector<TSpectatorClient>& Clients = pSpectator->Clients;
+
+	for(size_t i=0; i<Clients.size(); )
+	{
+		TSpectatorClient& Client = Clients[i];
+
+		if( bKey ) Client.bWaiting = false;
+
+		if( !Client.bWaiting )
+		{
+			Client.Output.insert(Client.Output.end(), Size.begin(), Size.end());
+			Client.Output.insert(Client.Output.end(), pSpectator->Frame.begin(), pSpectator->Frame.end());
+		}
+
+		if( !SendTheStream(Client.nSocket, Client.Output)
+			|| Client.Output.size() > SPECTATORMAXOUTPUT )
+		{
+			if( Client.Output.size() > SPECTATORMAXOUTPUT ) pSpectator->nDropped++;
+
+			::closesocket(SOCKET(Client.nSocket));
+			Clients.erase(Clients.begin() + i);
+			continue;
+		}
+
+		i++;
+	}
+}
+
+/*!****************************************************************************
+* @brief	Sets-up the viewer of a stream
+* @param	pReplay Pointer to the viewer
+* @param	pSource A file name, or "tcp:[host:]port" of a game streaming
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+bool SetupTheReplay(TReplay* pReplay, const char* pSource)
+{
+	assert(pReplay);
+	assert(pSource);
+
+	pReplay->fp = nullptr;
+	pReplay->nSocket = uintptr_t(INVALID_SOCKET);
+	pReplay->Input.clear();
+	pReplay->bHeader = false;
+	pReplay->nFrames = pReplay->nErrors = 0;
+
+	ResetTheModel(&pReplay->Model);
+
+	sockaddr_in Addr;
+
+	if( !ParseTheAddress(pSource, Addr) )
+	{
+		pReplay->fp = fopen(pSource, "rb");
+
+		return pReplay->fp != nullptr;
+	}
+
+	if( !StartTheSockets() ) return false;
+
+	SOCKET nSocket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+	if( nSocket == INVALID_SOCKET
+		|| ::connect(nSocket, (sockaddr*)&Addr, sizeof(Addr)) != 0
+		|| !SetNonBlocking(nSocket) )
+	{
+		if( nSocket != INVALID_SOCKET ) ::closesocket(nSocket);
+		StopTheSockets();
+		return false;
+	}
+
+	pReplay->nSocket = uintptr_t(nSocket);
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Closes the file or the connection of a viewer
+* @param	pReplay Pointer to the viewer
+******************************************************************************/
+static void CloseTheSource(TReplay* pReplay)
+{
+	assert(pReplay);
+
+	if( pReplay->fp )
+	{
+		fclose(pReplay->fp);
+		pReplay->fp = nullptr;
+	}
+
+	if( SOCKET(pReplay->nSocket) != INVALID_SOCKET )
+	{
+		::closesocket(SOCKET(pReplay->nSocket));
+		pReplay->nSocket = uintptr_t(INVALID_SOCKET);
+
+		StopTheSockets();
+	}
+}
+
+/*!****************************************************************************
+* @brief	Cleans-up the viewer of a stream
+* @param	pReplay Pointer to the viewer
+******************************************************************************/
+void CleanupTheReplay(TReplay* pReplay)
+{
+	assert(pReplay);
+
+	char Buffer[128];
+	sprintf(Buffer, "replay: %u frames, %u errors\n", pReplay->nFrames, pReplay->nErrors);
+
+	LogTheText(Buffer);
+
+	CloseTheSource(pReplay);
+}
+
+/*!****************************************************************************
+* @brief	Takes the next frame out of the bytes received, and decodes it
+* @param	pReplay Pointer to the viewer
+* @return	1 for a frame, 0 if it is not complete yet, -1 if the stream
+*			is corrupted
+******************************************************************************/
+static int TakeTheFrame(TReplay* pReplay)
+{
+	assert(pReplay);
+
+	std::vector<unsigned char>& Input = pReplay->Input;
+
+	if( !pReplay->bHeader )
+	{
+		uint32_t nHeader[2];
+
+		if( Input.size() < sizeof(nHeader) ) return 0;
+
+		memcpy(nHeader, Input.data(), sizeof(nHeader));
+
+		if( nHeader[0] != SPECTATORMAGIC || nHeader[1] != SPECTATORVERSION ) return -1;
+
+		Input.erase(Input.begin(), Input.begin() + sizeof(nHeader));
+		pReplay->bHeader = true;
+	}
+
+	const unsigned char* pData = Input.data();
+	const unsigned char* pEnd = pData + Input.size();
+	uint64_t nSize;
+											// a varint takes up to 10 bytes
+	if( !GetTheVarint(pData, pEnd, nSize) ) return Input.size() < 10 ? 0 : -1;
+
+	if( nSize > SPECTATORMAXFRAME ) return -1;
+
+	if( uint64_t(pEnd - pData) < nSize ) return 0;
+
+	if( DecodeTheFrame(&pReplay->Model, pData, size_t(nSize)) ) pReplay->nFrames++;
+	else pReplay->nErrors++;
+
+	Input.erase(Input.begin(), Input.begin() + (pData - Input.data()) + size_t(nSize));
+
+	return 1;
+}
+
+/*!****************************************************************************
+* @brief	Shows the model through the renderer of the game
+* @param	pModel Pointer to the model
+* @param	pGame Pointer to the game engine, its world and ships are
+*			overwritten
+* @note		The ships are drawn by Update(), with no time elapsing: the
+*			countdowns are set one tick back, as Update() runs them
+******************************************************************************/
+static void ShowTheModel(TSpectatorModel* pModel, TGame* pGame)
+{
+	assert(pModel);
+	assert(pGame);
+
+	TWorld* pWorld = &pGame->World;
+
+	for(int n=0; n<arCount; ++n)
+	{
+		TArchetype& A = pWorld->Archetypes[n];
+		const std::vector<TSpectatorTrack>& Tracks = pModel->Tracks[n];
+		unsigned nCount = unsigned(Tracks.size());
+											// the columns keep their capacity
+		A.nCount = nCount;
+		A.Pos.resize(A.nMask & cpPos ? nCount : 0);
+		A.Vel.resize(A.nMask & cpVel ? nCount : 0);
+		A.Rot.resize(A.nMask & cpSpin ? nCount : 0);
+		A.DRot.resize(A.nMask & cpSpin ? nCount : 0);
+		A.Radius.resize(A.nMask & cpRadius ? nCount : 0);
+		A.Shape.resize(A.nMask & cpShape ? nCount : 0);
+		A.Vertices.resize(A.nMask & cpShape ? nCount : 0);
+		A.Color.resize(A.nMask & cpColor ? nCount : 0);
+		A.Class.resize(A.nMask & cpClass ? nCount : 0);
+		A.Lifetime.resize(A.nMask & cpLifetime ? nCount : 0);
+		A.Owner.resize(A.nMask & cpOwner ? nCount : 0);
+
+		for(unsigned i=0; i<nCount; ++i)
+		{
+			const TSpectatorTrack& Track = Tracks[i];
+			double Scale = 1.0 / double(1 << FIXBITS);
+
+			if( A.nMask & cpPos ) A.Pos[i] = TVector2{ Track.nX * Scale, Track.nY * Scale };
+			if( A.nMask & cpVel ) A.Vel[i] = TVector2{ Track.nVX * Scale / DT, Track.nVY * Scale / DT };
+			if( A.nMask & cpSpin ) { A.Rot[i] = Track.nRot * Scale; A.DRot[i] = Track.nDRot * Scale; }
+			if( A.nMask & cpRadius ) A.Radius[i] = 0;
+			if( A.nMask & cpShape ) A.Shape[i] = Track.Shape;
+			if( A.nMask & cpColor ) A.Color[i] = Track.Color;
+			if( A.nMask & cpClass ) A.Class[i] = Track.nClass;
+			if( A.nMask & cpLifetime ) A.Lifetime[i] = 0;
+			if( A.nMask & cpOwner ) A.Owner[i] = nullptr;
+		}
+	}
+
+	TransformSystem(pWorld);
+	DrawSystem(pWorld, pGame->pVM);
+
+	size_t nShips = std::min(pModel->Ships.size(), pGame->pShips.size());
+
+	for(size_t i=0; i<nShips; ++i)
+	{
+		const TSpectatorShip& Ship = pModel->Ships[i];
+		TShip* pShip = pGame->pShips[i];
+											// not SetVisible(), no sounds
+		pShip->bAlive = (Ship.nFlags & sfAlive) != 0;
+		pShip->bVisible = (Ship.nFlags & sfVisible) != 0;
+		pShip->bShield = (Ship.nFlags & sfShield) != 0;
+
+		pShip->Pos = TVector2{ Ship.nX / SHIPPOS, Ship.nY / SHIPPOS };
+		pShip->Rot = Ship.nRot / SHIPROT;
+		pShip->Color = Ship.Color;
+
+		pShip->nImpulseTicks = Ship.nImpulseTicks + 1;
+		pShip->nShieldTick = unsigned(std::max(Ship.nShieldTick - 1, 0));
+		pShip->nExplosionTicks = Ship.nExplosionTicks > 0 ? Ship.nExplosionTicks + 1 : 0;
+		pShip->nWanderTicks = 0;
+
+		pShip->nDebris = Ship.nDebris;
+
+		for(int k=0; k<Ship.nDebris; ++k)
+		{
+			pShip->Debris[k] = TVector2{ pShip->Pos.X + Ship.Debris[k][0] / SHIPPOS,
+				pShip->Pos.Y + Ship.Debris[k][1] / SHIPPOS };
+			pShip->DebrisScales[k] = Ship.DebrisScales[k] / DEBRISSCALE;
+		}
+
+		Update(pShip, 0);
+	}
+
+	pGame->nScore = pModel->nScore;
+	pGame->nLevel = pModel->nLevel;
+	pGame->nLives = pModel->nLives;
+	pGame->bGameOver = pModel->bGameOver;
+
+	ShowInfo(pGame);
+}
+
+/*!****************************************************************************
+* @brief	Advances the viewer by a frame, and draws it
+* @param	pReplay Pointer to the viewer
+* @param	pGame Pointer to the game engine, used for the drawing only
+* @return	Returns true if a frame has been drawn
+* @note		Replaces Run() in the main loop: a file is played a frame
+*			per call, a live stream is decoded up to its last frame
+******************************************************************************/
+bool AdvanceTheReplay(TReplay* pReplay, TGame* pGame)
+{
+	assert(pReplay);
+	assert(pGame);
+
+	int nResult = 0;
+
+	if( pReplay->fp )
+	{
+		unsigned char Buffer[4096];
+
+		while( (nResult = TakeTheFrame(pReplay)) == 0 )
+		{
+			size_t nSize = fread(Buffer, 1, sizeof(Buffer), pReplay->fp);
+			if( nSize == 0 ) break;
+
+			pReplay->Input.insert(pReplay->Input.end(), Buffer, Buffer + nSize);
+		}
+	}
+	else if( SOCKET(pReplay->nSocket) != INVALID_SOCKET )
+	{
+		unsigned char Buffer[16384];
+
+		for(;;)
+		{
+			int nSize = ::recv(SOCKET(pReplay->nSocket), (char*)Buffer, sizeof(Buffer), 0);
+
+			if( nSize > 0 )
+			{
+				pReplay->Input.insert(pReplay->Input.end(), Buffer, Buffer + nSize);
+				continue;
+			}
+											// the game is over
+			if( nSize == 0 || ::WSAGetLastError() != WSAEWOULDBLOCK ) CloseTheSource(pReplay);
+
+			break;
+		}
+
+		while( (nResult = TakeTheFrame(pReplay)) == 1 ) {;}
+	}
+
+											// no way to find the next frame:
+											// the last one stays on screen
+	if( nResult < 0 )
+	{
+		pReplay->nErrors++;
+		pReplay->Input.clear();
+
+		CloseTheSource(pReplay);
+	}
+
+	if( !pReplay->Model.bValid ) return false;
+
+	ClearScreen(pGame->pVM, RGB(0,0,0));
+
+	ShowTheModel(&pReplay->Model, pGame);
+
+	return true;
+}
@@ -0,0 +1,116 @@
+
+#ifndef _SPECTATOR_H_
+#define _SPECTATOR_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "game.h"
+#include "ecs.h"
+
+
+#define SPECTATORMAGIC		0x564B3241		///< "A2KV"
+#define SPECTATORVERSION	1
+#define SPECTATORKEYFRAME	600				///< ticks between two keyframes
+#define SPECTATORMAXSKIP	60				///< ticks a delta frame can advance
+#define SPECTATORMAXOUTPUT	(256u << 10)	///< bytes queued to a spectator before dropping it
+#define SPECTATORMAXFRAME	(16u << 20)		///< bytes, a sanity limit on the decoding
+
+
+enum enSpectatorShipFlag { sfAlive = 1, sfVisible = 2, sfShield = 4 };
+
+struct TSpectatorTrack						///< an asteroid or a missile, as the viewer predicts it
+{
+	int64_t nX, nY;							///< 1/65536 px
+	int32_t nVX, nVY;						///< 1/65536 px per tick
+	int64_t nRot;							///< 1/65536 degree, in [0, 360)
+	int32_t nDRot;							///< 1/65536 degree per tick
+	int nClass;
+	COLORREF Color;
+	TVecPoints Shape;						///< whole pixels
+};
+
+struct TSpectatorShip						///< a ship, quantized
+{
+	unsigned nFlags;						///< see enSpectatorShipFlag
+	int32_t nX, nY;							///< 1/8 px
+	int32_t nRot;							///< 1/16 degree, in [0, 360)
+	int nImpulseTicks, nShieldTick, nExplosionTicks;
+	int nDebris;
+	int32_t Debris[SHIP_NDEBRIS][2];		///< 1/8 px, from the ship
+	int32_t DebrisScales[SHIP_NDEBRIS];		///< 1/32
+	COLORREF Color;
+};
+
+struct TSpectatorModel						///< the world rebuilt by the viewer, mirrored by the encoder
+{
+	bool bValid;							///< a keyframe has been decoded
+	unsigned nTick;
+	int nWidth, nHeight;
+	unsigned nMasks[arCount];				///< components of each archetype
+	COLORREF Colors[arCount];				///< of the last entity spawned, xor-ed with the next one
+	int nScore, nLevel, nLives;
+	bool bGameOver;
+
+	std::vector<TSpectatorShip> Ships;
+	std::vector<TSpectatorTrack> Tracks[arCount];	///< in the order of the rows
+};
+
+struct TSpectatorFix						///< scratch, a correction of a track
+{
+	unsigned nTrack, nMask;
+	int64_t nDX, nDY, nDRot;
+};
+
+struct TSpectatorClient
+{
+	uintptr_t nSocket;
+	bool bWaiting;							///< for the next keyframe
+	std::vector<unsigned char> Output;		///< TCP stream, not sent yet
+};
+
+struct TSpectator
+{
+	FILE* fp;								///< the stream file, nullptr if none
+	uintptr_t nListen;						///< the spectators socket, INVALID_SOCKET if none
+	std::vector<TSpectatorClient> Clients;
+	bool bNeedKey;							///< a keyframe at the next tick
+	unsigned nKeyTick;						///< tick of the last keyframe
+
+	TSpectatorModel Model;					///< as decoded by the spectators
+	std::vector<unsigned char> Frame;		///< scratch, the last frame encoded
+	std::vector<TSpectatorShip> Ships;		///< scratch, the ships quantized
+	std::vector<unsigned> Dead;				///< scratch, for the encoding
+	std::vector<TSpectatorFix> Fixes;
+											// statistics
+	unsigned nFrames, nKeyframes, nDropped;
+	unsigned nTicks;						///< of the game, streamed
+	uint64_t nBytes;
+	double EncodeTime;						///< seconds to encode a tick, smoothed
+	double MaxEncodeTime, TotalEncodeTime;
+};
+
+struct TReplay
+{
+	FILE* fp;								///< the stream file, nullptr if live
+	uintptr_t nSocket;						///< live: connected to the game, INVALID_SOCKET if none
+	std::vector<unsigned char> Input;		///< bytes not decoded yet
+	bool bHeader;							///< the stream header has been read
+
+	TSpectatorModel Model;
+	unsigned nFrames, nErrors;
+};
+
+bool SetupTheSpectator(TSpectator* pSpectator, const char* pTarget);
+void CleanupTheSpectator(TSpectator* pSpectator);
+void StreamTheTick(TSpectator* pSpectator, TGame* pGame);
+
+bool DecodeTheFrame(TSpectatorModel* pModel, const unsigned char* pData, size_t nSize);
+
+bool SetupTheReplay(TReplay* pReplay, const char* pSource);
+void CleanupTheReplay(TReplay* pReplay);
+bool AdvanceTheReplay(TReplay* pReplay, TGame* pGame);
+
+#endif
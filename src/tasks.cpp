@@ -0,0 +1,621 @@
+/*!****************************************************************************
+
+	@file	tasks.h
+	@file	tasks.cpp
+
+	@brief	Thread pool for background tasks, work-stealing job system
+			for the per-tick work, and timing of tasks
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include "platform.h"
+#include <assert.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "tasks.h"
+#include "utils.h"
+
+
+#define JOBSPERTHREAD	4					///< chunks of a parallel for, per thread
+
+											// queue owned by the calling thread,
+											// -1 for the threads not in a job system
+static thread_local int nOwnQueue = -1;
+
+
+/*!****************************************************************************
+* @brief	Worker thread body: runs the queued tasks until the pool quits
+* @param	pPool Pointer to the thread pool
+******************************************************************************/
+static void WorkerLoop(TTaskPool* pPool)
+{
+	assert(pPool);
+
+	std::unique_lock<std::mutex> Lock(pPool->Mutex);
+
+	for(;;)
+	{
+		pPool->Wakeup.wait(Lock, [pPool] { return pPool->bQuit || !pPool->Tasks.empty(); });
+
+		if( pPool->Tasks.empty() ) break;
+
+		TTask Task = std::move(pPool->Tasks.front());
+		pPool->Tasks.pop_front();
+		pPool->nBusy++;
+
+		Lock.unlock();
+			Task();
+		Lock.lock();
+
+		pPool->nBusy--;
+
+		if( pPool->Tasks.empty() && !pPool->nBusy ) pPool->Done.notify_all();
+	}
+}
+
+/*!****************************************************************************
+* @brief	Starts a pool of worker threads
+* @param	pPool Pointer to the thread pool
+* @param	nThreads Number of threads, 0 to use the number of cores
+******************************************************************************/
+void SetupTaskPool(TTaskPool* pPool, unsigned nThreads)
+{
+	assert(pPool);
+	assert(pPool->Workers.empty());
+
+	if( nThreads == 0 ) nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	pPool->nBusy = 0;
+	pPool->bQuit = false;
+
+	for(unsigned i=0; i<nThreads; ++i)
+	{
+		pPool->Workers.push_back(std::thread(WorkerLoop, pPool));
+	}
+}
+
+/*!****************************************************************************
+* @brief	Stops the pool, once the pending tasks are completed
+* @param	pPool Pointer to the thread pool
+******************************************************************************/
+void CleanupTaskPool(TTaskPool* pPool)
+{
+	assert(pPool);
+
+	{
+		std::lock_guard<std::mutex> Lock(pPool->Mutex);
+		pPool->bQuit = true;
+	}
+
+	pPool->Wakeup.notify_all();
+
+	for(int i=0; i<pPool->Workers.size(); ++i)
+	{
+		pPool->Workers[i].join();
+	}
+
+	pPool->Workers.clear();
+}
+
+/*!****************************************************************************
+* @brief	Queues a task
+* @param	pPool Pointer to the thread pool
+* @param	Task The task to be run by one of the workers
+******************************************************************************/
+void PushTheTask(TTaskPool* pPool, TTask Task)
+{
+	assert(pPool);
+
+	{
+		std::lock_guard<std::mutex> Lock(pPool->Mutex);
+		pPool->Tasks.push_back(std::move(Task));
+	}
+
+	pPool->Wakeup.notify_one();
+}
+
+/*!****************************************************************************
+* @brief	Waits for all the queued tasks to be completed
+* @param	pPool Pointer to the thread pool
+******************************************************************************/
+void WaitTheTasks(TTaskPool* pPool)
+{
+	assert(pPool);
+
+	std::unique_lock<std::mutex> Lock(pPool->Mutex);
+
+	pPool->Done.wait(Lock, [pPool] { return pPool->Tasks.empty() && !pPool->nBusy; });
+}
+
+/*!****************************************************************************
+* @brief	Checks, without blocking, if all the queued tasks are completed
+* @param	pPool Pointer to the thread pool
+* @return	Returns true if there is nothing left to do
+******************************************************************************/
+bool IsIdle(TTaskPool* pPool)
+{
+	assert(pPool);
+
+	std::lock_guard<std::mutex> Lock(pPool->Mutex);
+
+	return pPool->Tasks.empty() && !pPool->nBusy;
+}
+
+/*!****************************************************************************
+* @brief	Runs a job: a chunk of a range task, or a node of a graph that
+*			then queues the nodes depending on it, as soon as they are ready
+* @param	pJobs Pointer to the job system
+* @param	Job The job
+******************************************************************************/
+static void RunTheJob(TJobSystem* pJobs, const TJob& Job)
+{
+	if( Job.pTask )
+	{
+		(*Job.pTask)(Job.nBegin, Job.nEnd);
+	}
+	else
+	{
+		TJobNode& Node = Job.pGraph->Nodes[Job.nBegin];
+
+		Node.Task();
+
+		for(int nNext : Node.Next)
+		{
+			if( --Job.pGraph->Nodes[nNext].nWaiting == 0 )
+			{
+				PushTheJob(pJobs, TJob{ nullptr, Job.pGraph, unsigned(nNext), 0, Job.pPending });
+			}
+		}
+	}
+
+	(*Job.pPending)--;
+}
+
+/*!****************************************************************************
+* @brief	Runs a job, if any: first from the own queue, newest first,
+*			then stealing from the other queues, oldest first
+* @param	pJobs Pointer to the job system
+* @return	Returns true if a job has been run
+******************************************************************************/
+static bool RunOneJob(TJobSystem* pJobs)
+{
+	assert(pJobs);
+
+	unsigned nSelf = nOwnQueue < 0 ? pJobs->nQueues - 1 : unsigned(nOwnQueue);
+	TJob Job;
+	bool bFound = false;
+
+	for(unsigned i=0; i<pJobs->nQueues && !bFound; ++i)
+	{
+		TJobQueue& Queue = pJobs->pQueues[(nSelf + i) % pJobs->nQueues];
+
+		std::lock_guard<std::mutex> Lock(Queue.Mutex);
+
+		if( !Queue.nCount ) continue;
+
+		unsigned nMask = unsigned(Queue.Jobs.size()) - 1;
+
+		if( i == 0 )
+		{
+			Job = Queue.Jobs[(Queue.nFront + Queue.nCount - 1) & nMask];
+		}
+		else
+		{
+			Job = Queue.Jobs[Queue.nFront];
+			Queue.nFront = (Queue.nFront + 1) & nMask;
+		}
+
+		Queue.nCount--;
+		bFound = true;
+	}
+
+	if( !bFound ) return false;
+
+	pJobs->nQueued--;
+	RunTheJob(pJobs, Job);
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Job worker thread body: runs and steals the jobs, sleeps when
+*			there is nothing left to do
+* @param	pJobs Pointer to the job system
+* @param	nQueue The queue owned by the worker
+******************************************************************************/
+static void JobWorkerLoop(TJobSystem* pJobs, unsigned nQueue)
+{
+	assert(pJobs);
+
+	nOwnQueue = int(nQueue);
+
+	while( !pJobs->bQuit )
+	{
+		if( RunOneJob(pJobs) ) continue;
+
+		std::unique_lock<std::mutex> Lock(pJobs->Mutex);
+
+		pJobs->Wakeup.wait(Lock, [pJobs] { return pJobs->bQuit || pJobs->nQueued > 0; });
+	}
+}
+
+/*!****************************************************************************
+* @brief	Starts the job system
+* @param	pJobs Pointer to the job system
+* @param	nThreads Number of worker threads, 0 for one less than the
+*			number of cores: the main thread works too, while waiting
+******************************************************************************/
+void SetupJobSystem(TJobSystem* pJobs, unsigned nThreads)
+{
+	assert(pJobs);
+	assert(pJobs->Workers.empty());
+
+	if( nThreads == 0 ) nThreads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+	pJobs->nQueues = nThreads + 1;
+	pJobs->pQueues = new TJobQueue[pJobs->nQueues];
+	assert(pJobs->pQueues);
+											// the ticks find the room ready
+	for(unsigned i=0; i<pJobs->nQueues; ++i)
+	{
+		pJobs->pQueues[i].Jobs.resize(JOBQUEUESIZE);
+		pJobs->pQueues[i].nFront = pJobs->pQueues[i].nCount = 0;
+	}
+
+	pJobs->nQueued = 0;
+	pJobs->bQuit = false;
+
+	for(unsigned i=0; i<nThreads; ++i)
+	{
+		pJobs->Workers.push_back(std::thread(JobWorkerLoop, pJobs, i));
+	}
+}
+
+/*!****************************************************************************
+* @brief	Stops the job system
+* @param	pJobs Pointer to the job system
+* @note		No job must be pending
+******************************************************************************/
+void CleanupJobSystem(TJobSystem* pJobs)
+{
+	assert(pJobs);
+
+	if( !pJobs->pQueues ) return;
+
+	{
+		std::lock_guard<std::mutex> Lock(pJobs->Mutex);
+		pJobs->bQuit = true;
+	}
+
+	pJobs->Wakeup.notify_all();
+
+	for(int i=0; i<pJobs->Workers.size(); ++i)
+	{
+		pJobs->Workers[i].join();
+	}
+
+	pJobs->Workers.clear();
+
+	delete[] pJobs->pQueues;
+	pJobs->pQueues = nullptr;
+	pJobs->nQueues = 0;
+}
+
+/*!****************************************************************************
+* @brief	Gets the number of threads running the jobs
+* @param	pJobs Pointer to the job system, may be nullptr
+* @return	The number of workers plus the main thread
+******************************************************************************/
+unsigned GetTheThreads(TJobSystem* pJobs)
+{
+	return pJobs && pJobs->pQueues ? pJobs->nQueues : 1;
+}
+
+/*!****************************************************************************
+* @brief	Gets the index of the calling thread, to address per-thread data
+* @param	pJobs Pointer to the job system, may be nullptr
+* @return	An index less than GetTheThreads(), the last one for the
+*			main thread
+******************************************************************************/
+unsigned GetTheThreadIndex(TJobSystem* pJobs)
+{
+	unsigned nThreads = GetTheThreads(pJobs);
+
+	return nOwnQueue < 0 || unsigned(nOwnQueue) >= nThreads ? nThreads - 1 : unsigned(nOwnQueue);
+}
+
+/*!****************************************************************************
+* @brief	Doubles the room of a full job queue, keeping the order
+* @param	Queue The queue, locked
+******************************************************************************/
+static void GrowTheQueue(TJobQueue& Queue)
+{
+	std::vector<TJob> Jobs(std::max(size_t(JOBQUEUESIZE), 2 * Queue.Jobs.size()));
+
+	for(unsigned i=0; i<Queue.nCount; ++i)
+	{
+		Jobs[i] = Queue.Jobs[(Queue.nFront + i) & (Queue.Jobs.size() - 1)];
+	}
+
+	Queue.Jobs.swap(Jobs);
+	Queue.nFront = 0;
+}
+
+/*!****************************************************************************
+* @brief	Queues a job on the queue of the calling thread
+* @param	pJobs Pointer to the job system
+* @param	Job The job, copied
+* @note		Nothing is allocated, unless the queue is full
+******************************************************************************/
+void PushTheJob(TJobSystem* pJobs, const TJob& Job)
+{
+	assert(pJobs);
+	assert(pJobs->pQueues);
+
+	TJobQueue& Queue = pJobs->pQueues[nOwnQueue < 0 ? pJobs->nQueues - 1 : nOwnQueue];
+
+	{
+		std::lock_guard<std::mutex> Lock(Queue.Mutex);
+
+		if( Queue.nCount == Queue.Jobs.size() ) GrowTheQueue(Queue);
+
+		Queue.Jobs[(Queue.nFront + Queue.nCount) & (Queue.Jobs.size() - 1)] = Job;
+		Queue.nCount++;
+	}
+
+	pJobs->nQueued++;
+											// no wake-up lost: the workers check
+											// the counter holding the mutex
+	{
+		std::lock_guard<std::mutex> Lock(pJobs->Mutex);
+	}
+
+	pJobs->Wakeup.notify_one();
+}
+
+/*!****************************************************************************
+* @brief	Waits for a counter of pending jobs to reach zero, running the
+*			queued jobs in the meantime
+* @param	pJobs Pointer to the job system
+* @param	nPending The counter, decremented by the jobs when completed
+******************************************************************************/
+void WaitTheJobs(TJobSystem* pJobs, std::atomic<int>& nPending)
+{
+	assert(pJobs);
+
+	while( nPending > 0 )
+	{
+		if( !RunOneJob(pJobs) ) std::this_thread::yield();
+	}
+}
+
+/*!****************************************************************************
+* @brief	Runs a task over the range [0, nCount), split in chunks run
+*			in parallel
+* @param	pJobs Pointer to the job system, nullptr to run serially
+* @param	nCount The size of the range
+* @param	nGrain The minimum size of a chunk
+* @param	Task The task, called with the begin and the end of a chunk
+* @note		Returns once all the chunks are completed. The chunks must be
+*			independent: the result does not depend on the scheduling.
+*			Nothing is allocated: the chunks refer to the task.
+******************************************************************************/
+void ParallelFor(TJobSystem* pJobs, unsigned nCount, unsigned nGrain, const TRangeTask& Task)
+{
+	assert(nGrain > 0);
+
+	unsigned nThreads = GetTheThreads(pJobs);
+	unsigned nChunk = std::max(nGrain, (nCount + nThreads*JOBSPERTHREAD - 1) / (nThreads*JOBSPERTHREAD));
+
+	if( nThreads == 1 || nCount <= nChunk )
+	{
+		if( nCount ) Task(0, nCount);
+		return;
+	}
+
+	std::atomic<int> nPending((nCount + nChunk - 1) / nChunk);
+											// the first chunk is run by the caller
+	for(unsigned nBegin=nChunk; nBegin<nCount; nBegin+=nChunk)
+	{
+		unsigned nEnd = std::min(nCount, nBegin + nChunk);
+
+		PushTheJob(pJobs, TJob{ &Task, nullptr, nBegin, nEnd, &nPending });
+	}
+
+	Task(0, nChunk);
+	nPending--;
+
+	WaitTheJobs(pJobs, nPending);
+}
+
+/*!****************************************************************************
+* @brief	Adds a node to a graph of jobs
+* @param	pGraph Pointer to the graph
+* @param	pName The name of the node
+* @param	Task The work of the node
+* @return	The index of the node
+******************************************************************************/
+int AddTheNode(TJobGraph* pGraph, const char* pName, TTask Task)
+{
+	assert(pGraph);
+
+	pGraph->Nodes.emplace_back();
+
+	TJobNode& Node = pGraph->Nodes.back();
+	Node.pName = pName;
+	Node.Task = std::move(Task);
+	Node.nDeps = 0;
+	Node.nWaiting = 0;
+
+	return int(pGraph->Nodes.size()) - 1;
+}
+
+/*!****************************************************************************
+* @brief	Adds a dependency between two nodes of a graph of jobs
+* @param	pGraph Pointer to the graph
+* @param	nNode The node depending on the other one
+* @param	nDependsOn The node to be completed first
+******************************************************************************/
+void AddTheDependency(TJobGraph* pGraph, int nNode, int nDependsOn)
+{
+	assert(pGraph);
+	assert(nNode >= 0 && nNode < int(pGraph->Nodes.size()));
+	assert(nDependsOn >= 0 && nDependsOn < nNode);		// keeps the graph acyclic
+
+	pGraph->Nodes[nDependsOn].Next.push_back(nNode);
+	pGraph->Nodes[nNode].nDeps++;
+}
+
+/*!****************************************************************************
+* @brief	Runs all the nodes of a graph of jobs, each one after the
+*			nodes it depends on
+* @param	pJobs Pointer to the job system, nullptr to run serially
+* @param	pGraph Pointer to the graph
+* @note		Returns once all the nodes are completed. Serially, the nodes
+*			are run in the order they were added.
+******************************************************************************/
+void RunTheGraph(TJobSystem* pJobs, TJobGraph* pGraph)
+{
+	assert(pGraph);
+
+	if( GetTheThreads(pJobs) == 1 )
+	{										// the dependencies point backwards
+		for(TJobNode& Node : pGraph->Nodes) Node.Task();
+		return;
+	}
+
+	std::atomic<int> nPending(int(pGraph->Nodes.size()));
+
+	for(TJobNode& Node : pGraph->Nodes)
+	{
+		Node.nWaiting = Node.nDeps;
+	}
+
+	for(int i=0; i<pGraph->Nodes.size(); ++i)
+	{
+		if( !pGraph->Nodes[i].nDeps ) PushTheJob(pJobs, TJob{ nullptr, pGraph, unsigned(i), 0, &nPending });
+	}
+
+	WaitTheJobs(pJobs, nPending);
+}
+
+/*!****************************************************************************
+* @brief	Gets the time from the high resolution performance counter
+*			(the monotonic clock on Linux)
+* @return	The time, in seconds
+******************************************************************************/
+double GetTheTime()
+{
+#ifdef __linux__
+	timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+
+	return double(Now.tv_sec) + double(Now.tv_nsec) * 1e-9;
+#else
+	static LARGE_INTEGER Frequency = { 0 };
+
+	if( !Frequency.QuadPart ) ::QueryPerformanceFrequency(&Frequency);
+
+	LARGE_INTEGER Counter;
+	::QueryPerformanceCounter(&Counter);
+
+	return double(Counter.QuadPart) / double(Frequency.QuadPart);
+#endif
+}
+
+/*!****************************************************************************
+* @brief	Starts a timeline: the events are timed from now on
+* @param	pTimeline Pointer to the timeline
+* @note		Must be called from the main thread
+******************************************************************************/
+void StartTheTimeline(TTimeline* pTimeline)
+{
+	assert(pTimeline);
+
+	pTimeline->Origin = GetTheTime();
+	pTimeline->MainThread = std::this_thread::get_id();
+	pTimeline->Threads.clear();
+	pTimeline->Events.clear();
+}
+
+/*!****************************************************************************
+* @brief	Records an event ending now, on the calling thread
+* @param	pTimeline Pointer to the timeline
+* @param	pName The event name
+* @param	Start The event start time, as returned by GetTheTime()
+* @return	The current time, handy to time consecutive events
+******************************************************************************/
+double AddTheEvent(TTimeline* pTimeline, const char* pName, double Start)
+{
+	assert(pTimeline);
+	assert(pName);
+
+	double End = GetTheTime();
+
+	std::lock_guard<std::mutex> Lock(pTimeline->Mutex);
+
+	std::thread::id Id = std::this_thread::get_id();
+	unsigned nThread = 0;
+
+	if( Id != pTimeline->MainThread )
+	{
+		auto Iter = std::find(pTimeline->Threads.begin(), pTimeline->Threads.end(), Id);
+
+		if( Iter == pTimeline->Threads.end() )
+		{
+			Iter = pTimeline->Threads.insert(Iter, Id);
+		}
+
+		nThread = unsigned(Iter - pTimeline->Threads.begin()) + 1;
+	}
+
+	pTimeline->Events.push_back(TTimelineEvent {
+		pName, Start - pTimeline->Origin, End - pTimeline->Origin, nThread });
+
+	return End;
+}
+
+/*!****************************************************************************
+* @brief	Writes the timeline report, ordered by start time
+* @param	pTimeline Pointer to the timeline
+* @param	strFileName The report file; the report also goes to the log,
+*			see LogTheText()
+******************************************************************************/
+void ReportTheTimeline(TTimeline* pTimeline, std::string strFileName)
+{
+	assert(pTimeline);
+
+	std::lock_guard<std::mutex> Lock(pTimeline->Mutex);
+
+	std::vector<TTimelineEvent> Events = pTimeline->Events;
+
+	std::stable_sort(Events.begin(), Events.end(),
+		[](const TTimelineEvent& A, const TTimelineEvent& B) { return A.Start < B.Start; });
+
+	FILE* fp = fopen(strFileName.c_str(), "w");
+
+	char Buffer[256];
+	sprintf(Buffer, "%-16s %6s %10s %10s %10s\n", "event", "thread", "start ms", "end ms", "ms");
+
+	if( fp ) fputs(Buffer, fp);
+	LogTheText(Buffer);
+
+	for(int i=0; i<Events.size(); ++i)
+	{
+		sprintf(Buffer, "%-16s %6u %10.2f %10.2f %10.2f\n",
+			Events[i].strName.c_str(), Events[i].nThread,
+			Events[i].Start * 1000.0, Events[i].End * 1000.0,
+			(Events[i].End - Events[i].Start) * 1000.0);
+
+		if( fp ) fputs(Buffer, fp);
+		LogTheText(Buffer);
+	}
+
+	if( fp ) fclose(fp);
+}
@@ -0,0 +1,130 @@
+
+#ifndef _TASKS_H_
+#define _TASKS_H_
+
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+
+#define JOBQUEUESIZE		256				///< jobs of a queue at the start, a power of 2
+
+
+typedef std::function<void()> TTask;
+
+struct TTaskPool
+{
+	std::vector<std::thread> Workers;
+	std::deque<TTask> Tasks;
+
+	std::mutex Mutex;
+	std::condition_variable Wakeup, Done;
+
+	unsigned nBusy;
+	bool bQuit;
+};
+
+struct TRangeTask					///< a task on a range, see ParallelFor(): refers to
+{								///< the callable, so it never allocates
+	const void* pTask;				///< the callable, alive during the call
+	void (*pCall)(const void* pTask, unsigned nBegin, unsigned nEnd);
+
+	template<class T> TRangeTask(const T& Task)
+		: pTask(&Task), pCall([](const void* p, unsigned nBegin, unsigned nEnd) { (*(const T*) p)(nBegin, nEnd); })
+	{
+	}
+
+	void operator()(unsigned nBegin, unsigned nEnd) const { pCall(pTask, nBegin, nEnd); }
+};
+
+struct TJobGraph;
+
+struct TJob							///< a chunk of a range task, or a node of a graph:
+{								///< copied in the queues, it never allocates
+	const TRangeTask* pTask;		///< the range task, nullptr for a node
+	TJobGraph* pGraph;
+	unsigned nBegin, nEnd;			///< the chunk, or the node in nBegin
+	std::atomic<int>* pPending;		///< decremented once the job is completed
+};
+
+struct TJobQueue					///< per thread: the owner works at the back,
+{								///< the thieves steal from the front
+	std::mutex Mutex;
+	std::vector<TJob> Jobs;			///< circular, a power of 2, grows when full
+	unsigned nFront, nCount;
+};
+
+struct TJobSystem
+{
+	std::vector<std::thread> Workers;
+	TJobQueue* pQueues;				///< one per worker, the last one for the main thread
+	unsigned nQueues;
+
+	std::atomic<int> nQueued;		///< jobs queued, not started yet
+	std::mutex Mutex;				///< the idle workers sleep on it
+	std::condition_variable Wakeup;
+	std::atomic<bool> bQuit;
+};
+
+struct TJobNode
+{
+	const char* pName;
+	TTask Task;
+	std::vector<int> Next;			///< nodes depending on this one
+	int nDeps;
+	std::atomic<int> nWaiting;		///< dependencies not completed yet, while running
+};
+
+struct TJobGraph
+{
+	std::deque<TJobNode> Nodes;		///< a deque, the nodes never move
+};
+
+struct TTimelineEvent
+{
+	std::string strName;
+	double Start, End;				///< seconds, from the timeline origin
+	unsigned nThread;				///< 0 for the main thread
+};
+
+struct TTimeline
+{
+	double Origin;
+	std::thread::id MainThread;
+	std::vector<std::thread::id> Threads;
+	std::vector<TTimelineEvent> Events;
+	std::mutex Mutex;
+};
+
+void SetupTaskPool(TTaskPool* pPool, unsigned nThreads);
+void CleanupTaskPool(TTaskPool* pPool);
+
+void PushTheTask(TTaskPool* pPool, TTask Task);
+void WaitTheTasks(TTaskPool* pPool);
+bool IsIdle(TTaskPool* pPool);
+
+void SetupJobSystem(TJobSystem* pJobs, unsigned nThreads);
+void CleanupJobSystem(TJobSystem* pJobs);
+unsigned GetTheThreads(TJobSystem* pJobs);
+unsigned GetTheThreadIndex(TJobSystem* pJobs);
+
+void PushTheJob(TJobSystem* pJobs, const TJob& Job);
+void WaitTheJobs(TJobSystem* pJobs, std::atomic<int>& nPending);
+void ParallelFor(TJobSystem* pJobs, unsigned nCount, unsigned nGrain, const TRangeTask& Task);
+
+int AddTheNode(TJobGraph* pGraph, const char* pName, TTask Task);
+void AddTheDependency(TJobGraph* pGraph, int nNode, int nDependsOn);
+void RunTheGraph(TJobSystem* pJobs, TJobGraph* pGraph);
+
+double GetTheTime();
+
+void StartTheTimeline(TTimeline* pTimeline);
+double AddTheEvent(TTimeline* pTimeline, const char* pName, double Start);
+void ReportTheTimeline(TTimeline* pTimeline, std::string strFileName);
+
+#endif
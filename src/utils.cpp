@@ -11,7 +11,16 @@
 
 ******************************************************************************/
 
-#include <windows.h>
+#include "platform.h"
+
+#ifdef __linux__
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#include <assert.h>
 #include <iostream>
 #include <stdio.h>
 #include <string.h>
@@ -47,6 +56,18 @@ void Debounce()
 std::string GetExePath()
 {
 	std::string strResult;
+
+#ifdef __linux__
+	char ownPath[MAX_PATH + 1];
+
+	ssize_t nLength = ::readlink("/proc/self/exe", ownPath, MAX_PATH);
+
+	if( nLength > 0 )
+	{
+		strResult = std::string(ownPath, nLength);
+		strResult.erase(strResult.find_last_of('/'));
+	}
+#else
 	char ownPath[MAX_PATH];
 
 											// When NULL is passed to GetModuleHandle,
@@ -84,6 +105,7 @@ std::string GetExePath()
 			}
 		}
 	}
+#endif
 
 	return strResult;
 }
@@ -94,11 +116,208 @@ std::string GetExePath()
 ******************************************************************************/
 std::string GetDataPath()
 {
-	std::string strDataPath = GetExePath() + std::string(DATAFOLDER);
+											// resolved once: the exe does not move
+	static std::string strDataPath = GetExePath() + std::string(DATAFOLDER);
 
 	return strDataPath;
 }
 
+/*!****************************************************************************
+* @brief	Maps a whole file in memory, read-only
+* @param	pFile Pointer to the mapped file data structure
+* @param	strFileName The path to the file
+* @return	Returns true for success, false otherwise (empty files too)
+******************************************************************************/
+bool MapTheFile(TMappedFile* pFile, std::string strFileName)
+{
+	assert(pFile);
+
+	memset(pFile, 0, sizeof(TMappedFile));
+
+#ifdef __linux__
+	int fd = ::open(strFileName.c_str(), O_RDONLY);
+	if( fd < 0 ) return false;
+
+	struct stat Stat;
+	void* pView = nullptr;
+											// the mapping outlives the file
+											// descriptor
+	if( ::fstat(fd, &Stat) == 0 && Stat.st_size > 0 && uint64_t(Stat.st_size) < 0x100000000ULL )
+	{
+		pView = ::mmap(nullptr, Stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if( pView == MAP_FAILED ) pView = nullptr;
+	}
+
+	::close(fd);
+
+	if( !pView ) return false;
+
+	pFile->pData = (const unsigned char*) pView;
+	pFile->nSize = unsigned(Stat.st_size);
+#else
+	HANDLE hFile = ::CreateFileA(strFileName.c_str(), GENERIC_READ, FILE_SHARE_READ,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if( hFile == INVALID_HANDLE_VALUE ) return false;
+
+	LARGE_INTEGER Size;
+											// the wav/asset files are small: files
+											// larger than 4GB are not supported
+	if( !::GetFileSizeEx(hFile, &Size) || Size.QuadPart == 0 || Size.HighPart != 0 )
+	{
+		::CloseHandle(hFile);
+		return false;
+	}
+
+	HANDLE hMapping = ::CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	if( !hMapping )
+	{
+		::CloseHandle(hFile);
+		return false;
+	}
+
+	void* pView = ::MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+
+	if( !pView )
+	{
+		::CloseHandle(hMapping);
+		::CloseHandle(hFile);
+		return false;
+	}
+
+	pFile->hFile = hFile;
+	pFile->hMapping = hMapping;
+	pFile->pData = (const unsigned char*) pView;
+	pFile->nSize = Size.LowPart;
+#endif
+
+	return true;
+}
+
+/*!****************************************************************************
+* @brief	Releases a file mapped by MapTheFile()
+* @param	pFile Pointer to the mapped file data structure
+******************************************************************************/
+void UnmapTheFile(TMappedFile* pFile)
+{
+	assert(pFile);
+
+#ifdef __linux__
+	if( pFile->pData ) ::munmap((void*) pFile->pData, pFile->nSize);
+#else
+	if( pFile->pData ) ::UnmapViewOfFile(pFile->pData);
+	if( pFile->hMapping ) ::CloseHandle(pFile->hMapping);
+	if( pFile->hFile ) ::CloseHandle(pFile->hFile);
+#endif
+
+	memset(pFile, 0, sizeof(TMappedFile));
+}
+
+/*!****************************************************************************
+* @brief	Reads a whole file in a string
+* @param	strFileName The path to the file
+* @param[out] strText The file contents
+* @return	Returns true for success (also for empty files), false otherwise
+******************************************************************************/
+bool ReadTheFile(std::string strFileName, std::string& strText)
+{
+	bool bResult = false;
+
+	FILE* fp = fopen(strFileName.c_str(), "rb");
+
+	if( fp )
+	{
+		strText.resize(GetFileSize(fp));
+
+		bResult = fread(&strText[0], 1, strText.size(), fp) == strText.size();
+
+		fclose(fp);
+	}
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Writes a whole file, through a temporary file renamed over it
+* @param	strFileName The path to the file
+* @param	strText The file contents
+* @return	Returns true for success, false otherwise
+* @note		The temporary file is flushed to the disk before the rename:
+*			after a crash the file is either the old one or the new one
+******************************************************************************/
+bool WriteTheFile(std::string strFileName, const std::string& strText)
+{
+	std::string strTempFile = strFileName + ".tmp";
+
+#ifdef __linux__
+	int fd = ::open(strTempFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if( fd < 0 ) return false;
+
+	bool bResult = ::write(fd, strText.data(), strText.size()) == ssize_t(strText.size())
+		&& ::fsync(fd) == 0;
+
+	bResult = ::close(fd) == 0 && bResult;
+
+	bResult = bResult && ::rename(strTempFile.c_str(), strFileName.c_str()) == 0;
+
+	if( !bResult ) ::unlink(strTempFile.c_str());
+#else
+	HANDLE hFile = ::CreateFileA(strTempFile.c_str(), GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if( hFile == INVALID_HANDLE_VALUE ) return false;
+
+	DWORD nWritten = 0;
+
+	bool bResult = ::WriteFile(hFile, strText.data(), DWORD(strText.size()), &nWritten, NULL)
+		&& nWritten == strText.size()
+		&& ::FlushFileBuffers(hFile);
+
+	::CloseHandle(hFile);
+
+	bResult = bResult && ::MoveFileExA(strTempFile.c_str(), strFileName.c_str(),
+		MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+
+	if( !bResult ) ::DeleteFileA(strTempFile.c_str());
+#endif
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Splits a text in lines
+* @param	pText Pointer to the text, not necessarily zero terminated
+* @param	nSize Size of the text
+* @return	The lines, without line terminators (either LF or CR-LF)
+******************************************************************************/
+TVecStrings SplitTheLines(const char* pText, unsigned nSize)
+{
+	TVecStrings strLines;
+
+	unsigned nStart = 0;
+
+	for(unsigned i=0; i<=nSize; ++i)
+	{
+		if( i == nSize || pText[i] == '\n' )
+		{
+			unsigned nEnd = i;
+			if( nEnd > nStart && pText[nEnd-1] == '\r' ) nEnd--;
+											// a trailing newline does not
+											// start a new line
+			if( i < nSize || nEnd > nStart )
+			{
+				strLines.push_back(std::string(pText + nStart, nEnd - nStart));
+			}
+
+			nStart = i + 1;
+		}
+	}
+
+	return strLines;
+}
+
 /*!****************************************************************************
 * @brief	Gets the file size
 * @param	fp Pointer to a FILE struct
@@ -185,14 +404,34 @@ std::string GetFileName(std::string strPath, bool bRemoveExt)
 	return strPath;
 }
 
+/*!****************************************************************************
+* @brief	Writes a line of a log (e.g. of the server, of the batches,
+*			of the checks), to the console and to the debugger output (on
+*			Windows)
+* @param	pText The line
+******************************************************************************/
+void LogTheText(const char* pText)
+{
+	fputs(pText, stdout);
+	fflush(stdout);
+
+#ifndef __linux__
+	::OutputDebugStringA(pText);
+#endif
+}
+
 /*!****************************************************************************
 * @brief	Shows a MessageBox containing a specified string
 * @param	strMsg The message to show
 ******************************************************************************/
 void Show(std::string strMsg)
 {
+#ifdef __linux__
+	LogTheText((strMsg + "\n").c_str());
+#else
 	::MessageBoxA(0, strMsg.c_str(), "Info:",
 		MB_OK | MB_ICONINFORMATION | MB_TASKMODAL);
+#endif
 }
 
 /*!****************************************************************************
@@ -212,8 +451,12 @@ void Show(TVecIntegers IntList)
 		strcat(strList, Buffer);
 	}
 
+#ifdef __linux__
+	LogTheText(strList);
+#else
 	::MessageBoxA(0, strList, "Info",
 		MB_OK | MB_ICONINFORMATION | MB_TASKMODAL);
+#endif
 }
 
 /*!****************************************************************************
@@ -281,4 +524,42 @@ int ConvertToInt(char* pBuffer, int nLen)
     return a;
 }
 
+/*!****************************************************************************
+* @brief	Appends an unsigned integer as a varint: 7 bits per byte, the
+*			lowest first, the high bit set on all the bytes but the last
+* @param	Buffer The buffer to be appended to
+* @param	nValue The value
+******************************************************************************/
+void PutTheVarint(std::vector<unsigned char>& Buffer, uint64_t nValue)
+{
+	while( nValue >= 0x80 )
+	{
+		Buffer.push_back((unsigned char)(nValue | 0x80));
+		nValue >>= 7;
+	}
+
+	Buffer.push_back((unsigned char)nValue);
+}
+
+/*!****************************************************************************
+* @brief	Reads a varint, see PutTheVarint()
+* @param	pData Pointer to the varint, moved past it
+* @param	pEnd Pointer to the end of the data
+* @param	nValue The value read
+* @return	Returns false if the data ends before the varint does
+******************************************************************************/
+bool GetTheVarint(const unsigned char*& pData, const unsigned char* pEnd, uint64_t& nValue)
+{
+	nValue = 0;
+
+	for(unsigned nShift=0; pData < pEnd && nShift < 64; nShift += 7)
+	{
+		unsigned char nByte = *pData++;
+
+		nValue |= uint64_t(nByte & 0x7F) << nShift;
 
+		if( !(nByte & 0x80) ) return true;
+	}
+
+	return false;
+}
@@ -1,6 +1,8 @@
 #ifndef _UTILS_H_
 #define _UTILS_H_
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 #include <iostream>
@@ -13,11 +15,26 @@ typedef std::vector<std::string> TVecStrings;
 std::string GetExePath();
 std::string GetDataPath();
 
+struct TMappedFile
+{
+	void *hFile, *hMapping;			///< OS handles
+	const unsigned char* pData;		///< read-only view of the whole file
+	unsigned nSize;
+};
+
+bool MapTheFile(TMappedFile* pFile, std::string strFileName);
+void UnmapTheFile(TMappedFile* pFile);
+
 unsigned GetFileSize(FILE *fp);
+bool ReadTheFile(std::string strFileName, std::string& strText);
+bool WriteTheFile(std::string strFileName, const std::string& strText);
+TVecStrings SplitTheLines(const char* pText, unsigned nSize);
 bool IsWavFile(std::string strFileName);
 
 std::string GetFileName(std::string strPath, bool bRemoveExt);
 
+void LogTheText(const char* pText);
+
 void Show(std::string strMsg);
 void Show(TVecIntegers IntList);
 void Show(TVecStrings strList);
@@ -25,5 +42,8 @@ void Show(TVecStrings strList);
 bool IsBigEndian();
 int ConvertToInt(char* buffer, int len);
 
+void PutTheVarint(std::vector<unsigned char>& Buffer, uint64_t nValue);
+bool GetTheVarint(const unsigned char*& pData, const unsigned char* pEnd, uint64_t& nValue);
+
 #endif
 
@@ -24,6 +24,7 @@
 
 #include "commdefs.h"
 #include "video.h"
+#include "counters.h"
 
 
 /*!****************************************************************************
@@ -97,6 +98,9 @@ void DrawLines(TVideoManager* pVM,
 	TVecPoints& Pts, int nLineWidth, COLORREF Color, bool bClosed)
 {
 	assert(pVM);
+
+	if( pVM->bDisabled ) return;
+
 	assert(pVM->hDC);
 
 	HDC hDC = pVM->hDC;
@@ -114,7 +118,9 @@ void DrawLines(TVideoManager* pVM,
 		::LineTo(hDC, Pts[i].X, Pts[i].Y);
 	}
 
-	if( bClosed && (Pts.size() > 2) )
+	bool bClosing = bClosed && (Pts.size() > 2);
+
+	if( bClosing )
 	{
 		::MoveToEx(hDC, Pts[Pts.size()-1].X, Pts[Pts.size()-1].Y, (LPPOINT) NULL);
 		::LineTo(hDC, Pts[0].X, Pts[0].Y);
@@ -122,6 +128,10 @@ void DrawLines(TVideoManager* pVM,
 
 	::SelectObject(hDC, hOldPen);
 	::DeleteObject(hPen);
+
+	CountThe(ctDrawCalls, 1);
+	CountThe(ctPens, 1);
+	CountThe(ctSegments, (Pts.empty() ? 0 : Pts.size() - 1) + (bClosing ? 1 : 0));
 }
 
 /*!****************************************************************************
@@ -152,6 +162,9 @@ void DrawLines(TVideoManager* pVM,
 void DrawPoint(TVideoManager* pVM, TVector2& Pt, COLORREF Color)
 {
 	assert(pVM);
+
+	if( pVM->bDisabled ) return;
+
 	assert(pVM->hDC);
 
 	HDC hDC = pVM->hDC;
@@ -167,6 +180,8 @@ void DrawPoint(TVideoManager* pVM, TVector2& Pt, COLORREF Color)
 ******************************************************************************/
 void ClearScreen(TVideoManager* pVM, COLORREF Color)
 {
+	if( pVM->bDisabled ) return;
+
 	HBRUSH hBrush = ::CreateSolidBrush(Color);
 	assert(hBrush);
 
@@ -184,12 +199,13 @@ void ClearScreen(TVideoManager* pVM, COLORREF Color)
 * @param	strFontPath Full path to file containing the font
 * @param	strName Name for the font
 * @param	nSize The size of the font
+* @note		The font is not selected in the device context, so that it
+*			can be loaded by a thread other than the drawing one
 ******************************************************************************/
 bool LoadFont(TVideoManager* pVM,
 	std::string strFontPath, std::wstring strName, int nSize)
 {
 	assert(pVM);
-	assert(pVM->hDC);
 
 	bool bResult = false;
 
@@ -213,9 +229,49 @@ std::string strFontName = converter.to_bytes(strName);
 		//wcscpy_s(LF.lfFaceName, strName.c_str());
 		strcpy(LF.lfFaceName, strFontName.c_str());
 
-		HFONT hFont = ::CreateFontIndirect(&LF);
+		pVM->hFont = ::CreateFontIndirect(&LF);
+
+		bResult = true;
+	}
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Loads a true type (ttf) font from memory
+* @param	pVM Pointer to TVideoManager data structure
+* @param	pData Pointer to the font file image
+* @param	nDataSize Size of the font file image
+* @param	strName Name for the font
+* @param	nSize The size of the font
+* @note		The font is private to the process, as for the file version
+******************************************************************************/
+bool LoadFont(TVideoManager* pVM,
+	const unsigned char* pData, unsigned nDataSize, std::wstring strName, int nSize)
+{
+	assert(pVM);
+	assert(pData);
+
+	bool bResult = false;
 
-		::SelectObject(pVM->hDC, hFont);
+	std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+	std::string strFontName = converter.to_bytes(strName);
+
+	DWORD nFonts = 0;
+											// the system keeps its own copy
+	HANDLE hFontRes = AddFontMemResourceEx((void*) pData, nDataSize, NULL, &nFonts);
+
+	if( hFontRes && nFonts )
+	{
+		LOGFONT LF;
+		memset(&LF, 0, sizeof(LF));
+
+		LF.lfHeight = nSize;
+		LF.lfWeight = FW_NORMAL;
+		LF.lfOutPrecision = OUT_TT_ONLY_PRECIS;
+		strcpy(LF.lfFaceName, strFontName.c_str());
+
+		pVM->hFont = ::CreateFontIndirect(&LF);
 
 		bResult = true;
 	}
@@ -223,6 +279,18 @@ std::string strFontName = converter.to_bytes(strName);
 	return bResult;
 }
 
+/*!****************************************************************************
+* @brief	Selects the font loaded by LoadFont() for drawing texts
+* @param	pVM Pointer to TVideoManager data structure
+******************************************************************************/
+void SelectTheFont(TVideoManager* pVM)
+{
+	assert(pVM);
+	assert(pVM->hDC);
+
+	if( pVM->hFont ) ::SelectObject(pVM->hDC, pVM->hFont);
+}
+
 /*!****************************************************************************
 * @brief	Draws a text
 * @param	pVM Pointer to TVideoManager data structure
@@ -236,6 +304,9 @@ void DrawText(TVideoManager* pVM, char* pText, int nX, int nY, COLORREF nColor,
 {
 	assert(pText);
 	assert(pVM);
+
+	if( pVM->bDisabled ) return;
+
 	assert(pVM->hDC);
 
 	::SetTextAlign(pVM->hDC, nAlign);
@@ -255,7 +326,7 @@ void DrawText(TVideoManager* pVM, char* pText, int nX, int nY, COLORREF nColor,
 * @param	nAlign The alignment for the text
 ******************************************************************************/
 void DrawText(TVideoManager *pVM,
-	std::vector<std::string> StringList, int nX, int nY, int nLineHeight, COLORREF nColor, UINT nAlign)
+	const std::vector<std::string>& StringList, int nX, int nY, int nLineHeight, COLORREF nColor, UINT nAlign)
 {
 	assert(pVM);
 
@@ -267,3 +338,26 @@ void DrawText(TVideoManager *pVM,
 	}
 }
 
+/*!****************************************************************************
+* @brief	Draws a multiple lines of text, formatted in an arena
+* @param	pVM Pointer to TVideoManager data structure
+* @param	StringList A list of text strings, see PrintInTheArena()
+* @param	nX The X coordinate for the text
+* @param	nY The Y coordinate for the text
+* @param	nLineHeight The height for the text
+* @param	nColor The color for the text
+* @param	nAlign The alignment for the text
+******************************************************************************/
+void DrawText(TVideoManager *pVM,
+	const TArenaStrings& StringList, int nX, int nY, int nLineHeight, COLORREF nColor, UINT nAlign)
+{
+	assert(pVM);
+
+	for(int i=0; i<StringList.size(); i++)
+	{
+		DrawText(pVM, (char*) StringList[i], nX, nY, nColor, nAlign);
+
+		nY += 1.25 * nLineHeight;
+	}
+}
+
@@ -1,10 +1,11 @@
 #ifndef _SDLSYSTEM_H_
 #define _SDLSYSTEM_H_
 
-#include <windows.h>
+#include "platform.h"
 
 #include <string>
 
+#include "arena.h"
 #include "vectors.h"
 
 //#include <sdl2/sdl.h>
@@ -17,6 +18,9 @@ struct TVideoManager {
 
 	HDC hDC;
 	HBITMAP hBmp;
+	HFONT hFont;					///< loaded by LoadFont(), see SelectTheFont()
+
+	bool bDisabled;					///< the drawing is skipped, for the headless runs
 };
 
 bool SetupVideoManager(TVideoManager* pVM);
@@ -31,9 +35,13 @@ void DrawPoint(TVideoManager* pVM, TVector2& Pt, COLORREF Color);
 void ClearScreen(TVideoManager* pVM, COLORREF Color);
 
 bool LoadFont(TVideoManager* pVM, std::string strFontPath, std::wstring strName, int nSize);
+bool LoadFont(TVideoManager* pVM, const unsigned char* pData, unsigned nDataSize, std::wstring strName, int nSize);
+void SelectTheFont(TVideoManager* pVM);
 
 void DrawText(TVideoManager* pVM, char* pText, int nX, int nY, COLORREF nColor = RGB(255,255,255), UINT nAlign = TA_CENTER);
-void DrawText(TVideoManager* pVM, std::vector<std::string> StringList, int nX, int nY,
+void DrawText(TVideoManager* pVM, const std::vector<std::string>& StringList, int nX, int nY,
+	int nTextH, COLORREF nColor = RGB(255,255,255), UINT nAlign = TA_CENTER);
+void DrawText(TVideoManager* pVM, const TArenaStrings& StringList, int nX, int nY,
 	int nTextH, COLORREF nColor = RGB(255,255,255), UINT nAlign = TA_CENTER);
 
 #endif
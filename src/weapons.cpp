@@ -11,126 +11,36 @@
 
 ******************************************************************************/
 
-#include <windows.h>
+#include "platform.h"
 
 #include "weapons.h"
 
 
 
 /*!****************************************************************************
-* @brief	Builds the missile
-* @param	pMissile Pointer to the missile data structure
-* @param	pVM Pointer to the video manager data structure
-******************************************************************************/
-void Build(TMissile* pMissile, TVideoManager* pVM)
-{
-	assert(pMissile);
-	assert(pVM);
-
-	pMissile->Pos = TVector2{-10,-10};
-	pMissile->Vel = TVector2{0,0};
-	pMissile->bArmed = false;
-	pMissile->pVM = pVM;
-
-	pMissile->pShip = nullptr;
-}
-
-/*!****************************************************************************
-* @brief	Builds the missile
-* @param	pMissile Pointer to the missile data structure
-* @param	pVM Pointer to the video manager data structure
-* @param	Pos Initial position of the missile
-* @param	Vel Initial velocity of the missile
-******************************************************************************/
-void Build(TMissile* pMissile, TVideoManager* pVM, TVector2 Pos, TVector2 Vel)
-{
-	assert(pMissile);
-	assert(pVM);
-
-	pMissile->Pos = Pos;
-	pMissile->Vel = Vel;
-	pMissile->bArmed = false;
-	pMissile->pVM = pVM;
-
-	pMissile->pShip= nullptr;
-}
-
-/*!****************************************************************************
-* @brief	Gets the missile position
-* @param	pMissile Pointer to the missile data structure
-* @return	The position of the missile
-******************************************************************************/
-TVector2 GetPos(TMissile* pMissile)
-{
-	assert(pMissile);
-
-	return pMissile->Pos;
-}
-
-/*!****************************************************************************
-* @brief	Gets the status of missile
-* @param	pMissile Pointer to the missile data structure
-* @return	Returns true if the missile is armed, false otherwise
-******************************************************************************/
-bool IsArmed(TMissile* pMissile)
-{
-	assert(pMissile);
-
-	return pMissile->bArmed;
-}
-
-/*!****************************************************************************
-* @brief	Arms the missile
-* @param	pMissile Pointer to the missile data structure
+* @brief	Makes the components of a missile, already armed
+* @param	pShip Pointer to the ship that shoots the missile
 * @param	Pos The position of the missile
 * @param	Vel The velocity of the missile
+* @return	The missile entity, to be added to the world
+* @note		A missile is removed when it leaves the game area, or
+*			after MISSILELIFETIME ticks if it's too slow to leave it
 ******************************************************************************/
-void Arm(TMissile* pMissile, TVector2 Pos, TVector2 Vel)
-{
-	assert(pMissile);
-
-	pMissile->Pos = Pos;
-	pMissile->Vel = Vel;
-	pMissile->bArmed = true;
-	pMissile->Color = RGB(255,255,255);
-}
-
-/*!****************************************************************************
-* @brief	Updates by time the missile status
-* @param	pMissile Pointer to the missile data structure
-* @param	Dt The value for the delta time
-******************************************************************************/
-void Update(TMissile* pMissile, double Dt)
+TEntity MakeTheMissile(TShip* pShip, TVector2 Pos, TVector2 Vel)
 {
-	assert(pMissile);
-	assert(pMissile->pVM);
+	TEntity Missile;
 
-	pMissile->Pos.X += pMissile->Vel.X * Dt;
-	pMissile->Pos.Y += pMissile->Vel.Y * Dt;
-/*
-	SDL_SetRenderDrawColor(pMissile->pRenderer,
-		GetRValue(pMissile->Color), GetGValue(pMissile->Color), GetBValue(pMissile->Color), 255);
+	Missile.nArchetype = arMissile;
 
-	SDL_RenderDrawPoint(pMissile->pRenderer, pMissile->Pos.X, pMissile->Pos.Y);
-*/
+	Missile.Pos = Pos;
+	Missile.Vel = Vel;
+	Missile.Color = RGB(255,255,255);
 
-	DrawPoint(pMissile->pVM, pMissile->Pos, pMissile->Color);
-}
+	Missile.pOwner = pShip;
+	Missile.nLifetime = MISSILELIFETIME;
 
-/*!****************************************************************************
-* @brief	Deletes a bunch of missiles referenced by a vector of pointers
-* @param	Missiles Referernce to a list of pointers to missiles
-******************************************************************************/
-void Clear(TVecPtrMissiles& Missiles)
-{
-	for(int i=0; i<Missiles.size(); i++)
-	{
-		if( Missiles[i] )
-		{
-			delete Missiles[i];
-			Missiles[i] = nullptr;
-		}
-	}
+	Missile.Rot = Missile.DRot = Missile.Radius = 0;
+	Missile.nClass = 0;
 
-	Missiles.clear();
+	return Missile;
 }
@@ -1,3 +1,4 @@
+
 #ifndef _WEAPONS_H_
 #define _WEAPONS_H_
 
@@ -6,34 +7,17 @@
 
 //#include <sdl2/sdl.h>
 
+#include "ecs.h"
 #include "maths.h"
 #include "vectors.h"
 
 #include "video.h"
 
-struct TShip;
-
-struct TMissile
-{
-	bool bArmed;
-	TVector2 Pos, Vel;
-	COLORREF Color;
-	TVideoManager *pVM;
-
-	TShip* pShip;
-};
 
-typedef std::vector<TMissile*> TVecPtrMissiles;
+#define MISSILELIFETIME		100			///< ticks, enough to cross the screen
 
-void Build(TMissile* pMissile, TVideoManager* pVM);
-void Build(TMissile* pMissile, TVideoManager* pVM, TVector2 Pos, TVector2 Vel);
-
-TVector2 GetPos(TMissile* pMissile);
-bool IsArmed(TMissile* pMissile);
-void Arm(TMissile* pMissile, TVector2 Pos, TVector2 Vel);
-void Update(TMissile* pMissile, double Dt);
+struct TShip;
 
-void Clear(TVecPtrMissiles& Missiles);
+TEntity MakeTheMissile(TShip* pShip, TVector2 Pos, TVector2 Vel);
 
 #endif
-
@@ -0,0 +1,187 @@
+/*!****************************************************************************
+
+	@file	a2kpack.cpp
+
+	@brief	Build-time packer for the assets archive
+
+	Packs the game data files in a single indexed archive, read at
+	run-time by OpenTheArchive(). Each asset is named after its file
+	name, without path. It builds on any host with a C++11 compiler:
+
+		g++ -O2 -o a2kpack tools/a2kpack.cpp
+
+	and it is run from the data folder, after any change to the data:
+
+		a2kpack assets.pak bang_large.wav ... technolcd.ttf help.txt hiscores.txt
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "../src/archive.h"
+
+
+struct TPackItem
+{
+	std::string strPath, strName;
+	std::vector<unsigned char> Data;
+};
+
+
+/*!****************************************************************************
+* @brief	Reads a whole file
+* @param	strPath Path to the file
+* @param[out] Data The file contents
+* @return	Returns true for success, false otherwise
+******************************************************************************/
+static bool ReadTheFile(std::string strPath, std::vector<unsigned char>& Data)
+{
+	FILE* fp = fopen(strPath.c_str(), "rb");
+
+	if( !fp ) return false;
+
+	fseek(fp, 0, SEEK_END);
+	long nSize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	Data.resize(nSize > 0 ? nSize : 0);
+
+	bool bResult = nSize >= 0 && fread(Data.data(), 1, Data.size(), fp) == Data.size();
+
+	fclose(fp);
+
+	return bResult;
+}
+
+/*!****************************************************************************
+* @brief	Gets the file name, without path
+* @param	strPath The full path of a file
+* @return	The file name
+******************************************************************************/
+static std::string GetBaseName(std::string strPath)
+{
+	size_t nPos = strPath.find_last_of("\\/");
+
+	return nPos == std::string::npos ? strPath : strPath.substr(nPos + 1);
+}
+
+/*!****************************************************************************
+* @brief	Packer entry point
+* @param	nArgs Number of arguments
+* @param	pArgs The output archive, followed by the files to be packed
+******************************************************************************/
+int main(int nArgs, char* pArgs[])
+{
+	if( nArgs < 3 )
+	{
+		fprintf(stderr, "usage: a2kpack <archive> <file> [<file> ...]\n");
+		return 1;
+	}
+
+	std::vector<TPackItem> Items;
+
+	for(int i=2; i<nArgs; ++i)
+	{
+		TPackItem Item;
+		Item.strPath = pArgs[i];
+		Item.strName = GetBaseName(Item.strPath);
+
+		if( Item.strName.empty() || Item.strName.size() >= ARCHIVE_NAMELEN )
+		{
+			fprintf(stderr, "a2kpack: invalid asset name '%s'\n", Item.strName.c_str());
+			return 1;
+		}
+
+		if( !ReadTheFile(Item.strPath, Item.Data) )
+		{
+			fprintf(stderr, "a2kpack: cannot read '%s'\n", Item.strPath.c_str());
+			return 1;
+		}
+
+		Items.push_back(Item);
+	}
+											// the reader does a binary search
+	std::sort(Items.begin(), Items.end(),
+		[](const TPackItem& A, const TPackItem& B) { return strcmp(A.strName.c_str(), B.strName.c_str()) < 0; });
+
+	for(size_t i=1; i<Items.size(); ++i)
+	{
+		if( Items[i].strName == Items[i-1].strName )
+		{
+			fprintf(stderr, "a2kpack: duplicated asset '%s'\n", Items[i].strName.c_str());
+			return 1;
+		}
+	}
+
+	TArchiveHeader Header;
+	memset(&Header, 0, sizeof(Header));
+	memcpy(Header.Magic, ARCHIVE_MAGIC, 4);
+	Header.nVersion = ARCHIVE_VERSION;
+	Header.nEntries = Items.size();
+
+	std::vector<TArchiveEntry> Entries(Items.size());
+
+	uint64_t nOffset = sizeof(TArchiveHeader) + Entries.size() * sizeof(TArchiveEntry);
+
+	for(size_t i=0; i<Items.size(); ++i)
+	{
+		nOffset = (nOffset + ARCHIVE_ALIGN - 1) / ARCHIVE_ALIGN * ARCHIVE_ALIGN;
+
+		memset(&Entries[i], 0, sizeof(TArchiveEntry));
+		strcpy(Entries[i].Name, Items[i].strName.c_str());
+		Entries[i].nOffset = uint32_t(nOffset);
+		Entries[i].nSize = uint32_t(Items[i].Data.size());
+
+		nOffset += Items[i].Data.size();
+	}
+
+	if( nOffset > 0xFFFFFFFFu )
+	{
+		fprintf(stderr, "a2kpack: archive too large\n");
+		return 1;
+	}
+
+	FILE* fp = fopen(pArgs[1], "wb");
+
+	if( !fp )
+	{
+		fprintf(stderr, "a2kpack: cannot create '%s'\n", pArgs[1]);
+		return 1;
+	}
+
+	bool bResult = fwrite(&Header, sizeof(Header), 1, fp) == 1
+		&& fwrite(Entries.data(), sizeof(TArchiveEntry), Entries.size(), fp) == Entries.size();
+
+	size_t nPos = sizeof(TArchiveHeader) + Entries.size() * sizeof(TArchiveEntry);
+
+	for(size_t i=0; bResult && i<Items.size(); ++i)
+	{
+		static const unsigned char Padding[ARCHIVE_ALIGN] = { 0 };
+
+		bResult = fwrite(Padding, 1, Entries[i].nOffset - nPos, fp) == Entries[i].nOffset - nPos
+			&& fwrite(Items[i].Data.data(), 1, Items[i].Data.size(), fp) == Items[i].Data.size();
+
+		nPos = Entries[i].nOffset + Entries[i].nSize;
+	}
+
+	bResult = (fclose(fp) == 0) && bResult;
+
+	if( !bResult )
+	{
+		fprintf(stderr, "a2kpack: error writing '%s'\n", pArgs[1]);
+		return 1;
+	}
+
+	printf("a2kpack: %u assets, %u bytes\n", unsigned(Items.size()), unsigned(nOffset));
+
+	return 0;
+}
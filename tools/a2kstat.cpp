@@ -0,0 +1,181 @@
+/*!****************************************************************************
+
+	@file	a2kstat.cpp
+
+	@brief	Live reader of the counters of a running game
+
+	Reads the shared memory block published by the game when A2K_COUNTERS
+	is set, without stopping it, and prints the counters at every
+	interval: their values in the last tick, per second, and in all.
+	It builds on any host with a C++11 compiler:
+
+		g++ -O2 -o a2kstat tools/a2kstat.cpp		(-lrt on older Linux)
+
+	and it is run beside the game, or the server:
+
+		a2kstat [<name> [<seconds>]]
+
+	@noop	author:	Francesco Settembrini
+	@noop	last update: 23/6/2021
+	@noop	e-mail:	mailto:francesco.settembrini@poliba.it
+
+******************************************************************************/
+
+#ifdef __linux__
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#else
+	#include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "../src/counters.h"
+
+
+struct TCountersCopy						///< a consistent copy of the block
+{
+	uint32_t nProcess;
+	uint64_t nPublished, nTime;
+	char Names[ctCount][COUNTERSNAMELEN];
+	uint64_t Values[ctCount], Totals[ctCount];
+};
+
+
+/*!****************************************************************************
+* @brief	Maps the shared memory block of the counters, read-only
+* @param	pName The name of the block
+* @return	Pointer to the block, nullptr if the game has not created it
+******************************************************************************/
+static const TCountersBlock* MapTheCounters(const char* pName)
+{
+	void* pView = nullptr;
+
+#ifdef __linux__
+	std::string strName = std::string("/") + pName;
+
+	int fd = shm_open(strName.c_str(), O_RDONLY, 0);
+	if( fd < 0 ) return nullptr;
+
+	pView = mmap(nullptr, sizeof(TCountersBlock), PROT_READ, MAP_SHARED, fd, 0);
+	if( pView == MAP_FAILED ) pView = nullptr;
+
+	close(fd);
+#else
+	std::string strName = std::string("Local\\") + pName;
+
+	HANDLE hMapping = ::OpenFileMappingA(FILE_MAP_READ, FALSE, strName.c_str());
+	if( !hMapping ) return nullptr;
+											// the view keeps the mapping
+	pView = ::MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, sizeof(TCountersBlock));
+	::CloseHandle(hMapping);
+#endif
+
+	return (const TCountersBlock*) pView;
+}
+
+/*!****************************************************************************
+* @brief	Copies the block, consistently
+* @param	pBlock Pointer to the block
+* @param	Copy The copy
+* @return	Returns true for success, false if the game keeps writing it
+* @note		The reader side of a sequence lock: the copy is taken again if
+*			the game has written the block meanwhile
+******************************************************************************/
+static bool CopyTheCounters(const TCountersBlock* pBlock, TCountersCopy& Copy)
+{
+	if( pBlock->nMagic != COUNTERSMAGIC || pBlock->nVersion != COUNTERSVERSION
+		|| pBlock->nCount != ctCount ) return false;
+
+	for(int nTry=0; nTry<1000; ++nTry)
+	{
+		uint32_t nSequence = pBlock->nSequence.load(std::memory_order_acquire);
+		if( nSequence & 1 ) continue;
+
+		Copy.nProcess = pBlock->nProcess;
+		Copy.nPublished = pBlock->nPublished.load(std::memory_order_relaxed);
+		Copy.nTime = pBlock->nTime.load(std::memory_order_relaxed);
+		memcpy(Copy.Names, pBlock->Names, sizeof(Copy.Names));
+
+		for(int i=0; i<ctCount; ++i)
+		{
+			Copy.Values[i] = pBlock->Values[i].load(std::memory_order_relaxed);
+			Copy.Totals[i] = pBlock->Totals[i].load(std::memory_order_relaxed);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if( pBlock->nSequence.load(std::memory_order_relaxed) == nSequence ) return true;
+	}
+
+	return false;
+}
+
+/*!****************************************************************************
+* @brief	The entry point
+* @param	nArgs The number of arguments
+* @param	pArgs The arguments: the name of the block and the interval
+* @return	0 on success
+******************************************************************************/
+int main(int nArgs, char* pArgs[])
+{
+	const char* pName = nArgs > 1 ? pArgs[1] : COUNTERSNAME;
+	double Interval = nArgs > 2 ? atof(pArgs[2]) : 1.0;
+
+	if( Interval <= 0 )
+	{
+		fprintf(stderr, "usage: a2kstat [<name> [<seconds>]]\n");
+		return 1;
+	}
+
+	const TCountersBlock* pBlock = MapTheCounters(pName);
+
+	if( !pBlock )
+	{
+		fprintf(stderr, "a2kstat: no counters '%s', is A2K_COUNTERS set?\n", pName);
+		return 1;
+	}
+
+	TCountersCopy Last, Copy;
+	bool bLast = false;
+
+	for(;;)
+	{
+		if( !CopyTheCounters(pBlock, Copy) )
+		{
+			fprintf(stderr, "a2kstat: the counters '%s' are not readable\n", pName);
+			return 1;
+		}
+											// the rates need two copies
+		double Seconds = bLast ? (Copy.nTime - Last.nTime) * 1e-6 : 0;
+
+		printf("%s, process %u, %llu ticks published, at %.1f s\n", pName, Copy.nProcess,
+			(unsigned long long) Copy.nPublished, Copy.nTime * 1e-6);
+		printf("  %-16s %14s %14s %16s\n", "counter", "last tick", "per second", "total");
+
+		for(int i=0; i<ctCount; ++i)
+		{
+			double Rate = Seconds > 0 ? (Copy.Totals[i] - Last.Totals[i]) / Seconds : 0;
+
+			printf("  %-16.*s %14llu %14.1f %16llu\n", COUNTERSNAMELEN, Copy.Names[i],
+				(unsigned long long) Copy.Values[i], Rate, (unsigned long long) Copy.Totals[i]);
+		}
+
+		printf("\n");
+		fflush(stdout);
+
+		Last = Copy;
+		bLast = true;
+
+		std::this_thread::sleep_for(std::chrono::duration<double>(Interval));
+	}
+
+	return 0;
+}